@@ -1,8 +1,14 @@
 #version 330
-uniform vec2 z_range;
-uniform int z_clipping;
 uniform int color_mode;
 
+layout(std140) uniform FrameUniforms {
+  mat4 view_matrix;
+  mat4 projection_matrix;
+  vec2 z_range;
+  int z_clipping;
+  vec2 viewport_size;
+};
+
 in vec4 frag_color;
 flat in ivec4 frag_info;
 in vec3 frag_world_position;
@@ -11,7 +17,9 @@ layout (location=0) out vec4 color;
 layout (location=1) out ivec4 info;
 
 void main() {
-  if (z_clipping != 0 && color_mode == 0 &&
+  // point clouds (height, scalar or rgb colors) only
+  if (z_clipping != 0 && (color_mode == 0 || color_mode == 3 ||
+      color_mode == 4) &&
       (frag_world_position.z < z_range[0] || frag_world_position.z > z_range[1])) {
     discard;
   }
@@ -2,53 +2,102 @@
 uniform float point_size;
 uniform float point_scale;
 uniform mat4 model_matrix;
-uniform mat4 view_matrix;
-uniform mat4 projection_matrix;
+
+// shared by all programs, updated once per frame
+layout(std140) uniform FrameUniforms {
+  mat4 view_matrix;
+  mat4 projection_matrix;
+  vec2 z_range;
+  int z_clipping;
+  vec2 viewport_size;
+};
+
+// dequantization of 16-bit normalized positions, identity for floats
+uniform vec3 position_offset = vec3(0.0);
+uniform vec3 position_scale = vec3(1.0);
 
 uniform int color_mode;
 uniform vec4 material_color;
+// values of vert_scalar mapped to the ends of the colormap
+uniform vec2 scalar_range = vec2(0.0, 1.0);
+// the turbo colors of the height (over z_range) or scalar colormap, laid
+// out on the CPU from the distribution of the values
+uniform sampler1D colormap;
 
-uniform vec2 z_range;
-uniform ivec4 info_values;
+// written with the vertex index to the ID target, 0 for not pickable
+uniform int pick_id;
+// of polyline segments, in pixels
+uniform float line_width = 1.0;
 
-in vec3 vert_position;
-in vec3 vert_direction;     // line direction
-in vec4 vert_color;
-in ivec4 vert_info;
+layout(location = 0) in vec3 vert_position;
+layout(location = 1) in vec3 vert_next;          // polyline segment end
+layout(location = 2) in vec4 vert_color;
+layout(location = 3) in ivec4 vert_info;
+layout(location = 4) in float vert_scalar;      // per-point field
+layout(location = 5) in vec3 vert_normal;       // mesh vertices
+// per instance of a gizmo batch: rows of the affine transform and color
+layout(location = 6) in vec4 instance_row0;
+layout(location = 7) in vec4 instance_row1;
+layout(location = 8) in vec4 instance_row2;
+layout(location = 9) in vec4 instance_color;
 
 out vec4 frag_color;
 flat out ivec4 frag_info;
 out vec3 frag_world_position;
 
-vec3 turbo(in float x) {
-    const vec4 kRedVec4 = vec4(0.13572138, 4.61539260, -42.66032258, 132.13108234);
-    const vec4 kGreenVec4 = vec4(0.09140261, 2.19418839, 4.84296658, -14.18503333);
-    const vec4 kBlueVec4 = vec4(0.10667330, 12.64194608, -60.58204836, 110.36276771);
-    const vec2 kRedVec2 = vec2(-152.94239396, 59.28637943);
-    const vec2 kGreenVec2 = vec2(4.27729857, 2.82956604);
-    const vec2 kBlueVec2 = vec2(-89.90310912, 27.34824973);
-
-    x = clamp(x, 0.0, 1.0);
-    vec4 v4 = vec4(1.0, x, x * x, x * x * x);
-    vec2 v2 = v4.zw * v4.z;
-    return vec3(
-        dot(v4, kRedVec4)   + dot(v2, kRedVec2),
-        dot(v4, kGreenVec4) + dot(v2, kGreenVec2),
-        dot(v4, kBlueVec4)  + dot(v2, kBlueVec2)
-    );
+// color of x in [0, 1], between the centers of the first and the last
+// texels of the table
+vec3 lookup_colormap(in float x) {
+    float size = float(textureSize(colormap, 0));
+    return texture(colormap, (clamp(x, 0.0, 1.0) * (size - 1.0) + 0.5) /
+                   size).rgb;
 }
 
 vec4 rainbow(vec3 position) {
-    float p = (position.z - z_range[0]) / (z_range[1] - z_range[0]);
-    return vec4(turbo(p), 1.0);
+    float range = max(z_range[1] - z_range[0], 1e-6);
+    return vec4(lookup_colormap((position.z - z_range[0]) / range), 1.0);
+}
+
+// corner gl_VertexID of the quad covering the segment from vert_position
+// to vert_next, line_width pixels wide; the part behind the camera is cut
+// off first, so that the ends project to the same side
+vec4 widen_segment(mat4 model_view_projection) {
+    const float kNearW = 1e-4;
+    vec4 a = model_view_projection * vec4(vert_position, 1.0);
+    vec4 b = model_view_projection * vec4(vert_next, 1.0);
+    if (a.w < kNearW && b.w < kNearW) {
+        return vec4(0.0, 0.0, 2.0, 1.0);
+    }
+    if (a.w < kNearW) {
+        a = mix(a, b, (kNearW - a.w) / (b.w - a.w));
+    } else if (b.w < kNearW) {
+        b = mix(b, a, (kNearW - b.w) / (a.w - b.w));
+    }
+    vec2 screen_a = a.xy / a.w * viewport_size;
+    vec2 screen_b = b.xy / b.w * viewport_size;
+    vec2 direction = screen_b - screen_a;
+    vec2 normal = vec2(-direction.y, direction.x) /
+        max(length(direction), 1e-6);
+    // strip order: a-, b-, a+, b+
+    vec4 corner = (gl_VertexID & 1) == 0 ? a : b;
+    float side = (gl_VertexID & 2) == 0 ? -1.0 : 1.0;
+    // half the width on either side, from pixels to clip space
+    corner.xy += normal * side * line_width / viewport_size * corner.w;
+    return corner;
 }
 
 void main() {
-    vec4 world_position = model_matrix * vec4(vert_position, 1.0);
+    vec3 position = position_offset + position_scale * vert_position;
+    if (color_mode == 6) {
+        vec4 p = vec4(position, 1.0);
+        position = vec3(dot(instance_row0, p), dot(instance_row1, p),
+                        dot(instance_row2, p));
+    }
+    vec4 world_position = model_matrix * vec4(position, 1.0);
     frag_world_position = world_position.xyz;
     gl_Position = projection_matrix * view_matrix * world_position;
 
-    frag_info = info_values;
+    frag_info = ivec4(pick_id, gl_VertexID, 0, 0);
     if (color_mode == 0) {
         frag_color = rainbow(frag_world_position);
     } else if (color_mode == 1) {
@@ -56,6 +105,27 @@ void main() {
     } else if (color_mode == 2) {
         frag_color = vert_color;
         frag_info = vert_info;
+    } else if (color_mode == 3) {
+        float range = max(scalar_range[1] - scalar_range[0], 1e-6);
+        frag_color = vec4(
+            lookup_colormap((vert_scalar - scalar_range[0]) / range), 1.0);
+    } else if (color_mode == 4) {
+        // packed rgb, the unused byte reads as zero alpha
+        frag_color = vec4(vert_color.rgb, 1.0);
+    } else if (color_mode == 5) {
+        // two-sided headlight, the camera looks along -z in view space
+        vec3 normal = normalize(mat3(view_matrix * model_matrix) * vert_normal);
+        float light = 0.25 + 0.75 * abs(normal.z);
+        frag_color = vec4(rainbow(frag_world_position).rgb * light, 1.0);
+    } else if (color_mode == 6) {
+        frag_color = vert_color * instance_color;
+        frag_info = ivec4(pick_id, gl_InstanceID, 0, 0);
+    } else if (color_mode == 7) {
+        frag_color = vec4(vert_color.rgb, 1.0);
+        frag_info = ivec4(pick_id, gl_InstanceID, 0, 0);
+        // zero alpha ends a polyline, its segment to the next one collapses
+        gl_Position = vert_color.a == 0.0 ? vec4(0.0, 0.0, 2.0, 1.0) :
+            widen_segment(projection_matrix * view_matrix * model_matrix);
     }
 
     vec3 ndc = gl_Position.xyz / gl_Position.w;
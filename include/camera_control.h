@@ -23,6 +23,10 @@ class CameraControl {
 
   virtual Eigen::Matrix4f GetViewMatrix() const = 0;
 
+ protected:
+  static Eigen::Matrix4f LookAt(const Eigen::Vector3f &eye,
+      const Eigen::Vector3f &center, const Eigen::Vector3f &up);
+
  protected:
   bool left_button_down_ = false;
   bool middle_button_down_ = false;
@@ -56,4 +60,31 @@ class ArcCameraControl : public CameraControl {
   double phi_ = 0.0;
 };
 
+// Deterministic camera for benchmarks: one orbit around center while the
+// distance swings between 2x and 0.5x radius, so that culling and LOD
+// selection go through far overviews and close-ups alike.
+class OrbitCameraPath : public CameraControl {
+ public:
+  OrbitCameraPath(const Eigen::Vector3f &center, float radius);
+  ~OrbitCameraPath() override = default;
+
+  void OnMouseButton(double x, double y,
+      int button, bool press_down) override {
+  }
+  void OnMouseMove(double x, double y) override {
+  }
+  void OnMouseScroll(double xoffset, double yoffset) override {
+  }
+
+  /** @brief move the camera to position t in [0, 1] along the path **/
+  void SetTime(float t);
+
+  Eigen::Matrix4f GetViewMatrix() const override;
+
+ private:
+  Eigen::Vector3f center_;
+  float radius_ = 1.f;
+  Eigen::Vector3f eye_;
+};
+
 }  // namespace ogl_viewer
@@ -0,0 +1,60 @@
+#pragma once
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+#undef GLFW_DLL
+
+#include <string>
+
+#include <Eigen/Core>
+
+#include "value_histogram.h"
+
+namespace ogl_viewer {
+
+// how a Colormap spreads the values over its colors
+enum class ColormapScaling {
+  // linearly from the smallest to the largest value
+  kMinMax,
+  // linearly between the 1st and 99th percentiles, clamping the rest
+  kPercentile,
+  // between the same percentiles, with equal amounts of values per color
+  kEqualize
+};
+
+/** @brief "minmax", "percentile" or "equalize" **/
+bool ParseColormapScaling(const std::string &name, ColormapScaling *scaling);
+
+const char* ColormapScalingName(ColormapScaling scaling);
+
+// The turbo colormap as a 1D lookup texture that the shaders sample with
+// the value normalized over range(). The table is built from the
+// distribution of the values, so a histogram-equalized mapping costs the
+// vertex shader no more than a linear one.
+class Colormap {
+ public:
+  Colormap();
+  ~Colormap();
+
+  Colormap(const Colormap&) = delete;
+  Colormap& operator=(const Colormap&) = delete;
+
+  /** @brief rebuild the table for the values of histogram; keeps the table
+   *  and range as they are while the histogram is empty **/
+  void Update(const ValueHistogram &histogram, ColormapScaling scaling);
+
+  GLuint texture() const {
+    return texture_;
+  }
+
+  /** @brief values mapped to the first and last entries of the table **/
+  const Eigen::Vector2f& range() const {
+    return range_;
+  }
+
+ private:
+  GLuint texture_ = 0;
+  Eigen::Vector2f range_ = Eigen::Vector2f(-5.f, 10.f);
+};
+
+}  // namespace ogl_viewer
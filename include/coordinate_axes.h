@@ -13,7 +13,7 @@ class CoordinateAxes : public Drawable {
   CoordinateAxes();
   ~CoordinateAxes();
 
-  void Draw(GLSLShader *shader) const override;
+  void Enqueue(GLSLShader *shader, RenderQueue *queue) const override;
 
  private:
   std::vector<Eigen::Vector3f,
@@ -1,33 +1,370 @@
 #pragma once
 
+#include "colormap.h"
+#include "frustum.h"
 #include "glsl_shader.h"
+#include "point_cache.h"
+#include "point_cloud_loader.h"
+#include "point_index.h"
+#include "point_octree.h"
+#include "render_queue.h"
+#include "upload_ring.h"
+#include "value_histogram.h"
+#include "voxel_filter.h"
+#include <chrono>
+#include <future>
+#include <memory>
 #include <string>
+#include <vector>
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
 
 namespace ogl_viewer {
 
+// DrawItem::pick_id of the drawables that can be picked
+enum PickId {
+  kPickNone = 0,
+  kPickPointCloud = 1,
+  kPickSequence = 2,
+  kPickLive = 3,
+  kPickMesh = 4,
+  kPickPose = 5,
+  kPickBox = 6,
+  kPickPolyline = 7
+};
+
 class Drawable {
  public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
   Drawable() = default;
   virtual ~Drawable() = default;
 
-  virtual void Draw(GLSLShader *shader) const = 0;
+  /** @brief submit this frame's draw items; vertex layouts are set up once
+   *  in the VAOs, so items only carry draw ranges and uniforms **/
+  virtual void Enqueue(GLSLShader *shader, RenderQueue *queue) const = 0;
   virtual bool LoadDataFromFile(const std::string &filepath) {
     return false;
   }
+
+  /** @brief called once per frame before Enqueue with the current camera **/
+  virtual void UpdateView(const Eigen::Matrix4f &view_matrix,
+      const Eigen::Matrix4f &projection_matrix,
+      const Eigen::Vector2i &viewport_size) {
+  }
+
+  void set_model_matrix(const Eigen::Matrix4f &model_matrix) {
+    model_matrix_ = model_matrix;
+  }
+
+  /** @brief heights of what was drawn with the height colormap so far, in
+   *  model coordinates; empty for drawables with colors of their own **/
+  const ValueHistogram& height_histogram() const {
+    return height_histogram_;
+  }
+
+ protected:
+  Eigen::Matrix4f model_matrix_ = Eigen::Matrix4f::Identity();
+  ValueHistogram height_histogram_;
+};
+
+// per-frame culling counters of a PointCloud
+struct RenderStats {
+  std::size_t total_chunks = 0;
+  std::size_t visible_chunks = 0;
+  std::size_t visible_points = 0;
+};
+
+// contiguous range of the vertex buffer with its own position encoding
+struct PointChunk {
+  std::size_t first = 0;
+  std::size_t count = 0;
+  // quantized positions decode to offset + scale * (q / 65535)
+  Eigen::Vector3f offset = Eigen::Vector3f::Zero();
+  Eigen::Vector3f scale = Eigen::Vector3f::Ones();
+};
+
+// one field of the source file in vertex buffer order: floats for scalars,
+// the packed 0x00RRGGBB words of rgb/rgba fields otherwise
+struct PointAttribute {
+  std::string name;
+  bool rgb = false;
+  std::vector<float> values;
+  // of the scalar values
+  ValueHistogram histogram;
 };
 
 class PointCloud : public Drawable {
  public:
   PointCloud() = default;
   ~PointCloud() override;
-  void Draw(GLSLShader *shader) const override;
+  void Enqueue(GLSLShader *shader, RenderQueue *queue) const override;
   bool LoadDataFromFile(const std::string &filepath) override;
+  void UpdateView(const Eigen::Matrix4f &view_matrix,
+      const Eigen::Matrix4f &projection_matrix,
+      const Eigen::Vector2i &viewport_size) override;
+
+  /** @brief with the camera of the last UpdateView, set up the draw ranges
+   *  of another point budget of points in LOD mode, from a larger budget at
+   *  a finer node size than UpdateView selects. The ranges only hold points
+   *  not drawn since UpdateView, to be drawn on top of the frame so far.
+   *  False once there are no more points to draw. **/
+  bool RefineView();
+
+  /** @brief load through pcl::io::loadPCDFile instead of the native reader **/
+  void set_use_pcl_loader(bool use_pcl_loader) {
+    use_pcl_loader_ = use_pcl_loader;
+  }
+
+  /** @brief build an octree level-of-detail hierarchy at load time **/
+  void set_use_lod(bool use_lod) {
+    use_lod_ = use_lod;
+  }
+
+  /** @brief maximum number of points drawn per frame in LOD mode **/
+  void set_point_budget(std::size_t point_budget) {
+    point_budget_ = point_budget;
+  }
+
+  /** @brief store positions as 16-bit integers relative to the bounds of
+   *  their chunk (6 instead of 12 bytes per point) **/
+  void set_quantize_positions(bool quantize_positions) {
+    quantize_positions_ = quantize_positions;
+  }
+
+  /** @brief reopen clouds from <file>.ovcache when it is up to date, and
+   *  write it after building the octree otherwise **/
+  void set_use_cache(bool use_cache) {
+    use_cache_ = use_cache;
+  }
+
+  /** @brief reduce the cloud to one point per occupied voxel at load time;
+   *  the cache is neither read nor written then **/
+  void set_voxel_filter(const VoxelFilter &voxel_filter) {
+    voxel_filter_ = voxel_filter;
+  }
+
+  /** @brief index the points once loaded, on a worker thread, for
+   *  selections and measurements; 16 bytes per point **/
+  void set_build_index(bool build_index) {
+    build_index_ = build_index;
+  }
+
+  /** @brief take the spatial index once it is built; once per frame **/
+  void UpdateIndex();
+
+  /** @brief the spatial index of the points in model coordinates, null
+   *  until it is built **/
+  const PointIndex* index() const {
+    return index_.get();
+  }
+
+  /** @brief file the points were loaded from **/
+  const std::string& source_path() const {
+    return source_path_;
+  }
+
+  const RenderStats& render_stats() const {
+    return render_stats_;
+  }
+
+  /** @brief bounds of the points loaded so far **/
+  const Eigen::AlignedBox3f& bounds() const {
+    return bounds_;
+  }
+
+  /** @brief decode on a background thread and upload progressively through
+   *  PumpUploads; layouts the native reader does not handle are loaded
+   *  synchronously with LoadDataFromFile **/
+  bool StartLoading(const std::string &filepath);
+
+  /** @brief upload at most max_bytes of decoded data, once per frame **/
+  void PumpUploads(std::size_t max_bytes);
+
+  bool loading() const {
+    return loader_ != nullptr;
+  }
+
+  /** @brief fraction of the background loading done, in [0, 1] **/
+  float load_progress() const;
+
+  /** @brief fields of the source file the points can be colored by: scalars
+   *  through the colormap, rgb/rgba as they are **/
+  const std::vector<std::string>& attribute_names() const {
+    return attribute_names_;
+  }
+
+  /** @brief color the points by a field of the source file, empty for the
+   *  height colormap. The field is read on a worker thread, unless it is one
+   *  of the last two kept decoded, and UpdateAttributes uploads it to its
+   *  own buffer; the positions stay as they are. **/
+  void set_color_attribute(const std::string &name) {
+    color_attribute_ = name;
+  }
+
+  const std::string& color_attribute() const {
+    return color_attribute_;
+  }
+
+  /** @brief the height colormap, then every field in turn **/
+  void NextColorAttribute();
+
+  /** @brief how the values of a scalar field spread over the colormap **/
+  void SetColormapScaling(ColormapScaling scaling);
+
+  /** @brief start reading the requested field and upload it once read, or
+   *  drop the buffer of a field no longer shown; once per frame **/
+  void UpdateAttributes();
+
+  /** @brief the requested field is not drawn yet **/
+  bool attribute_loading() const {
+    return num_points_ > 0 && color_attribute_ != resident_attribute_;
+  }
+
+  /** @brief chunk and index in the source file of a vertex of the buffer
+   *  drawn, e.g. a picked one; false if there is no such vertex **/
+  bool LookupVertex(int vertex, std::size_t *chunk,
+      std::size_t *point_index) const;
+
+ private:
+  bool LoadWithPcdReader(const std::string &filepath);
+  bool LoadWithPcl(const std::string &filepath);
+  // false if there is no up to date cache for filepath
+  bool LoadFromCache(const std::string &filepath);
+  // voxel filter the whole cloud at hand if asked to, then upload it with
+  // or without the octree
+  void UploadPoints(std::vector<float> *xyz);
+  // build the octree over xyz and upload the reordered positions
+  void UploadWithLod(std::vector<float> *xyz);
+  void AllocateBuffer(GLsizeiptr size, const void *data);
+  // position attribute of vao_ reading vbo_ in the current format
+  void SetupVertexArray();
+  // make every octree node a chunk
+  void ResetChunksFromOctree();
+  // split [first, first + count) into chunks; xyz points at the first of
+  // them and consecutive points are stride floats apart
+  void AppendChunks(const float *xyz, std::size_t stride, std::size_t first,
+      std::size_t count);
+  // chunks [chunk_begin, chunks_.size()) with glBufferSubData, xyz holding
+  // the points from chunks_[chunk_begin].first on
+  void UploadChunks(std::size_t chunk_begin, const float *xyz,
+      std::size_t stride);
+  // the vertex buffer contents of a chunk: xyz itself for float positions,
+  // else the quantized copy in encode_buffer_
+  const void* EncodeChunk(const PointChunk &chunk, const float *xyz,
+      std::size_t stride);
+  // stage up to size bytes into buffer at offset, within the byte budget and
+  // the free upload ring slots; returns the bytes uploaded
+  std::size_t UploadBytes(GLuint buffer, std::size_t offset, const char *data,
+      std::size_t size, std::size_t *budget);
+  // upload the LOD ordered copy node by node, true once complete
+  bool PumpLodUploads(std::size_t *budget);
+  // the vertex buffer of a background load, once the point count is known
+  void AllocateLoaderBuffer();
+  void FinishLoading();
+  // remember the colorable fields of the file the points come from
+  void ListAttributes(const std::string &filepath);
+  // own buffer of vao_ bound to the color or scalar attribute
+  void UploadAttribute(const PointAttribute &attribute);
+  // make attribute the most recent of decoded_attributes_, dropping the
+  // oldest beyond kMaxDecodedAttributes
+  void KeepDecoded(std::unique_ptr<PointAttribute> attribute);
+  void ReleaseAttribute();
+  void ReportLoad(const std::string &filepath, const char *loader_name,
+      std::chrono::steady_clock::time_point start_time) const;
+  // index the positions of the whole vertex buffer, taking xyz, once
+  // point_order_ is final
+  void StartIndexBuild(std::vector<float> *xyz);
 
  private:
+  bool use_pcl_loader_ = false;
+  bool use_lod_ = true;
+  bool quantize_positions_ = false;
+  bool use_cache_ = true;
+  VoxelFilter voxel_filter_;
+  std::size_t point_budget_ = 3000000;
+  // octree nodes smaller than this on screen are not refined
+  float min_node_pixels_ = 50.f;
+
+  // where UploadWithLod writes the cache, empty for none
+  std::string cache_path_;
+  PointCacheKey cache_key_;
+
   GLuint vao_ = 0;
   GLuint vbo_ = 0;
   int num_points_ = 0;
   int stride_ = 0;
+  Eigen::AlignedBox3f bounds_;
+
+  // the octree nodes in LOD mode, consecutive ranges else
+  std::vector<PointChunk> chunks_;
+  BoxArray chunk_bounds_;
+  std::vector<uint8_t> chunk_visible_;
+  // leading chunks whose data is in the vertex buffer
+  std::size_t num_resident_chunks_ = 0;
+  RenderStats render_stats_;
+
+  std::vector<uint16_t> encode_buffer_;
+  float max_quantization_error_ = 0.f;
+
+  std::unique_ptr<PointOctree> octree_;
+  std::vector<int> selected_nodes_;
+  std::vector<GLint> draw_firsts_;
+  std::vector<GLsizei> draw_counts_;
+  // chunk of every draw range, ranges are not merged when quantized
+  std::vector<int> draw_chunks_;
+  // camera of the last UpdateView and the refined selection made for it,
+  // whose first refined_cursor_ nodes have been drawn
+  Eigen::Matrix4f view_matrix_ = Eigen::Matrix4f::Identity();
+  Eigen::Matrix4f projection_matrix_ = Eigen::Matrix4f::Identity();
+  float viewport_height_ = 0.f;
+  bool refined_selected_ = false;
+  std::vector<int> refined_nodes_;
+  std::size_t refined_cursor_ = 0;
+
+  // background loading state
+  std::unique_ptr<PointCloudLoader> loader_;
+  std::unique_ptr<UploadRing> upload_ring_;
+  std::string loading_filepath_;
+  std::chrono::steady_clock::time_point load_start_time_;
+  PointCloudLoader::Chunk pending_chunk_;
+  std::size_t num_uploaded_points_ = 0;
+  // LOD ordered copy uploaded after decoding, swapped in once complete
+  std::unique_ptr<PointOctree> pending_octree_;
+  std::vector<float> lod_positions_;
+  std::size_t lod_node_cursor_ = 0;
+  std::size_t lod_node_uploaded_bytes_ = 0;
+  std::size_t num_lod_uploaded_points_ = 0;
+  GLuint lod_vbo_ = 0;
+
+  // per-point fields of the source file, read on demand; vertex i is point
+  // point_order_[i] of the file, or point i when point_order_ is empty
+  std::string source_path_;
+  std::vector<uint32_t> point_order_;
+  std::vector<std::string> attribute_names_;
+  std::string color_attribute_;
+  // field held by attribute_vbo_, empty for none
+  std::string resident_attribute_;
+  bool resident_rgb_ = false;
+  Eigen::Vector2f scalar_range_ = Eigen::Vector2f(0.f, 1.f);
+  // of the resident scalar field
+  ColormapScaling colormap_scaling_ = ColormapScaling::kPercentile;
+  ValueHistogram attribute_histogram_;
+  std::unique_ptr<Colormap> attribute_colormap_;
+  GLuint attribute_vbo_ = 0;
+  std::future<std::unique_ptr<PointAttribute>> attribute_future_;
+  // the last fields read or shown, most recent last; switching back to one
+  // only uploads it again
+  std::vector<std::unique_ptr<PointAttribute>> decoded_attributes_;
+
+  // spatial index of the vertex buffer positions, with their source indices
+  bool build_index_ = true;
+  std::unique_ptr<PointIndex> index_;
+  std::future<std::unique_ptr<PointIndex>> index_future_;
+  std::chrono::steady_clock::time_point index_start_time_;
+  // positions of loads that stream them to the GPU without keeping them
+  std::vector<float> index_positions_;
 };
 
 }  // namespace ogl_viewer
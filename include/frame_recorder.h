@@ -0,0 +1,171 @@
+#pragma once
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+#undef GLFW_DLL
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <Eigen/Core>
+
+#include "thread_pool.h"
+
+namespace ogl_viewer {
+
+// how recorded frames are written
+enum class RecordFormat {
+  // a PNG file per frame, <prefix>000000.png, <prefix>000001.png, ...
+  kPng,
+  // every frame appended to <prefix>.rgba as it was read back: RGBA bytes,
+  // bottom row first, all frames the size of the first one
+  kRaw
+};
+
+/** @brief "png" or "raw"; false for anything else **/
+bool ParseRecordFormat(const std::string &name, RecordFormat *format);
+
+// what a FrameRecorder wrote and dropped so far, over all its recordings
+struct RecordStats {
+  std::size_t frames_written = 0;
+  // by the recording when the writers fell behind by more than
+  // kMaxQueuedBytes, or when the size changed in raw format
+  std::size_t frames_dropped = 0;
+  std::size_t screenshots_written = 0;
+};
+
+// Screenshots and recordings of the frames drawn, without stalling them. A
+// capture reads the color attachment of a framebuffer into one of a ring of
+// pixel buffer objects and fences it; once the fence has passed, a frame or
+// two later, Poll copies the pixels out and hands them to writer threads,
+// which encode PNG files or append raw frames. The render thread waits only
+// when every buffer of the ring is still in flight, i.e. when the GPU is
+// several frames behind.
+class FrameRecorder {
+ public:
+  FrameRecorder();
+  ~FrameRecorder();
+
+  FrameRecorder(const FrameRecorder&) = delete;
+  FrameRecorder& operator=(const FrameRecorder&) = delete;
+
+  /** @brief write every frame captured from now on **/
+  bool StartRecording(const std::string &prefix, RecordFormat format);
+
+  /** @brief capture no more frames; those captured so far are written out
+   *  and the recording closed on the writer threads, without waiting **/
+  void StopRecording();
+
+  bool recording() const {
+    return recording_ != nullptr;
+  }
+
+  /** @brief write the next frame captured to path as PNG **/
+  void RequestScreenshot(const std::string &path);
+
+  /** @brief a screenshot was requested or a recording runs, Capture should
+   *  be called after the next frame **/
+  bool wants_capture() const {
+    return recording_ != nullptr || !screenshot_paths_.empty();
+  }
+
+  /** @brief start reading back color attachment 0 of framebuffer for the
+   *  screenshots requested and the recording **/
+  void Capture(GLuint framebuffer, const Eigen::Vector2i &size);
+
+  /** @brief hand the readbacks completed since the last call to the
+   *  writers; never waits **/
+  void Poll();
+
+  /** @brief a readback is in flight, Poll should be called again **/
+  bool pending() const;
+
+  /** @brief wait for every readback and write **/
+  void Finish();
+
+  RecordStats stats() const;
+
+ private:
+  // one recording, shared by the readbacks and writes of its frames; the
+  // last of them to finish prints what was written and closes the file
+  struct Recording {
+    ~Recording();
+
+    std::string prefix;
+    RecordFormat format = RecordFormat::kPng;
+    // render thread: the next frame number and, of raw recordings, the size
+    // set by the first frame
+    int64_t next_frame = 0;
+    Eigen::Vector2i raw_size = Eigen::Vector2i::Zero();
+    // under FrameRecorder::mutex_ while frames are queued: the raw file and
+    // the next frame to append
+    FILE *raw_file = nullptr;
+    int64_t next_raw_frame = 0;
+    std::size_t frames_written = 0;
+    std::size_t frames_dropped = 0;
+  };
+
+  struct Readback {
+    GLuint buffer = 0;
+    std::size_t capacity = 0;
+    GLsync fence = nullptr;
+    uint64_t sequence = 0;
+    Eigen::Vector2i size = Eigen::Vector2i::Zero();
+    // the recording it is part of, besides the screenshots; null for none
+    std::shared_ptr<Recording> recording;
+    std::vector<std::string> screenshot_paths;
+  };
+
+  // pixels and where they go, on a writer thread
+  struct Job {
+    std::vector<uint8_t> pixels;
+    Eigen::Vector2i size = Eigen::Vector2i::Zero();
+    std::vector<std::string> screenshot_paths;
+    // of a recorded frame: its recording and its PNG file, or its place in
+    // the raw stream
+    std::shared_ptr<Recording> recording;
+    std::string frame_path;
+    int64_t raw_frame = -1;
+  };
+
+  // the readback in flight captured first, null when there is none
+  Readback* Oldest();
+
+  // copy a completed readback out and submit it to the writers, in the
+  // order of capture so that recorded frames are numbered as drawn; a
+  // recorded frame is dropped while the writers are too far behind, unless
+  // wait is set
+  void Submit(Readback *readback, bool wait);
+  // writer thread
+  void Write(const std::shared_ptr<Job> &job);
+  // append a raw frame once those before it are written; writer thread
+  bool AppendRawFrame(const Job &job);
+
+ private:
+  std::vector<Readback> readbacks_;
+  uint64_t next_sequence_ = 1;
+
+  // the one frames are captured for, null when not recording
+  std::shared_ptr<Recording> recording_;
+  std::vector<std::string> screenshot_paths_;
+
+  // guards the members below, shared with the writer threads
+  mutable std::mutex mutex_;
+  std::condition_variable written_;
+  std::size_t queued_bytes_ = 0;
+  std::size_t queued_jobs_ = 0;
+  // pixel buffers handed back by the writers for reuse
+  std::vector<std::vector<uint8_t>> free_pixels_;
+  RecordStats stats_;
+
+  // last, so that its threads are joined before anything they use goes
+  std::unique_ptr<ThreadPool> writers_;
+};
+
+}  // namespace ogl_viewer
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ogl_viewer {
+
+// Axis-aligned boxes stored as structure of arrays, so that several boxes
+// can be tested against a plane with one SIMD instruction.
+struct BoxArray {
+  std::vector<float> min_x;
+  std::vector<float> min_y;
+  std::vector<float> min_z;
+  std::vector<float> max_x;
+  std::vector<float> max_y;
+  std::vector<float> max_z;
+
+  std::size_t size() const {
+    return min_x.size();
+  }
+
+  void Clear();
+  void Add(const Eigen::AlignedBox3f &box);
+};
+
+class Frustum {
+ public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  /** @brief extract the six clip planes of projection * view **/
+  explicit Frustum(const Eigen::Matrix4f &view_projection);
+
+  bool Intersects(const Eigen::AlignedBox3f &box) const;
+
+  /** @brief visible[i] = 1 if boxes[i] may intersect the frustum, else 0;
+   *  returns the number of visible boxes **/
+  std::size_t CullBoxes(const BoxArray &boxes,
+      std::vector<uint8_t> *visible) const;
+
+ private:
+  // a x + b y + c z + d >= 0 inside
+  Eigen::Vector4f planes_[6];
+};
+
+}  // namespace ogl_viewer
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <Eigen/StdVector>
+
+#include "drawable.h"
+
+namespace ogl_viewer {
+
+enum class GizmoShape {
+  // red, green and blue unit segments along x, y and z
+  kAxes,
+  // the twelve edges of the unit cube centered at the origin
+  kBox
+};
+
+// per-instance data of a GizmoBatch: the top three rows of the affine
+// transform, row-major, and the color as normalized RGBA bytes (52 bytes)
+struct GizmoInstance {
+  float rows[12];
+  uint32_t color;
+};
+
+// Many copies of one gizmo shape in a single instanced draw call. The shape
+// is built once into a shared vertex and element buffer; what changes per
+// frame is only the instance buffer, streamed like a StreamBuffer into the
+// one of two buffers that was not drawn last. The instance color multiplies
+// the vertex colors and picking reports the instance index.
+class GizmoBatch : public Drawable {
+ public:
+  GizmoBatch(GizmoShape shape, int pick_id);
+  ~GizmoBatch() override;
+
+  GizmoBatch(const GizmoBatch&) = delete;
+  GizmoBatch& operator=(const GizmoBatch&) = delete;
+
+  void Enqueue(GLSLShader *shader, RenderQueue *queue) const override;
+
+  void Clear() {
+    instances_.clear();
+  }
+
+  /** @brief append an instance; boxes take their size as the scale of the
+   *  transform. Shown from the next Upload on. **/
+  void Add(const Eigen::Affine3f &transform, const Eigen::Vector4f &color);
+
+  /** @brief replace the instances drawn by those added since Clear (or the
+   *  last Upload), which are moved, not copied, to the drawn set; the next
+   *  Upload draws only what is added after this one **/
+  void Upload();
+
+  /** @brief instances added since Clear or the last Upload **/
+  std::size_t size() const {
+    return instances_.size();
+  }
+
+  /** @brief instances drawn, as of the last Upload **/
+  std::size_t num_drawn() const {
+    return drawn_instances_.size();
+  }
+
+  /** @brief bytes streamed by the last Upload **/
+  std::size_t uploaded_bytes() const {
+    return drawn_instances_.size() * sizeof(GizmoInstance);
+  }
+
+  /** @brief transform of a drawn instance, e.g. a picked one; false if there
+   *  is no such instance **/
+  bool LookupInstance(int instance, Eigen::Affine3f *transform) const;
+
+ private:
+  // the triangles of the shape into the shared buffers
+  void BuildShape(GizmoShape shape);
+
+ private:
+  int pick_id_ = kPickNone;
+  GLuint shape_vbo_ = 0;
+  GLuint shape_ebo_ = 0;
+  GLsizei num_indices_ = 0;
+  // one per instance buffer, both reading the shared shape buffers
+  GLuint vaos_[2] = {0, 0};
+  GLuint instance_vbos_[2] = {0, 0};
+  int front_ = 0;
+
+  std::vector<GizmoInstance> instances_;
+  // what the front buffer holds, for LookupInstance
+  std::vector<GizmoInstance> drawn_instances_;
+};
+
+// a pose file: one pose per line as "x y z qx qy qz qw", optionally after a
+// timestamp (TUM format); blank lines and lines starting with # are skipped
+bool LoadPoseFile(const std::string &path,
+    std::vector<Eigen::Affine3f,
+        Eigen::aligned_allocator<Eigen::Affine3f>> *poses);
+
+// a box file: one box per line as "cx cy cz length width height yaw",
+// optionally followed by "r g b" in [0, 1]; the box is centered at c, its
+// length along x and its width along y rotated by yaw around z
+bool LoadBoxFile(const std::string &path,
+    std::vector<Eigen::Affine3f,
+        Eigen::aligned_allocator<Eigen::Affine3f>> *boxes,
+    std::vector<Eigen::Vector4f,
+        Eigen::aligned_allocator<Eigen::Vector4f>> *colors);
+
+}  // namespace ogl_viewer
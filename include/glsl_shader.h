@@ -4,6 +4,7 @@
 #include <GL/glew.h>
 #undef GLFW_DLL
 
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <unordered_map>
@@ -12,18 +13,54 @@
 
 namespace ogl_viewer {
 
+// vertex attribute locations, fixed by the layout qualifiers of the shaders
+enum VertexAttribLocation {
+  kPositionAttrib = 0,
+  // the point after vert_position, of polyline segments
+  kNextPositionAttrib = 1,
+  kColorAttrib = 2,
+  kInfoAttrib = 3,
+  kScalarAttrib = 4,
+  kNormalAttrib = 5,
+  // per instance: three rows of an affine transform, then a color
+  kInstanceTransformAttrib = 6,
+  kInstanceColorAttrib = 9
+};
+
+// uniform buffer binding point of the FrameUniforms block
+const GLuint kFrameUniformsBinding = 0;
+
+// Program built from a vertex and a fragment shader file. Linked programs
+// are stored as driver binaries next to the vertex shader, keyed by the
+// sources and the driver, so that warm starts skip compilation.
 class GLSLShader {
  public:
   GLSLShader() = default;
-  ~GLSLShader() = default;
+  ~GLSLShader();
+
+  GLSLShader(const GLSLShader&) = delete;
+  GLSLShader& operator=(const GLSLShader&) = delete;
+
+  void set_use_binary_cache(bool use_binary_cache) {
+    use_binary_cache_ = use_binary_cache;
+  }
 
   bool Init(const std::string& vertex_shader_filepath,
       const std::string& fragment_shader_filepath);
 
+  /** @brief rebuild the program in place when a source file changed on disk;
+   *  the current program stays in use if the new one fails to build **/
+  bool ReloadIfChanged();
+
   void Use() const {
     glUseProgram(shader_program_);
   }
 
+  /** @brief current program object, replaced by a successful reload **/
+  GLuint program() const {
+    return shader_program_;
+  }
+
   /** @brief get attribute variable location **/
   GLint GetAttribLocation(const std::string& name);
 
@@ -71,10 +108,22 @@ class GLSLShader {
   }
 
  private:
-  GLuint LoadShaderFromFile(const std::string& filepath, GLuint shader_type);
+  /** @brief program of the current files, 0 on failure **/
+  GLuint BuildProgram();
+  GLuint CompileShader(const std::string& source, const std::string& filepath,
+      GLuint shader_type);
+  GLuint LoadProgramBinary(const std::string& path, uint64_t key);
+  void SaveProgramBinary(const std::string& path, uint64_t key,
+      GLuint program);
 
  private:
   GLuint shader_program_ = 0;
+  bool use_binary_cache_ = true;
+  std::string vertex_shader_filepath_;
+  std::string fragment_shader_filepath_;
+  // modification times of the sources of the last build, -1 if missing
+  int64_t vertex_mtime_ns_ = -1;
+  int64_t fragment_mtime_ns_ = -1;
   std::unordered_map<std::string, GLint> attrib_map_;
   std::unordered_map<std::string, GLint> uniform_map_;
 };
@@ -0,0 +1,84 @@
+#pragma once
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+#undef GLFW_DLL
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "tracer.h"
+
+namespace ogl_viewer {
+
+// GL_TIME_ELAPSED queries around render passes. Results are polled once per
+// frame and only taken when available, so timing never stalls the pipeline;
+// they show up a frame or two late on the GPU track of the Tracer and in the
+// per-frame totals.
+class GpuTimer {
+ public:
+  // frames whose GPU totals are kept
+  static const int kFrameHistory = 128;
+
+  GpuTimer();
+  ~GpuTimer();
+
+  GpuTimer(const GpuTimer&) = delete;
+  GpuTimer& operator=(const GpuTimer&) = delete;
+
+  /** @brief collect finished queries and start a new frame **/
+  void BeginFrame();
+
+  /** @brief time GPU work until End; passes cannot overlap, nested Begin
+   *  calls are counted in the outermost one **/
+  void Begin(const char *name);
+  void End();
+
+  /** @brief GPU milliseconds of the frame age frames before the current
+   *  one, negative while its queries are still pending **/
+  float frame_ms(int age) const;
+
+ private:
+  struct PendingQuery {
+    GLuint query;
+    const char *name;
+    int64_t cpu_begin_us;
+    uint64_t frame;
+  };
+
+  std::vector<GLuint> free_queries_;
+  std::deque<PendingQuery> pending_;
+  int depth_ = 0;
+  uint64_t frame_ = 0;
+  // totals so far and queries still pending, per frame
+  std::vector<float> frame_ms_;
+  std::vector<int> frame_pending_;
+};
+
+// Times the enclosing scope on the GPU when timer is not null.
+class GpuTimerScope {
+ public:
+  GpuTimerScope(GpuTimer *timer, const char *name) : timer_(timer) {
+    if (timer_ != nullptr) {
+      timer_->Begin(name);
+    }
+  }
+
+  ~GpuTimerScope() {
+    if (timer_ != nullptr) {
+      timer_->End();
+    }
+  }
+
+  GpuTimerScope(const GpuTimerScope&) = delete;
+  GpuTimerScope& operator=(const GpuTimerScope&) = delete;
+
+ private:
+  GpuTimer *timer_;
+};
+
+}  // namespace ogl_viewer
+
+#define TRACE_GPU_SCOPE(timer, name) ::ogl_viewer::GpuTimerScope \
+    OGL_VIEWER_TRACE_CONCAT(gpu_trace_scope_, __LINE__)(timer, name)
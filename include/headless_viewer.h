@@ -0,0 +1,48 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+
+#include "opengl_model_viewer.h"
+
+namespace ogl_viewer {
+
+// Renders into an offscreen framebuffer of a surfaceless EGL context, so that
+// frame times can be measured on hosts without a display or a GPU (Mesa's
+// llvmpipe is enough). There is no swap chain and hence no vsync.
+class HeadlessViewer : public OpenGLModelViewer {
+ public:
+  HeadlessViewer() = default;
+  ~HeadlessViewer() override;
+
+  bool Init(const char* window_name, int width, int height,
+      const std::string &model_file_path,
+      const char* glsl_version = "#version 330") override;
+
+  /** @brief finish loading, replay OrbitCameraPath over num_frames frames
+   *  and write load time, frame time percentiles and points drawn as JSON
+   *  to output_path ("-" for stdout) **/
+  bool RunBenchmark(int num_frames, const std::string &output_path);
+
+  Eigen::Vector2i FrameBufferSize() override {
+    return size_;
+  }
+
+ private:
+  bool CreateContext();
+  bool CreateFramebuffer(int width, int height);
+
+ private:
+  // EGLDisplay and EGLContext, kept opaque to spare EGL headers to includers
+  void *egl_display_ = nullptr;
+  void *egl_context_ = nullptr;
+  GLuint fbo_ = 0;
+  GLuint color_buffer_ = 0;
+  GLuint depth_buffer_ = 0;
+  Eigen::Vector2i size_ = Eigen::Vector2i::Zero();
+
+  std::string model_file_path_;
+  std::chrono::steady_clock::time_point load_start_time_;
+};
+
+}  // namespace ogl_viewer
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "drawable.h"
+#include "shm_ring.h"
+#include "stream_buffer.h"
+
+namespace ogl_viewer {
+
+/** @brief whether a model path of the form shm:<name> names a shared
+ *  memory ring rather than a file **/
+bool IsLivePath(const std::string &path);
+
+/** @brief the shared memory object name of such a path, with the leading
+ *  slash POSIX asks for **/
+std::string LiveRingName(const std::string &path);
+
+// counters of a LiveCloud, latencies over the recently shown frames
+struct LiveStats {
+  bool connected = false;
+  uint64_t sequence = 0;
+  std::size_t frames_shown = 0;
+  // published but replaced by a newer frame before the viewer got to them
+  uint64_t skipped_frames = 0;
+  // overwritten by the producer while being uploaded
+  std::size_t torn_frames = 0;
+  // from the publication to the end of the upload / of the buffer swap
+  float upload_latency_ms = 0.f;
+  float present_latency_p50_ms = 0.f;
+  float present_latency_p99_ms = 0.f;
+};
+
+// Shows the frames a producer process publishes into a shared memory ring
+// (see ShmRingProducer). Only the latest frame is taken each render frame
+// and it is uploaded straight from the shared mapping. The ring is mapped
+// once a producer has created it, and again after it restarts.
+class LiveCloud : public Drawable {
+ public:
+  explicit LiveCloud(const std::string &ring_name);
+
+  void Enqueue(GLSLShader *shader, RenderQueue *queue) const override;
+
+  /** @brief upload the newest published frame, once per frame **/
+  void Update();
+
+  /** @brief the frame is on screen (the buffer swap returned) **/
+  void FramePresented();
+
+  LiveStats stats() const;
+
+  std::size_t num_points() const {
+    return buffer_.num_points();
+  }
+
+  /** @brief frames uploaded so far **/
+  std::size_t frames_shown() const {
+    return frames_shown_;
+  }
+
+ private:
+  static const std::size_t kLatencyHistory = 128;
+
+  std::string ring_name_;
+  ShmRingConsumer consumer_;
+  StreamBuffer buffer_;
+  // heights of the frame being read, added to height_histogram_ once it
+  // is validated
+  ValueHistogram frame_histogram_;
+
+  // last time the ring was (re)opened or a frame arrived
+  std::chrono::steady_clock::time_point check_time_;
+  std::chrono::steady_clock::time_point frame_time_;
+
+  uint64_t sequence_ = 0;
+  std::size_t frames_shown_ = 0;
+  std::size_t torn_frames_ = 0;
+  float upload_latency_ms_ = 0.f;
+  // publish time of the uploaded frame not presented yet, -1 for none
+  int64_t unpresented_publish_ns_ = -1;
+  std::vector<float> present_latency_ms_;
+  std::size_t num_present_latencies_ = 0;
+};
+
+}  // namespace ogl_viewer
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace ogl_viewer {
+
+/** @brief decompress an LZF stream (the codec used by PCD
+ *  binary_compressed); returns the number of bytes written, 0 on error **/
+std::size_t LzfDecompress(const uint8_t *in, std::size_t in_size,
+    uint8_t *out, std::size_t out_size);
+
+/** @brief compress into an LZF stream LzfDecompress reads back; returns the
+ *  number of bytes written, 0 if the result does not fit into out_size **/
+std::size_t LzfCompress(const uint8_t *in, std::size_t in_size,
+    uint8_t *out, std::size_t out_size);
+
+}  // namespace ogl_viewer
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace ogl_viewer {
+
+// triangles of a mesh file, polygons being split into fans
+struct MeshData {
+  // 3 floats per vertex
+  std::vector<float> positions;
+  // 3 floats per vertex, empty when the file has none
+  std::vector<float> normals;
+  // 3 vertex indices per triangle
+  std::vector<uint32_t> indices;
+
+  std::size_t num_vertices() const {
+    return positions.size() / 3;
+  }
+
+  std::size_t num_triangles() const {
+    return indices.size() / 3;
+  }
+};
+
+/** @brief whether the path names a .ply or .obj file **/
+bool IsMeshPath(const std::string &path);
+
+/** @brief memory-map and parse a PLY (ascii or binary) or OBJ file. Text is
+ *  parsed in blocks of lines, binary PLY records in ranges, both spread over
+ *  ThreadPool::Global(). Area-weighted vertex normals are computed when the
+ *  file has none. **/
+bool LoadMesh(const std::string &filepath, MeshData *mesh);
+
+/** @brief parse a PLY file held in memory **/
+bool ParsePly(const char *data, std::size_t size, MeshData *mesh);
+
+/** @brief parse an OBJ file held in memory; only v and f lines are used **/
+bool ParseObj(const char *data, std::size_t size, MeshData *mesh);
+
+/** @brief area-weighted normals of the vertices, unit length **/
+void ComputeVertexNormals(MeshData *mesh);
+
+}  // namespace ogl_viewer
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ogl_viewer {
+
+// entries of the simulated post-transform vertex cache
+const int kVertexCacheSize = 32;
+
+// transformed vertices per triangle (ACMR, 0.5 at best for large regular
+// meshes, 3 at worst) and per vertex (ATVR, 1 at best) of an index order
+// drawn through a FIFO vertex cache
+struct VertexCacheStats {
+  double acmr = 0.0;
+  double atvr = 0.0;
+};
+
+/** @brief simulate a FIFO post-transform cache of cache_size entries **/
+VertexCacheStats AnalyzeVertexCache(const std::vector<uint32_t> &indices,
+    std::size_t num_vertices, int cache_size = kVertexCacheSize);
+
+/** @brief reorder the triangles for the post-transform cache with Forsyth's
+ *  linear-speed algorithm: the next triangle is the one whose vertices
+ *  score best, by their position in a simulated LRU cache and by how few
+ *  triangles still use them **/
+void OptimizeVertexCache(std::vector<uint32_t> *indices,
+    std::size_t num_vertices);
+
+/** @brief number the vertices in the order the triangles first use them,
+ *  so that vertex fetches walk the buffer forward; renumbers indices and
+ *  fills remap with the new index of every old vertex (~0u for unused
+ *  ones). Returns the number of vertices used. **/
+std::size_t OptimizeVertexFetch(std::vector<uint32_t> *indices,
+    std::size_t num_vertices, std::vector<uint32_t> *remap);
+
+/** @brief move the components per vertex of values to their remapped
+ *  place, dropping unused vertices **/
+void RemapVertices(const std::vector<uint32_t> &remap,
+    std::size_t new_num_vertices, int components, std::vector<float> *values);
+
+// a range of triangles drawn with 16-bit indices relative to first_vertex
+struct MeshBatch {
+  std::size_t first_index = 0;
+  std::size_t num_indices = 0;
+  std::size_t first_vertex = 0;
+  std::size_t num_vertices = 0;
+};
+
+/** @brief cut the triangles, in their order, into batches of at most 65536
+ *  vertices each. short_indices receives the batch-relative indices and
+ *  vertex_sources the vertex of the input behind every vertex of the
+ *  batches, the few used by two batches being duplicated. **/
+void SplitShortIndices(const std::vector<uint32_t> &indices,
+    std::size_t num_vertices, std::vector<uint16_t> *short_indices,
+    std::vector<uint32_t> *vertex_sources, std::vector<MeshBatch> *batches);
+
+}  // namespace ogl_viewer
@@ -7,13 +7,120 @@
 #include <GLFW/glfw3.h>
 #include <Eigen/Core>
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <utility>
+
 #include "drawable.h"
 #include "camera_control.h"
+#include "colormap.h"
+#include "frame_recorder.h"
+#include "gizmo_batch.h"
+#include "polyline_batch.h"
+#include "gpu_timer.h"
+#include "live_cloud.h"
+#include "pick_buffer.h"
+#include "seqlock.h"
+#include "sequence_cloud.h"
+#include "synthetic_overlays.h"
+#include "triangle_mesh.h"
 
 namespace ogl_viewer {
 
+struct ViewerOptions {
+  // load point clouds through pcl::io::loadPCDFile instead of PcdReader
+  bool use_pcl_loader = false;
+  // build an octree at load time and draw it under a per-frame point budget
+  bool use_lod = true;
+  std::size_t point_budget = 3000000;
+  // decode on a worker thread and show the cloud while it arrives
+  bool async_loading = true;
+  std::size_t upload_bytes_per_frame = 16 << 20;
+  // 16-bit positions relative to the bounds of each chunk
+  bool quantize_positions = false;
+  // reopen clouds from the preprocessed <file>.ovcache next to them
+  bool use_cache = true;
+  // field of the PCD file the points are colored by, empty for height
+  std::string color_attribute;
+  // how heights and scalar fields spread over the colormap, from their
+  // distribution (cycled with M)
+  ColormapScaling colormap_scaling = ColormapScaling::kPercentile;
+  // load-time voxel grid filter: leaf size, or the number of points to keep
+  // (which wins), 0 for none
+  float voxel_leaf_size = 0.f;
+  std::size_t voxel_target_points = 0;
+  // PLY/OBJ meshes: reorder for the vertex cache and vertex fetches, and
+  // draw with 16-bit indices in batches
+  bool optimize_meshes = true;
+  bool short_mesh_indices = false;
+  // instanced overlays: axes at the poses of a pose file, boxes of a box
+  // file (see LoadPoseFile, LoadBoxFile), or that many synthetic vehicles
+  // with both instead, moving every frame
+  std::string poses_path;
+  std::string boxes_path;
+  std::size_t synthetic_gizmos = 0;
+  // polylines of a polyline file (see LoadPolylineFile), and that many
+  // segments of synthetic lanes, appended over the first frames
+  std::string polylines_path;
+  std::size_t synthetic_segments = 0;
+  // Chrome trace JSON of CPU scopes and GPU passes, written on exit
+  std::string trace_path;
+  // frame time graph in the top-left corner, toggled with F3
+  bool stats_overlay = false;
+  // write every frame drawn from the start (toggled with R), as PNG files
+  // <record_prefix><n>_000000.png... or one raw stream <record_prefix><n>.rgba,
+  // n the lowest not taken yet; F12 writes a screenshot
+  bool record = false;
+  std::string record_prefix = "frame_";
+  RecordFormat record_format = RecordFormat::kPng;
+  // headless runs write their last frame there
+  std::string screenshot_path;
+  // index the cloud once loaded for selections (shift-drag lasso, B, G) and
+  // measurements (N); selections are exported with E
+  bool build_index = true;
+  // directory of rainbow.vert and rainbow.frag
+  std::string shader_dir = "./data/shader";
+  // keep linked programs as <shader_dir>/rainbow.glprog for warm starts
+  bool use_shader_cache = true;
+  // rebuild the program when a shader file changes while running
+  bool watch_shaders = true;
+  // draw only when something changed and sleep otherwise, refining the
+  // point selection while the camera is still; redraw every frame if false
+  bool on_demand = true;
+  // playback of a directory of PCD frames: frame rate, frames decoded ahead
+  // and memory of the decoded frame cache, optionally LZF compressed
+  double frame_rate = 10.0;
+  int prefetch_frames = 16;
+  std::size_t frame_cache_bytes = std::size_t(512) << 20;
+  bool compress_frames = false;
+};
+
+// closed polygon of window positions, as cursor positions are given
+typedef std::vector<Eigen::Vector2f,
+    Eigen::aligned_allocator<Eigen::Vector2f>> ScreenPolygon;
+
+// camera and window state handed from the input thread to the render
+// thread through a SeqLock; plain arrays to stay trivially copyable
+struct ViewState {
+  float view_matrix[16] = {};
+  float projection_matrix[16] = {};
+  int framebuffer_size[2] = {0, 0};
+  int window_size[2] = {0, 0};
+  double cursor[2] = {-1.0, -1.0};
+  // bumped by every input that moved the camera, the last one at
+  // input_time_us (Tracer::NowMicros)
+  uint64_t camera_sequence = 0;
+  int64_t input_time_us = 0;
+};
+
 class OpenGLModelViewer {
  public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
   OpenGLModelViewer();
   virtual ~OpenGLModelViewer();
 
@@ -21,11 +128,28 @@ class OpenGLModelViewer {
       const std::string &model_file_path,
       const char* glsl_version = "#version 330");
 
+  /** @brief handle input on the calling thread while a render thread,
+   *  which takes over the GL context, draws; returns once the window is
+   *  closed **/
   void Run();
 
+  void set_options(const ViewerOptions &options) {
+    options_ = options;
+  }
+
   void Close();
 
-  Eigen::Vector2i FrameBufferSize();
+  /** @brief show frame rate and culling counters in the window title **/
+  void UpdateWindowTitle();
+
+  /** @brief bar along the bottom edge of the window, progress in [0, 1] **/
+  void DrawProgressBar(float progress);
+
+  /** @brief CPU (orange) and GPU (cyan) time of the recent frames, the
+   *  white line marking 60 fps **/
+  void DrawStatsOverlay();
+
+  virtual Eigen::Vector2i FrameBufferSize();
 
   virtual void Draw();
 
@@ -34,13 +158,199 @@ class OpenGLModelViewer {
       int action, int mods);
   static void CursorPosCallback(GLFWwindow* window, double xpos, double ypos);
   static void ScrollCallback(GLFWwindow* window, double xoffset, double yoffset);
+  static void KeyCallback(GLFWwindow* window, int key, int scancode,
+      int action, int mods);
+  static void WindowRefreshCallback(GLFWwindow* window);
 
  protected:
+  /** @brief frames of the render thread until Run asks it to quit **/
+  void RenderLoop();
+
+  /** @brief hand the camera, window and cursor state to the render thread
+   *  and wake it; input thread only **/
+  void PublishViewState();
+
+  void WakeRenderer();
+
+  /** @brief key presses queued by KeyCallback, on the render thread **/
+  void HandleKey(int key, int action);
+
+  /** @brief camera the next Draw uses **/
+  void SetFrameCamera(const Eigen::Matrix4f &view_matrix,
+      const Eigen::Matrix4f &projection_matrix) {
+    frame_view_matrix_ = view_matrix;
+    frame_projection_matrix_ = projection_matrix;
+  }
+
+  /** @brief shader, drawables and camera, once a GL context is current **/
+  bool InitScene(int width, int height, const std::string &model_file_path);
+
+  /** @brief fill the gizmo batches and the polylines from their files;
+   *  the poses are joined by a polyline too **/
+  bool LoadOverlays();
+
+  /** @brief per frame: move the synthetic vehicles, append the next
+   *  synthetic lanes and upload the polylines appended **/
+  void UpdateOverlays(double time);
+
+  /** @brief bounds of the mesh or of the points loaded so far **/
+  const Eigen::AlignedBox3f& SceneBounds() const;
+
+  /** @brief start a frame of the stats overlay and of the GPU timer **/
+  void BeginFrameStats();
+
+  /** @brief write the trace requested with ViewerOptions::trace_path **/
+  void WriteTrace();
+
+  /** @brief hot reload of the shader files, polled a few times a second **/
+  void CheckShaders();
+
+  /** @brief something on screen changes every frame without input: loading,
+   *  playback or the stats overlay **/
+  bool Animating() const;
+
+  /** @brief return at once when a frame is due, else sleep until input
+   *  arrives or until something polled (shaders, live frames, picks) wants
+   *  a look; render thread **/
+  void WaitForWork(bool animating);
+
+  /** @brief the next refinement of the point selection on top of the last
+   *  frame; false once there is nothing left to add **/
+  bool DrawRefinement();
+
+  /** @brief take the last completed pick and start reading what is under
+   *  the cursor, when it moved or a frame was drawn **/
+  void PickHovered(bool frame_drawn);
+
+  /** @brief rebuild the height colormap from the heights of the drawables
+   *  in height colors, when more of them arrived **/
+  void UpdateHeightColormap();
+
+  /** @brief the picked point in words, empty when there is none **/
+  std::string DescribePick(const PickResult &pick) const;
+
+  /** @brief <stem><n><extension> of the lowest n from *counter on that
+   *  is not taken yet **/
+  std::string NextFreePath(const std::string &stem,
+      const std::string &extension, int *counter);
+
+  /** @brief record under the next free <record_prefix><n>, see
+   *  ViewerOptions::record **/
+  bool StartRecording();
+
+  /** @brief select the points of the cloud inside a lasso drawn over the
+   *  last frame **/
+  void SelectLasso(const ScreenPolygon &lasso);
+
+  /** @brief selections, measurements and export of the cloud's spatial
+   *  index: B, G, N, E and X **/
+  void HandleSelectionKey(int key);
+
+  /** @brief report the export started with E once written; once per
+   *  frame **/
+  void UpdateExport();
+
+  /** @brief make points the selection and bound it with a box **/
+  void SetSelection(std::vector<uint32_t> *points, const char *what,
+      std::chrono::steady_clock::time_point start_time);
+
+ protected:
+  ViewerOptions options_;
   GLFWwindow *glfw_window_ = nullptr;
   std::unique_ptr<GLSLShader> shader_;
+  std::unique_ptr<RenderQueue> render_queue_;
+  // of everything drawn in height colors, rebuilt when their heights change
+  std::unique_ptr<Colormap> height_colormap_;
+  std::size_t height_colormap_count_ = 0;
   std::unique_ptr<Drawable> coord_axes_;
   std::unique_ptr<CameraControl> camera_control_;
-  std::unique_ptr<Drawable> point_cloud_;
+  std::unique_ptr<PointCloud> point_cloud_;
+  // only when the model path is a directory of frames
+  std::unique_ptr<SequenceCloud> sequence_cloud_;
+  // only when the model path is shm:<name>
+  std::unique_ptr<LiveCloud> live_cloud_;
+  // only when the model path is a .ply or .obj file
+  std::unique_ptr<TriangleMesh> mesh_;
+  // axes at poses and boxes, one instanced draw each
+  std::unique_ptr<GizmoBatch> poses_;
+  std::unique_ptr<GizmoBatch> boxes_;
+  // trajectories and lanes, one instanced draw
+  std::unique_ptr<PolylineBatch> polylines_;
+  // vehicles and lanes of --synthetic-gizmos and --synthetic-segments
+  std::unique_ptr<SyntheticOverlays> synthetic_overlays_;
+  // the scene is drawn here with an ID target, then blitted to the window
+  std::unique_ptr<PickBuffer> pick_buffer_;
+  PickResult hovered_;
+  Eigen::Vector2i pick_pixel_ = Eigen::Vector2i(-1, -1);
+  // screenshots and recordings of the scene, without the progress bar and
+  // the stats overlay
+  std::unique_ptr<FrameRecorder> frame_recorder_;
+  int next_screenshot_ = 0;
+  int next_recording_ = 0;
+  // the lasso while shift and the left button are held (input thread), and
+  // the last one released (render thread, under render_mutex_)
+  bool lasso_active_ = false;
+  ScreenPolygon lasso_;
+  ScreenPolygon pending_lasso_;
+  // points of point_cloud_->index() selected, bounded by selection_box_
+  std::vector<uint32_t> selection_;
+  std::unique_ptr<GizmoBatch> selection_box_;
+  int next_selection_ = 0;
+  // the export started with E, written on a worker thread
+  std::future<bool> export_future_;
+  std::string export_path_;
+  std::size_t export_points_ = 0;
+  std::chrono::steady_clock::time_point export_start_time_;
+  // the points measured with N, the last one in marks_[1]
+  Eigen::Vector3f marks_[2];
+  int num_marks_ = 0;
+
+  // on-demand rendering: whether the last frame is out of date, what it was
+  // drawn with and whether its points are still being refined
+  bool redraw_ = true;
+  bool refining_ = false;
+  uint64_t drawn_camera_sequence_ = 0;
+  Eigen::Vector2i drawn_size_ = Eigen::Vector2i::Zero();
+
+  // input thread to render thread: camera and window, keys and refreshes
+  SeqLock<ViewState> view_state_;
+  // the input thread's copy of what it published last
+  ViewState published_state_;
+  std::thread render_thread_;
+  std::atomic<bool> quit_{false};
+  std::mutex render_mutex_;
+  std::condition_variable render_wake_;
+  bool wake_pending_ = false;
+  bool refresh_pending_ = false;
+  std::vector<std::pair<int, int>> pending_keys_;
+  // render thread to input thread, which alone may set it
+  std::mutex title_mutex_;
+  std::string pending_title_;
+
+  // snapshot of the view state the render thread draws with
+  Eigen::Matrix4f frame_view_matrix_ = Eigen::Matrix4f::Identity();
+  Eigen::Matrix4f frame_projection_matrix_ = Eigen::Matrix4f::Identity();
+  Eigen::Vector2i frame_size_ = Eigen::Vector2i::Zero();
+  Eigen::Vector2i frame_window_size_ = Eigen::Vector2i::Zero();
+  Eigen::Vector2d frame_cursor_ = Eigen::Vector2d(-1.0, -1.0);
+  // motion-to-photon latency: from a camera input to the return of the
+  // buffer swap of the first frame showing it
+  uint64_t presented_camera_sequence_ = 0;
+  std::vector<float> input_latency_ms_;
+  std::size_t num_input_latencies_ = 0;
+  // only while tracing or showing the stats overlay
+  std::unique_ptr<GpuTimer> gpu_timer_;
+  bool show_stats_overlay_ = false;
+  // CPU frame times of the overlay, indexed like GpuTimer frames
+  std::vector<float> cpu_frame_ms_;
+  int frame_index_ = 0;
+  int64_t last_frame_us_ = -1;
+
+  std::string window_name_;
+  // frames drawn for the once-per-second statistics in the window title
+  int stats_frames_ = 0;
+  double stats_start_time_ = 0.0;
+  double shader_check_time_ = 0.0;
 };
 
 }  // namespace ogl_viewer
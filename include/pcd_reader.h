@@ -0,0 +1,137 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace ogl_viewer {
+
+struct PcdHeader {
+  std::vector<std::string> fields;
+  std::vector<int> sizes;
+  std::vector<char> types;
+  std::vector<int> counts;
+  int width = 0;
+  int height = 0;
+  std::size_t num_points = 0;
+  // "ascii", "binary" or "binary_compressed"
+  std::string data_type;
+  // byte offset of the first payload byte in the file
+  std::size_t data_offset = 0;
+
+  /** @brief index of the named field, -1 if absent **/
+  int FieldIndex(const std::string &name) const;
+
+  /** @brief byte offset of a field inside one packed point record **/
+  int FieldOffset(int field_index) const;
+
+  /** @brief size in bytes of one packed point record **/
+  int PointSize() const;
+};
+
+/** @brief parse the text header at the beginning of a PCD file **/
+bool ParsePcdHeader(const char *data, std::size_t size, PcdHeader *header);
+
+// Native PCD reader. The file is memory-mapped and the positions (or any
+// other field) are handed out in bounded chunks, so callers can stream them to
+// the GPU without ever holding the whole cloud in memory. Decoding of binary_compressed and ascii
+// payloads is spread over ThreadPool::Global().
+class PcdReader {
+ public:
+  // xyz is tightly packed (3 floats per point) and only valid during the
+  // call; returning false stops the reading
+  typedef std::function<bool(const float *xyz, std::size_t num_points)>
+      ChunkCallback;
+  // one value per point, otherwise like ChunkCallback
+  typedef std::function<bool(const float *values, std::size_t num_points)>
+      FieldCallback;
+
+  PcdReader() = default;
+  ~PcdReader();
+
+  PcdReader(const PcdReader&) = delete;
+  PcdReader& operator=(const PcdReader&) = delete;
+
+  bool Open(const std::string &filepath);
+  void Close();
+
+  const PcdHeader& header() const {
+    return header_;
+  }
+
+  /** @brief whether the payload layout is supported by ReadPositions **/
+  bool CanReadPositions() const;
+
+  /** @brief stream x/y/z positions in chunks of at most chunk_points;
+   *  false on error or when the callback stopped the reading **/
+  bool ReadPositions(std::size_t chunk_points, const ChunkCallback &callback);
+
+  /** @brief whether ReadField handles the field: any integer or floating
+   *  point type, only the first element being read when COUNT > 1 **/
+  bool CanReadField(int field_index) const;
+
+  /** @brief stream one field converted to float in chunks of at most
+   *  chunk_points. With raw_bits, 4-byte values are copied bit for bit
+   *  instead, which keeps packed rgb/rgba colors intact. **/
+  bool ReadField(int field_index, bool raw_bits, std::size_t chunk_points,
+      const FieldCallback &callback);
+
+  /** @brief whether ReadRecords handles the payload: binary and
+   *  binary_compressed **/
+  bool CanReadRecords() const;
+
+  /** @brief the packed records (header().PointSize() bytes, every field in
+   *  header order) of some points of the file, in the order given **/
+  bool ReadRecords(const std::vector<uint32_t> &points,
+      std::vector<char> *records);
+
+ private:
+  bool ReadBinaryPositions(std::size_t chunk_points,
+      const ChunkCallback &callback);
+  bool ReadCompressedPositions(std::size_t chunk_points,
+      const ChunkCallback &callback);
+  bool ReadBinaryField(int field_index, bool raw_bits,
+      std::size_t chunk_points, const FieldCallback &callback);
+  bool ReadCompressedField(int field_index, bool raw_bits,
+      std::size_t chunk_points, const FieldCallback &callback);
+  // num_values tokens of every ascii line, token k at index tokens[k];
+  // raw_bits parses integer tokens into the bits of the float
+  bool ReadAsciiValues(const int *tokens, int num_values, bool raw_bits,
+      std::size_t chunk_points, const ChunkCallback &callback);
+
+  // num_points records of point_size bytes fit between data_offset and the
+  // end of the file
+  bool PayloadFits(std::size_t point_size) const;
+
+  // the binary_compressed payload, laid out field by field
+  bool DecompressPayload(std::vector<char> *raw);
+
+  // gather x/y/z of points [first, first + count) into chunk_buffer_,
+  // field k of point i being at base + offsets[k] + i * step
+  void GatherPositions(const char *base, const std::size_t offsets[3],
+      std::size_t step, std::size_t first, std::size_t count);
+
+  // the same for a single field of the given type, converted to float
+  void GatherField(const char *base, std::size_t step, char type, int size,
+      bool raw_bits, std::size_t first, std::size_t count);
+
+  // index of the first token of a field on an ascii line
+  int FieldToken(int field_index) const;
+
+  // drop already consumed pages of the mapping from the resident set
+  void ReleasePages(std::size_t begin, std::size_t end);
+
+ private:
+  int fd_ = -1;
+  const char *data_ = nullptr;
+  std::size_t size_ = 0;
+  PcdHeader header_;
+  int xyz_offsets_[3] = {-1, -1, -1};
+  // token index of x/y/z on an ascii line
+  int xyz_tokens_[3] = {-1, -1, -1};
+  std::vector<float> chunk_buffer_;
+};
+
+}  // namespace ogl_viewer
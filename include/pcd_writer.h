@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <Eigen/Geometry>
+
+#include "pcd_reader.h"
+#include "point_index.h"
+
+namespace ogl_viewer {
+
+/** @brief write num_points packed records with the fields of header as a
+ *  binary PCD file; the point count and data layout of header are
+ *  ignored **/
+bool WritePcd(const std::string &path, const PcdHeader &header,
+    const char *records, std::size_t num_points);
+
+/** @brief write tightly packed x/y/z positions as a binary PCD file **/
+bool WritePcdPositions(const std::string &path, const float *xyz,
+    std::size_t num_points);
+
+/** @brief write some points of an index to a binary PCD file: every field
+ *  of their records in source_path, a binary or binary_compressed PCD file
+ *  the index was built from, or their positions only otherwise (empty
+ *  source_path, other formats) **/
+bool WriteSelection(const std::string &path, const PointIndex &index,
+    const std::vector<uint32_t> &points, const std::string &source_path);
+
+/** @brief read source_path with PcdReader, index it and write the points
+ *  inside box to output_path with every field of the source **/
+bool CropPointCloud(const std::string &source_path,
+    const Eigen::AlignedBox3f &box, const std::string &output_path);
+
+}  // namespace ogl_viewer
@@ -0,0 +1,109 @@
+#pragma once
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+#undef GLFW_DLL
+
+#include <cstdint>
+#include <vector>
+
+#include <Eigen/Core>
+
+namespace ogl_viewer {
+
+// what was drawn at a pixel, as read back from the ID target
+struct PickResult {
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  bool hit = false;
+  // DrawItem::pick_id of the drawable and the vertex index in its buffer
+  int pick_id = 0;
+  int vertex = 0;
+  // window pixel (top-left origin) of the hit, which may be off the
+  // requested one by up to the pick radius
+  Eigen::Vector2i pixel = Eigen::Vector2i::Zero();
+  // unprojected from the depth buffer
+  Eigen::Vector3f position = Eigen::Vector3f::Zero();
+};
+
+// Offscreen target of the scene with an integer ID attachment next to the
+// color one, which the fragment shader fills with the pick id and vertex
+// index of every fragment. The color is blitted to the window afterwards.
+// A pick reads a small region around a pixel into a pixel buffer object
+// and fences it; the result is taken a frame or two later, once the fence
+// has passed, so picking never waits for the GPU.
+class PickBuffer {
+ public:
+  PickBuffer();
+  ~PickBuffer();
+
+  PickBuffer(const PickBuffer&) = delete;
+  PickBuffer& operator=(const PickBuffer&) = delete;
+
+  /** @brief (re)allocate the attachments, nothing when the size is kept **/
+  bool Resize(int width, int height);
+
+  /** @brief draw into the color and ID attachments from now on **/
+  void Bind();
+
+  /** @brief clear color and depth, and the IDs to nothing picked **/
+  void Clear(const Eigen::Vector4f &color);
+
+  /** @brief copy the color attachment into framebuffer and bind it **/
+  void BlitColor(GLuint framebuffer);
+
+  /** @brief start reading the region around a window pixel (top-left
+   *  origin) of what has been drawn so far; dropped while all readback
+   *  slots are still in flight **/
+  void RequestPick(const Eigen::Vector2i &pixel,
+      const Eigen::Matrix4f &view_projection);
+
+  /** @brief the newest pick completed since the last call, the drawable
+   *  nearest to the requested pixel; false when none completed **/
+  bool PollPick(PickResult *result);
+
+  /** @brief a readback is in flight, PollPick should be called again **/
+  bool pending() const;
+
+  const Eigen::Vector2i& size() const {
+    return size_;
+  }
+
+  /** @brief the offscreen target, whose color attachment is the scene **/
+  GLuint framebuffer() const {
+    return fbo_;
+  }
+
+ private:
+  struct Readback {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    GLuint buffer = 0;
+    GLsync fence = nullptr;
+    uint64_t sequence = 0;
+    // region read, in GL pixels, and the requested pixel within it
+    Eigen::Vector2i origin = Eigen::Vector2i::Zero();
+    Eigen::Vector2i extent = Eigen::Vector2i::Zero();
+    Eigen::Vector2i center = Eigen::Vector2i::Zero();
+    Eigen::Vector2i framebuffer_size = Eigen::Vector2i::Zero();
+    Eigen::Matrix4f inverse_view_projection = Eigen::Matrix4f::Identity();
+  };
+
+  // nearest hit of a completed readback
+  void Evaluate(const Readback &readback, PickResult *result) const;
+
+ private:
+  GLuint fbo_ = 0;
+  GLuint color_buffer_ = 0;
+  GLuint id_buffer_ = 0;
+  GLuint depth_buffer_ = 0;
+  Eigen::Vector2i size_ = Eigen::Vector2i::Zero();
+
+  std::vector<Readback, Eigen::aligned_allocator<Readback>> readbacks_;
+  uint64_t next_sequence_ = 1;
+  // of the newest result returned, older readbacks finishing late are
+  // dropped
+  uint64_t result_sequence_ = 0;
+};
+
+}  // namespace ogl_viewer
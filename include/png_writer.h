@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace ogl_viewer {
+
+/** @brief write RGBA8 pixels as an 8-bit RGB PNG file, dropping alpha.
+ *  Rows are bottom first when bottom_up is set, as glReadPixels returns
+ *  them. Compressed for speed rather than size (zlib level 1, run-length
+ *  strategy). **/
+bool WritePng(const std::string &path, const uint8_t *rgba, int width,
+    int height, bool bottom_up);
+
+}  // namespace ogl_viewer
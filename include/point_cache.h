@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "point_octree.h"
+
+namespace ogl_viewer {
+
+// identifies the source file a cache was made from
+struct PointCacheKey {
+  uint64_t file_size = 0;
+  int64_t mtime_ns = 0;
+  // FNV-1a of the file head and of blocks sampled over the rest of it
+  uint64_t hash = 0;
+};
+
+bool ComputePointCacheKey(const std::string &source_path, PointCacheKey *key);
+
+/** @brief <source_path>.ovcache **/
+std::string PointCachePath(const std::string &source_path);
+
+/** @brief write the octree ordered positions, their index in the source
+ *  file (see PointOctree::Build) and the hierarchy; the file is written under
+ *  a temporary name and renamed once complete **/
+bool WritePointCache(const std::string &cache_path, const PointCacheKey &key,
+    const std::vector<float> &xyz, const std::vector<uint32_t> &order,
+    const PointOctree &octree);
+
+/** @brief read source_path with PcdReader, build the octree and write the
+ *  cache next to it **/
+bool BuildPointCache(const std::string &source_path);
+
+// Viewer-native preprocessed point cloud: the positions in octree order, ready
+// to be copied to the vertex buffer as is, the source index of every point (to
+// bring other fields of the source file into the same order) and the octree
+// nodes. The
+// file is memory-mapped, so reopening a cloud costs one sequential read.
+class PointCache {
+ public:
+  PointCache() = default;
+  ~PointCache();
+
+  PointCache(const PointCache&) = delete;
+  PointCache& operator=(const PointCache&) = delete;
+
+  /** @brief map cache_path; false if it is missing, corrupted or was not
+   *  made from the file identified by key **/
+  bool Open(const std::string &cache_path, const PointCacheKey &key);
+  void Close();
+
+  std::size_t num_points() const {
+    return num_points_;
+  }
+
+  /** @brief 3 floats per point, valid until Close **/
+  const float* positions() const {
+    return positions_;
+  }
+
+  /** @brief index of every point in the source file, valid until Close **/
+  const uint32_t* order() const {
+    return order_;
+  }
+
+  /** @brief hand the cached hierarchy to octree **/
+  void ReadOctree(PointOctree *octree) const;
+
+ private:
+  int fd_ = -1;
+  const char *data_ = nullptr;
+  std::size_t size_ = 0;
+  std::size_t num_points_ = 0;
+  const float *positions_ = nullptr;
+  const uint32_t *order_ = nullptr;
+  std::size_t num_nodes_ = 0;
+  const char *nodes_ = nullptr;
+};
+
+}  // namespace ogl_viewer
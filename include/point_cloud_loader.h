@@ -0,0 +1,113 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "pcd_reader.h"
+#include "point_cache.h"
+#include "point_octree.h"
+#include "voxel_filter.h"
+
+namespace ogl_viewer {
+
+// Decodes a PCD file on a worker thread into bounded staging chunks that the
+// render thread picks up at its own pace. In LOD mode the worker also keeps
+// the whole cloud and builds the octree once decoding is done. With a voxel
+// filter the whole cloud is reduced first, and only the remaining points
+// are handed out.
+class PointCloudLoader {
+ public:
+  struct Chunk {
+    // index of the first point of the chunk (in the file when unfiltered)
+    std::size_t first = 0;
+    std::vector<float> xyz;
+  };
+
+  PointCloudLoader() = default;
+  ~PointCloudLoader();
+
+  PointCloudLoader(const PointCloudLoader&) = delete;
+  PointCloudLoader& operator=(const PointCloudLoader&) = delete;
+
+  /** @brief open the file and start the worker; false if the file cannot
+   *  be read natively (the caller should fall back to a synchronous load).
+   *  With write_cache the worker also stores the octree ordered cloud in a
+   *  PointCache next to the file (LOD mode only). **/
+  bool Start(const std::string &filepath, bool build_lod, bool write_cache);
+
+  /** @brief reduce the cloud before handing it out; set before Start. No
+   *  cache is written then. **/
+  void set_voxel_filter(const VoxelFilter &voxel_filter) {
+    voxel_filter_ = voxel_filter;
+  }
+
+  /** @brief points handed out, the points of the file until the voxel
+   *  filter is done **/
+  std::size_t num_points() const {
+    return num_points_;
+  }
+
+  std::size_t num_decoded_points() const {
+    return num_decoded_points_;
+  }
+
+  /** @brief the next decoded chunk in file order, false if none is ready **/
+  bool PopChunk(Chunk *chunk);
+
+  /** @brief decoding (and the octree build in LOD mode) is over **/
+  bool finished() const {
+    return finished_;
+  }
+
+  bool failed() const {
+    return failed_;
+  }
+
+  /** @brief once finished(): the octree and the positions reordered for it **/
+  std::unique_ptr<PointOctree> TakeOctree();
+  std::vector<float> TakeLodPositions();
+
+  /** @brief once finished(): the file index of every point in its final
+   *  order, empty when that is the file order **/
+  std::vector<uint32_t> TakePointOrder();
+
+ private:
+  void Run();
+  // wait for room in the queue, false when cancelled
+  bool PushChunk(Chunk chunk);
+
+ private:
+  static const std::size_t kStagingChunkPoints = 1 << 18;
+  static const std::size_t kMaxQueuedChunks = 16;
+
+  PcdReader reader_;
+  bool build_lod_ = false;
+  std::string cache_path_;
+  PointCacheKey cache_key_;
+  VoxelFilter voxel_filter_;
+  std::atomic<std::size_t> num_points_{0};
+  std::thread worker_;
+
+  std::mutex mutex_;
+  std::condition_variable queue_not_full_;
+  std::deque<Chunk> queue_;
+
+  std::atomic<std::size_t> num_decoded_points_{0};
+  std::atomic<bool> cancel_{false};
+  std::atomic<bool> finished_{false};
+  std::atomic<bool> failed_{false};
+
+  std::unique_ptr<PointOctree> octree_;
+  std::vector<float> lod_positions_;
+  std::vector<uint32_t> point_order_;
+};
+
+}  // namespace ogl_viewer
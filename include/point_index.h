@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <Eigen/StdVector>
+
+namespace ogl_viewer {
+
+// Retained spatial index of a point cloud for selections and measurements,
+// kept on the CPU next to the vertex buffers. The points are sorted along a
+// Morton curve with the parallel radix sort, over only the bits the point
+// count calls for, and cut into leaves of kLeafPoints consecutive points.
+// Every kFanout boxes of a level are bounded by one box of the level above,
+// up to a single root, so a subtree always covers a contiguous range of
+// points. Building takes 24 bytes per point while sorting and keeps 16
+// (position and source index). Non-finite points are left out.
+//
+// Selections collect the subtrees entirely inside the region as whole
+// ranges and the points of the leaves crossing its border for testing,
+// then test and gather them on ThreadPool::Global(). Selected points are
+// indices into the index, in index order; source_index maps them back to
+// the points given to Build.
+class PointIndex {
+ public:
+  static const std::size_t kLeafPoints = 256;
+  static const std::size_t kFanout = 8;
+
+  PointIndex() = default;
+
+  PointIndex(const PointIndex&) = delete;
+  PointIndex& operator=(const PointIndex&) = delete;
+
+  /** @brief index num_points points stride floats apart. source (may be
+   *  null) gives the index of every point to report, e.g. its index in
+   *  the file; point i itself otherwise. **/
+  void Build(const float *xyz, std::size_t stride, std::size_t num_points,
+      const uint32_t *source);
+
+  std::size_t size() const {
+    return source_.size();
+  }
+
+  const Eigen::AlignedBox3f& bounds() const {
+    return bounds_;
+  }
+
+  Eigen::Map<const Eigen::Vector3f> position(uint32_t point) const {
+    return Eigen::Map<const Eigen::Vector3f>(&xyz_[point * 3]);
+  }
+
+  uint32_t source_index(uint32_t point) const {
+    return source_[point];
+  }
+
+  /** @brief points inside an axis-aligned box **/
+  void SelectBox(const Eigen::AlignedBox3f &box,
+      std::vector<uint32_t> *points) const;
+
+  /** @brief points inside the unit cube [-0.5, 0.5]^3 transformed by box,
+   *  i.e. a box as drawn by GizmoBatch **/
+  void SelectOrientedBox(const Eigen::Affine3f &box,
+      std::vector<uint32_t> *points) const;
+
+  /** @brief points within radius of center **/
+  void SelectRadius(const Eigen::Vector3f &center, float radius,
+      std::vector<uint32_t> *points) const;
+
+  /** @brief points in front of the camera that project into a polygon of
+   *  viewport pixels (top-left origin, as window cursor positions); the
+   *  polygon is closed between its last and first vertex and filled by the
+   *  even-odd rule **/
+  void SelectPolygon(const Eigen::Matrix4f &view_matrix,
+      const Eigen::Matrix4f &projection_matrix,
+      const Eigen::Vector2i &viewport_size,
+      const std::vector<Eigen::Vector2f,
+          Eigen::aligned_allocator<Eigen::Vector2f>> &polygon,
+      std::vector<uint32_t> *points) const;
+
+  /** @brief the k points nearest to query, nearest first, and their squared
+   *  distances (may be null) **/
+  void Nearest(const Eigen::Vector3f &query, std::size_t k,
+      std::vector<uint32_t> *points,
+      std::vector<float> *squared_distances) const;
+
+  /** @brief tight bounds of some indexed points **/
+  Eigen::AlignedBox3f Bounds(const std::vector<uint32_t> &points) const;
+
+ private:
+  // where a box of the hierarchy lies relative to a selected region
+  enum class Overlap {
+    kOutside,
+    kPartial,
+    kInside
+  };
+
+  // points of box index at level, clamped to the points indexed
+  std::size_t RangeBegin(int level, std::size_t index) const;
+  std::size_t RangeEnd(int level, std::size_t index) const;
+
+  // the points of every subtree classified kInside and those of every
+  // leaf classified kPartial that pass test, in index order
+  template <typename Classify, typename Test>
+  void Select(const Classify &classify, const Test &test,
+      std::vector<uint32_t> *points) const;
+
+ private:
+  // Morton ordered positions and the source index of every point
+  std::vector<float> xyz_;
+  std::vector<uint32_t> source_;
+  Eigen::AlignedBox3f bounds_;
+  // levels_[0] bounds the leaves, the last level holds the root only
+  std::vector<std::vector<Eigen::AlignedBox3f,
+      Eigen::aligned_allocator<Eigen::AlignedBox3f>>> levels_;
+  // points per box on every level
+  std::vector<std::size_t> level_points_;
+};
+
+}  // namespace ogl_viewer
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace ogl_viewer {
+
+struct OctreeNode {
+  // cubic cell covered by the node
+  Eigen::AlignedBox3f bounds;
+  // tight bounds of the points stored in this node
+  Eigen::AlignedBox3f point_bounds;
+  // tight bounds of the points of the node and all of its descendants
+  Eigen::AlignedBox3f subtree_bounds;
+  // points stored in this node: [first, first + count) of the reordered cloud
+  std::size_t first = 0;
+  std::size_t count = 0;
+  // the node and all of its descendants: [first, first + subtree_count)
+  std::size_t subtree_count = 0;
+  int level = 0;
+  int children[8] = {-1, -1, -1, -1, -1, -1, -1, -1};
+};
+
+// Level-of-detail hierarchy over a point cloud. Every node keeps a spatially
+// uniform subsample of the points in its cell (one point per cell of a
+// kSampleGridSize^3 grid) and hands the rest down to its children, so drawing
+// a node together with some of its ancestors gives a representative picture
+// of the cloud at that density.
+class PointOctree {
+ public:
+  PointOctree() = default;
+  ~PointOctree() = default;
+
+  /** @brief build the hierarchy and reorder xyz (3 floats per point) so
+   *  that the points of every node are contiguous; order (may be null)
+   *  receives the original index of every reordered point **/
+  void Build(std::vector<float> *xyz, std::vector<uint32_t> *order = nullptr);
+
+  /** @brief pick the nodes to draw, largest projected size first, until the
+   *  point budget is spent; nodes smaller than min_node_pixels on screen are
+   *  not refined any further. Nodes flagged 0 in visible (indexed like
+   *  nodes(), may be null) are skipped together with their subtree. **/
+  void SelectNodes(const Eigen::Matrix4f &view_matrix,
+      const Eigen::Matrix4f &projection_matrix, float viewport_height,
+      std::size_t point_budget, float min_node_pixels,
+      const std::vector<uint8_t> *visible, std::vector<int> *selected) const;
+
+  const std::vector<OctreeNode>& nodes() const {
+    return nodes_;
+  }
+
+  /** @brief adopt a hierarchy built earlier over the same reordered points,
+   *  e.g. one read back from a PointCache **/
+  void set_nodes(std::vector<OctreeNode> nodes) {
+    nodes_ = std::move(nodes);
+  }
+
+  void set_max_points_per_node(std::size_t max_points_per_node) {
+    max_points_per_node_ = max_points_per_node;
+  }
+
+ private:
+  void BuildNode(int node_index, const float *xyz, uint32_t *order,
+      uint32_t *scratch, std::size_t begin, std::size_t end);
+  void ComputeSubtreeBounds(const std::vector<float> &xyz);
+
+ private:
+  static const int kSampleGridSize = 64;
+  static const int kMaxDepth = 20;
+
+  std::size_t max_points_per_node_ = 16384;
+  std::vector<OctreeNode> nodes_;
+};
+
+}  // namespace ogl_viewer
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "thread_pool.h"
+
+namespace ogl_viewer {
+
+/** @brief whether path names a directory (a sequence of frames) **/
+bool IsDirectory(const std::string &path);
+
+// memory held by the decoded frames of a PointSequence
+struct SequenceCacheStats {
+  std::size_t cached_frames = 0;
+  std::size_t cached_bytes = 0;
+  // positions the cached frames would take uncompressed
+  std::size_t raw_bytes = 0;
+  std::size_t pending_frames = 0;
+};
+
+// The PCD files of a directory, played back as frames in file name order.
+// Frames are decoded ahead of the playback position by a dedicated thread
+// pool into a cache bounded in bytes. When the cache is full, the frames
+// farthest from the playback position are dropped first. Cached frames may
+// be kept LZF compressed (after splitting the floats into byte planes), at
+// the cost of decompressing them when they are shown.
+class PointSequence {
+ public:
+  PointSequence() = default;
+  ~PointSequence();
+
+  PointSequence(const PointSequence&) = delete;
+  PointSequence& operator=(const PointSequence&) = delete;
+
+  void set_cache_bytes(std::size_t cache_bytes) {
+    cache_bytes_ = cache_bytes;
+  }
+
+  void set_compress(bool compress) {
+    compress_ = compress;
+  }
+
+  /** @brief number of frames decoded ahead of the playback position **/
+  void set_prefetch_frames(int prefetch_frames) {
+    prefetch_frames_ = prefetch_frames;
+  }
+
+  /** @brief list the *.pcd files of a directory; false if there are none **/
+  bool Open(const std::string &directory, int num_threads = 2);
+
+  std::size_t num_frames() const {
+    return frame_paths_.size();
+  }
+
+  const std::string& frame_path(std::size_t index) const {
+    return frame_paths_[index];
+  }
+
+  /** @brief decode frame index and the ones after it in direction (+1 or
+   *  -1), wrapping around at the ends of the sequence **/
+  void Prefetch(std::size_t index, int direction);
+
+  /** @brief copy the positions of a decoded frame into xyz; false if it is
+   *  not decoded yet. A frame that failed to decode is empty. **/
+  bool GetFrame(std::size_t index, std::vector<float> *xyz);
+
+  SequenceCacheStats cache_stats();
+
+ private:
+  struct Frame {
+    bool ready = false;
+    std::size_t num_points = 0;
+    // positions, or their byte planes LZF compressed when compress_ is set
+    std::vector<float> xyz;
+    std::vector<uint8_t> compressed;
+  };
+
+  // pool task decoding one frame
+  void DecodeFrame(std::size_t index);
+  // drop the frames farthest from the playback position until the cache
+  // fits; mutex_ is held
+  void EvictFrames();
+  // distance of a frame to the playback position, along the sequence loop
+  std::size_t PlaybackDistance(std::size_t index) const;
+  static std::size_t FrameBytes(const Frame &frame);
+
+ private:
+  std::vector<std::string> frame_paths_;
+  std::size_t cache_bytes_ = std::size_t(512) << 20;
+  bool compress_ = false;
+  int prefetch_frames_ = 16;
+  // most frames submitted to the pool and not decoded yet
+  std::size_t max_pending_frames_ = 4;
+
+  std::unique_ptr<ThreadPool> pool_;
+  std::atomic<bool> cancel_{false};
+
+  std::mutex mutex_;
+  std::map<std::size_t, Frame> frames_;
+  std::size_t cached_bytes_ = 0;
+  std::size_t num_pending_ = 0;
+  std::size_t playback_index_ = 0;
+  int playback_direction_ = 1;
+  // decompressed byte planes, used by GetFrame only
+  std::vector<uint8_t> planes_buffer_;
+};
+
+}  // namespace ogl_viewer
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <Eigen/Core>
+#include <Eigen/StdVector>
+
+#include "drawable.h"
+
+namespace ogl_viewer {
+
+typedef std::vector<Eigen::Vector3f,
+    Eigen::aligned_allocator<Eigen::Vector3f>> Polyline;
+
+// a point of a PolylineBatch as stored in its vertex buffer: the position
+// and the color of the segment to the next point as normalized RGBA bytes,
+// whose alpha is 0 on the last point of every polyline (16 bytes)
+struct PolylinePoint {
+  float position[3];
+  uint32_t color;
+};
+
+// Polylines of any number of segments, drawn with one instanced call. Only
+// the points are stored, one after the other; consecutive polylines are
+// separated by the zero alpha of their last point. Every segment is an
+// instance reading two neighboring points, which the vertex shader widens
+// into a screen-aligned quad of line_width pixels. Appended polylines are
+// staged and copied behind the points already on the GPU by Upload; when
+// the buffer is full it grows by copying on the GPU.
+class PolylineBatch : public Drawable {
+ public:
+  explicit PolylineBatch(int pick_id);
+  ~PolylineBatch() override;
+
+  PolylineBatch(const PolylineBatch&) = delete;
+  PolylineBatch& operator=(const PolylineBatch&) = delete;
+
+  void Enqueue(GLSLShader *shader, RenderQueue *queue) const override;
+
+  /** @brief start a new polyline; ignored for less than two points **/
+  void AddPolyline(const Polyline &points, const Eigen::Vector4f &color);
+
+  /** @brief continue the last polyline, in its color, by more points; a
+   *  polyline already uploaded is joined by rewriting its end point **/
+  void ExtendPolyline(const Polyline &points);
+
+  /** @brief copy what was added since the last Upload to the GPU **/
+  void Upload();
+
+  /** @brief width in pixels **/
+  void set_line_width(float line_width) {
+    line_width_ = line_width;
+  }
+
+  std::size_t num_polylines() const {
+    return polyline_starts_.size();
+  }
+
+  /** @brief segments drawn, as of the last Upload **/
+  std::size_t num_segments() const {
+    return num_uploaded_points_ - num_uploaded_polylines_;
+  }
+
+  /** @brief vertex buffer bytes in use and allocated **/
+  std::size_t used_bytes() const {
+    return num_uploaded_points_ * sizeof(PolylinePoint);
+  }
+  std::size_t capacity_bytes() const {
+    return capacity_ * sizeof(PolylinePoint);
+  }
+
+  /** @brief polyline and segment within it of a drawn segment, e.g. a
+   *  picked one; false if there is no such segment **/
+  bool LookupSegment(int segment, std::size_t *polyline,
+      std::size_t *index) const;
+
+ private:
+  // a buffer of capacity points holding the points uploaded so far
+  void Reserve(std::size_t capacity);
+  // the point attributes of vao_, in the current buffer
+  void SetupVertexArray();
+  // points of the last polyline, in its color, the last one ending it
+  void StagePoints(const Polyline &points);
+
+ private:
+  int pick_id_ = kPickNone;
+  float line_width_ = 2.f;
+  GLuint vao_ = 0;
+  GLuint vbo_ = 0;
+  std::size_t capacity_ = 0;
+  std::size_t num_uploaded_points_ = 0;
+  std::size_t num_uploaded_polylines_ = 0;
+
+  // points not uploaded yet, and whether the last uploaded point has to be
+  // rewritten because ExtendPolyline continued its polyline
+  std::vector<PolylinePoint> staged_points_;
+  bool reopen_last_ = false;
+  // first point of every polyline, for LookupSegment
+  std::vector<std::size_t> polyline_starts_;
+  uint32_t last_color_ = 0;
+};
+
+// a polyline file: one "x y z" point per line, polylines separated by blank
+// lines; lines starting with # are skipped
+bool LoadPolylineFile(const std::string &path,
+    std::vector<Polyline> *polylines);
+
+}  // namespace ogl_viewer
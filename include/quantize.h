@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <Eigen/Core>
+
+namespace ogl_viewer {
+
+/** @brief quantize count positions of xyz (3 floats every stride floats) to
+ *  3 uint16 each relative to a box, decoded by the shaders as
+ *  offset + scale * (q / 65535); returns the largest decoding error **/
+float QuantizePositions(const float *xyz, std::size_t stride,
+    std::size_t count, const Eigen::Vector3f &offset,
+    const Eigen::Vector3f &scale, uint16_t *quantized);
+
+}  // namespace ogl_viewer
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace ogl_viewer {
+
+/** @brief stable LSD radix sort of keys and their indices over the low
+ *  num_bits bits, spread over ThreadPool::Global(); the scratch vectors
+ *  are resized to hold the scatter targets of the passes **/
+void RadixSort(int num_bits, std::vector<uint64_t> *keys,
+    std::vector<uint32_t> *indices, std::vector<uint64_t> *keys_scratch,
+    std::vector<uint32_t> *indices_scratch);
+
+}  // namespace ogl_viewer
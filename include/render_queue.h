@@ -0,0 +1,144 @@
+#pragma once
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+#undef GLFW_DLL
+
+#include <cstddef>
+#include <vector>
+
+#include <Eigen/Core>
+#include <Eigen/StdVector>
+
+#include "glsl_shader.h"
+
+namespace ogl_viewer {
+
+// One draw call and the state it needs. Vertex layout lives in the VAO, set
+// up once by the drawable; the per-draw uniforms are set by the queue only
+// when they differ from what the program already holds.
+struct DrawItem {
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  GLSLShader *shader = nullptr;
+  GLuint vao = 0;
+  GLenum mode = GL_POINTS;
+
+  // glDrawArrays(first, count), glMultiDrawArrays when firsts is set or
+  // glDrawElementsBaseVertex(count, index_type) when indexed, from
+  // index_offset bytes into the element buffer; the arrays have to stay
+  // valid until Flush. Plain and indexed draws are instanced when
+  // instance_count is not 1.
+  GLint first = 0;
+  GLsizei count = 0;
+  const GLint *firsts = nullptr;
+  const GLsizei *counts = nullptr;
+  GLsizei draw_count = 0;
+  bool indexed = false;
+  GLenum index_type = GL_UNSIGNED_INT;
+  std::size_t index_offset = 0;
+  GLint base_vertex = 0;
+  GLsizei instance_count = 1;
+
+  // 0 height colormap, 1 material color, 2 vertex color and info, 3 scalar
+  // attribute through the colormap over scalar_range, 4 rgb attribute, 5
+  // height colormap lit by a headlight along the vertex normals, 6 vertex
+  // color times the instance color, with the instance transform, 7
+  // polyline segments widened to line_width pixels
+  int color_mode = 0;
+  Eigen::Matrix4f model_matrix = Eigen::Matrix4f::Identity();
+  Eigen::Vector3f position_offset = Eigen::Vector3f::Zero();
+  Eigen::Vector3f position_scale = Eigen::Vector3f::Ones();
+  Eigen::Vector2f scalar_range = Eigen::Vector2f(0.f, 1.f);
+  // 1D lookup texture of the colormap of color modes 0, 3 and 5, 0 for the
+  // height colormap of the frame
+  GLuint colormap = 0;
+  float line_width = 1.f;
+  // written with the vertex index into the ID target (see PickBuffer), 0
+  // where nothing can be picked
+  int pick_id = 0;
+};
+
+// GL calls issued by the last Flush, and how many the same items would have
+// cost when every draw set its whole state and the frame uniforms were set
+// one by one
+struct RenderQueueStats {
+  std::size_t draw_items = 0;
+  std::size_t gl_calls = 0;
+  std::size_t unsorted_gl_calls = 0;
+};
+
+// Collects the draw items of a frame, sorts them by program, VAO and state
+// and issues them while skipping redundant binds and uniform updates. The
+// view and projection matrices reach every program through the std140
+// FrameUniforms block, updated once per frame.
+class RenderQueue {
+ public:
+  RenderQueue();
+  ~RenderQueue();
+
+  RenderQueue(const RenderQueue&) = delete;
+  RenderQueue& operator=(const RenderQueue&) = delete;
+
+  void SetFrameUniforms(const Eigen::Matrix4f &view_matrix,
+      const Eigen::Matrix4f &projection_matrix,
+      const Eigen::Vector2f &z_range, bool z_clipping,
+      const Eigen::Vector2i &viewport_size);
+
+  /** @brief lookup texture of the items without a colormap of their own **/
+  void set_height_colormap(GLuint texture) {
+    height_colormap_ = texture;
+  }
+
+  void Submit(const DrawItem &item) {
+    items_.push_back(item);
+  }
+
+  /** @brief issue and clear the submitted items **/
+  void Flush();
+
+  const RenderQueueStats& stats() const {
+    return stats_;
+  }
+
+ private:
+  // per-draw uniform locations of a program, resolved once, and the values
+  // it holds (uniforms are program state and survive across frames); both
+  // are reset when the shader reloads into a new program
+  struct ProgramState {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    GLSLShader *shader = nullptr;
+    GLuint program = 0;
+    GLint color_mode_loc = -1;
+    GLint model_matrix_loc = -1;
+    GLint position_offset_loc = -1;
+    GLint position_scale_loc = -1;
+    GLint scalar_range_loc = -1;
+    GLint line_width_loc = -1;
+    GLint pick_id_loc = -1;
+    bool has_values = false;
+    int color_mode = 0;
+    Eigen::Matrix4f model_matrix;
+    Eigen::Vector3f position_offset;
+    Eigen::Vector3f position_scale;
+    Eigen::Vector2f scalar_range;
+    float line_width = 0.f;
+    int pick_id = 0;
+  };
+
+  ProgramState* GetProgramState(GLSLShader *shader);
+  // number of GL calls issued
+  std::size_t ApplyUniforms(const DrawItem &item, ProgramState *state);
+
+ private:
+  GLuint frame_ubo_ = 0;
+  std::size_t frame_ubo_updates_ = 0;
+  GLuint height_colormap_ = 0;
+  std::vector<DrawItem, Eigen::aligned_allocator<DrawItem>> items_;
+  std::vector<std::size_t> order_;
+  std::vector<ProgramState, Eigen::aligned_allocator<ProgramState>> programs_;
+  RenderQueueStats stats_;
+};
+
+}  // namespace ogl_viewer
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace ogl_viewer {
+
+// Single-writer sequence lock around a trivially copyable value. Stores never
+// wait; a load retries while a store is in progress. The value lives in
+// relaxed atomic words, so a load racing with a store reads torn but well
+// defined data, which the sequence check then throws away.
+template <typename T>
+class SeqLock {
+ public:
+  static_assert(std::is_trivially_copyable<T>::value,
+      "SeqLock values are copied word by word");
+
+  SeqLock() {
+    Store(T());
+  }
+
+  SeqLock(const SeqLock&) = delete;
+  SeqLock& operator=(const SeqLock&) = delete;
+
+  /** @brief publish value; only one thread may store **/
+  void Store(const T &value) {
+    uint32_t words[kNumWords] = {};
+    std::memcpy(words, &value, sizeof(T));
+    const uint64_t sequence = sequence_.load(std::memory_order_relaxed);
+    sequence_.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (std::size_t i = 0; i < kNumWords; ++i) {
+      words_[i].store(words[i], std::memory_order_relaxed);
+    }
+    sequence_.store(sequence + 2, std::memory_order_release);
+  }
+
+  /** @brief the last value stored, from any thread **/
+  T Load() const {
+    uint32_t words[kNumWords];
+    uint64_t before = 0;
+    uint64_t after = 0;
+    do {
+      before = sequence_.load(std::memory_order_acquire);
+      for (std::size_t i = 0; i < kNumWords; ++i) {
+        words[i] = words_[i].load(std::memory_order_relaxed);
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+      after = sequence_.load(std::memory_order_relaxed);
+    } while ((before & 1) != 0 || before != after);
+    T value;
+    std::memcpy(&value, words, sizeof(T));
+    return value;
+  }
+
+ private:
+  static const std::size_t kNumWords = (sizeof(T) + 3) / 4;
+
+  std::atomic<uint64_t> sequence_{0};
+  std::atomic<uint32_t> words_[kNumWords];
+};
+
+}  // namespace ogl_viewer
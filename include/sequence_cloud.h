@@ -0,0 +1,104 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "drawable.h"
+#include "point_sequence.h"
+#include "stream_buffer.h"
+
+namespace ogl_viewer {
+
+// Plays a PointSequence at a fixed frame rate, or steps through it. Shown
+// frames go through a StreamBuffer. When the next frame is not decoded yet,
+// the current one stays on screen and playback resumes from the late frame
+// once it arrives.
+class SequenceCloud : public Drawable {
+ public:
+  SequenceCloud() = default;
+
+  void Enqueue(GLSLShader *shader, RenderQueue *queue) const override;
+
+  /** @brief frames per second of playback, the sensor rate **/
+  void set_frame_rate(double frame_rate) {
+    frame_rate_ = frame_rate;
+  }
+
+  PointSequence& sequence() {
+    return sequence_;
+  }
+
+  bool Open(const std::string &directory);
+
+  /** @brief advance playback and upload the frame due now, once per frame **/
+  void Update();
+
+  void SetPlaying(bool playing);
+
+  bool playing() const {
+    return playing_;
+  }
+
+  /** @brief pause and move delta frames, wrapping around **/
+  void Step(int delta);
+
+  /** @brief pause and show frame index **/
+  void Seek(std::size_t index);
+
+  std::size_t num_frames() const {
+    return sequence_.num_frames();
+  }
+
+  /** @brief a frame was decoded and uploaded since Open **/
+  bool frame_shown() const {
+    return frame_shown_;
+  }
+
+  /** @brief index of the frame on screen, valid once frame_shown() **/
+  std::size_t shown_frame() const {
+    return shown_frame_;
+  }
+
+  /** @brief paused with the requested frame on screen **/
+  bool settled() const {
+    return !playing_ && frame_shown_ && shown_frame_ == requested_frame_;
+  }
+
+  std::size_t num_points() const {
+    return buffer_.num_points();
+  }
+
+  /** @brief playback frames that were not decoded in time **/
+  std::size_t late_frames() const {
+    return late_frames_;
+  }
+
+ private:
+  // frame the playback clock asks for at time now
+  std::size_t TargetFrame(std::chrono::steady_clock::time_point now) const;
+
+ private:
+  PointSequence sequence_;
+  double frame_rate_ = 10.0;
+
+  StreamBuffer buffer_;
+
+  bool playing_ = true;
+  int direction_ = 1;
+  // playback shows clock_frame_ at clock_time_ and advances from there
+  std::size_t clock_frame_ = 0;
+  std::chrono::steady_clock::time_point clock_time_;
+  // frame shown while paused
+  std::size_t requested_frame_ = 0;
+  std::size_t shown_frame_ = 0;
+  bool frame_shown_ = false;
+  std::size_t late_frames_ = 0;
+  std::vector<float> frame_xyz_;
+  // frames whose heights went into height_histogram_
+  std::vector<bool> frame_in_histogram_;
+};
+
+}  // namespace ogl_viewer
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace ogl_viewer {
+
+// Frames of x/y/z float positions passed from a producer process to the
+// viewer through a POSIX shared memory object. The producer writes into the
+// slots of a ring in turn and publishes the sequence number of the last
+// complete frame; the viewer reads the latest one straight from the mapping.
+// Each slot carries a sequence lock, so a reader that was lapped by the
+// producer while reading notices it instead of showing a torn frame.
+//
+// Layout: ShmRingHeader, then num_slots times (ShmRingSlot, positions), each
+// slot padded to a multiple of 64 bytes.
+
+struct ShmRingHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t num_slots;
+  uint64_t max_points;
+  uint64_t slot_stride;
+  // sequence number of the last published frame, 0 before the first
+  std::atomic<uint64_t> published;
+};
+
+struct ShmRingSlot {
+  // 2 * frame sequence number once written, odd while being written
+  std::atomic<uint64_t> lock;
+  uint64_t num_points;
+  // CLOCK_MONOTONIC time of the publication, shared by all processes
+  int64_t publish_time_ns;
+};
+
+/** @brief monotonic clock of the publish times, in nanoseconds **/
+int64_t ShmRingNowNs();
+
+class ShmRingProducer {
+ public:
+  ShmRingProducer() = default;
+  ~ShmRingProducer();
+
+  ShmRingProducer(const ShmRingProducer&) = delete;
+  ShmRingProducer& operator=(const ShmRingProducer&) = delete;
+
+  /** @brief create (or take over) the shared memory object name, e.g.
+   *  "/ogl_viewer", for frames of up to max_points points **/
+  bool Create(const std::string &name, std::size_t max_points,
+      int num_slots = 4);
+
+  /** @brief unmap, and remove the object so that readers notice **/
+  void Close();
+
+  std::size_t max_points() const {
+    return max_points_;
+  }
+
+  /** @brief slot the next frame is written into, max_points() * 3 floats;
+   *  valid until PublishFrame **/
+  float* AcquireFrame();
+
+  /** @brief publish the first num_points points of the acquired slot **/
+  void PublishFrame(std::size_t num_points);
+
+  /** @brief copy and publish in one go; num_points is clamped to
+   *  max_points() **/
+  void Publish(const float *xyz, std::size_t num_points);
+
+ private:
+  std::string name_;
+  char *data_ = nullptr;
+  std::size_t size_ = 0;
+  std::size_t max_points_ = 0;
+  uint64_t sequence_ = 0;
+  bool writing_ = false;
+};
+
+class ShmRingConsumer {
+ public:
+  struct Frame {
+    uint64_t sequence = 0;
+    const float *xyz = nullptr;
+    std::size_t num_points = 0;
+    int64_t publish_time_ns = 0;
+  };
+
+  ShmRingConsumer() = default;
+  ~ShmRingConsumer();
+
+  ShmRingConsumer(const ShmRingConsumer&) = delete;
+  ShmRingConsumer& operator=(const ShmRingConsumer&) = delete;
+
+  /** @brief map the object if a producer created it, false otherwise **/
+  bool Open(const std::string &name);
+  void Close();
+
+  bool is_open() const {
+    return data_ != nullptr;
+  }
+
+  /** @brief the last published frame if it is newer than the previous one
+   *  returned; the positions point into the shared mapping **/
+  bool AcquireLatest(Frame *frame);
+
+  /** @brief whether the producer left the frame alone while it was read;
+   *  a false return means the positions read were torn **/
+  bool Validate(const Frame &frame) const;
+
+  /** @brief whether the object was removed or replaced by a restarted
+   *  producer, in which case it should be opened again **/
+  bool Stale() const;
+
+  /** @brief frames published but never returned by AcquireLatest **/
+  uint64_t skipped_frames() const {
+    return skipped_frames_;
+  }
+
+ private:
+  const ShmRingSlot* SlotOf(uint64_t sequence) const;
+
+ private:
+  std::string name_;
+  char *data_ = nullptr;
+  std::size_t size_ = 0;
+  ino_t inode_ = 0;
+  uint64_t last_sequence_ = 0;
+  uint64_t skipped_frames_ = 0;
+};
+
+}  // namespace ogl_viewer
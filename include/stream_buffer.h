@@ -0,0 +1,48 @@
+#pragma once
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+#undef GLFW_DLL
+
+#include <cstddef>
+
+namespace ogl_viewer {
+
+// Float positions replaced every frame. There are two vertex buffers: a new
+// frame goes into the one that was not drawn last, after orphaning its
+// storage, so an upload never waits for the GPU to finish reading the
+// frame before.
+class StreamBuffer {
+ public:
+  StreamBuffer();
+  ~StreamBuffer();
+
+  StreamBuffer(const StreamBuffer&) = delete;
+  StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+  /** @brief replace the positions; xyz may be freed once this returns **/
+  void Upload(const float *xyz, std::size_t num_points);
+
+  /** @brief go back to the positions uploaded before the last Upload, e.g.
+   *  when those turned out to be torn **/
+  void Revert();
+
+  /** @brief vertex array of the last uploaded frame **/
+  GLuint vao() const {
+    return vaos_[front_];
+  }
+
+  std::size_t num_points() const {
+    return num_points_;
+  }
+
+ private:
+  GLuint vaos_[2] = {0, 0};
+  GLuint vbos_[2] = {0, 0};
+  int front_ = 0;
+  std::size_t num_points_ = 0;
+  // of the back buffer, for Revert
+  std::size_t back_num_points_ = 0;
+};
+
+}  // namespace ogl_viewer
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <random>
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+#include "gizmo_batch.h"
+#include "polyline_batch.h"
+
+namespace ogl_viewer {
+
+// Demo and benchmark content over a scene (--synthetic-gizmos,
+// --synthetic-segments): vehicles circling its center on the ground, a pose
+// and a box each, and lanes of smooth random walks appended over the first
+// frames. A lane left unfinished at the end of a frame is continued by the
+// next one with PolylineBatch::ExtendPolyline, as a recorded trajectory
+// would be. The same for every run, so benchmark runs compare.
+class SyntheticOverlays {
+ public:
+  SyntheticOverlays(std::size_t num_vehicles, std::size_t num_lane_segments)
+      : num_vehicles_(num_vehicles), num_lane_segments_(num_lane_segments) {
+  }
+
+  /** @brief the vehicles move or lanes are still to be appended **/
+  bool animating() const {
+    return num_vehicles_ > 0 || lane_segments_ < num_lane_segments_;
+  }
+
+  /** @brief replace the instances of poses and boxes by the vehicles where
+   *  they are at time seconds, and upload them **/
+  void UpdateVehicles(double time, const Eigen::AlignedBox3f &bounds,
+      GizmoBatch *poses, GizmoBatch *boxes) const;
+
+  /** @brief append the next lane segments over bounds to polylines, which
+   *  uploads them with its next Upload **/
+  void AppendLanes(const Eigen::AlignedBox3f &bounds,
+      PolylineBatch *polylines);
+
+ private:
+  // the next num_points points of the current lane
+  void WalkLane(const Eigen::Vector3f &center, float radius,
+      std::size_t num_points, Polyline *lane);
+
+  std::size_t num_vehicles_ = 0;
+  std::size_t num_lane_segments_ = 0;
+  // lane segments appended so far
+  std::size_t lane_segments_ = 0;
+
+  // the lane being appended: its index, segments so far, and the walk,
+  // at the next point relative to the scene center
+  std::size_t lane_index_ = 0;
+  std::size_t lane_length_ = 0;
+  std::mt19937 lane_random_;
+  Eigen::Vector2f lane_position_ = Eigen::Vector2f::Zero();
+  float lane_heading_ = 0.f;
+};
+
+}  // namespace ogl_viewer
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace ogl_viewer {
+
+class ThreadPool {
+ public:
+  /** @brief num_threads <= 0 means one worker per hardware thread **/
+  explicit ThreadPool(int num_threads = 0);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  /** @brief process-wide pool shared by the loaders **/
+  static ThreadPool& Global();
+
+  int num_threads() const {
+    return static_cast<int>(workers_.size());
+  }
+
+  std::future<void> Submit(std::function<void()> task);
+
+  /** @brief run body(begin, end) over [begin, end) split into ranges of
+   *  at least min_grain items; the calling thread takes part and the call
+   *  returns once every range is done. Not to be called from inside a task
+   *  of the same pool. **/
+  void ParallelFor(std::size_t begin, std::size_t end, std::size_t min_grain,
+      const std::function<void(std::size_t, std::size_t)> &body);
+
+ private:
+  void WorkerLoop();
+
+ private:
+  std::vector<std::thread> workers_;
+  std::queue<std::function<void()>> tasks_;
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  bool stop_ = false;
+};
+
+}  // namespace ogl_viewer
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace ogl_viewer {
+
+// Process wide recorder of timed scopes, exported in the Chrome trace event
+// format (chrome://tracing, ui.perfetto.dev). Recording is off by default;
+// a disabled TRACE_SCOPE costs one relaxed atomic load.
+class Tracer {
+ public:
+  // thread id of the GPU track
+  static const int kGpuThreadId = 0;
+
+  static Tracer& Global();
+
+  static bool enabled() {
+    return enabled_.load(std::memory_order_relaxed);
+  }
+
+  void set_enabled(bool enabled) {
+    enabled_.store(enabled, std::memory_order_relaxed);
+  }
+
+  /** @brief microseconds since the first call, steady clock **/
+  static int64_t NowMicros();
+
+  /** @brief id of the calling thread in the trace, starting at 1 **/
+  static int CurrentThreadId();
+
+  /** @brief label the calling thread in the trace **/
+  void SetThreadName(const char *name);
+
+  /** @brief record a complete event; name must outlive the tracer (string
+   *  literals) **/
+  void AddEvent(const char *name, int thread_id, int64_t begin_us,
+      int64_t duration_us);
+
+  /** @brief write everything recorded so far as Chrome trace JSON **/
+  bool WriteChromeTrace(const std::string &filepath) const;
+
+ private:
+  Tracer() = default;
+
+  struct Event {
+    const char *name;
+    int thread_id;
+    int64_t begin_us;
+    int64_t duration_us;
+  };
+
+  // long sessions keep the first events, about 32 MB worth
+  static const std::size_t kMaxEvents = 1 << 20;
+
+  static std::atomic<bool> enabled_;
+
+  mutable std::mutex mutex_;
+  std::vector<Event> events_;
+  std::vector<std::pair<int, std::string>> thread_names_;
+  std::size_t num_dropped_events_ = 0;
+};
+
+// Records its own lifetime on the calling thread when tracing is enabled.
+class TraceScope {
+ public:
+  explicit TraceScope(const char *name)
+      : name_(name), begin_us_(Tracer::enabled() ? Tracer::NowMicros() : -1) {
+  }
+
+  ~TraceScope() {
+    if (begin_us_ >= 0) {
+      Tracer::Global().AddEvent(name_, Tracer::CurrentThreadId(), begin_us_,
+          Tracer::NowMicros() - begin_us_);
+    }
+  }
+
+  TraceScope(const TraceScope&) = delete;
+  TraceScope& operator=(const TraceScope&) = delete;
+
+ private:
+  const char *name_;
+  int64_t begin_us_;
+};
+
+}  // namespace ogl_viewer
+
+#define OGL_VIEWER_TRACE_CONCAT_(a, b) a##b
+#define OGL_VIEWER_TRACE_CONCAT(a, b) OGL_VIEWER_TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) ::ogl_viewer::TraceScope \
+    OGL_VIEWER_TRACE_CONCAT(trace_scope_, __LINE__)(name)
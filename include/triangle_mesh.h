@@ -0,0 +1,83 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+#include "drawable.h"
+#include "mesh_loader.h"
+#include "mesh_optimizer.h"
+
+namespace ogl_viewer {
+
+// outcome of the last TriangleMesh::LoadDataFromFile
+struct MeshStats {
+  std::size_t num_vertices = 0;
+  std::size_t num_triangles = 0;
+  // vertex cache efficiency of the file order and of the order drawn
+  VertexCacheStats file_cache;
+  VertexCacheStats drawn_cache;
+  // draw calls, one per 16-bit batch, and the vertices the batches share
+  std::size_t num_batches = 0;
+  std::size_t duplicated_vertices = 0;
+  double load_ms = 0.0;
+  double optimize_ms = 0.0;
+};
+
+// Triangle mesh from a PLY or OBJ file, shaded with the height colormap
+// under a headlight. At load time the triangles are reordered for the
+// post-transform vertex cache and the vertices for fetch locality, then
+// stored as a float position and a packed 10:10:10 normal (16 bytes).
+class TriangleMesh : public Drawable {
+ public:
+  TriangleMesh() = default;
+  ~TriangleMesh() override;
+
+  void Enqueue(GLSLShader *shader, RenderQueue *queue) const override;
+  bool LoadDataFromFile(const std::string &filepath) override;
+
+  /** @brief reorder triangles and vertices at load time **/
+  void set_optimize(bool optimize) {
+    optimize_ = optimize;
+  }
+
+  /** @brief draw with 16-bit indices, in batches of up to 65536 vertices **/
+  void set_short_indices(bool short_indices) {
+    short_indices_ = short_indices;
+  }
+
+  const MeshStats& stats() const {
+    return stats_;
+  }
+
+  const Eigen::AlignedBox3f& bounds() const {
+    return bounds_;
+  }
+
+  /** @brief vertex of the file behind a vertex of the buffer drawn, e.g. a
+   *  picked one; false if there is no such vertex **/
+  bool LookupVertex(int vertex, std::size_t *file_vertex) const;
+
+ private:
+  // the vertex buffer and the element buffer of 32 or 16-bit indices
+  void Upload(const MeshData &mesh, const void *indices,
+      std::size_t index_bytes);
+
+ private:
+  bool optimize_ = true;
+  bool short_indices_ = false;
+  MeshStats stats_;
+  Eigen::AlignedBox3f bounds_;
+
+  GLuint vao_ = 0;
+  GLuint vbo_ = 0;
+  GLuint ebo_ = 0;
+  GLenum index_type_ = GL_UNSIGNED_INT;
+  std::vector<MeshBatch> batches_;
+  // vertex of the file of every vertex of the buffer
+  std::vector<uint32_t> source_vertices_;
+};
+
+}  // namespace ogl_viewer
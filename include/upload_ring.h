@@ -0,0 +1,45 @@
+#pragma once
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+#undef GLFW_DLL
+
+#include <vector>
+
+namespace ogl_viewer {
+
+// Ring of staging buffers allocated once and reused. Every upload maps the
+// next free slot unsynchronized, writes the data and unmaps it again (the
+// buffers are not persistently mapped), then copies it into the destination
+// buffer on the GPU; a fence per slot tells when it may be reused, so
+// uploads never wait for the GPU.
+class UploadRing {
+ public:
+  UploadRing(GLsizeiptr slot_size, int num_slots);
+  ~UploadRing();
+
+  UploadRing(const UploadRing&) = delete;
+  UploadRing& operator=(const UploadRing&) = delete;
+
+  GLsizeiptr slot_size() const {
+    return slot_size_;
+  }
+
+  /** @brief copy size (<= slot_size) bytes into dst_buffer at dst_offset;
+   *  returns false without doing anything if the GPU still reads the next
+   *  slot, the caller should retry next frame **/
+  bool Upload(GLuint dst_buffer, GLintptr dst_offset, const void *data,
+      GLsizeiptr size);
+
+ private:
+  struct Slot {
+    GLuint buffer = 0;
+    GLsync fence = nullptr;
+  };
+
+  GLsizeiptr slot_size_ = 0;
+  std::vector<Slot> slots_;
+  std::size_t next_slot_ = 0;
+};
+
+}  // namespace ogl_viewer
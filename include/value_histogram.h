@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ogl_viewer {
+
+// Distribution of a stream of values, e.g. the heights of the points loaded
+// so far, over kNumBins equal bins. The bins cover a range that doubles,
+// merging pairs of bins, whenever values beyond it come in, so values can be
+// added batch by batch without a first pass over all of them. NaN and
+// infinite values are skipped.
+class ValueHistogram {
+ public:
+  static const int kNumBins = 4096;
+
+  /** @brief add count values found stride floats apart. Large batches are
+   *  spread over ThreadPool::Global(), so this is not to be called from one
+   *  of its tasks. **/
+  void Add(const float *values, std::size_t stride, std::size_t count);
+
+  /** @brief add the values of another histogram, at their bin centers **/
+  void Merge(const ValueHistogram &other);
+
+  void Clear();
+
+  std::size_t count() const {
+    return count_;
+  }
+
+  /** @brief smallest and largest values added **/
+  float min() const {
+    return min_;
+  }
+  float max() const {
+    return max_;
+  }
+
+  /** @brief value below which the given fraction of the values lie,
+   *  interpolated within its bin **/
+  float Percentile(float fraction) const;
+
+  /** @brief fraction of the values below each of num_values values evenly
+   *  spaced over [low, high], the inverse of Percentile **/
+  void Ranks(float low, float high, int num_values, float *ranks) const;
+
+ private:
+  // grow the range of the bins until it covers [min_value, max_value]
+  void Fit(float min_value, float max_value);
+
+  int Bin(float value) const;
+
+ private:
+  std::vector<uint64_t> bins_;
+  // the bins cover [low_, low_ + kNumBins * bin_width_)
+  float low_ = 0.f;
+  float bin_width_ = 0.f;
+  float min_ = 0.f;
+  float max_ = 0.f;
+  std::size_t count_ = 0;
+};
+
+}  // namespace ogl_viewer
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+namespace ogl_viewer {
+
+// outcome of the last VoxelFilter::Apply
+struct VoxelFilterStats {
+  std::size_t input_points = 0;
+  std::size_t output_points = 0;
+  float leaf_size = 0.f;
+  // key sorts run, more than one while searching the leaf size of a target
+  int sort_passes = 0;
+  double elapsed_ms = 0.0;
+};
+
+// Load-time reduction to one point per occupied cell of a regular grid, at
+// the centroid of the cell's points. The cell keys are computed in parallel
+// and ordered with a parallel LSD radix sort over only the bits the grid
+// needs, so the points of a cell end up next to each other without any hash
+// map; the memory needed is 24 bytes per input point.
+class VoxelFilter {
+ public:
+  VoxelFilter() = default;
+
+  /** @brief edge length of the cells, 0 for none **/
+  void set_leaf_size(float leaf_size) {
+    leaf_size_ = leaf_size;
+  }
+
+  /** @brief search the leaf size that leaves about target_points (within
+   *  5%); takes precedence over the leaf size, 0 for none **/
+  void set_target_points(std::size_t target_points) {
+    target_points_ = target_points;
+  }
+
+  bool enabled() const {
+    return leaf_size_ > 0.f || target_points_ > 0;
+  }
+
+  /** @brief filter xyz (3 floats per point) in place and print the reduction.
+   *  source (may be null) receives for every remaining point the index of
+   *  the first input point of its cell. Non-finite points are dropped. **/
+  void Apply(std::vector<float> *xyz, std::vector<uint32_t> *source);
+
+  const VoxelFilterStats& stats() const {
+    return stats_;
+  }
+
+ private:
+  // sort the cell keys of every point into keys_ and indices_; returns the
+  // number of occupied cells, and may enlarge leaf_size to fit the key bits
+  std::size_t SortCells(const std::vector<float> &xyz,
+      const Eigen::AlignedBox3f &bounds, float *leaf_size);
+
+ private:
+  float leaf_size_ = 0.f;
+  std::size_t target_points_ = 0;
+  VoxelFilterStats stats_;
+
+  // cell key and input index of every point, sorted by key; the second
+  // buffers are the scatter targets of the radix passes
+  std::vector<uint64_t> keys_;
+  std::vector<uint64_t> keys_scratch_;
+  std::vector<uint32_t> indices_;
+  std::vector<uint32_t> indices_scratch_;
+  // points with finite coordinates, sorted before the others
+  std::size_t num_valid_points_ = 0;
+};
+
+}  // namespace ogl_viewer
@@ -1,5 +1,6 @@
 #include "camera_control.h"
 
+#include <algorithm>
 #include <cmath>
 
 namespace ogl_viewer {
@@ -21,6 +22,30 @@ Eigen::Matrix4f CameraControl::GetProjectionMatrix() const {
   return proj_mat.transpose();
 }
 
+Eigen::Matrix4f CameraControl::LookAt(const Eigen::Vector3f &eye,
+    const Eigen::Vector3f &center, const Eigen::Vector3f &up) {
+  Eigen::Vector3f f = (center - eye).normalized();
+  Eigen::Vector3f s = f.cross(up).normalized();
+  Eigen::Vector3f u = s.cross(f);
+
+  Eigen::Matrix4f view_mat = Eigen::Matrix4f::Identity();
+  // refer to glm::lookAt
+  view_mat(0, 0) = s[0];
+  view_mat(1, 0) = s[1];
+  view_mat(2, 0) = s[2];
+  view_mat(0, 1) = u[0];
+  view_mat(1, 1) = u[1];
+  view_mat(2, 1) = u[2];
+  view_mat(0, 2) = -f[0];
+  view_mat(1, 2) = -f[1];
+  view_mat(2, 2) = -f[2];
+  view_mat(3, 0) = -s.dot(eye);
+  view_mat(3, 1) = -u.dot(eye);
+  view_mat(3, 2) = f.dot(eye);
+
+  return view_mat.transpose();
+}
+
 ArcCameraControl::ArcCameraControl() {
   center_ = Eigen::Vector3d::Zero();
   distance_ = 30.0;
@@ -91,28 +116,27 @@ Eigen::Matrix4f ArcCameraControl::GetViewMatrix() const {
   Eigen::Vector3f offset = quat * Eigen::Vector3f(distance_, 0.0f, 0.0f);
   Eigen::Vector3f center = center_.cast<float>();
   Eigen::Vector3f eye = center + offset;
-  Eigen::Vector3f up = Eigen::Vector3f::UnitZ();
+  return LookAt(eye, center, Eigen::Vector3f::UnitZ());
+}
 
-  Eigen::Vector3f f = (center - eye).normalized();
-  Eigen::Vector3f s = f.cross(up).normalized();
-  Eigen::Vector3f u = s.cross(f);
+OrbitCameraPath::OrbitCameraPath(const Eigen::Vector3f &center,
+    float radius) : center_(center), radius_(std::max(radius, 1e-3f)) {
+  z_near_ = 0.01f * radius_;
+  z_far_ = 10.f * radius_;
+  SetTime(0.f);
+}
 
-  Eigen::Matrix4f view_mat = Eigen::Matrix4f::Identity();
-  // refer to glm::lookAt
-  view_mat(0, 0) = s[0];
-  view_mat(1, 0) = s[1];
-  view_mat(2, 0) = s[2];
-  view_mat(0, 1) = u[0];
-  view_mat(1, 1) = u[1];
-  view_mat(2, 1) = u[2];
-  view_mat(0, 2) = -f[0];
-  view_mat(1, 2) = -f[1];
-  view_mat(2, 2) = -f[2];
-  view_mat(3, 0) = -s.dot(eye);
-  view_mat(3, 1) = -u.dot(eye);
-  view_mat(3, 2) = f.dot(eye);
+void OrbitCameraPath::SetTime(float t) {
+  const float theta = 2.f * M_PI * t;
+  // 2x radius at the start and the end, 0.5x halfway
+  const float distance = radius_ * (1.25f + 0.75f * std::cos(theta));
+  const float phi = 30.f * M_PI / 180.f;
+  eye_ = center_ + distance * Eigen::Vector3f(std::cos(phi) * std::cos(theta),
+      std::cos(phi) * std::sin(theta), std::sin(phi));
+}
 
-  return view_mat.transpose();
+Eigen::Matrix4f OrbitCameraPath::GetViewMatrix() const {
+  return LookAt(eye_, center_, Eigen::Vector3f::UnitZ());
 }
 
 }  // namespace ogl_viewer
@@ -0,0 +1,137 @@
+#include "colormap.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "tracer.h"
+
+namespace ogl_viewer {
+
+namespace {
+
+// entries of the lookup table
+const int kTableSize = 1024;
+// share of the values clamped to either end by kPercentile and kEqualize
+const float kClipFraction = 0.01f;
+
+// polynomial approximation of turbo, x in [0, 1]
+Eigen::Vector3f Turbo(float x) {
+  const Eigen::Vector4f kRed4(0.13572138f, 4.61539260f, -42.66032258f,
+      132.13108234f);
+  const Eigen::Vector4f kGreen4(0.09140261f, 2.19418839f, 4.84296658f,
+      -14.18503333f);
+  const Eigen::Vector4f kBlue4(0.10667330f, 12.64194608f, -60.58204836f,
+      110.36276771f);
+  const Eigen::Vector2f kRed2(-152.94239396f, 59.28637943f);
+  const Eigen::Vector2f kGreen2(4.27729857f, 2.82956604f);
+  const Eigen::Vector2f kBlue2(-89.90310912f, 27.34824973f);
+
+  x = std::min(std::max(x, 0.f), 1.f);
+  const Eigen::Vector4f v4(1.f, x, x * x, x * x * x);
+  const Eigen::Vector2f v2 = v4.tail<2>() * v4.z();
+  return Eigen::Vector3f(
+      v4.dot(kRed4) + v2.dot(kRed2),
+      v4.dot(kGreen4) + v2.dot(kGreen2),
+      v4.dot(kBlue4) + v2.dot(kBlue2));
+}
+
+// RGBA bytes of the table, entry i showing turbo(positions[i])
+std::vector<uint8_t> MakeTable(const std::vector<float> &positions) {
+  std::vector<uint8_t> table(positions.size() * 4);
+  for (std::size_t i = 0; i < positions.size(); ++i) {
+    const Eigen::Vector3f color = Turbo(positions[i]);
+    for (int k = 0; k < 3; ++k) {
+      table[i * 4 + k] = static_cast<uint8_t>(
+          std::min(std::max(color[k], 0.f), 1.f) * 255.f + 0.5f);
+    }
+    table[i * 4 + 3] = 255;
+  }
+  return table;
+}
+
+}  // namespace
+
+bool ParseColormapScaling(const std::string &name, ColormapScaling *scaling) {
+  for (ColormapScaling candidate : {ColormapScaling::kMinMax,
+      ColormapScaling::kPercentile, ColormapScaling::kEqualize}) {
+    if (name == ColormapScalingName(candidate)) {
+      *scaling = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
+const char* ColormapScalingName(ColormapScaling scaling) {
+  switch (scaling) {
+  case ColormapScaling::kMinMax:
+    return "minmax";
+  case ColormapScaling::kPercentile:
+    return "percentile";
+  case ColormapScaling::kEqualize:
+    return "equalize";
+  }
+  return "";
+}
+
+Colormap::Colormap() {
+  std::vector<float> positions(kTableSize);
+  for (int i = 0; i < kTableSize; ++i) {
+    positions[i] = static_cast<float>(i) / (kTableSize - 1);
+  }
+  const std::vector<uint8_t> table = MakeTable(positions);
+
+  glGenTextures(1, &texture_);
+  glBindTexture(GL_TEXTURE_1D, texture_);
+  glTexImage1D(GL_TEXTURE_1D, 0, GL_RGBA8, kTableSize, 0, GL_RGBA,
+      GL_UNSIGNED_BYTE, table.data());
+  // colors in between entries blend, values beyond the range clamp
+  glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAX_LEVEL, 0);
+  glBindTexture(GL_TEXTURE_1D, 0);
+}
+
+Colormap::~Colormap() {
+  glDeleteTextures(1, &texture_);
+}
+
+void Colormap::Update(const ValueHistogram &histogram,
+    ColormapScaling scaling) {
+  if (histogram.count() == 0) {
+    return;
+  }
+  TRACE_SCOPE("Colormap::Update");
+  const float clip = scaling == ColormapScaling::kMinMax ? 0.f :
+      kClipFraction;
+  float low = histogram.Percentile(clip);
+  float high = histogram.Percentile(1.f - clip);
+  if (!(high > low)) {
+    // a single value, or nearly so
+    low = histogram.min();
+    high = std::max(histogram.max(), low + 1e-6f);
+  }
+  range_ = Eigen::Vector2f(low, high);
+
+  std::vector<float> positions(kTableSize);
+  if (scaling == ColormapScaling::kEqualize) {
+    // the share of the values below an entry picks its color
+    histogram.Ranks(low, high, kTableSize, positions.data());
+    for (float &position : positions) {
+      position = (position - clip) / (1.f - 2.f * clip);
+    }
+  } else {
+    for (int i = 0; i < kTableSize; ++i) {
+      positions[i] = static_cast<float>(i) / (kTableSize - 1);
+    }
+  }
+  const std::vector<uint8_t> table = MakeTable(positions);
+  glBindTexture(GL_TEXTURE_1D, texture_);
+  glTexSubImage1D(GL_TEXTURE_1D, 0, 0, kTableSize, GL_RGBA,
+      GL_UNSIGNED_BYTE, table.data());
+  glBindTexture(GL_TEXTURE_1D, 0);
+}
+
+}  // namespace ogl_viewer
@@ -2,6 +2,8 @@
 
 #include <iostream>
 
+#include "tracer.h"
+
 namespace ogl_viewer {
 
 CoordinateAxes::CoordinateAxes() {
@@ -58,6 +60,8 @@ CoordinateAxes::CoordinateAxes() {
   glBindBuffer(GL_ARRAY_BUFFER, vbo_);
   glBufferData(GL_ARRAY_BUFFER, sizeof(float) * vertices_ext.size() * 3,
       vertices_ext.data(), GL_STATIC_DRAW);
+  glEnableVertexAttribArray(kPositionAttrib);
+  glVertexAttribPointer(kPositionAttrib, 3, GL_FLOAT, GL_FALSE, 0, 0);
 
   // bind color buffer
   std::vector<Eigen::Vector4f,
@@ -73,6 +77,8 @@ CoordinateAxes::CoordinateAxes() {
   glBindBuffer(GL_ARRAY_BUFFER, cbo_);
   glBufferData(GL_ARRAY_BUFFER, sizeof(float) * colors_ext.size() * 4,
       colors_ext.data(), GL_STATIC_DRAW);
+  glEnableVertexAttribArray(kColorAttrib);
+  glVertexAttribPointer(kColorAttrib, 4, GL_FLOAT, GL_FALSE, 0, 0);
 
   // bind element buffer (draw triangles)
   // triangle vertex indices of a 'line segment'
@@ -110,28 +116,19 @@ CoordinateAxes::~CoordinateAxes() {
   glDeleteVertexArrays(1, &vao_);
 }
 
-void CoordinateAxes::Draw(GLSLShader *shader) const {
-  glBindVertexArray(vao_);
-
-  GLint position_loc = shader->GetAttribLocation("vert_position");
-  glEnableVertexAttribArray(position_loc);
-  glBindBuffer(GL_ARRAY_BUFFER, vbo_);
-  glVertexAttribPointer(position_loc, 3, GL_FLOAT, GL_FALSE, 0, 0);
-
-  GLint color_loc = shader->GetAttribLocation("vert_color");
-  glEnableVertexAttribArray(color_loc);
-  glBindBuffer(GL_ARRAY_BUFFER, cbo_);
-  glVertexAttribPointer(color_loc, 4, GL_FLOAT, GL_FALSE, 0, 0);
-
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo_);
-  glDrawElements(GL_TRIANGLES, num_indices_, GL_UNSIGNED_INT, 0);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-
-  glDisableVertexAttribArray(position_loc);
-  glDisableVertexAttribArray(color_loc);
-
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
-  glBindVertexArray(0);
+void CoordinateAxes::Enqueue(GLSLShader *shader, RenderQueue *queue) const {
+  TRACE_SCOPE("CoordinateAxes::Enqueue");
+  DrawItem item;
+  item.shader = shader;
+  item.vao = vao_;
+  item.mode = GL_TRIANGLES;
+  item.indexed = true;
+  item.count = num_indices_;
+  item.index_type = GL_UNSIGNED_INT;
+  // per-vertex colors
+  item.color_mode = 2;
+  item.model_matrix = model_matrix_;
+  queue->Submit(item);
 }
 
 }  // namespace ogl_viewer
@@ -1,52 +1,982 @@
 #include "drawable.h"
 
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
 #include <pcl/io/pcd_io.h>
 #include <pcl/point_types.h>
 
+#include "pcd_reader.h"
+#include "quantize.h"
+#include "tracer.h"
+
 namespace ogl_viewer {
 
+namespace {
+
+// number of points handed to glBufferSubData at once (12 MB of positions)
+const std::size_t kUploadChunkPoints = 1 << 20;
+// points per frustum culling chunk when there is no octree
+const std::size_t kCullChunkPoints = 1 << 16;
+// fields kept decoded on the CPU: the one shown and the one before
+const std::size_t kMaxDecodedAttributes = 2;
+// staging ring used by background loading
+const GLsizeiptr kUploadSlotBytes = 4 << 20;
+const int kUploadRingSlots = 8;
+// bytes of a quantized position
+const int kQuantizedStride = 3 * sizeof(uint16_t);
+// selection refined while the camera is still: budget multiplier and
+// smallest node size relative to those of a moving camera
+const std::size_t kRefineBudgetFactor = 16;
+const float kRefineNodePixelsFactor = 0.125f;
+
+double PeakRssMegaBytes() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+  return usage.ru_maxrss / (1024.0 * 1024.0);  // bytes
+#else
+  return usage.ru_maxrss / 1024.0;  // kilobytes
+#endif
+}
+
+PointChunk MakeChunk(std::size_t first, std::size_t count,
+    const Eigen::AlignedBox3f &bounds) {
+  PointChunk chunk;
+  chunk.first = first;
+  chunk.count = count;
+  if (count > 0) {
+    chunk.offset = bounds.min();
+    chunk.scale = bounds.sizes();
+  }
+  return chunk;
+}
+
+PointChunk MakeNodeChunk(const OctreeNode &node) {
+  return MakeChunk(node.first, node.count, node.point_bounds);
+}
+
+bool IsRgbField(const std::string &name) {
+  return name == "rgb" || name == "rgba";
+}
+
+// read one field of filepath and bring it into vertex order; null on error
+std::unique_ptr<PointAttribute> ReadAttribute(const std::string &filepath,
+    const std::string &name, const std::vector<uint32_t> *order,
+    std::size_t num_points) {
+  TRACE_SCOPE("ReadAttribute");
+  std::unique_ptr<PointAttribute> attribute(new PointAttribute);
+  attribute->name = name;
+  attribute->rgb = IsRgbField(name);
+
+  PcdReader reader;
+  if (!reader.Open(filepath)) {
+    return nullptr;
+  }
+  std::vector<float> values;
+  values.reserve(reader.header().num_points);
+  const bool read_ok = reader.ReadField(reader.header().FieldIndex(name),
+      attribute->rgb, kUploadChunkPoints,
+      [&](const float *chunk, std::size_t count) {
+        values.insert(values.end(), chunk, chunk + count);
+        return true;
+      });
+  // with an order the file may hold more points than remain after the
+  // voxel filter
+  const bool sizes_match = order->empty() ? values.size() == num_points :
+      order->size() == num_points && (num_points == 0 ||
+          *std::max_element(order->begin(), order->end()) < values.size());
+  if (!read_ok || !sizes_match) {
+    std::cerr << "error : failed to read field " << name << " of "
+        << filepath << "\n";
+    return nullptr;
+  }
+
+  if (order->empty()) {
+    attribute->values.swap(values);
+  } else {
+    attribute->values.resize(num_points);
+    for (std::size_t i = 0; i < num_points; ++i) {
+      attribute->values[i] = values[(*order)[i]];
+    }
+  }
+  if (!attribute->rgb) {
+    attribute->histogram.Add(attribute->values.data(), 1,
+        attribute->values.size());
+  }
+  return attribute;
+}
+
+// index the positions of the vertex buffer; vertex i is point order[i] of
+// the file, or point i when order is empty
+std::unique_ptr<PointIndex> BuildPointIndex(std::vector<float> xyz,
+    std::vector<uint32_t> order) {
+  TRACE_SCOPE("BuildPointIndex");
+  std::unique_ptr<PointIndex> index(new PointIndex);
+  const std::size_t num_points = xyz.size() / 3;
+  index->Build(xyz.data(), 3, num_points,
+      order.size() == num_points ? order.data() : nullptr);
+  return index;
+}
+
+}  // namespace
+
 PointCloud::~PointCloud() {
+  loader_.reset();
+  upload_ring_.reset();
+  if (attribute_future_.valid()) {
+    attribute_future_.wait();
+  }
+  if (index_future_.valid()) {
+    index_future_.wait();
+  }
   glDeleteVertexArrays(1, &vao_);
   glDeleteBuffers(1, &vbo_);
+  glDeleteBuffers(1, &lod_vbo_);
+  glDeleteBuffers(1, &attribute_vbo_);
 }
 
-void PointCloud::Draw(GLSLShader *shader) const {
-  if (num_points_ == 0) {
+void PointCloud::Enqueue(GLSLShader *shader, RenderQueue *queue) const {
+  if (num_points_ == 0 || draw_firsts_.empty()) {
     return;
   }
+  TRACE_SCOPE("PointCloud::Enqueue");
 
-  GLint position_loc = shader->GetAttribLocation("vert_position");
-  glBindVertexArray(vao_);
-  glEnableVertexAttribArray(position_loc);
+  DrawItem item;
+  item.shader = shader;
+  item.vao = vao_;
+  item.mode = GL_POINTS;
+  if (resident_attribute_.empty()) {
+    item.color_mode = 0;
+  } else {
+    item.color_mode = resident_rgb_ ? 4 : 3;
+    item.scalar_range = scalar_range_;
+    if (attribute_colormap_) {
+      item.colormap = attribute_colormap_->texture();
+    }
+  }
+  item.model_matrix = model_matrix_;
+  item.pick_id = kPickPointCloud;
+  if (quantize_positions_) {
+    // every chunk dequantizes with its own offset and scale
+    for (std::size_t i = 0; i < draw_firsts_.size(); ++i) {
+      const PointChunk &chunk = chunks_[draw_chunks_[i]];
+      item.first = draw_firsts_[i];
+      item.count = draw_counts_[i];
+      item.position_offset = chunk.offset;
+      item.position_scale = chunk.scale;
+      queue->Submit(item);
+    }
+  } else {
+    item.firsts = draw_firsts_.data();
+    item.counts = draw_counts_.data();
+    item.draw_count = static_cast<GLsizei>(draw_firsts_.size());
+    queue->Submit(item);
+  }
+}
 
-  glBindBuffer(GL_ARRAY_BUFFER, vbo_);
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride_, 0);
+void PointCloud::UpdateView(const Eigen::Matrix4f &view_matrix,
+    const Eigen::Matrix4f &projection_matrix,
+    const Eigen::Vector2i &viewport_size) {
+  TRACE_SCOPE("PointCloud::UpdateView");
+  const Frustum frustum(projection_matrix * view_matrix);
+  frustum.CullBoxes(chunk_bounds_, &chunk_visible_);
 
-  glDrawArrays(GL_POINTS, 0, num_points_);
+  view_matrix_ = view_matrix;
+  projection_matrix_ = projection_matrix;
+  viewport_height_ = static_cast<float>(viewport_size.y());
+  refined_selected_ = false;
 
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
-  glDisableVertexAttribArray(0);
+  draw_firsts_.clear();
+  draw_counts_.clear();
+  draw_chunks_.clear();
+  render_stats_.total_chunks = chunks_.size();
+  render_stats_.visible_chunks = 0;
+  render_stats_.visible_points = 0;
+  if (octree_) {
+    octree_->SelectNodes(view_matrix, projection_matrix, viewport_size.y(),
+        point_budget_, min_node_pixels_, &chunk_visible_, &selected_nodes_);
+    for (int node_index : selected_nodes_) {
+      const PointChunk &chunk = chunks_[node_index];
+      draw_firsts_.push_back(static_cast<GLint>(chunk.first));
+      draw_counts_.push_back(static_cast<GLsizei>(chunk.count));
+      draw_chunks_.push_back(node_index);
+      render_stats_.visible_points += chunk.count;
+    }
+    render_stats_.visible_chunks = selected_nodes_.size();
+    return;
+  }
+
+  for (std::size_t i = 0; i < num_resident_chunks_; ++i) {
+    if (!chunk_visible_[i]) {
+      continue;
+    }
+    const PointChunk &chunk = chunks_[i];
+    // merge runs of visible chunks into one range unless each chunk needs
+    // its own dequantization uniforms
+    if (!quantize_positions_ && !draw_firsts_.empty() &&
+        static_cast<std::size_t>(draw_firsts_.back() + draw_counts_.back()) ==
+            chunk.first) {
+      draw_counts_.back() += static_cast<GLsizei>(chunk.count);
+    } else {
+      draw_firsts_.push_back(static_cast<GLint>(chunk.first));
+      draw_counts_.push_back(static_cast<GLsizei>(chunk.count));
+      draw_chunks_.push_back(static_cast<int>(i));
+    }
+    ++render_stats_.visible_chunks;
+    render_stats_.visible_points += chunk.count;
+  }
+}
+
+bool PointCloud::RefineView() {
+  if (!octree_ || loader_) {
+    return false;
+  }
+  TRACE_SCOPE("PointCloud::RefineView");
+  if (!refined_selected_) {
+    // the nodes UpdateView selected come first, as the larger budget and
+    // the smaller nodes only let the selection go on for longer
+    octree_->SelectNodes(view_matrix_, projection_matrix_, viewport_height_,
+        point_budget_ * kRefineBudgetFactor,
+        min_node_pixels_ * kRefineNodePixelsFactor, &chunk_visible_,
+        &refined_nodes_);
+    refined_cursor_ = std::min(selected_nodes_.size(), refined_nodes_.size());
+    refined_selected_ = true;
+  }
+
+  draw_firsts_.clear();
+  draw_counts_.clear();
+  draw_chunks_.clear();
+  std::size_t num_points = 0;
+  while (refined_cursor_ < refined_nodes_.size() &&
+      (num_points == 0 || num_points +
+          chunks_[refined_nodes_[refined_cursor_]].count <= point_budget_)) {
+    const int node_index = refined_nodes_[refined_cursor_++];
+    const PointChunk &chunk = chunks_[node_index];
+    draw_firsts_.push_back(static_cast<GLint>(chunk.first));
+    draw_counts_.push_back(static_cast<GLsizei>(chunk.count));
+    draw_chunks_.push_back(node_index);
+    num_points += chunk.count;
+  }
+  render_stats_.visible_chunks += draw_firsts_.size();
+  render_stats_.visible_points += num_points;
+  return !draw_firsts_.empty();
+}
+
+bool PointCloud::LookupVertex(int vertex, std::size_t *chunk,
+    std::size_t *point_index) const {
+  if (vertex < 0 || vertex >= num_points_) {
+    return false;
+  }
+  const std::size_t index = static_cast<std::size_t>(vertex);
+  // octree nodes are not sorted by first, and a lookup per pick is cheap
+  for (std::size_t i = 0; i < num_resident_chunks_; ++i) {
+    if (index >= chunks_[i].first &&
+        index < chunks_[i].first + chunks_[i].count) {
+      *chunk = i;
+      *point_index = point_order_.empty() ? index : point_order_[index];
+      return true;
+    }
+  }
+  return false;
 }
 
 bool PointCloud::LoadDataFromFile(const std::string &filepath) {
+  TRACE_SCOPE("PointCloud::LoadDataFromFile");
+  const auto start_time = std::chrono::steady_clock::now();
+  point_order_.clear();
+  ListAttributes(filepath);
+
+  // the cache bypasses PCL, so it is only used with the native reader; it
+  // holds the unfiltered cloud
+  const bool use_cache = use_cache_ && !use_pcl_loader_ &&
+      !voxel_filter_.enabled();
+  if (use_cache && LoadFromCache(filepath)) {
+    ReportLoad(filepath, "cache", start_time);
+    return true;
+  }
+  cache_path_.clear();
+  if (use_cache && use_lod_ && ComputePointCacheKey(filepath, &cache_key_)) {
+    cache_path_ = PointCachePath(filepath);
+  }
+
+  bool loaded = false;
+  const char *loader_name = "pcl";
+  if (use_pcl_loader_) {
+    loaded = LoadWithPcl(filepath);
+  } else {
+    loader_name = "native";
+    loaded = LoadWithPcdReader(filepath);
+  }
+  if (!loaded) {
+    return false;
+  }
+
+  ReportLoad(filepath, loader_name, start_time);
+  return true;
+}
+
+bool PointCloud::LoadWithPcdReader(const std::string &filepath) {
+  PcdReader reader;
+  if (!reader.Open(filepath)) {
+    std::cerr << "Cannot read " << filepath << "\n";
+    return false;
+  }
+  if (!reader.CanReadPositions()) {
+    // layouts the native reader does not handle yet
+    reader.Close();
+    return LoadWithPcl(filepath);
+  }
+
+  if (use_lod_ || voxel_filter_.enabled()) {
+    // the octree and the voxel filter need the whole cloud at hand
+    std::vector<float> xyz;
+    xyz.reserve(reader.header().num_points * 3);
+    const bool read_ok = reader.ReadPositions(kUploadChunkPoints,
+        [&](const float *chunk, std::size_t count) {
+          xyz.insert(xyz.end(), chunk, chunk + count * 3);
+          return true;
+        });
+    if (!read_ok) {
+      std::cerr << "Cannot read " << filepath << "\n";
+      return false;
+    }
+    UploadPoints(&xyz);
+    return true;
+  }
+
+  num_points_ = reader.header().num_points;
+  stride_ = quantize_positions_ ? kQuantizedStride : 3 * sizeof(float);
+  AllocateBuffer(static_cast<GLsizeiptr>(num_points_) * stride_, nullptr);
+
+  std::size_t first = 0;
+  const bool read_ok = reader.ReadPositions(kUploadChunkPoints,
+      [&](const float *xyz, std::size_t count) {
+        const std::size_t chunk_begin = chunks_.size();
+        AppendChunks(xyz, 3, first, count);
+        UploadChunks(chunk_begin, xyz, 3);
+        if (build_index_) {
+          index_positions_.insert(index_positions_.end(), xyz,
+              xyz + count * 3);
+        }
+        first += count;
+        return true;
+      });
+  if (!read_ok) {
+    std::cerr << "Cannot read " << filepath << "\n";
+    num_points_ = 0;
+    std::vector<float>().swap(index_positions_);
+    return false;
+  }
+  StartIndexBuild(&index_positions_);
+
+  return true;
+}
+
+bool PointCloud::LoadWithPcl(const std::string &filepath) {
   pcl::PointCloud<pcl::PointXYZ>::Ptr cloud(new pcl::PointCloud<pcl::PointXYZ>);
   if (pcl::io::loadPCDFile<pcl::PointXYZ>(filepath, *cloud) == -1) {
     std::cerr << "Cannot read " << filepath << "\n";
     return false;
   }
 
+  if (use_lod_ || voxel_filter_.enabled()) {
+    std::vector<float> xyz(cloud->size() * 3);
+    for (std::size_t i = 0; i < cloud->size(); ++i) {
+      xyz[i * 3] = cloud->points[i].x;
+      xyz[i * 3 + 1] = cloud->points[i].y;
+      xyz[i * 3 + 2] = cloud->points[i].z;
+    }
+    cloud.reset();
+    UploadPoints(&xyz);
+    return true;
+  }
+
+  const std::size_t point_stride = sizeof(pcl::PointXYZ) / sizeof(float);
   num_points_ = cloud->size();
-  stride_ = sizeof(pcl::PointXYZ);
+  stride_ = quantize_positions_ ? kQuantizedStride : sizeof(pcl::PointXYZ);
+  AllocateBuffer(static_cast<GLsizeiptr>(num_points_) * stride_, nullptr);
+  if (num_points_ > 0) {
+    AppendChunks(&cloud->points[0].x, point_stride, 0, num_points_);
+    UploadChunks(0, &cloud->points[0].x, point_stride);
+  }
+  if (build_index_) {
+    std::vector<float> xyz(cloud->size() * 3);
+    for (std::size_t i = 0; i < cloud->size(); ++i) {
+      xyz[i * 3] = cloud->points[i].x;
+      xyz[i * 3 + 1] = cloud->points[i].y;
+      xyz[i * 3 + 2] = cloud->points[i].z;
+    }
+    StartIndexBuild(&xyz);
+  }
+
+  return true;
+}
+
+bool PointCloud::LoadFromCache(const std::string &filepath) {
+  TRACE_SCOPE("PointCloud::LoadFromCache");
+  PointCacheKey key;
+  PointCache cache;
+  if (!ComputePointCacheKey(filepath, &key) ||
+      !cache.Open(PointCachePath(filepath), key)) {
+    return false;
+  }
+
+  num_points_ = cache.num_points();
+  stride_ = quantize_positions_ ? kQuantizedStride : 3 * sizeof(float);
+  AllocateBuffer(static_cast<GLsizeiptr>(num_points_) * stride_, nullptr);
+  point_order_.assign(cache.order(), cache.order() + num_points_);
+  if (use_lod_) {
+    octree_.reset(new PointOctree);
+    cache.ReadOctree(octree_.get());
+    ResetChunksFromOctree();
+  } else {
+    AppendChunks(cache.positions(), 3, 0, num_points_);
+  }
+  UploadChunks(0, cache.positions(), 3);
+  if (build_index_) {
+    std::vector<float> xyz(cache.positions(),
+        cache.positions() + static_cast<std::size_t>(num_points_) * 3);
+    StartIndexBuild(&xyz);
+  }
+  return true;
+}
+
+void PointCloud::UploadPoints(std::vector<float> *xyz) {
+  if (voxel_filter_.enabled()) {
+    voxel_filter_.Apply(xyz, &point_order_);
+  }
+  if (use_lod_) {
+    UploadWithLod(xyz);
+    return;
+  }
+  num_points_ = xyz->size() / 3;
+  stride_ = quantize_positions_ ? kQuantizedStride : 3 * sizeof(float);
+  AllocateBuffer(static_cast<GLsizeiptr>(num_points_) * stride_, nullptr);
+  AppendChunks(xyz->data(), 3, 0, num_points_);
+  UploadChunks(0, xyz->data(), 3);
+  StartIndexBuild(xyz);
+}
+
+void PointCloud::UploadWithLod(std::vector<float> *xyz) {
+  const auto start_time = std::chrono::steady_clock::now();
+  octree_.reset(new PointOctree);
+  std::vector<uint32_t> octree_order;
+  octree_->Build(xyz, &octree_order);
+  if (!point_order_.empty()) {
+    // points left by the voxel filter
+    for (uint32_t &index : octree_order) {
+      index = point_order_[index];
+    }
+  }
+  point_order_.swap(octree_order);
+  const double elapsed_ms = std::chrono::duration<double, std::milli>(
+      std::chrono::steady_clock::now() - start_time).count();
+  std::cout << "built " << octree_->nodes().size() << " octree nodes in "
+      << elapsed_ms << " ms\n";
+
+  num_points_ = xyz->size() / 3;
+  stride_ = quantize_positions_ ? kQuantizedStride : 3 * sizeof(float);
+  AllocateBuffer(static_cast<GLsizeiptr>(num_points_) * stride_, nullptr);
+  ResetChunksFromOctree();
+  UploadChunks(0, xyz->data(), 3);
+
+  if (!cache_path_.empty() &&
+      WritePointCache(cache_path_, cache_key_, *xyz, point_order_,
+          *octree_)) {
+    std::cout << "wrote " << cache_path_ << "\n";
+  }
+  StartIndexBuild(xyz);
+}
+
+void PointCloud::ResetChunksFromOctree() {
+  // every node is a chunk, culled with its subtree bounds
+  chunks_.clear();
+  chunk_bounds_.Clear();
+  for (const OctreeNode &node : octree_->nodes()) {
+    chunks_.push_back(MakeNodeChunk(node));
+    chunk_bounds_.Add(node.subtree_bounds);
+  }
+  num_resident_chunks_ = 0;
+  if (!octree_->nodes().empty()) {
+    bounds_ = octree_->nodes()[0].subtree_bounds;
+  }
+}
+
+bool PointCloud::StartLoading(const std::string &filepath) {
+  TRACE_SCOPE("PointCloud::StartLoading");
+  if (use_pcl_loader_) {
+    return LoadDataFromFile(filepath);
+  }
+  point_order_.clear();
+  ListAttributes(filepath);
+  // an up to date cache is read at disk speed, no need to stream it
+  if (use_cache_ && !voxel_filter_.enabled()) {
+    const auto start_time = std::chrono::steady_clock::now();
+    if (LoadFromCache(filepath)) {
+      ReportLoad(filepath, "cache", start_time);
+      return true;
+    }
+  }
+  std::unique_ptr<PointCloudLoader> loader(new PointCloudLoader);
+  loader->set_voxel_filter(voxel_filter_);
+  if (!loader->Start(filepath, use_lod_, use_cache_)) {
+    return LoadDataFromFile(filepath);
+  }
+
+  loader_ = std::move(loader);
+  loading_filepath_ = filepath;
+  load_start_time_ = std::chrono::steady_clock::now();
+  stride_ = quantize_positions_ ? kQuantizedStride : 3 * sizeof(float);
+  if (!voxel_filter_.enabled()) {
+    AllocateLoaderBuffer();
+  }
+  upload_ring_.reset(new UploadRing(kUploadSlotBytes, kUploadRingSlots));
+  return true;
+}
+
+void PointCloud::AllocateLoaderBuffer() {
+  if (vao_ != 0) {
+    return;
+  }
+  num_points_ = loader_->num_points();
+  AllocateBuffer(static_cast<GLsizeiptr>(num_points_) * stride_, nullptr);
+}
+
+void PointCloud::PumpUploads(std::size_t max_bytes) {
+  if (!loader_) {
+    return;
+  }
+  TRACE_SCOPE("PointCloud::PumpUploads");
+
+  // decoded chunks in file order, drawable as soon as they are resident
+  std::size_t budget = max_bytes;
+  while (budget > 0) {
+    if (num_resident_chunks_ == chunks_.size()) {
+      if (!loader_->PopChunk(&pending_chunk_)) {
+        break;
+      }
+      AllocateLoaderBuffer();
+      AppendChunks(pending_chunk_.xyz.data(), 3, pending_chunk_.first,
+          pending_chunk_.xyz.size() / 3);
+      height_histogram_.Add(&pending_chunk_.xyz[2], 3,
+          pending_chunk_.xyz.size() / 3);
+      if (build_index_ && !use_lod_) {
+        index_positions_.insert(index_positions_.end(),
+            pending_chunk_.xyz.begin(), pending_chunk_.xyz.end());
+      }
+      continue;
+    }
+    const PointChunk &chunk = chunks_[num_resident_chunks_];
+    const float *xyz =
+        &pending_chunk_.xyz[(chunk.first - pending_chunk_.first) * 3];
+    const void *data = EncodeChunk(chunk, xyz, 3);
+    const std::size_t size = chunk.count * stride_;
+    if (!upload_ring_->Upload(vbo_, chunk.first * stride_, data, size)) {
+      return;
+    }
+    budget -= std::min(budget, size);
+    ++num_resident_chunks_;
+    num_uploaded_points_ += chunk.count;
+  }
+
+  if (num_resident_chunks_ < chunks_.size() || !loader_->finished()) {
+    return;
+  }
+  if (loader_->PopChunk(&pending_chunk_)) {
+    // pushed right before the worker finished
+    AllocateLoaderBuffer();
+    AppendChunks(pending_chunk_.xyz.data(), 3, pending_chunk_.first,
+        pending_chunk_.xyz.size() / 3);
+    height_histogram_.Add(&pending_chunk_.xyz[2], 3,
+        pending_chunk_.xyz.size() / 3);
+    if (build_index_ && !use_lod_) {
+      index_positions_.insert(index_positions_.end(),
+          pending_chunk_.xyz.begin(), pending_chunk_.xyz.end());
+    }
+    return;
+  }
+  if (loader_->failed()) {
+    std::cerr << "Cannot read " << loading_filepath_ << "\n";
+    loader_.reset();
+    upload_ring_.reset();
+    std::vector<float>().swap(index_positions_);
+    return;
+  }
+  // nothing was pushed when the filter left no points
+  AllocateLoaderBuffer();
+  if (!use_lod_) {
+    point_order_ = loader_->TakePointOrder();
+    StartIndexBuild(&index_positions_);
+    FinishLoading();
+    return;
+  }
+
+  if (!PumpLodUploads(&budget)) {
+    return;
+  }
+  glDeleteBuffers(1, &vbo_);
+  vbo_ = lod_vbo_;
+  lod_vbo_ = 0;
+  SetupVertexArray();
+  octree_ = std::move(pending_octree_);
+  point_order_ = loader_->TakePointOrder();
+  StartIndexBuild(&lod_positions_);
+  std::vector<float>().swap(lod_positions_);
+  ResetChunksFromOctree();
+  num_resident_chunks_ = chunks_.size();
+  FinishLoading();
+}
+
+bool PointCloud::PumpLodUploads(std::size_t *budget) {
+  // the octree ordered copy goes to a second buffer, then replaces the first
+  if (!pending_octree_) {
+    pending_octree_ = loader_->TakeOctree();
+    lod_positions_ = loader_->TakeLodPositions();
+    lod_node_cursor_ = 0;
+    lod_node_uploaded_bytes_ = 0;
+    glGenBuffers(1, &lod_vbo_);
+    glBindBuffer(GL_ARRAY_BUFFER, lod_vbo_);
+    glBufferData(GL_ARRAY_BUFFER,
+        static_cast<GLsizeiptr>(lod_positions_.size() / 3) * stride_,
+        nullptr, GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+  }
+
+  const std::vector<OctreeNode> &nodes = pending_octree_->nodes();
+  while (*budget > 0 && lod_node_cursor_ < nodes.size()) {
+    const PointChunk chunk = MakeNodeChunk(nodes[lod_node_cursor_]);
+    const char *data = static_cast<const char*>(
+        EncodeChunk(chunk, &lod_positions_[chunk.first * 3], 3));
+    const std::size_t size = chunk.count * stride_;
+    lod_node_uploaded_bytes_ += UploadBytes(lod_vbo_,
+        chunk.first * stride_ + lod_node_uploaded_bytes_,
+        data + lod_node_uploaded_bytes_, size - lod_node_uploaded_bytes_,
+        budget);
+    if (lod_node_uploaded_bytes_ < size) {
+      return false;
+    }
+    lod_node_uploaded_bytes_ = 0;
+    num_lod_uploaded_points_ += chunk.count;
+    ++lod_node_cursor_;
+  }
+  return lod_node_cursor_ == nodes.size();
+}
+
+float PointCloud::load_progress() const {
+  if (!loader_) {
+    return 1.f;
+  }
+  if (vao_ == 0) {
+    // decoding before the voxel filter, the first half of a filtered load
+    const std::size_t num_points = std::max<std::size_t>(1,
+        loader_->num_points());
+    return 0.5f * std::min(1.f,
+        static_cast<float>(loader_->num_decoded_points()) / num_points);
+  }
+  if (num_points_ == 0) {
+    return 1.f;
+  }
+  const float total = static_cast<float>(num_points_) * (use_lod_ ? 2 : 1);
+  const float progress =
+      (num_uploaded_points_ + num_lod_uploaded_points_) / total;
+  return voxel_filter_.enabled() ? 0.5f + 0.5f * progress : progress;
+}
+
+std::size_t PointCloud::UploadBytes(GLuint buffer, std::size_t offset,
+    const char *data, std::size_t size, std::size_t *budget) {
+  const std::size_t slot_size = upload_ring_->slot_size();
+  std::size_t uploaded = 0;
+  while (uploaded < size && *budget > 0) {
+    const std::size_t n = std::min(std::min(size - uploaded, slot_size),
+        *budget);
+    if (!upload_ring_->Upload(buffer, offset + uploaded, data + uploaded, n)) {
+      break;
+    }
+    uploaded += n;
+    *budget -= n;
+  }
+  return uploaded;
+}
+
+void PointCloud::UpdateIndex() {
+  if (!index_future_.valid() || index_future_.wait_for(
+      std::chrono::seconds(0)) != std::future_status::ready) {
+    return;
+  }
+  index_ = index_future_.get();
+  const double elapsed_ms = std::chrono::duration<double, std::milli>(
+      std::chrono::steady_clock::now() - index_start_time_).count();
+  std::cout << "indexed " << index_->size() << " points for selections in "
+      << elapsed_ms << " ms\n";
+}
+
+void PointCloud::StartIndexBuild(std::vector<float> *xyz) {
+  if (!build_index_) {
+    return;
+  }
+  if (index_future_.valid()) {
+    index_future_.wait();
+  }
+  index_.reset();
+  index_start_time_ = std::chrono::steady_clock::now();
+  // the loaded positions move to the worker, the source order is copied
+  index_future_ = std::async(std::launch::async, BuildPointIndex,
+      std::move(*xyz), point_order_);
+  std::vector<float>().swap(*xyz);
+}
+
+void PointCloud::FinishLoading() {
+  loader_.reset();
+  upload_ring_.reset();
+  ReportLoad(loading_filepath_, "background", load_start_time_);
+}
+
+void PointCloud::ListAttributes(const std::string &filepath) {
+  source_path_ = filepath;
+  attribute_names_.clear();
+  decoded_attributes_.clear();
+  PcdReader reader;
+  if (!reader.Open(filepath)) {
+    return;
+  }
+  const PcdHeader &header = reader.header();
+  for (std::size_t i = 0; i < header.fields.size(); ++i) {
+    const std::string &name = header.fields[i];
+    if (name == "x" || name == "y" || name == "z" || name == "_" ||
+        !reader.CanReadField(static_cast<int>(i))) {
+      continue;
+    }
+    attribute_names_.push_back(name);
+  }
+}
+
+void PointCloud::NextColorAttribute() {
+  const auto it = std::find(attribute_names_.begin(), attribute_names_.end(),
+      color_attribute_);
+  if (it == attribute_names_.end()) {
+    color_attribute_ = attribute_names_.empty() ? "" : attribute_names_[0];
+  } else if (it + 1 == attribute_names_.end()) {
+    color_attribute_.clear();
+  } else {
+    color_attribute_ = *(it + 1);
+  }
+}
 
+void PointCloud::UpdateAttributes() {
+  // the vertex order is final once loading is over
+  if (loader_ || num_points_ == 0) {
+    return;
+  }
+  if (attribute_future_.valid() &&
+      attribute_future_.wait_for(std::chrono::seconds(0)) ==
+          std::future_status::ready) {
+    std::unique_ptr<PointAttribute> attribute = attribute_future_.get();
+    if (!attribute) {
+      // keep what is shown rather than reading the field again every frame
+      color_attribute_ = resident_attribute_;
+      return;
+    }
+    KeepDecoded(std::move(attribute));
+  }
+  if (color_attribute_ == resident_attribute_) {
+    return;
+  }
+  if (color_attribute_.empty()) {
+    ReleaseAttribute();
+    return;
+  }
+  for (std::unique_ptr<PointAttribute> &decoded : decoded_attributes_) {
+    if (decoded->name == color_attribute_) {
+      std::unique_ptr<PointAttribute> attribute = std::move(decoded);
+      UploadAttribute(*attribute);
+      KeepDecoded(std::move(attribute));
+      return;
+    }
+  }
+  if (attribute_future_.valid()) {
+    // one field is read at a time
+    return;
+  }
+  if (std::find(attribute_names_.begin(), attribute_names_.end(),
+      color_attribute_) == attribute_names_.end()) {
+    std::cerr << "error : " << source_path_ << " has no field "
+        << color_attribute_ << " to color by.\n";
+    color_attribute_ = resident_attribute_;
+    return;
+  }
+  // ReadField uses the global pool, so it cannot run as one of its tasks
+  attribute_future_ = std::async(std::launch::async, ReadAttribute,
+      source_path_, color_attribute_, &point_order_,
+      static_cast<std::size_t>(num_points_));
+}
+
+void PointCloud::KeepDecoded(std::unique_ptr<PointAttribute> attribute) {
+  decoded_attributes_.erase(std::remove_if(decoded_attributes_.begin(),
+      decoded_attributes_.end(),
+      [&attribute](const std::unique_ptr<PointAttribute> &decoded) {
+        return !decoded || decoded->name == attribute->name;
+      }), decoded_attributes_.end());
+  decoded_attributes_.push_back(std::move(attribute));
+  if (decoded_attributes_.size() > kMaxDecodedAttributes) {
+    decoded_attributes_.erase(decoded_attributes_.begin(),
+        decoded_attributes_.end() - kMaxDecodedAttributes);
+  }
+}
+
+void PointCloud::SetColormapScaling(ColormapScaling scaling) {
+  colormap_scaling_ = scaling;
+  if (resident_attribute_.empty() || resident_rgb_) {
+    return;
+  }
+  if (!attribute_colormap_) {
+    attribute_colormap_.reset(new Colormap);
+  }
+  attribute_colormap_->Update(attribute_histogram_, scaling);
+  scalar_range_ = attribute_colormap_->range();
+}
+
+void PointCloud::UploadAttribute(const PointAttribute &attribute) {
+  TRACE_SCOPE("PointCloud::UploadAttribute");
+  ReleaseAttribute();
+  glGenBuffers(1, &attribute_vbo_);
+  glBindVertexArray(vao_);
+  glBindBuffer(GL_ARRAY_BUFFER, attribute_vbo_);
+  glBufferData(GL_ARRAY_BUFFER,
+      static_cast<GLsizeiptr>(attribute.values.size() * sizeof(float)),
+      attribute.values.data(), GL_STATIC_DRAW);
+  if (attribute.rgb) {
+    // 0x00RRGGBB words are B, G, R, 0 bytes in memory
+    glEnableVertexAttribArray(kColorAttrib);
+    glVertexAttribPointer(kColorAttrib, GL_BGRA, GL_UNSIGNED_BYTE, GL_TRUE,
+        0, 0);
+  } else {
+    glEnableVertexAttribArray(kScalarAttrib);
+    glVertexAttribPointer(kScalarAttrib, 1, GL_FLOAT, GL_FALSE, 0, 0);
+  }
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  resident_attribute_ = attribute.name;
+  resident_rgb_ = attribute.rgb;
+  std::cout << "coloring by " << attribute.name;
+  if (!attribute.rgb) {
+    attribute_histogram_ = attribute.histogram;
+    SetColormapScaling(colormap_scaling_);
+    std::cout << " in [" << attribute_histogram_.min() << ", "
+        << attribute_histogram_.max() << "], colormap over ["
+        << scalar_range_.x() << ", " << scalar_range_.y() << "]";
+  }
+  std::cout << ", attribute buffer "
+      << attribute.values.size() * sizeof(float) / (1024.0 * 1024.0)
+      << " MB\n";
+}
+
+void PointCloud::ReleaseAttribute() {
+  if (attribute_vbo_ == 0) {
+    return;
+  }
+  glBindVertexArray(vao_);
+  glDisableVertexAttribArray(kColorAttrib);
+  glDisableVertexAttribArray(kScalarAttrib);
+  glBindVertexArray(0);
+  glDeleteBuffers(1, &attribute_vbo_);
+  attribute_vbo_ = 0;
+  resident_attribute_.clear();
+  resident_rgb_ = false;
+  attribute_histogram_.Clear();
+}
+
+void PointCloud::ReportLoad(const std::string &filepath,
+    const char *loader_name,
+    std::chrono::steady_clock::time_point start_time) const {
+  const double elapsed_ms = std::chrono::duration<double, std::milli>(
+      std::chrono::steady_clock::now() - start_time).count();
+  std::cout << "loaded " << num_points_ << " points from " << filepath
+      << " (" << loader_name << " loader): " << elapsed_ms << " ms, peak RSS "
+      << PeakRssMegaBytes() << " MB, vertex buffer "
+      << static_cast<double>(num_points_) * stride_ / (1024.0 * 1024.0)
+      << " MB\n";
+  if (quantize_positions_) {
+    std::cout << "positions quantized to 16 bits, max error "
+        << max_quantization_error_ << "\n";
+  }
+}
+
+void PointCloud::AppendChunks(const float *xyz, std::size_t stride,
+    std::size_t first, std::size_t count) {
+  for (std::size_t begin = 0; begin < count; begin += kCullChunkPoints) {
+    const std::size_t end = std::min(count, begin + kCullChunkPoints);
+    Eigen::AlignedBox3f bounds;
+    for (std::size_t i = begin; i < end; ++i) {
+      bounds.extend(Eigen::Map<const Eigen::Vector3f>(xyz + i * stride));
+    }
+    chunks_.push_back(MakeChunk(first + begin, end - begin, bounds));
+    chunk_bounds_.Add(bounds);
+    bounds_.extend(bounds);
+  }
+}
+
+void PointCloud::UploadChunks(std::size_t chunk_begin, const float *xyz,
+    std::size_t stride) {
+  if (chunk_begin >= chunks_.size()) {
+    return;
+  }
+  TRACE_SCOPE("glBufferSubData");
+  const std::size_t base = chunks_[chunk_begin].first;
+  const std::size_t count = chunks_.back().first + chunks_.back().count - base;
+  height_histogram_.Add(xyz + 2, stride, count);
+  glBindBuffer(GL_ARRAY_BUFFER, vbo_);
+  for (std::size_t i = chunk_begin; i < chunks_.size(); ++i) {
+    const PointChunk &chunk = chunks_[i];
+    const void *data = EncodeChunk(chunk,
+        xyz + (chunk.first - base) * stride, stride);
+    glBufferSubData(GL_ARRAY_BUFFER,
+        static_cast<GLintptr>(chunk.first) * stride_,
+        static_cast<GLsizeiptr>(chunk.count) * stride_, data);
+  }
+  num_resident_chunks_ = chunks_.size();
+}
+
+const void* PointCloud::EncodeChunk(const PointChunk &chunk, const float *xyz,
+    std::size_t stride) {
+  if (!quantize_positions_) {
+    return xyz;
+  }
+
+  encode_buffer_.resize(chunk.count * 3);
+  const float max_error = QuantizePositions(xyz, stride, chunk.count,
+      chunk.offset, chunk.scale, encode_buffer_.data());
+  max_quantization_error_ = std::max(max_quantization_error_, max_error);
+  return encode_buffer_.data();
+}
+
+void PointCloud::AllocateBuffer(GLsizeiptr size, const void *data) {
   glGenVertexArrays(1, &vao_);
   glBindVertexArray(vao_);
 
   glGenBuffers(1, &vbo_);
   glBindBuffer(GL_ARRAY_BUFFER, vbo_);
-  glBufferData(GL_ARRAY_BUFFER, num_points_ * stride_,
-      cloud->points.data(), GL_STATIC_DRAW);
+  glBufferData(GL_ARRAY_BUFFER, size, data, GL_STATIC_DRAW);
+  SetupVertexArray();
+}
 
-  return true;
+void PointCloud::SetupVertexArray() {
+  glBindVertexArray(vao_);
+  glBindBuffer(GL_ARRAY_BUFFER, vbo_);
+  glEnableVertexAttribArray(kPositionAttrib);
+  if (quantize_positions_) {
+    glVertexAttribPointer(kPositionAttrib, 3, GL_UNSIGNED_SHORT, GL_TRUE,
+        stride_, 0);
+  } else {
+    glVertexAttribPointer(kPositionAttrib, 3, GL_FLOAT, GL_FALSE, stride_, 0);
+  }
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
 }  // namespace ogl_viewer
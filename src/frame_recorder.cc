@@ -0,0 +1,333 @@
+#include "frame_recorder.h"
+
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <utility>
+
+#include "png_writer.h"
+#include "tracer.h"
+
+namespace ogl_viewer {
+
+namespace {
+
+// readbacks in flight; each takes one or two frames to come back
+const int kFrameReadbacks = 3;
+// PNG encoding takes longer than a frame, so two frames are encoded at once
+const int kWriterThreads = 2;
+// pixels waiting for the writers, beyond which recorded frames are dropped
+const std::size_t kMaxQueuedBytes = std::size_t(256) << 20;
+// of the waits for a fence in Capture and Finish
+const GLuint64 kFenceTimeoutNs = 100000000;
+
+void WaitForFence(GLsync fence) {
+  while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+      kFenceTimeoutNs) == GL_TIMEOUT_EXPIRED) {
+  }
+}
+
+}  // namespace
+
+bool ParseRecordFormat(const std::string &name, RecordFormat *format) {
+  if (name == "png") {
+    *format = RecordFormat::kPng;
+  } else if (name == "raw") {
+    *format = RecordFormat::kRaw;
+  } else {
+    std::cerr << "error : unknown record format " << name
+        << ", expected png or raw\n";
+    return false;
+  }
+  return true;
+}
+
+FrameRecorder::FrameRecorder()
+    : readbacks_(kFrameReadbacks), writers_(new ThreadPool(kWriterThreads)) {
+  for (Readback &readback : readbacks_) {
+    glGenBuffers(1, &readback.buffer);
+  }
+}
+
+FrameRecorder::~FrameRecorder() {
+  StopRecording();
+  Finish();
+  for (Readback &readback : readbacks_) {
+    glDeleteBuffers(1, &readback.buffer);
+  }
+  writers_.reset();
+}
+
+FrameRecorder::Recording::~Recording() {
+  std::cout << "recorded " << frames_written << " frames to " << prefix
+      << (format == RecordFormat::kRaw ? ".rgba" : "######.png");
+  if (frames_dropped > 0) {
+    std::cout << ", dropped " << frames_dropped
+        << " the writers could not keep up with";
+  }
+  std::cout << "\n";
+  if (raw_file != nullptr) {
+    std::fclose(raw_file);
+    if (frames_written > 0) {
+      std::cout << "encode with: ffmpeg -f rawvideo -pixel_format rgba "
+          << "-video_size " << raw_size.x() << "x" << raw_size.y()
+          << " -framerate 30 -i " << prefix << ".rgba -vf vflip "
+          << prefix << ".mp4\n";
+    }
+  }
+}
+
+bool FrameRecorder::StartRecording(const std::string &prefix,
+    RecordFormat format) {
+  StopRecording();
+  FILE *raw_file = nullptr;
+  if (format == RecordFormat::kRaw) {
+    const std::string path = prefix + ".rgba";
+    raw_file = std::fopen(path.c_str(), "wb");
+    if (raw_file == nullptr) {
+      std::cerr << "error : failed to open " << path << "\n";
+      return false;
+    }
+  }
+  recording_ = std::make_shared<Recording>();
+  recording_->prefix = prefix;
+  recording_->format = format;
+  recording_->raw_file = raw_file;
+  std::cout << "recording to " << prefix
+      << (format == RecordFormat::kRaw ? ".rgba" : "######.png") << "\n";
+  return true;
+}
+
+void FrameRecorder::StopRecording() {
+  // frames captured before count in, as they were drawn while recording;
+  // the readbacks and writes in flight hold on to the recording until the
+  // last of them closes it
+  recording_.reset();
+}
+
+void FrameRecorder::RequestScreenshot(const std::string &path) {
+  screenshot_paths_.push_back(path);
+}
+
+void FrameRecorder::Capture(GLuint framebuffer, const Eigen::Vector2i &size) {
+  if (!wants_capture() || (size.array() <= 0).any()) {
+    return;
+  }
+  TRACE_SCOPE("FrameRecorder::Capture");
+  Readback *readback = nullptr;
+  for (Readback &candidate : readbacks_) {
+    if (candidate.fence == nullptr) {
+      readback = &candidate;
+      break;
+    }
+  }
+  if (readback == nullptr) {
+    // the GPU is a whole ring behind, frames are not skipped for that
+    readback = Oldest();
+    WaitForFence(readback->fence);
+    Submit(readback, false);
+  }
+
+  const std::size_t bytes = 4 * static_cast<std::size_t>(size.prod());
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, readback->buffer);
+  if (readback->capacity < bytes) {
+    glBufferData(GL_PIXEL_PACK_BUFFER, bytes, nullptr, GL_STREAM_READ);
+    readback->capacity = bytes;
+  }
+  // into the bound pack buffer, so glReadPixels returns without waiting
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+  glReadBuffer(GL_COLOR_ATTACHMENT0);
+  glReadPixels(0, 0, size.x(), size.y(), GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  readback->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  readback->sequence = next_sequence_++;
+  readback->size = size;
+  readback->recording = recording_;
+  readback->screenshot_paths.swap(screenshot_paths_);
+  screenshot_paths_.clear();
+}
+
+void FrameRecorder::Poll() {
+  // in the order of capture, stopping at the first still in flight
+  Readback *readback = Oldest();
+  while (readback != nullptr &&
+      glClientWaitSync(readback->fence, 0, 0) != GL_TIMEOUT_EXPIRED) {
+    TRACE_SCOPE("FrameRecorder::Poll");
+    Submit(readback, false);
+    readback = Oldest();
+  }
+}
+
+bool FrameRecorder::pending() const {
+  for (const Readback &readback : readbacks_) {
+    if (readback.fence != nullptr) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void FrameRecorder::Finish() {
+  for (Readback *readback = Oldest(); readback != nullptr;
+      readback = Oldest()) {
+    WaitForFence(readback->fence);
+    Submit(readback, true);
+  }
+  std::unique_lock<std::mutex> lock(mutex_);
+  written_.wait(lock, [this]() { return queued_jobs_ == 0; });
+}
+
+RecordStats FrameRecorder::stats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+FrameRecorder::Readback* FrameRecorder::Oldest() {
+  Readback *oldest = nullptr;
+  for (Readback &readback : readbacks_) {
+    if (readback.fence != nullptr &&
+        (oldest == nullptr || readback.sequence < oldest->sequence)) {
+      oldest = &readback;
+    }
+  }
+  return oldest;
+}
+
+void FrameRecorder::Submit(Readback *readback, bool wait) {
+  glDeleteSync(readback->fence);
+  readback->fence = nullptr;
+  const std::size_t bytes = 4 * static_cast<std::size_t>(
+      readback->size.prod());
+
+  std::shared_ptr<Job> job = std::make_shared<Job>();
+  job->size = readback->size;
+  job->screenshot_paths.swap(readback->screenshot_paths);
+  std::shared_ptr<Recording> recording;
+  recording.swap(readback->recording);
+  bool record = recording != nullptr;
+  if (record && recording->format == RecordFormat::kRaw &&
+      !recording->raw_size.isZero() &&
+      readback->size != recording->raw_size) {
+    // a raw stream has a single frame size
+    record = false;
+  } else if (record) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (wait) {
+      written_.wait(lock, [this, bytes]() {
+        return queued_jobs_ == 0 || queued_bytes_ + bytes <= kMaxQueuedBytes;
+      });
+    }
+    record = queued_bytes_ + bytes <= kMaxQueuedBytes || queued_jobs_ == 0;
+  }
+  if (recording && !record) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++stats_.frames_dropped;
+    ++recording->frames_dropped;
+  }
+  if (!record && job->screenshot_paths.empty()) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!free_pixels_.empty()) {
+      job->pixels.swap(free_pixels_.back());
+      free_pixels_.pop_back();
+    }
+  }
+  job->pixels.resize(bytes);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, readback->buffer);
+  const void *data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bytes,
+      GL_MAP_READ_BIT);
+  if (data == nullptr) {
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    std::cerr << "error : failed to map a frame readback.\n";
+    return;
+  }
+  std::memcpy(job->pixels.data(), data, bytes);
+  glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  // numbered only once they are sure to be written, raw frames are
+  // appended in this order
+  if (record && recording->format == RecordFormat::kRaw) {
+    recording->raw_size = readback->size;
+    job->raw_frame = recording->next_frame++;
+    job->recording = recording;
+  } else if (record) {
+    std::ostringstream path;
+    path << recording->prefix << std::setw(6) << std::setfill('0')
+        << recording->next_frame++ << ".png";
+    job->frame_path = path.str();
+    job->recording = recording;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queued_bytes_ += bytes;
+    ++queued_jobs_;
+  }
+  writers_->Submit([this, job]() { Write(job); });
+}
+
+void FrameRecorder::Write(const std::shared_ptr<Job> &job) {
+  TRACE_SCOPE("FrameRecorder::Write");
+  std::size_t screenshots = 0;
+  for (const std::string &path : job->screenshot_paths) {
+    if (WritePng(path, job->pixels.data(), job->size.x(), job->size.y(),
+        true)) {
+      std::cout << "screenshot written to " << path << "\n";
+      ++screenshots;
+    }
+  }
+  bool written = false;
+  if (!job->frame_path.empty()) {
+    written = WritePng(job->frame_path, job->pixels.data(), job->size.x(),
+        job->size.y(), true);
+  } else if (job->raw_frame >= 0) {
+    written = AppendRawFrame(*job);
+  }
+
+  std::shared_ptr<Recording> recording;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.screenshots_written += screenshots;
+    if (written) {
+      ++stats_.frames_written;
+      ++job->recording->frames_written;
+    }
+    recording.swap(job->recording);
+  }
+  // the last frame of a stopped recording closes it, before Finish returns
+  recording.reset();
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  queued_bytes_ -= job->pixels.size();
+  --queued_jobs_;
+  if (free_pixels_.size() < static_cast<std::size_t>(kFrameReadbacks)) {
+    free_pixels_.push_back(std::move(job->pixels));
+  }
+  written_.notify_all();
+}
+
+bool FrameRecorder::AppendRawFrame(const Job &job) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  // the frame before is on the other writer thread or written already
+  Recording *recording = job.recording.get();
+  written_.wait(lock, [recording, &job]() {
+    return recording->next_raw_frame == job.raw_frame;
+  });
+  lock.unlock();
+  const bool written = std::fwrite(job.pixels.data(), 1, job.pixels.size(),
+      recording->raw_file) == job.pixels.size();
+  if (!written) {
+    std::cerr << "error : failed to append frame " << job.raw_frame
+        << " to the recording.\n";
+  }
+  lock.lock();
+  ++recording->next_raw_frame;
+  written_.notify_all();
+  return written;
+}
+
+}  // namespace ogl_viewer
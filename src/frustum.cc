@@ -0,0 +1,102 @@
+#include "frustum.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace ogl_viewer {
+
+void BoxArray::Clear() {
+  min_x.clear();
+  min_y.clear();
+  min_z.clear();
+  max_x.clear();
+  max_y.clear();
+  max_z.clear();
+}
+
+void BoxArray::Add(const Eigen::AlignedBox3f &box) {
+  min_x.push_back(box.min().x());
+  min_y.push_back(box.min().y());
+  min_z.push_back(box.min().z());
+  max_x.push_back(box.max().x());
+  max_y.push_back(box.max().y());
+  max_z.push_back(box.max().z());
+}
+
+Frustum::Frustum(const Eigen::Matrix4f &view_projection) {
+  // Gribb & Hartmann: the clip planes are sums/differences of the rows
+  const Eigen::Vector4f row3 = view_projection.row(3).transpose();
+  for (int i = 0; i < 3; ++i) {
+    const Eigen::Vector4f row = view_projection.row(i).transpose();
+    planes_[i * 2] = row3 + row;
+    planes_[i * 2 + 1] = row3 - row;
+  }
+  for (auto &plane : planes_) {
+    plane /= plane.head<3>().norm();
+  }
+}
+
+bool Frustum::Intersects(const Eigen::AlignedBox3f &box) const {
+  for (const auto &plane : planes_) {
+    // the box corner furthest along the plane normal
+    const Eigen::Vector3f p(
+        plane.x() >= 0.f ? box.max().x() : box.min().x(),
+        plane.y() >= 0.f ? box.max().y() : box.min().y(),
+        plane.z() >= 0.f ? box.max().z() : box.min().z());
+    if (plane.head<3>().dot(p) + plane.w() < 0.f) {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::size_t Frustum::CullBoxes(const BoxArray &boxes,
+    std::vector<uint8_t> *visible) const {
+  const std::size_t num_boxes = boxes.size();
+  visible->assign(num_boxes, 1);
+  std::size_t i = 0;
+
+#if defined(__SSE2__)
+  for (; i + 4 <= num_boxes; i += 4) {
+    __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    for (const auto &plane : planes_) {
+      const __m128 px = _mm_loadu_ps(plane.x() >= 0.f ?
+          &boxes.max_x[i] : &boxes.min_x[i]);
+      const __m128 py = _mm_loadu_ps(plane.y() >= 0.f ?
+          &boxes.max_y[i] : &boxes.min_y[i]);
+      const __m128 pz = _mm_loadu_ps(plane.z() >= 0.f ?
+          &boxes.max_z[i] : &boxes.min_z[i]);
+      __m128 dist = _mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(plane.x())),
+          _mm_set1_ps(plane.w()));
+      dist = _mm_add_ps(dist, _mm_mul_ps(py, _mm_set1_ps(plane.y())));
+      dist = _mm_add_ps(dist, _mm_mul_ps(pz, _mm_set1_ps(plane.z())));
+      inside = _mm_and_ps(inside, _mm_cmpge_ps(dist, _mm_setzero_ps()));
+    }
+    const int mask = _mm_movemask_ps(inside);
+    for (int k = 0; k < 4; ++k) {
+      (*visible)[i + k] = (mask >> k) & 1;
+    }
+  }
+#endif
+
+  for (; i < num_boxes; ++i) {
+    for (const auto &plane : planes_) {
+      const float px = plane.x() >= 0.f ? boxes.max_x[i] : boxes.min_x[i];
+      const float py = plane.y() >= 0.f ? boxes.max_y[i] : boxes.min_y[i];
+      const float pz = plane.z() >= 0.f ? boxes.max_z[i] : boxes.min_z[i];
+      if (plane.x() * px + plane.y() * py + plane.z() * pz + plane.w() < 0.f) {
+        (*visible)[i] = 0;
+        break;
+      }
+    }
+  }
+
+  std::size_t num_visible = 0;
+  for (uint8_t v : *visible) {
+    num_visible += v;
+  }
+  return num_visible;
+}
+
+}  // namespace ogl_viewer
@@ -0,0 +1,302 @@
+#include "gizmo_batch.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "tracer.h"
+
+namespace ogl_viewer {
+
+namespace {
+
+// half the thickness of the gizmo segments, in units of the shape
+const float kAxesHalfWidth = 0.01f;
+const float kBoxHalfWidth = 0.01f;
+
+struct ShapeVertex {
+  float position[3];
+  float color[4];
+};
+
+// a segment as two crossed ribbons of two triangles each side, the same
+// shape as the segments of CoordinateAxes
+void AppendSegment(const Eigen::Vector3f &from, const Eigen::Vector3f &to,
+    const Eigen::Vector4f &color, float half_width,
+    std::vector<ShapeVertex> *vertices, std::vector<uint32_t> *indices) {
+  const Eigen::Vector3f direction = to - from;
+  const Eigen::Vector3f axis =
+      std::abs(direction.normalized().dot(Eigen::Vector3f::UnitZ())) < 0.9f ?
+      Eigen::Vector3f::UnitZ() : Eigen::Vector3f::UnitX();
+  const Eigen::Vector3f local_x = axis.cross(direction).normalized();
+  const Eigen::Vector3f local_y = local_x.cross(direction).normalized();
+  const Eigen::Vector3f offsets[4] = {
+      -local_x * half_width, local_x * half_width,
+      -local_y * half_width, local_y * half_width};
+
+  const uint32_t base = static_cast<uint32_t>(vertices->size());
+  for (const Eigen::Vector3f &offset : offsets) {
+    for (const Eigen::Vector3f &end : {from, to}) {
+      ShapeVertex vertex;
+      Eigen::Map<Eigen::Vector3f>(vertex.position) = end + offset;
+      Eigen::Map<Eigen::Vector4f>(vertex.color) = color;
+      vertices->push_back(vertex);
+    }
+  }
+  static const uint32_t kSegmentIndices[] = {
+      0, 1, 4,  1, 5, 4,  4, 5, 2,  5, 3, 2,
+      2, 3, 6,  3, 6, 7,  6, 7, 0,  7, 1, 0};
+  for (uint32_t index : kSegmentIndices) {
+    indices->push_back(base + index);
+  }
+}
+
+uint32_t PackColor(const Eigen::Vector4f &color) {
+  uint32_t packed = 0;
+  for (int k = 0; k < 4; ++k) {
+    const float value = std::max(0.f, std::min(1.f, color[k]));
+    packed |= static_cast<uint32_t>(std::lround(value * 255.f)) << (8 * k);
+  }
+  return packed;
+}
+
+// the numbers of a line, false for blank lines and comments
+bool ReadValues(const std::string &line, std::vector<double> *values) {
+  values->clear();
+  const std::size_t begin = line.find_first_not_of(" \t\r");
+  if (begin == std::string::npos || line[begin] == '#') {
+    return false;
+  }
+  std::istringstream iss(line);
+  double value = 0.0;
+  while (iss >> value) {
+    values->push_back(value);
+  }
+  if (!iss.eof()) {
+    // not a number
+    values->clear();
+  }
+  return true;
+}
+
+}  // namespace
+
+GizmoBatch::GizmoBatch(GizmoShape shape, int pick_id) : pick_id_(pick_id) {
+  glGenBuffers(1, &shape_vbo_);
+  glGenBuffers(1, &shape_ebo_);
+  BuildShape(shape);
+
+  glGenVertexArrays(2, vaos_);
+  glGenBuffers(2, instance_vbos_);
+  for (int i = 0; i < 2; ++i) {
+    glBindVertexArray(vaos_[i]);
+    glBindBuffer(GL_ARRAY_BUFFER, shape_vbo_);
+    glEnableVertexAttribArray(kPositionAttrib);
+    glVertexAttribPointer(kPositionAttrib, 3, GL_FLOAT, GL_FALSE,
+        sizeof(ShapeVertex), 0);
+    glEnableVertexAttribArray(kColorAttrib);
+    glVertexAttribPointer(kColorAttrib, 4, GL_FLOAT, GL_FALSE,
+        sizeof(ShapeVertex),
+        reinterpret_cast<const void*>(offsetof(ShapeVertex, color)));
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, shape_ebo_);
+
+    // advanced once per instance instead of per vertex
+    glBindBuffer(GL_ARRAY_BUFFER, instance_vbos_[i]);
+    for (int row = 0; row < 3; ++row) {
+      const GLuint location = kInstanceTransformAttrib + row;
+      glEnableVertexAttribArray(location);
+      glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE,
+          sizeof(GizmoInstance),
+          reinterpret_cast<const void*>(row * 4 * sizeof(float)));
+      glVertexAttribDivisor(location, 1);
+    }
+    glEnableVertexAttribArray(kInstanceColorAttrib);
+    glVertexAttribPointer(kInstanceColorAttrib, 4, GL_UNSIGNED_BYTE, GL_TRUE,
+        sizeof(GizmoInstance),
+        reinterpret_cast<const void*>(offsetof(GizmoInstance, color)));
+    glVertexAttribDivisor(kInstanceColorAttrib, 1);
+  }
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+GizmoBatch::~GizmoBatch() {
+  glDeleteVertexArrays(2, vaos_);
+  glDeleteBuffers(2, instance_vbos_);
+  glDeleteBuffers(1, &shape_vbo_);
+  glDeleteBuffers(1, &shape_ebo_);
+}
+
+void GizmoBatch::BuildShape(GizmoShape shape) {
+  std::vector<ShapeVertex> vertices;
+  std::vector<uint32_t> indices;
+  if (shape == GizmoShape::kAxes) {
+    for (int k = 0; k < 3; ++k) {
+      Eigen::Vector4f color(0.f, 0.f, 0.f, 1.f);
+      color[k] = 1.f;
+      AppendSegment(Eigen::Vector3f::Zero(), Eigen::Vector3f::Unit(k), color,
+          kAxesHalfWidth, &vertices, &indices);
+    }
+  } else {
+    // white, the instance color shows as it is
+    const Eigen::Vector4f color = Eigen::Vector4f::Ones();
+    for (int k = 0; k < 3; ++k) {
+      // the four edges along axis k
+      for (int corner = 0; corner < 4; ++corner) {
+        Eigen::Vector3f from = Eigen::Vector3f::Constant(-0.5f);
+        from[(k + 1) % 3] = (corner & 1) ? 0.5f : -0.5f;
+        from[(k + 2) % 3] = (corner & 2) ? 0.5f : -0.5f;
+        Eigen::Vector3f to = from;
+        to[k] = 0.5f;
+        AppendSegment(from, to, color, kBoxHalfWidth, &vertices, &indices);
+      }
+    }
+  }
+  num_indices_ = static_cast<GLsizei>(indices.size());
+
+  glBindBuffer(GL_ARRAY_BUFFER, shape_vbo_);
+  glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(ShapeVertex),
+      vertices.data(), GL_STATIC_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  // no VAO is bound, so the element buffer binding is not recorded
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, shape_ebo_);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint32_t),
+      indices.data(), GL_STATIC_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+void GizmoBatch::Enqueue(GLSLShader *shader, RenderQueue *queue) const {
+  if (drawn_instances_.empty()) {
+    return;
+  }
+  DrawItem item;
+  item.shader = shader;
+  item.vao = vaos_[front_];
+  item.mode = GL_TRIANGLES;
+  item.indexed = true;
+  item.count = num_indices_;
+  item.index_type = GL_UNSIGNED_INT;
+  item.instance_count = static_cast<GLsizei>(drawn_instances_.size());
+  // vertex colors times instance colors, instance transforms
+  item.color_mode = 6;
+  item.model_matrix = model_matrix_;
+  item.pick_id = pick_id_;
+  queue->Submit(item);
+}
+
+void GizmoBatch::Add(const Eigen::Affine3f &transform,
+    const Eigen::Vector4f &color) {
+  GizmoInstance instance;
+  for (int r = 0; r < 3; ++r) {
+    for (int c = 0; c < 4; ++c) {
+      instance.rows[r * 4 + c] = transform.matrix()(r, c);
+    }
+  }
+  instance.color = PackColor(color);
+  instances_.push_back(instance);
+}
+
+void GizmoBatch::Upload() {
+  TRACE_SCOPE("GizmoBatch::Upload");
+  // the front buffer may still be read by the last frame's draw
+  const int back = 1 - front_;
+  glBindBuffer(GL_ARRAY_BUFFER, instance_vbos_[back]);
+  const GLsizeiptr size = instances_.size() * sizeof(GizmoInstance);
+  glBufferData(GL_ARRAY_BUFFER, size, nullptr, GL_STREAM_DRAW);
+  if (size > 0) {
+    glBufferSubData(GL_ARRAY_BUFFER, 0, size, instances_.data());
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  front_ = back;
+  // the vectors trade places, the next frame's instances reuse the storage
+  // of the last ones
+  drawn_instances_.swap(instances_);
+  instances_.clear();
+}
+
+bool GizmoBatch::LookupInstance(int instance,
+    Eigen::Affine3f *transform) const {
+  // as drawn; instances_ already collects those of the next Upload
+  if (instance < 0 ||
+      static_cast<std::size_t>(instance) >= drawn_instances_.size()) {
+    return false;
+  }
+  const float *rows = drawn_instances_[instance].rows;
+  transform->matrix().setIdentity();
+  for (int r = 0; r < 3; ++r) {
+    for (int c = 0; c < 4; ++c) {
+      transform->matrix()(r, c) = rows[r * 4 + c];
+    }
+  }
+  return true;
+}
+
+bool LoadPoseFile(const std::string &path,
+    std::vector<Eigen::Affine3f,
+        Eigen::aligned_allocator<Eigen::Affine3f>> *poses) {
+  std::ifstream ifs(path);
+  if (!ifs) {
+    std::cerr << "error : failed to open " << path << "\n";
+    return false;
+  }
+  poses->clear();
+  std::string line;
+  std::vector<double> values;
+  for (int line_number = 1; std::getline(ifs, line); ++line_number) {
+    if (!ReadValues(line, &values)) {
+      continue;
+    }
+    if (values.size() != 7 && values.size() != 8) {
+      std::cerr << "error : " << path << ":" << line_number
+          << ": expected [t] x y z qx qy qz qw\n";
+      return false;
+    }
+    const double *v = &values[values.size() - 7];
+    const Eigen::Quaternionf rotation(v[6], v[3], v[4], v[5]);
+    Eigen::Affine3f pose = Eigen::Affine3f::Identity();
+    pose.translate(Eigen::Vector3f(v[0], v[1], v[2]));
+    pose.rotate(rotation.normalized());
+    poses->push_back(pose);
+  }
+  return true;
+}
+
+bool LoadBoxFile(const std::string &path,
+    std::vector<Eigen::Affine3f,
+        Eigen::aligned_allocator<Eigen::Affine3f>> *boxes,
+    std::vector<Eigen::Vector4f,
+        Eigen::aligned_allocator<Eigen::Vector4f>> *colors) {
+  std::ifstream ifs(path);
+  if (!ifs) {
+    std::cerr << "error : failed to open " << path << "\n";
+    return false;
+  }
+  boxes->clear();
+  colors->clear();
+  std::string line;
+  std::vector<double> values;
+  for (int line_number = 1; std::getline(ifs, line); ++line_number) {
+    if (!ReadValues(line, &values)) {
+      continue;
+    }
+    if (values.size() != 7 && values.size() != 10) {
+      std::cerr << "error : " << path << ":" << line_number
+          << ": expected cx cy cz length width height yaw [r g b]\n";
+      return false;
+    }
+    Eigen::Affine3f box = Eigen::Affine3f::Identity();
+    box.translate(Eigen::Vector3f(values[0], values[1], values[2]));
+    box.rotate(Eigen::AngleAxisf(values[6], Eigen::Vector3f::UnitZ()));
+    box.scale(Eigen::Vector3f(values[3], values[4], values[5]));
+    boxes->push_back(box);
+    colors->push_back(values.size() == 10 ?
+        Eigen::Vector4f(values[7], values[8], values[9], 1.f) :
+        Eigen::Vector4f(1.f, 0.8f, 0.1f, 1.f));
+  }
+  return true;
+}
+
+}  // namespace ogl_viewer
@@ -1,44 +1,205 @@
 #include "glsl_shader.h"
 
+#include <sys/stat.h>
+
+#include <cstdio>
+#include <cstring>
 #include <vector>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 
+#include "tracer.h"
+
 namespace ogl_viewer {
 
-bool GLSLShader::Init(const std::string& vertex_shader_filepath,
-    const std::string& fragment_shader_filepath) {
-  GLuint vertex_shader = LoadShaderFromFile(vertex_shader_filepath,
-      GL_VERTEX_SHADER);
-  GLuint fragment_shader = LoadShaderFromFile(fragment_shader_filepath,
-      GL_FRAGMENT_SHADER);
+namespace {
 
-  shader_program_ = glCreateProgram();
-  glAttachShader(shader_program_, vertex_shader);
-  glAttachShader(shader_program_, fragment_shader);
-  glLinkProgram(shader_program_);
+const char kBinaryMagic[8] = {'O', 'V', 'P', 'R', 'O', 'G', '1', '\0'};
 
-  glDeleteShader(vertex_shader);
-  glDeleteShader(fragment_shader);
+struct BinaryHeader {
+  char magic[8];
+  uint64_t key;
+  uint32_t format;
+  uint32_t size;
+};
 
-  GLint result = GL_FALSE;
-  int info_log_length = -1;
+uint64_t Fnv1a(const std::string &data, uint64_t hash) {
+  for (char c : data) {
+    hash ^= static_cast<uint8_t>(c);
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
 
-  glGetProgramiv(shader_program_, GL_LINK_STATUS, &result);
-  glGetProgramiv(shader_program_, GL_INFO_LOG_LENGTH, &info_log_length);
-  std::vector<char> error_message(info_log_length);
-  glGetProgramInfoLog(shader_program_, info_log_length, nullptr, error_message.data());
+int64_t FileMtimeNs(const std::string &filepath) {
+  struct stat st;
+  if (stat(filepath.c_str(), &st) != 0) {
+    return -1;
+  }
+#ifdef __APPLE__
+  const struct timespec &mtime = st.st_mtimespec;
+#else
+  const struct timespec &mtime = st.st_mtim;
+#endif
+  return static_cast<int64_t>(mtime.tv_sec) * 1000000000 + mtime.tv_nsec;
+}
 
-  if (result != GL_TRUE) {
-    std::cerr << "error : failed to link program.\n";
-    std::cerr << std::string(error_message.begin(), error_message.end()) << "\n";
+bool ReadFile(const std::string &filepath, std::string *content) {
+  std::ifstream ifs(filepath);
+  if (!ifs) {
+    std::cerr << "error: failed to open " << filepath << "\n";
     return false;
   }
+  std::stringstream ss;
+  ss << ifs.rdbuf();
+  *content = ss.str();
+  return true;
+}
 
+std::string GLString(GLenum name) {
+  const GLubyte *value = glGetString(name);
+  return value ? reinterpret_cast<const char*>(value) : "";
+}
+
+/** @brief rainbow.vert -> rainbow.glprog, in the same directory **/
+std::string ProgramBinaryPath(const std::string &vertex_shader_filepath) {
+  const std::size_t slash = vertex_shader_filepath.find_last_of('/');
+  const std::size_t dot = vertex_shader_filepath.find_last_of('.');
+  if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+    return vertex_shader_filepath + ".glprog";
+  }
+  return vertex_shader_filepath.substr(0, dot) + ".glprog";
+}
+
+bool ProgramBinarySupported() {
+  if (!GLEW_ARB_get_program_binary) {
+    return false;
+  }
+  GLint num_formats = 0;
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats);
+  return num_formats > 0;
+}
+
+}  // namespace
+
+GLSLShader::~GLSLShader() {
+  glDeleteProgram(shader_program_);
+}
+
+bool GLSLShader::Init(const std::string& vertex_shader_filepath,
+    const std::string& fragment_shader_filepath) {
+  TRACE_SCOPE("GLSLShader::Init");
+  vertex_shader_filepath_ = vertex_shader_filepath;
+  fragment_shader_filepath_ = fragment_shader_filepath;
+  glDeleteProgram(shader_program_);
+  shader_program_ = BuildProgram();
+  attrib_map_.clear();
+  uniform_map_.clear();
+  return shader_program_ != 0;
+}
+
+bool GLSLShader::ReloadIfChanged() {
+  if (vertex_shader_filepath_.empty() ||
+      (FileMtimeNs(vertex_shader_filepath_) == vertex_mtime_ns_ &&
+          FileMtimeNs(fragment_shader_filepath_) == fragment_mtime_ns_)) {
+    return false;
+  }
+  TRACE_SCOPE("GLSLShader::ReloadIfChanged");
+  const GLuint program = BuildProgram();
+  if (program == 0) {
+    std::cerr << "warning : keeping the previous program of "
+        << vertex_shader_filepath_ << "\n";
+    return false;
+  }
+
+  // uniform locations and values belong to the old program
+  glDeleteProgram(shader_program_);
+  shader_program_ = program;
+  attrib_map_.clear();
+  uniform_map_.clear();
+  std::cout << "reloaded " << vertex_shader_filepath_ << " and "
+      << fragment_shader_filepath_ << "\n";
   return true;
 }
 
+GLuint GLSLShader::BuildProgram() {
+  // taken before reading, so that a write racing the read triggers a reload
+  vertex_mtime_ns_ = FileMtimeNs(vertex_shader_filepath_);
+  fragment_mtime_ns_ = FileMtimeNs(fragment_shader_filepath_);
+  std::string vertex_source;
+  std::string fragment_source;
+  if (!ReadFile(vertex_shader_filepath_, &vertex_source) ||
+      !ReadFile(fragment_shader_filepath_, &fragment_source)) {
+    return 0;
+  }
+
+  // binaries are only valid for the driver that produced them
+  const bool use_binary = use_binary_cache_ && ProgramBinarySupported();
+  const std::string binary_path = ProgramBinaryPath(vertex_shader_filepath_);
+  uint64_t key = 14695981039346656037ull;
+  if (use_binary) {
+    key = Fnv1a(vertex_source, key);
+    key = Fnv1a(std::string(1, '\0') + fragment_source, key);
+    key = Fnv1a(std::string(1, '\0') + GLString(GL_VENDOR) + "\n" +
+        GLString(GL_RENDERER) + "\n" + GLString(GL_VERSION), key);
+  }
+
+  GLuint program = use_binary ? LoadProgramBinary(binary_path, key) : 0;
+  if (program == 0) {
+    GLuint vertex_shader = CompileShader(vertex_source,
+        vertex_shader_filepath_, GL_VERTEX_SHADER);
+    GLuint fragment_shader = CompileShader(fragment_source,
+        fragment_shader_filepath_, GL_FRAGMENT_SHADER);
+    if (vertex_shader == 0 || fragment_shader == 0) {
+      glDeleteShader(vertex_shader);
+      glDeleteShader(fragment_shader);
+      return 0;
+    }
+
+    program = glCreateProgram();
+    if (use_binary) {
+      glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT,
+          GL_TRUE);
+    }
+    glAttachShader(program, vertex_shader);
+    glAttachShader(program, fragment_shader);
+    glLinkProgram(program);
+
+    glDeleteShader(vertex_shader);
+    glDeleteShader(fragment_shader);
+
+    GLint result = GL_FALSE;
+    int info_log_length = 0;
+
+    glGetProgramiv(program, GL_LINK_STATUS, &result);
+    glGetProgramiv(program, GL_INFO_LOG_LENGTH, &info_log_length);
+    std::vector<char> error_message(info_log_length);
+    glGetProgramInfoLog(program, info_log_length, nullptr,
+        error_message.data());
+
+    if (result != GL_TRUE) {
+      std::cerr << "error : failed to link program.\n";
+      std::cerr << std::string(error_message.begin(), error_message.end())
+          << "\n";
+      glDeleteProgram(program);
+      return 0;
+    }
+    if (use_binary) {
+      SaveProgramBinary(binary_path, key, program);
+    }
+  }
+
+  // GLSL 330 has no binding layout qualifier for blocks, and the binding is
+  // not part of a program binary
+  const GLuint frame_block = glGetUniformBlockIndex(program, "FrameUniforms");
+  if (frame_block != GL_INVALID_INDEX) {
+    glUniformBlockBinding(program, frame_block, kFrameUniformsBinding);
+  }
+
+  return program;
+}
+
 GLint GLSLShader::GetAttribLocation(const std::string& name) {
   auto iter = attrib_map_.find(name);
   if (iter != attrib_map_.end()) {
@@ -69,23 +230,14 @@ GLint GLSLShader::GetUniformLocation(const std::string& name) {
   return id;
 }
 
-GLuint GLSLShader::LoadShaderFromFile(const std::string& filepath,
-    GLuint shader_type) {
+GLuint GLSLShader::CompileShader(const std::string& source,
+    const std::string& filepath, GLuint shader_type) {
   GLuint shader_id = glCreateShader(shader_type);
-  std::ifstream ifs(filepath);
-  if (!ifs) {
-    std::cerr << "error: failed to open " << filepath << "\n";
-    return GL_FALSE;
-  }
-
-  std::stringstream ss;
-  ss << ifs.rdbuf();
-  std::string shader_content = ss.str();
 
   GLint result = GL_FALSE;
   int info_log_length = 0;
 
-  char const* shader_content_ptr = shader_content.c_str();
+  char const* shader_content_ptr = source.c_str();
   glShaderSource(shader_id, 1, &shader_content_ptr, nullptr);
   glCompileShader(shader_id);
 
@@ -98,9 +250,75 @@ GLuint GLSLShader::LoadShaderFromFile(const std::string& filepath,
   if (result != GL_TRUE) {
     std::cerr << "error : failed to compile shader " << filepath << "\n";
     std::cerr << std::string(error_message.begin(), error_message.end()) << "\n";
+    glDeleteShader(shader_id);
+    return 0;
   }
 
   return shader_id;
 }
 
+GLuint GLSLShader::LoadProgramBinary(const std::string& path, uint64_t key) {
+  TRACE_SCOPE("GLSLShader::LoadProgramBinary");
+  std::ifstream ifs(path, std::ios::binary);
+  BinaryHeader header;
+  if (!ifs || !ifs.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+      std::memcmp(header.magic, kBinaryMagic, sizeof(kBinaryMagic)) != 0 ||
+      header.key != key) {
+    return 0;
+  }
+  std::vector<char> binary(header.size);
+  if (!ifs.read(binary.data(), binary.size())) {
+    return 0;
+  }
+
+  // a driver update may still reject the binary, then it is rebuilt
+  GLuint program = glCreateProgram();
+  glProgramBinary(program, header.format, binary.data(),
+      static_cast<GLsizei>(binary.size()));
+  GLint result = GL_FALSE;
+  glGetProgramiv(program, GL_LINK_STATUS, &result);
+  if (result != GL_TRUE) {
+    glDeleteProgram(program);
+    return 0;
+  }
+  return program;
+}
+
+void GLSLShader::SaveProgramBinary(const std::string& path, uint64_t key,
+    GLuint program) {
+  TRACE_SCOPE("GLSLShader::SaveProgramBinary");
+  GLint size = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &size);
+  if (size <= 0) {
+    return;
+  }
+  std::vector<char> binary(size);
+  GLenum format = 0;
+  glGetProgramBinary(program, size, nullptr, &format, binary.data());
+
+  BinaryHeader header = BinaryHeader();
+  std::memcpy(header.magic, kBinaryMagic, sizeof(kBinaryMagic));
+  header.key = key;
+  header.format = format;
+  header.size = static_cast<uint32_t>(size);
+
+  // written aside and renamed, so that a reader never sees a partial file
+  const std::string tmp_path = path + ".tmp";
+  {
+    std::ofstream ofs(tmp_path, std::ios::binary);
+    ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    ofs.write(binary.data(), binary.size());
+    if (!ofs) {
+      std::cerr << "warning : failed to write " << tmp_path << "\n";
+      ofs.close();
+      std::remove(tmp_path.c_str());
+      return;
+    }
+  }
+  if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+    std::cerr << "warning : failed to write " << path << "\n";
+    std::remove(tmp_path.c_str());
+  }
+}
+
 }  // namespace ogl_viewer
@@ -0,0 +1,87 @@
+#include "gpu_timer.h"
+
+namespace ogl_viewer {
+
+GpuTimer::GpuTimer()
+    : frame_ms_(kFrameHistory, 0.f), frame_pending_(kFrameHistory, 0) {
+}
+
+GpuTimer::~GpuTimer() {
+  for (const PendingQuery &pending : pending_) {
+    free_queries_.push_back(pending.query);
+  }
+  if (!free_queries_.empty()) {
+    glDeleteQueries(static_cast<GLsizei>(free_queries_.size()),
+        free_queries_.data());
+  }
+}
+
+void GpuTimer::BeginFrame() {
+  // queries finish in submission order, stop at the first pending one
+  while (!pending_.empty()) {
+    const PendingQuery &pending = pending_.front();
+    GLint available = 0;
+    glGetQueryObjectiv(pending.query, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available) {
+      break;
+    }
+    GLuint64 elapsed_ns = 0;
+    glGetQueryObjectui64v(pending.query, GL_QUERY_RESULT, &elapsed_ns);
+    if (frame_ - pending.frame < kFrameHistory) {
+      const int slot = pending.frame % kFrameHistory;
+      frame_ms_[slot] += elapsed_ns * 1e-6f;
+      --frame_pending_[slot];
+    }
+    // the GPU track is aligned on submission, only the duration is measured
+    if (Tracer::enabled()) {
+      Tracer::Global().AddEvent(pending.name, Tracer::kGpuThreadId,
+          pending.cpu_begin_us, static_cast<int64_t>(elapsed_ns / 1000));
+    }
+    free_queries_.push_back(pending.query);
+    pending_.pop_front();
+  }
+
+  ++frame_;
+  const int slot = frame_ % kFrameHistory;
+  frame_ms_[slot] = 0.f;
+  frame_pending_[slot] = 0;
+}
+
+void GpuTimer::Begin(const char *name) {
+  if (depth_++ > 0) {
+    return;
+  }
+  GLuint query = 0;
+  if (free_queries_.empty()) {
+    glGenQueries(1, &query);
+  } else {
+    query = free_queries_.back();
+    free_queries_.pop_back();
+  }
+  glBeginQuery(GL_TIME_ELAPSED, query);
+
+  PendingQuery pending;
+  pending.query = query;
+  pending.name = name;
+  pending.cpu_begin_us = Tracer::NowMicros();
+  pending.frame = frame_;
+  pending_.push_back(pending);
+  ++frame_pending_[frame_ % kFrameHistory];
+}
+
+void GpuTimer::End() {
+  if (depth_ == 0 || --depth_ > 0) {
+    return;
+  }
+  glEndQuery(GL_TIME_ELAPSED);
+}
+
+float GpuTimer::frame_ms(int age) const {
+  if (age < 0 || age >= kFrameHistory || static_cast<uint64_t>(age) > frame_) {
+    return -1.f;
+  }
+  const int slot = (frame_ - age) % kFrameHistory;
+  return frame_pending_[slot] > 0 ? -1.f : frame_ms_[slot];
+}
+
+}  // namespace ogl_viewer
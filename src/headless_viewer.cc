@@ -0,0 +1,316 @@
+#include "headless_viewer.h"
+
+#ifdef WITH_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+#include "tracer.h"
+
+namespace ogl_viewer {
+
+namespace {
+
+// frames rendered before measuring, they pay for shader and buffer warm-up
+const int kWarmupFrames = 10;
+// frames per second of the synthetic vehicles' motion
+const double kGizmoFrameRate = 30.0;
+
+// nearest-rank percentile of sorted values, p in [0, 100]
+double Percentile(const std::vector<double> &sorted, double p) {
+  if (sorted.empty()) {
+    return 0.0;
+  }
+  const std::size_t rank = static_cast<std::size_t>(
+      std::ceil(p / 100.0 * sorted.size()));
+  return sorted[std::min(std::max<std::size_t>(rank, 1), sorted.size()) - 1];
+}
+
+std::string JsonString(const std::string &value) {
+  std::string quoted = "\"";
+  for (char c : value) {
+    if (c == '"' || c == '\\') {
+      quoted += '\\';
+    }
+    quoted += (static_cast<unsigned char>(c) < 0x20) ? ' ' : c;
+  }
+  return quoted + "\"";
+}
+
+}  // namespace
+
+HeadlessViewer::~HeadlessViewer() {
+#ifdef WITH_EGL
+  if (egl_context_ == nullptr) {
+    return;
+  }
+  // GL objects have to go while the context is still alive
+  point_cloud_.reset();
+  mesh_.reset();
+  poses_.reset();
+  boxes_.reset();
+  polylines_.reset();
+  coord_axes_.reset();
+  shader_.reset();
+  render_queue_.reset();
+  height_colormap_.reset();
+  pick_buffer_.reset();
+  frame_recorder_.reset();
+  gpu_timer_.reset();
+  glDeleteFramebuffers(1, &fbo_);
+  glDeleteRenderbuffers(1, &color_buffer_);
+  glDeleteRenderbuffers(1, &depth_buffer_);
+
+  EGLDisplay display = static_cast<EGLDisplay>(egl_display_);
+  eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+  eglDestroyContext(display, static_cast<EGLContext>(egl_context_));
+  eglTerminate(display);
+#endif
+}
+
+bool HeadlessViewer::Init(const char* window_name, int width, int height,
+    const std::string &model_file_path, const char* glsl_version) {
+  window_name_ = window_name;
+  model_file_path_ = model_file_path;
+  if (!CreateContext()) {
+    return false;
+  }
+
+  glewExperimental = GL_TRUE;
+  const GLenum glew_status = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+  // a GLX build of GLEW complains about the missing X display only after
+  // loading the GL entry points
+  const bool glew_ok = glew_status == GLEW_OK ||
+      glew_status == GLEW_ERROR_NO_GLX_DISPLAY;
+#else
+  const bool glew_ok = glew_status == GLEW_OK;
+#endif
+  if (!glew_ok) {
+    std::cerr << "failed to init GLEW.\n";
+    return false;
+  }
+
+  if (!CreateFramebuffer(width, height)) {
+    return false;
+  }
+  load_start_time_ = std::chrono::steady_clock::now();
+  // nothing is selected in a benchmark, and indexing would take CPU time
+  // from the measured frames
+  options_.build_index = false;
+  return InitScene(width, height, model_file_path);
+}
+
+bool HeadlessViewer::CreateContext() {
+#ifdef WITH_EGL
+  EGLDisplay display = EGL_NO_DISPLAY;
+#ifdef EGL_PLATFORM_SURFACELESS_MESA
+  // no X or Wayland server involved
+  PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+      reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+          eglGetProcAddress("eglGetPlatformDisplayEXT"));
+  if (get_platform_display != nullptr) {
+    display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA,
+        EGL_DEFAULT_DISPLAY, nullptr);
+  }
+#endif
+  if (display == EGL_NO_DISPLAY) {
+    display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+  }
+  if (display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr)) {
+    std::cerr << "error : failed to initialize EGL.\n";
+    return false;
+  }
+  egl_display_ = display;
+
+  // the default surface type is window, which surfaceless displays lack
+  const EGLint config_attribs[] = {
+      EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+      EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+      EGL_NONE};
+  EGLConfig config;
+  EGLint num_configs = 0;
+  if (!eglChooseConfig(display, config_attribs, &config, 1, &num_configs) ||
+      num_configs == 0 || !eglBindAPI(EGL_OPENGL_API)) {
+    std::cerr << "error : no EGL config for desktop OpenGL.\n";
+    return false;
+  }
+
+  // OpenGL 3.3 core, as the windowed viewer
+  const EGLint context_attribs[] = {
+      EGL_CONTEXT_MAJOR_VERSION_KHR, 3,
+      EGL_CONTEXT_MINOR_VERSION_KHR, 3,
+      EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR,
+      EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+      EGL_NONE};
+  EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT,
+      context_attribs);
+  if (context == EGL_NO_CONTEXT) {
+    std::cerr << "error : failed to create an EGL context.\n";
+    return false;
+  }
+  egl_context_ = context;
+  if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+    std::cerr << "error : failed to make the EGL context current.\n";
+    return false;
+  }
+  return true;
+#else
+  std::cerr << "error : built without EGL, headless mode is unavailable.\n";
+  return false;
+#endif
+}
+
+bool HeadlessViewer::CreateFramebuffer(int width, int height) {
+  size_ = Eigen::Vector2i(width, height);
+  glGenRenderbuffers(1, &color_buffer_);
+  glBindRenderbuffer(GL_RENDERBUFFER, color_buffer_);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+  glGenRenderbuffers(1, &depth_buffer_);
+  glBindRenderbuffer(GL_RENDERBUFFER, depth_buffer_);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+  glGenFramebuffers(1, &fbo_);
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo_);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+      GL_RENDERBUFFER, color_buffer_);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+      GL_RENDERBUFFER, depth_buffer_);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    std::cerr << "error : incomplete offscreen framebuffer.\n";
+    return false;
+  }
+  return true;
+}
+
+bool HeadlessViewer::RunBenchmark(int num_frames,
+    const std::string &output_path) {
+  // uploads are part of the load time, not of the frame times
+  while (point_cloud_->loading() || point_cloud_->attribute_loading()) {
+    TRACE_SCOPE("Load");
+    point_cloud_->PumpUploads(options_.upload_bytes_per_frame);
+    point_cloud_->UpdateAttributes();
+    glFinish();
+    if (point_cloud_->loading() || point_cloud_->attribute_loading()) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+  const double load_ms = std::chrono::duration<double, std::milli>(
+      std::chrono::steady_clock::now() - load_start_time_).count();
+
+  const Eigen::AlignedBox3f &bounds = SceneBounds();
+  Eigen::Vector3f center = Eigen::Vector3f::Zero();
+  float radius = 1.f;
+  if (!bounds.isEmpty()) {
+    center = bounds.center();
+    radius = 0.5f * bounds.diagonal().norm();
+  }
+  OrbitCameraPath *path = new OrbitCameraPath(center, radius);
+  path->SetWindowSize(size_.x(), size_.y());
+  camera_control_.reset(path);
+
+  std::vector<double> frame_ms;
+  std::vector<double> points_drawn;
+  double gl_calls = 0.0;
+  double unsorted_gl_calls = 0.0;
+  for (int i = -kWarmupFrames; i < num_frames; ++i) {
+    TRACE_SCOPE("Frame");
+    BeginFrameStats();
+    path->SetTime(std::max(i, 0) / static_cast<float>(num_frames));
+    SetFrameCamera(path->GetViewMatrix(), path->GetProjectionMatrix());
+    const auto begin = std::chrono::steady_clock::now();
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo_);
+    glViewport(0, 0, size_.x(), size_.y());
+    glClearColor(0.5f, 0.5f, 0.5f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    // gizmos streamed every frame, as detections would be
+    UpdateOverlays(std::max(i, 0) / kGizmoFrameRate);
+    Draw();
+    if (i == num_frames - 1 && !options_.screenshot_path.empty()) {
+      frame_recorder_->RequestScreenshot(options_.screenshot_path);
+    }
+    // warm-up frames are not recorded
+    if (i >= 0) {
+      frame_recorder_->Capture(fbo_, size_);
+    }
+    frame_recorder_->Poll();
+    // nothing paces the frames, wait for the GPU to be done with this one
+    glFinish();
+    if (i < 0) {
+      continue;
+    }
+    frame_ms.push_back(std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - begin).count());
+    points_drawn.push_back(point_cloud_->render_stats().visible_points);
+    gl_calls += render_queue_->stats().gl_calls;
+    unsorted_gl_calls += render_queue_->stats().unsorted_gl_calls;
+  }
+
+  frame_recorder_->StopRecording();
+  frame_recorder_->Finish();
+  const RecordStats record_stats = frame_recorder_->stats();
+  WriteTrace();
+
+  std::vector<double> sorted = frame_ms;
+  std::sort(sorted.begin(), sorted.end());
+  const double frame_count = std::max<std::size_t>(frame_ms.size(), 1);
+  const double mean_ms =
+      std::accumulate(frame_ms.begin(), frame_ms.end(), 0.0) / frame_count;
+  const double mean_points = std::accumulate(points_drawn.begin(),
+      points_drawn.end(), 0.0) / frame_count;
+  const double max_points = points_drawn.empty() ? 0.0 :
+      *std::max_element(points_drawn.begin(), points_drawn.end());
+  const char *renderer =
+      reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+
+  std::ofstream ofs;
+  if (output_path != "-") {
+    ofs.open(output_path.c_str());
+    if (!ofs) {
+      std::cerr << "error : failed to open " << output_path << "\n";
+      return false;
+    }
+  }
+  std::ostream &os = output_path == "-" ? std::cout : ofs;
+  os << "{\n"
+      << "  \"model\": " << JsonString(model_file_path_) << ",\n"
+      << "  \"renderer\": " << JsonString(renderer ? renderer : "") << ",\n"
+      << "  \"width\": " << size_.x() << ",\n"
+      << "  \"height\": " << size_.y() << ",\n"
+      << "  \"lod\": " << (options_.use_lod ? "true" : "false") << ",\n"
+      << "  \"point_budget\": " << options_.point_budget << ",\n"
+      << "  \"quantize_positions\": "
+      << (options_.quantize_positions ? "true" : "false") << ",\n"
+      << "  \"colormap\": \""
+      << ColormapScalingName(options_.colormap_scaling) << "\",\n"
+      << "  \"gizmos\": "
+      << poses_->num_drawn() + boxes_->num_drawn() << ",\n"
+      << "  \"polyline_segments\": " << polylines_->num_segments() << ",\n"
+      << "  \"load_ms\": " << load_ms << ",\n"
+      << "  \"frames\": " << frame_ms.size() << ",\n"
+      << "  \"frame_ms\": {\"mean\": " << mean_ms
+      << ", \"p50\": " << Percentile(sorted, 50.0)
+      << ", \"p95\": " << Percentile(sorted, 95.0)
+      << ", \"p99\": " << Percentile(sorted, 99.0)
+      << ", \"max\": " << (sorted.empty() ? 0.0 : sorted.back()) << "},\n"
+      << "  \"points_drawn\": {\"mean\": " << mean_points
+      << ", \"max\": " << max_points << "},\n"
+      << "  \"gl_calls_per_frame\": " << gl_calls / frame_count << ",\n"
+      << "  \"unsorted_gl_calls_per_frame\": "
+      << unsorted_gl_calls / frame_count << ",\n"
+      << "  \"recorded_frames\": " << record_stats.frames_written << ",\n"
+      << "  \"dropped_frames\": " << record_stats.frames_dropped << "\n"
+      << "}\n";
+  return static_cast<bool>(os);
+}
+
+}  // namespace ogl_viewer
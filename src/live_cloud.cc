@@ -0,0 +1,137 @@
+#include "live_cloud.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include "tracer.h"
+
+namespace ogl_viewer {
+
+namespace {
+
+// wait between attempts to map the ring while there is no producer
+const std::chrono::milliseconds kReconnectInterval(500);
+// without new frames for this long, check whether the producer restarted
+const std::chrono::milliseconds kStaleInterval(1000);
+// uploads of the newest frame before a torn one is given up on
+const int kMaxFrameAttempts = 3;
+
+const char kLivePrefix[] = "shm:";
+
+}  // namespace
+
+bool IsLivePath(const std::string &path) {
+  return path.compare(0, sizeof(kLivePrefix) - 1, kLivePrefix) == 0;
+}
+
+std::string LiveRingName(const std::string &path) {
+  const std::string name = path.substr(sizeof(kLivePrefix) - 1);
+  return !name.empty() && name[0] == '/' ? name : "/" + name;
+}
+
+LiveCloud::LiveCloud(const std::string &ring_name)
+    : ring_name_(ring_name),
+      present_latency_ms_(kLatencyHistory, 0.f) {
+}
+
+void LiveCloud::Enqueue(GLSLShader *shader, RenderQueue *queue) const {
+  if (buffer_.num_points() == 0) {
+    return;
+  }
+  DrawItem item;
+  item.shader = shader;
+  item.vao = buffer_.vao();
+  item.mode = GL_POINTS;
+  item.count = static_cast<GLsizei>(buffer_.num_points());
+  item.color_mode = 0;
+  item.model_matrix = model_matrix_;
+  item.pick_id = kPickLive;
+  queue->Submit(item);
+}
+
+void LiveCloud::Update() {
+  TRACE_SCOPE("LiveCloud::Update");
+  const auto now = std::chrono::steady_clock::now();
+  if (!consumer_.is_open()) {
+    if (now - check_time_ < kReconnectInterval) {
+      return;
+    }
+    check_time_ = now;
+    if (!consumer_.Open(ring_name_)) {
+      return;
+    }
+    std::cout << "connected to " << ring_name_ << "\n";
+    frame_time_ = now;
+  }
+
+  ShmRingConsumer::Frame frame;
+  if (!consumer_.AcquireLatest(&frame)) {
+    if (now - frame_time_ > kStaleInterval &&
+        now - check_time_ > kStaleInterval) {
+      check_time_ = now;
+      if (consumer_.Stale()) {
+        std::cout << "producer of " << ring_name_ << " is gone\n";
+        consumer_.Close();
+      }
+    }
+    return;
+  }
+  frame_time_ = now;
+
+  for (int attempt = 1; ; ++attempt) {
+    // straight from the mapping, glBufferSubData copies before returning;
+    // the heights are read within the validated span as well
+    buffer_.Upload(frame.xyz, frame.num_points);
+    frame_histogram_.Clear();
+    frame_histogram_.Add(frame.xyz + 2, 3, frame.num_points);
+    if (consumer_.Validate(frame)) {
+      break;
+    }
+    // lapped by the producer: back to the frame shown, and on to the newer
+    // one that replaced the torn one
+    ++torn_frames_;
+    buffer_.Revert();
+    if (attempt == kMaxFrameAttempts || !consumer_.AcquireLatest(&frame)) {
+      return;
+    }
+  }
+  height_histogram_.Merge(frame_histogram_);
+  sequence_ = frame.sequence;
+  ++frames_shown_;
+  upload_latency_ms_ =
+      (ShmRingNowNs() - frame.publish_time_ns) * 1e-6f;
+  unpresented_publish_ns_ = frame.publish_time_ns;
+}
+
+void LiveCloud::FramePresented() {
+  if (unpresented_publish_ns_ < 0) {
+    return;
+  }
+  present_latency_ms_[num_present_latencies_ % kLatencyHistory] =
+      (ShmRingNowNs() - unpresented_publish_ns_) * 1e-6f;
+  ++num_present_latencies_;
+  unpresented_publish_ns_ = -1;
+}
+
+LiveStats LiveCloud::stats() const {
+  LiveStats stats;
+  stats.connected = consumer_.is_open();
+  stats.sequence = sequence_;
+  stats.frames_shown = frames_shown_;
+  stats.skipped_frames = consumer_.skipped_frames();
+  stats.torn_frames = torn_frames_;
+  stats.upload_latency_ms = upload_latency_ms_;
+
+  std::vector<float> latencies(present_latency_ms_.begin(),
+      present_latency_ms_.begin() +
+          std::min(num_present_latencies_, kLatencyHistory));
+  if (!latencies.empty()) {
+    std::sort(latencies.begin(), latencies.end());
+    stats.present_latency_p50_ms = latencies[latencies.size() / 2];
+    stats.present_latency_p99_ms = latencies[std::min(latencies.size() - 1,
+        latencies.size() * 99 / 100)];
+  }
+  return stats;
+}
+
+}  // namespace ogl_viewer
@@ -0,0 +1,138 @@
+#include "lzf.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace ogl_viewer {
+
+namespace {
+
+// longest literal run and back reference of the format, farthest reference
+const std::size_t kMaxLiteral = 1 << 5;
+const std::size_t kMaxMatch = (1 << 8) + (1 << 3);
+const std::size_t kMaxOffset = 1 << 13;
+const int kHashBits = 14;
+
+inline uint32_t HashTriple(const uint8_t *p) {
+  const uint32_t v = (static_cast<uint32_t>(p[0]) << 16) |
+      (static_cast<uint32_t>(p[1]) << 8) | p[2];
+  return (v * 2654435761u) >> (32 - kHashBits);
+}
+
+// emit in[begin, end) as literal runs, false if out is too small
+bool EmitLiterals(const uint8_t *in, std::size_t begin, std::size_t end,
+    uint8_t **op, uint8_t *out_end) {
+  while (begin < end) {
+    const std::size_t n = std::min(end - begin, kMaxLiteral);
+    if (*op + 1 + n > out_end) {
+      return false;
+    }
+    *(*op)++ = static_cast<uint8_t>(n - 1);
+    std::memcpy(*op, in + begin, n);
+    *op += n;
+    begin += n;
+  }
+  return true;
+}
+
+}  // namespace
+
+std::size_t LzfDecompress(const uint8_t *in, std::size_t in_size,
+    uint8_t *out, std::size_t out_size) {
+  const uint8_t *ip = in;
+  const uint8_t *const in_end = in + in_size;
+  uint8_t *op = out;
+  uint8_t *const out_end = out + out_size;
+
+  while (ip < in_end) {
+    std::size_t ctrl = *ip++;
+    if (ctrl < (1 << 5)) {
+      // literal run of ctrl + 1 bytes
+      ++ctrl;
+      if (op + ctrl > out_end || ip + ctrl > in_end) {
+        return 0;
+      }
+      std::memcpy(op, ip, ctrl);
+      op += ctrl;
+      ip += ctrl;
+    } else {
+      // back reference
+      std::size_t len = ctrl >> 5;
+      const uint8_t *ref = op - ((ctrl & 0x1f) << 8) - 1;
+      if (ip >= in_end) {
+        return 0;
+      }
+      if (len == 7) {
+        len += *ip++;
+        if (ip >= in_end) {
+          return 0;
+        }
+      }
+      ref -= *ip++;
+      len += 2;
+      if (op + len > out_end || ref < out) {
+        return 0;
+      }
+      // the source may overlap the destination, copy byte by byte
+      for (std::size_t i = 0; i < len; ++i) {
+        *op++ = *ref++;
+      }
+    }
+  }
+  return op - out;
+}
+
+std::size_t LzfCompress(const uint8_t *in, std::size_t in_size,
+    uint8_t *out, std::size_t out_size) {
+  // last position of every hashed 3-byte sequence, plus one (0 is empty)
+  std::vector<std::size_t> table(1 << kHashBits, 0);
+  uint8_t *op = out;
+  uint8_t *const out_end = out + out_size;
+
+  std::size_t literal_begin = 0;
+  std::size_t i = 0;
+  while (i + 2 < in_size) {
+    const uint32_t hash = HashTriple(in + i);
+    const std::size_t candidate = table[hash];
+    table[hash] = i + 1;
+    if (candidate == 0 || i - (candidate - 1) > kMaxOffset ||
+        std::memcmp(in + candidate - 1, in + i, 3) != 0) {
+      ++i;
+      continue;
+    }
+    const std::size_t ref = candidate - 1;
+    const std::size_t max_len = std::min(kMaxMatch, in_size - i);
+    std::size_t len = 3;
+    while (len < max_len && in[ref + len] == in[i + len]) {
+      ++len;
+    }
+
+    if (!EmitLiterals(in, literal_begin, i, &op, out_end) ||
+        op + 3 > out_end) {
+      return 0;
+    }
+    const std::size_t offset = i - ref - 1;
+    const std::size_t code = len - 2;
+    if (code < 7) {
+      *op++ = static_cast<uint8_t>((code << 5) | (offset >> 8));
+    } else {
+      *op++ = static_cast<uint8_t>((7 << 5) | (offset >> 8));
+      *op++ = static_cast<uint8_t>(code - 7);
+    }
+    *op++ = static_cast<uint8_t>(offset & 0xff);
+
+    // index the end of the match, so that runs keep matching
+    i += len;
+    if (i + 2 < in_size) {
+      table[HashTriple(in + i - 1)] = i;
+    }
+    literal_begin = i;
+  }
+  if (!EmitLiterals(in, literal_begin, in_size, &op, out_end)) {
+    return 0;
+  }
+  return op - out;
+}
+
+}  // namespace ogl_viewer
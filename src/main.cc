@@ -1,17 +1,218 @@
 #include <cstdlib>
 #include <iostream>
+#include <vector>
 
+#include "headless_viewer.h"
+#include "live_cloud.h"
+#include "mesh_loader.h"
 #include "opengl_model_viewer.h"
+#include "pcd_writer.h"
+#include "point_cache.h"
+#include "point_sequence.h"
 
 int main(int argc, char **argv) {
-  if (argc != 2) {
-    std::cout << "Usage: " << argv[0] << " <model_file_path>\n";
+  ogl_viewer::ViewerOptions options;
+  bool build_cache = false;
+  bool crop = false;
+  Eigen::AlignedBox3f crop_box;
+  std::string crop_output = "cropped.pcd";
+  int benchmark_frames = 0;
+  std::string benchmark_output = "-";
+  std::vector<std::string> paths;
+  bool args_ok = true;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg(argv[i]);
+    if (arg == "--pcl-loader") {
+      options.use_pcl_loader = true;
+    } else if (arg == "--no-lod") {
+      options.use_lod = false;
+    } else if (arg == "--point-budget" && i + 1 < argc) {
+      options.point_budget = std::strtoull(argv[++i], nullptr, 10);
+    } else if (arg == "--sync-load") {
+      options.async_loading = false;
+    } else if (arg == "--upload-budget-mb" && i + 1 < argc) {
+      options.upload_bytes_per_frame =
+          std::strtoull(argv[++i], nullptr, 10) << 20;
+    } else if (arg == "--quantize") {
+      options.quantize_positions = true;
+    } else if (arg == "--no-cache") {
+      options.use_cache = false;
+    } else if (arg == "--voxel-leaf" && i + 1 < argc) {
+      options.voxel_leaf_size = std::atof(argv[++i]);
+    } else if (arg == "--voxel-target" && i + 1 < argc) {
+      options.voxel_target_points = std::strtoull(argv[++i], nullptr, 10);
+    } else if (arg == "--no-mesh-optimize") {
+      options.optimize_meshes = false;
+    } else if (arg == "--short-indices") {
+      options.short_mesh_indices = true;
+    } else if (arg == "--poses" && i + 1 < argc) {
+      options.poses_path = argv[++i];
+    } else if (arg == "--boxes" && i + 1 < argc) {
+      options.boxes_path = argv[++i];
+    } else if (arg == "--synthetic-gizmos" && i + 1 < argc) {
+      options.synthetic_gizmos = std::strtoull(argv[++i], nullptr, 10);
+    } else if (arg == "--polylines" && i + 1 < argc) {
+      options.polylines_path = argv[++i];
+    } else if (arg == "--synthetic-segments" && i + 1 < argc) {
+      options.synthetic_segments = std::strtoull(argv[++i], nullptr, 10);
+    } else if (arg == "--color" && i + 1 < argc) {
+      options.color_attribute = argv[++i];
+    } else if (arg == "--colormap" && i + 1 < argc) {
+      if (!ParseColormapScaling(argv[++i], &options.colormap_scaling)) {
+        args_ok = false;
+        break;
+      }
+    } else if (arg == "--build-cache") {
+      build_cache = true;
+    } else if (arg == "--crop" && i + 6 < argc) {
+      crop = true;
+      for (int k = 0; k < 3; ++k) {
+        crop_box.min()[k] = std::atof(argv[i + 1 + k]);
+        crop_box.max()[k] = std::atof(argv[i + 4 + k]);
+      }
+      i += 6;
+    } else if (arg == "--crop-output" && i + 1 < argc) {
+      crop_output = argv[++i];
+    } else if (arg == "--no-spatial-index") {
+      options.build_index = false;
+    } else if (arg == "--trace" && i + 1 < argc) {
+      options.trace_path = argv[++i];
+    } else if (arg == "--stats-overlay") {
+      options.stats_overlay = true;
+    } else if (arg == "--record" && i + 1 < argc) {
+      options.record = true;
+      options.record_prefix = argv[++i];
+    } else if (arg == "--record-format" && i + 1 < argc) {
+      if (!ParseRecordFormat(argv[++i], &options.record_format)) {
+        args_ok = false;
+        break;
+      }
+    } else if (arg == "--screenshot" && i + 1 < argc) {
+      options.screenshot_path = argv[++i];
+    } else if (arg == "--shader-dir" && i + 1 < argc) {
+      options.shader_dir = argv[++i];
+    } else if (arg == "--no-shader-cache") {
+      options.use_shader_cache = false;
+    } else if (arg == "--no-shader-reload") {
+      options.watch_shaders = false;
+    } else if (arg == "--continuous") {
+      options.on_demand = false;
+    } else if (arg == "--fps" && i + 1 < argc) {
+      options.frame_rate = std::atof(argv[++i]);
+    } else if (arg == "--prefetch" && i + 1 < argc) {
+      options.prefetch_frames = std::atoi(argv[++i]);
+    } else if (arg == "--frame-cache-mb" && i + 1 < argc) {
+      options.frame_cache_bytes = std::strtoull(argv[++i], nullptr, 10) << 20;
+    } else if (arg == "--compress-frames") {
+      options.compress_frames = true;
+    } else if (arg == "--benchmark" && i + 1 < argc) {
+      benchmark_frames = std::atoi(argv[++i]);
+    } else if (arg == "--benchmark-output" && i + 1 < argc) {
+      benchmark_output = argv[++i];
+    } else if (arg[0] != '-') {
+      paths.push_back(arg);
+    } else {
+      args_ok = false;
+      break;
+    }
+  }
+  if (!args_ok || paths.empty() || (!build_cache && paths.size() > 1) ||
+      (crop && crop_box.isEmpty())) {
+    std::cout << "Usage: " << argv[0] << " [options] <model_file_path>\n"
+        << "       " << argv[0] << " [options] <ply_or_obj_file>\n"
+        << "       " << argv[0] << " [options] <pcd_directory>\n"
+        << "       " << argv[0] << " [options] shm:<name>\n"
+        << "       " << argv[0] << " --build-cache <pcd_file_path>...\n"
+        << "       " << argv[0] << " --crop <min xyz> <max xyz> <pcd_file_path>\n"
+        << "  --pcl-loader            load through PCL instead of the native reader\n"
+        << "  --no-lod                stream the cloud as is, without an octree\n"
+        << "  --point-budget <n>      points drawn per frame in LOD mode\n"
+        << "  --sync-load             load before showing the window\n"
+        << "  --upload-budget-mb <n>  upload limit per frame while loading\n"
+        << "  --quantize              store positions as 16-bit integers\n"
+        << "  --no-cache              neither read nor write <file>.ovcache\n"
+        << "  --voxel-leaf <size>     keep one point per voxel of this size\n"
+        << "  --voxel-target <n>      pick the voxel size that keeps about n points\n"
+        << "  --no-mesh-optimize      draw meshes in the order of the file\n"
+        << "  --short-indices         draw meshes with 16-bit indices in batches\n"
+        << "  --poses <file>          draw axes at the poses of file\n"
+        << "  --boxes <file>          draw the boxes of file\n"
+        << "  --synthetic-gizmos <n>  draw n moving vehicle poses and boxes\n"
+        << "  --polylines <file>      draw the polylines of file\n"
+        << "  --synthetic-segments <n> draw n segments of synthetic lanes\n"
+        << "  --color <field>         color by a PCD field (cycle with C)\n"
+        << "  --colormap <scaling>    minmax, percentile (default) or equalize\n"
+        << "                          colors of heights and fields (cycle with M)\n"
+        << "  --build-cache           write <file>.ovcache for every file and exit\n"
+        << "  --crop <6 numbers>      write the points inside the box to a PCD\n"
+        << "                          file with all their fields and exit\n"
+        << "  --crop-output <file>    where --crop writes (default cropped.pcd)\n"
+        << "  --no-spatial-index      no selections (lasso, B, N), less memory\n"
+        << "  --trace <file>          write a Chrome trace of CPU and GPU time on exit\n"
+        << "  --stats-overlay         show the frame time graph (toggle with F3)\n"
+        << "  --record <prefix>       write every frame drawn (toggle with R,\n"
+        << "                          screenshot with F12)\n"
+        << "  --record-format <f>     png (<prefix><n>_000000.png...) or raw\n"
+        << "                          (<prefix><n>.rgba), n the lowest free\n"
+        << "  --screenshot <file>     with --benchmark, write the last frame as PNG\n"
+        << "  --shader-dir <dir>      load rainbow.vert/.frag from dir\n"
+        << "  --no-shader-cache       always compile shaders from source\n"
+        << "  --no-shader-reload      do not rebuild shaders edited while running\n"
+        << "  --continuous            redraw every frame instead of on demand\n"
+        << "  --fps <hz>              playback rate of a directory of frames\n"
+        << "  --prefetch <n>          frames decoded ahead of playback\n"
+        << "  --frame-cache-mb <n>    memory of the decoded frame cache\n"
+        << "  --compress-frames       keep cached frames LZF compressed\n"
+        << "  --benchmark <frames>    render offscreen along a scripted camera path\n"
+        << "                          and print frame time statistics as JSON\n"
+        << "  --benchmark-output <f>  write the benchmark JSON to f instead\n";
     return -1;
   }
 
-  const std::string model_file_path(argv[1]);
+  if (build_cache) {
+    int status = 0;
+    for (const std::string &path : paths) {
+      if (ogl_viewer::IsMeshPath(path)) {
+        std::cerr << "error : " << path << " is a mesh, only point clouds "
+            << "are cached\n";
+        status = 1;
+      } else if (!ogl_viewer::BuildPointCache(path)) {
+        std::cerr << "error : failed to build the cache of " << path << "\n";
+        status = 1;
+      }
+    }
+    return status;
+  }
+
+  if (crop) {
+    if (ogl_viewer::IsMeshPath(paths[0]) ||
+        ogl_viewer::IsDirectory(paths[0]) ||
+        ogl_viewer::IsLivePath(paths[0])) {
+      std::cerr << "error : --crop takes a single PCD file.\n";
+      return 1;
+    }
+    return ogl_viewer::CropPointCloud(paths[0], crop_box, crop_output) ?
+        0 : 1;
+  }
+
+  if (benchmark_frames > 0) {
+    if (ogl_viewer::IsDirectory(paths[0]) ||
+        ogl_viewer::IsLivePath(paths[0])) {
+      std::cerr << "error : the benchmark takes a single PCD, PLY or OBJ "
+          << "file.\n";
+      return 1;
+    }
+    ogl_viewer::HeadlessViewer app;
+    app.set_options(options);
+    if (!app.Init("OpenGLModelViewer", 1280, 720, paths[0])) {
+      return 1;
+    }
+    return app.RunBenchmark(benchmark_frames, benchmark_output) ? 0 : 1;
+  }
+
   ogl_viewer::OpenGLModelViewer app;
-  app.Init("OpenGLModelViewer", 1280, 720, model_file_path);
+  app.set_options(options);
+  app.Init("OpenGLModelViewer", 1280, 720, paths[0]);
   app.Run();
   return 0;
 }
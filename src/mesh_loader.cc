@@ -0,0 +1,952 @@
+#include "mesh_loader.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+#include "thread_pool.h"
+#include "tracer.h"
+
+namespace ogl_viewer {
+
+namespace {
+
+// records per parallel task when decoding binary PLY elements
+const std::size_t kRecordGrain = 1 << 14;
+// smallest block of text parsed by one task
+const std::size_t kMinTextBlock = 1 << 16;
+
+inline bool IsSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\r';
+}
+
+std::string Lowercase(std::string s) {
+  std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) {
+    return static_cast<char>(std::tolower(c));
+  });
+  return s;
+}
+
+bool HasSuffix(const std::string &s, const std::string &suffix) {
+  return s.size() >= suffix.size() &&
+      s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// the next whitespace separated token of [*p, end), advancing *p past it
+bool NextToken(const char **p, const char *end, const char **token_begin,
+    const char **token_end) {
+  const char *q = *p;
+  while (q < end && IsSpace(*q)) {
+    ++q;
+  }
+  *token_begin = q;
+  while (q < end && !IsSpace(*q)) {
+    ++q;
+  }
+  *token_end = q;
+  *p = q;
+  return *token_end != *token_begin;
+}
+
+// the mapping is not null-terminated, strtof and strtol need a copy
+bool ParseFloat(const char *begin, const char *end, float *value) {
+  char buf[64];
+  const std::size_t len = std::min<std::size_t>(end - begin, sizeof(buf) - 1);
+  std::memcpy(buf, begin, len);
+  buf[len] = '\0';
+  char *parse_end = nullptr;
+  *value = std::strtof(buf, &parse_end);
+  return parse_end != buf;
+}
+
+bool ParseInt(const char *begin, const char *end, long *value) {
+  char buf[32];
+  const std::size_t len = std::min<std::size_t>(end - begin, sizeof(buf) - 1);
+  std::memcpy(buf, begin, len);
+  buf[len] = '\0';
+  char *parse_end = nullptr;
+  *value = std::strtol(buf, &parse_end, 10);
+  return parse_end != buf;
+}
+
+// a line with something else than whitespace and comments
+bool HasContent(const char *begin, const char *end) {
+  for (const char *p = begin; p < end; ++p) {
+    if (*p == '#') {
+      return false;
+    }
+    if (!IsSpace(*p)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// split text into blocks that start at line boundaries
+std::vector<std::size_t> SplitTextBlocks(const char *text,
+    std::size_t text_size) {
+  const ThreadPool &pool = ThreadPool::Global();
+  const std::size_t num_blocks = std::max<std::size_t>(1, std::min(
+      text_size / kMinTextBlock,
+      static_cast<std::size_t>(4 * (pool.num_threads() + 1))));
+  std::vector<std::size_t> block_begins(num_blocks + 1, text_size);
+  block_begins[0] = 0;
+  for (std::size_t i = 1; i < num_blocks; ++i) {
+    std::size_t pos = std::max(block_begins[i - 1], text_size * i / num_blocks);
+    const char *newline = static_cast<const char*>(
+        std::memchr(text + pos, '\n', text_size - pos));
+    block_begins[i] = newline ? newline - text + 1 : text_size;
+  }
+  return block_begins;
+}
+
+// calls line(begin, end) for the lines of [begin, end) with content, until
+// it returns false
+template <typename LineFunction>
+void ForEachLine(const char *p, const char *end, const LineFunction &line) {
+  while (p < end) {
+    const char *line_end = static_cast<const char*>(
+        std::memchr(p, '\n', end - p));
+    if (line_end == nullptr) {
+      line_end = end;
+    }
+    if (HasContent(p, line_end) && !line(p, line_end)) {
+      return;
+    }
+    p = line_end + 1;
+  }
+}
+
+// fan triangulation of a polygon onto indices
+void AppendFan(const uint32_t *polygon, std::size_t num_corners,
+    std::vector<uint32_t> *indices) {
+  for (std::size_t k = 2; k < num_corners; ++k) {
+    indices->push_back(polygon[0]);
+    indices->push_back(polygon[k - 1]);
+    indices->push_back(polygon[k]);
+  }
+}
+
+// concatenate the per-block triangles in block order
+void GatherBlocks(const std::vector<std::vector<uint32_t>> &blocks,
+    std::vector<uint32_t> *indices) {
+  std::vector<std::size_t> offsets(blocks.size() + 1, 0);
+  for (std::size_t i = 0; i < blocks.size(); ++i) {
+    offsets[i + 1] = offsets[i] + blocks[i].size();
+  }
+  indices->resize(offsets.back());
+  ThreadPool::Global().ParallelFor(0, blocks.size(), 1,
+      [&](std::size_t b, std::size_t e) {
+        for (std::size_t i = b; i < e; ++i) {
+          std::copy(blocks[i].begin(), blocks[i].end(),
+              indices->begin() + offsets[i]);
+        }
+      });
+}
+
+bool CheckIndices(const MeshData &mesh) {
+  const std::size_t num_vertices = mesh.num_vertices();
+  std::atomic<bool> ok(true);
+  ThreadPool::Global().ParallelFor(0, mesh.indices.size(), kRecordGrain,
+      [&](std::size_t b, std::size_t e) {
+        for (std::size_t i = b; i < e; ++i) {
+          if (mesh.indices[i] >= num_vertices) {
+            ok = false;
+            return;
+          }
+        }
+      });
+  if (!ok) {
+    std::cerr << "error : mesh face refers to a vertex out of range.\n";
+  }
+  return ok;
+}
+
+// PLY header description
+
+enum PlyFormat {
+  kPlyAscii,
+  kPlyBinaryLittleEndian,
+  kPlyBinaryBigEndian
+};
+
+struct PlyProperty {
+  std::string name;
+  // 'i' signed, 'u' unsigned integer or 'f' floating point, of size bytes
+  char kind = 'f';
+  int size = 4;
+  // list properties: element count type, then kind and size of the items
+  bool list = false;
+  char count_kind = 'u';
+  int count_size = 1;
+};
+
+struct PlyElement {
+  std::string name;
+  std::size_t count = 0;
+  std::vector<PlyProperty> properties;
+
+  int PropertyIndex(const std::string &property_name) const {
+    for (std::size_t i = 0; i < properties.size(); ++i) {
+      if (properties[i].name == property_name) {
+        return static_cast<int>(i);
+      }
+    }
+    return -1;
+  }
+
+  bool HasLists() const {
+    for (const PlyProperty &property : properties) {
+      if (property.list) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // bytes of a binary record without list properties
+  std::size_t RecordSize() const {
+    std::size_t size = 0;
+    for (const PlyProperty &property : properties) {
+      size += property.size;
+    }
+    return size;
+  }
+};
+
+bool ParsePlyType(const std::string &name, char *kind, int *size) {
+  static const struct {
+    const char *name;
+    char kind;
+    int size;
+  } kTypes[] = {
+    {"char", 'i', 1}, {"int8", 'i', 1}, {"uchar", 'u', 1}, {"uint8", 'u', 1},
+    {"short", 'i', 2}, {"int16", 'i', 2}, {"ushort", 'u', 2},
+    {"uint16", 'u', 2}, {"int", 'i', 4}, {"int32", 'i', 4}, {"uint", 'u', 4},
+    {"uint32", 'u', 4}, {"float", 'f', 4}, {"float32", 'f', 4},
+    {"double", 'f', 8}, {"float64", 'f', 8}
+  };
+  for (const auto &type : kTypes) {
+    if (name == type.name) {
+      *kind = type.kind;
+      *size = type.size;
+      return true;
+    }
+  }
+  std::cerr << "error : unknown PLY property type " << name << "\n";
+  return false;
+}
+
+// the header lines up to end_header; *body_offset is the first byte after
+bool ParsePlyHeader(const char *data, std::size_t size, PlyFormat *format,
+    std::vector<PlyElement> *elements, std::size_t *body_offset) {
+  const char *end = data + size;
+  const char *p = data;
+  bool has_format = false;
+  int line_number = 0;
+  while (p < end) {
+    const char *line_end = static_cast<const char*>(
+        std::memchr(p, '\n', end - p));
+    if (line_end == nullptr) {
+      break;
+    }
+    std::istringstream iss(std::string(p, line_end));
+    p = line_end + 1;
+    std::string keyword;
+    iss >> keyword;
+    if (line_number++ == 0) {
+      if (keyword != "ply") {
+        std::cerr << "error : not a PLY file.\n";
+        return false;
+      }
+      continue;
+    }
+    if (keyword == "format") {
+      std::string name;
+      iss >> name;
+      if (name == "ascii") {
+        *format = kPlyAscii;
+      } else if (name == "binary_little_endian") {
+        *format = kPlyBinaryLittleEndian;
+      } else if (name == "binary_big_endian") {
+        *format = kPlyBinaryBigEndian;
+      } else {
+        std::cerr << "error : unknown PLY format " << name << "\n";
+        return false;
+      }
+      has_format = true;
+    } else if (keyword == "element") {
+      PlyElement element;
+      iss >> element.name >> element.count;
+      if (iss.fail()) {
+        std::cerr << "error : malformed PLY element line.\n";
+        return false;
+      }
+      elements->push_back(element);
+    } else if (keyword == "property") {
+      if (elements->empty()) {
+        std::cerr << "error : PLY property outside of an element.\n";
+        return false;
+      }
+      PlyProperty property;
+      std::string type;
+      iss >> type;
+      if (type == "list") {
+        std::string count_type;
+        property.list = true;
+        iss >> count_type >> type;
+        if (!ParsePlyType(count_type, &property.count_kind,
+            &property.count_size)) {
+          return false;
+        }
+      }
+      iss >> property.name;
+      if (iss.fail() || !ParsePlyType(type, &property.kind, &property.size)) {
+        return false;
+      }
+      elements->back().properties.push_back(property);
+    } else if (keyword == "end_header") {
+      *body_offset = p - data;
+      if (!has_format) {
+        std::cerr << "error : PLY header without a format.\n";
+        return false;
+      }
+      return true;
+    }
+    // comment and obj_info lines are skipped
+  }
+  std::cerr << "error : PLY header without end_header.\n";
+  return false;
+}
+
+// one binary PLY value, byte swapped when the file is big endian
+double LoadPlyValue(const char *p, char kind, int size, bool swap) {
+  char bytes[8];
+  std::memcpy(bytes, p, size);
+  if (swap) {
+    std::reverse(bytes, bytes + size);
+  }
+  switch (size) {
+    case 1:
+      return kind == 'i' ? static_cast<double>(static_cast<int8_t>(bytes[0])) :
+          static_cast<double>(static_cast<uint8_t>(bytes[0]));
+    case 2: {
+      if (kind == 'i') {
+        int16_t value;
+        std::memcpy(&value, bytes, 2);
+        return value;
+      }
+      uint16_t value;
+      std::memcpy(&value, bytes, 2);
+      return value;
+    }
+    case 4: {
+      if (kind == 'f') {
+        float value;
+        std::memcpy(&value, bytes, 4);
+        return value;
+      } else if (kind == 'i') {
+        int32_t value;
+        std::memcpy(&value, bytes, 4);
+        return value;
+      }
+      uint32_t value;
+      std::memcpy(&value, bytes, 4);
+      return value;
+    }
+    default: {
+      double value;
+      std::memcpy(&value, bytes, 8);
+      return value;
+    }
+  }
+}
+
+// x/y/z and nx/ny/nz of the vertex element, -1 where absent
+void PlyVertexProperties(const PlyElement &vertex, int positions[3],
+    int normals[3]) {
+  const char *position_names[3] = {"x", "y", "z"};
+  const char *normal_names[3] = {"nx", "ny", "nz"};
+  for (int k = 0; k < 3; ++k) {
+    positions[k] = vertex.PropertyIndex(position_names[k]);
+    normals[k] = vertex.PropertyIndex(normal_names[k]);
+  }
+  if (normals[0] < 0 || normals[1] < 0 || normals[2] < 0) {
+    normals[0] = normals[1] = normals[2] = -1;
+  }
+}
+
+int PlyFaceProperty(const PlyElement &face) {
+  int index = face.PropertyIndex("vertex_indices");
+  if (index < 0) {
+    index = face.PropertyIndex("vertex_index");
+  }
+  if (index >= 0 && !face.properties[index].list) {
+    return -1;
+  }
+  return index;
+}
+
+bool ParseBinaryPlyVertices(const PlyElement &vertex, bool swap,
+    const char *p, const char *end, MeshData *mesh) {
+  int positions[3];
+  int normals[3];
+  PlyVertexProperties(vertex, positions, normals);
+  std::size_t offsets[6] = {0, 0, 0, 0, 0, 0};
+  std::size_t offset = 0;
+  for (std::size_t i = 0; i < vertex.properties.size(); ++i) {
+    for (int k = 0; k < 3; ++k) {
+      if (positions[k] == static_cast<int>(i)) {
+        offsets[k] = offset;
+      }
+      if (normals[k] == static_cast<int>(i)) {
+        offsets[3 + k] = offset;
+      }
+    }
+    offset += vertex.properties[i].size;
+  }
+  const std::size_t stride = vertex.RecordSize();
+  if (static_cast<std::size_t>(end - p) < vertex.count * stride) {
+    std::cerr << "error : PLY vertex data is truncated.\n";
+    return false;
+  }
+  const bool has_normals = normals[0] >= 0;
+  mesh->positions.resize(vertex.count * 3);
+  if (has_normals) {
+    mesh->normals.resize(vertex.count * 3);
+  }
+  ThreadPool::Global().ParallelFor(0, vertex.count, kRecordGrain,
+      [&](std::size_t b, std::size_t e) {
+        for (std::size_t i = b; i < e; ++i) {
+          const char *record = p + i * stride;
+          for (int k = 0; k < 3; ++k) {
+            const PlyProperty &position = vertex.properties[positions[k]];
+            mesh->positions[i * 3 + k] = static_cast<float>(LoadPlyValue(
+                record + offsets[k], position.kind, position.size, swap));
+            if (has_normals) {
+              const PlyProperty &normal = vertex.properties[normals[k]];
+              mesh->normals[i * 3 + k] = static_cast<float>(LoadPlyValue(
+                  record + offsets[3 + k], normal.kind, normal.size, swap));
+            }
+          }
+        }
+      });
+  return true;
+}
+
+// records with lists one after the other, *p being advanced past them;
+// the polygons of property vertex_list are appended to indices, -1 to only
+// skip the records
+bool ParseBinaryPlyRecords(const PlyElement &element, int vertex_list,
+    bool swap, const char **p, const char *end,
+    std::vector<uint32_t> *indices) {
+  std::vector<uint32_t> polygon;
+  for (std::size_t i = 0; i < element.count; ++i) {
+    for (std::size_t j = 0; j < element.properties.size(); ++j) {
+      const PlyProperty &property = element.properties[j];
+      if (!property.list) {
+        *p += property.size;
+        continue;
+      }
+      if (*p + property.count_size > end) {
+        std::cerr << "error : PLY " << element.name << " data is truncated.\n";
+        return false;
+      }
+      const std::size_t count = static_cast<std::size_t>(LoadPlyValue(*p,
+          property.count_kind, property.count_size, swap));
+      *p += property.count_size;
+      if (*p + count * property.size > end) {
+        std::cerr << "error : PLY " << element.name << " data is truncated.\n";
+        return false;
+      }
+      if (static_cast<int>(j) == vertex_list) {
+        polygon.resize(count);
+        for (std::size_t k = 0; k < count; ++k) {
+          polygon[k] = static_cast<uint32_t>(LoadPlyValue(
+              *p + k * property.size, property.kind, property.size, swap));
+        }
+        AppendFan(polygon.data(), count, indices);
+      }
+      *p += count * property.size;
+    }
+  }
+  return true;
+}
+
+// every face a triangle makes the records fixed-size, decoded in parallel;
+// false without touching anything when that is not the case
+bool ParseBinaryPlyTriangles(const PlyElement &face, bool swap,
+    const char *p, const char *end, std::vector<uint32_t> *indices) {
+  const int vertex_list = PlyFaceProperty(face);
+  std::size_t stride = 0;
+  std::size_t list_offset = 0;
+  for (std::size_t j = 0; j < face.properties.size(); ++j) {
+    const PlyProperty &property = face.properties[j];
+    if (property.list && static_cast<int>(j) != vertex_list) {
+      return false;
+    }
+    if (static_cast<int>(j) == vertex_list) {
+      list_offset = stride;
+      stride += property.count_size + 3 * property.size;
+    } else {
+      stride += property.size;
+    }
+  }
+  if (static_cast<std::size_t>(end - p) < face.count * stride) {
+    return false;
+  }
+  const PlyProperty &list = face.properties[vertex_list];
+  std::vector<uint32_t> triangles(face.count * 3);
+  std::atomic<bool> all_triangles(true);
+  ThreadPool::Global().ParallelFor(0, face.count, kRecordGrain,
+      [&](std::size_t b, std::size_t e) {
+        for (std::size_t i = b; i < e && all_triangles; ++i) {
+          const char *record = p + i * stride + list_offset;
+          if (LoadPlyValue(record, list.count_kind, list.count_size,
+              swap) != 3.0) {
+            all_triangles = false;
+            return;
+          }
+          record += list.count_size;
+          for (int k = 0; k < 3; ++k) {
+            triangles[i * 3 + k] = static_cast<uint32_t>(LoadPlyValue(
+                record + k * list.size, list.kind, list.size, swap));
+          }
+        }
+      });
+  if (!all_triangles) {
+    return false;
+  }
+  indices->swap(triangles);
+  return true;
+}
+
+bool ParseBinaryPly(const std::vector<PlyElement> &elements, bool swap,
+    const char *p, const char *end, MeshData *mesh) {
+  for (const PlyElement &element : elements) {
+    if (element.name == "vertex") {
+      if (element.HasLists()) {
+        std::cerr << "error : PLY vertices with list properties.\n";
+        return false;
+      }
+      if (!ParseBinaryPlyVertices(element, swap, p, end, mesh)) {
+        return false;
+      }
+      p += element.count * element.RecordSize();
+    } else if (element.name == "face") {
+      if (ParseBinaryPlyTriangles(element, swap, p, end, &mesh->indices)) {
+        return true;
+      }
+      // polygons, or lists besides the vertex indices
+      mesh->indices.clear();
+      return ParseBinaryPlyRecords(element, PlyFaceProperty(element), swap,
+          &p, end, &mesh->indices);
+    } else if (!element.HasLists()) {
+      p += element.count * element.RecordSize();
+    } else {
+      // skip edges and the like record by record
+      if (!ParseBinaryPlyRecords(element, -1, swap, &p, end, nullptr)) {
+        return false;
+      }
+    }
+    if (p > end) {
+      std::cerr << "error : PLY data is truncated.\n";
+      return false;
+    }
+  }
+  return true;
+}
+
+bool ParseAsciiPly(const std::vector<PlyElement> &elements, const char *text,
+    std::size_t text_size, MeshData *mesh) {
+  // every record is a line; record r belongs to the element whose range of
+  // element_begins holds it
+  std::vector<std::size_t> element_begins(elements.size() + 1, 0);
+  int vertex_element = -1;
+  int face_element = -1;
+  for (std::size_t i = 0; i < elements.size(); ++i) {
+    element_begins[i + 1] = element_begins[i] + elements[i].count;
+    if (elements[i].name == "vertex" && vertex_element < 0) {
+      vertex_element = static_cast<int>(i);
+    } else if (elements[i].name == "face" && face_element < 0) {
+      face_element = static_cast<int>(i);
+    }
+  }
+  const std::size_t num_records = element_begins.back();
+  int positions[3] = {-1, -1, -1};
+  int normals[3] = {-1, -1, -1};
+  int vertex_list = -1;
+  std::size_t num_vertices = 0;
+  if (vertex_element >= 0) {
+    const PlyElement &vertex = elements[vertex_element];
+    if (vertex.HasLists()) {
+      std::cerr << "error : PLY vertices with list properties.\n";
+      return false;
+    }
+    PlyVertexProperties(vertex, positions, normals);
+    num_vertices = vertex.count;
+  }
+  if (face_element >= 0) {
+    vertex_list = PlyFaceProperty(elements[face_element]);
+  }
+  mesh->positions.resize(num_vertices * 3);
+  if (normals[0] >= 0) {
+    mesh->normals.resize(num_vertices * 3);
+  }
+  const int last_vertex_token = std::max(
+      std::max(positions[0], positions[1]), std::max(positions[2],
+          std::max(normals[0], std::max(normals[1], normals[2]))));
+
+  ThreadPool &pool = ThreadPool::Global();
+  const std::vector<std::size_t> block_begins =
+      SplitTextBlocks(text, text_size);
+  const std::size_t num_blocks = block_begins.size() - 1;
+
+  // pass 1: count the records of every block
+  std::vector<std::size_t> block_records(num_blocks + 1, 0);
+  pool.ParallelFor(0, num_blocks, 1, [&](std::size_t b, std::size_t e) {
+    for (std::size_t block = b; block < e; ++block) {
+      std::size_t count = 0;
+      ForEachLine(text + block_begins[block], text + block_begins[block + 1],
+          [&](const char*, const char*) {
+            ++count;
+            return true;
+          });
+      block_records[block + 1] = count;
+    }
+  });
+  for (std::size_t i = 0; i < num_blocks; ++i) {
+    block_records[i + 1] += block_records[i];
+  }
+  if (block_records[num_blocks] < num_records) {
+    std::cerr << "error : PLY ascii data has " << block_records[num_blocks]
+        << " records, " << num_records << " declared.\n";
+    return false;
+  }
+
+  // pass 2: vertices into their slots, triangles per block
+  std::vector<std::vector<uint32_t>> block_indices(num_blocks);
+  std::atomic<bool> parse_ok(true);
+  pool.ParallelFor(0, num_blocks, 1, [&](std::size_t b, std::size_t e) {
+    float values[6];
+    std::vector<uint32_t> polygon;
+    for (std::size_t block = b; block < e; ++block) {
+      std::size_t record = block_records[block];
+      std::vector<uint32_t> *indices = &block_indices[block];
+      ForEachLine(text + block_begins[block], text + block_begins[block + 1],
+          [&](const char *p, const char *line_end) {
+            if (record >= num_records) {
+              return false;
+            }
+            const std::size_t element = std::upper_bound(
+                element_begins.begin(), element_begins.end(), record) -
+                element_begins.begin() - 1;
+            const std::size_t index = record - element_begins[element];
+            ++record;
+            const char *token_begin = nullptr;
+            const char *token_end = nullptr;
+            if (static_cast<int>(element) == vertex_element) {
+              for (int token = 0; token <= last_vertex_token; ++token) {
+                if (!NextToken(&p, line_end, &token_begin, &token_end)) {
+                  parse_ok = false;
+                  return false;
+                }
+                for (int k = 0; k < 3; ++k) {
+                  if (positions[k] == token) {
+                    ParseFloat(token_begin, token_end, &values[k]);
+                  } else if (normals[k] == token) {
+                    ParseFloat(token_begin, token_end, &values[3 + k]);
+                  }
+                }
+              }
+              std::copy(values, values + 3, &mesh->positions[index * 3]);
+              if (!mesh->normals.empty()) {
+                std::copy(values + 3, values + 6, &mesh->normals[index * 3]);
+              }
+            } else if (static_cast<int>(element) == face_element) {
+              const PlyElement &face = elements[face_element];
+              for (std::size_t j = 0; j < face.properties.size(); ++j) {
+                long count = 1;
+                if (face.properties[j].list) {
+                  if (!NextToken(&p, line_end, &token_begin, &token_end) ||
+                      !ParseInt(token_begin, token_end, &count) ||
+                      count < 0) {
+                    parse_ok = false;
+                    return false;
+                  }
+                }
+                polygon.clear();
+                for (long k = 0; k < count; ++k) {
+                  long value = 0;
+                  if (!NextToken(&p, line_end, &token_begin, &token_end)) {
+                    parse_ok = false;
+                    return false;
+                  }
+                  if (static_cast<int>(j) == vertex_list) {
+                    ParseInt(token_begin, token_end, &value);
+                    polygon.push_back(static_cast<uint32_t>(value));
+                  }
+                }
+                if (static_cast<int>(j) == vertex_list) {
+                  AppendFan(polygon.data(), polygon.size(), indices);
+                }
+              }
+            }
+            return true;
+          });
+    }
+  });
+  if (!parse_ok) {
+    std::cerr << "error : malformed line in PLY ascii data.\n";
+    return false;
+  }
+  GatherBlocks(block_indices, &mesh->indices);
+  return true;
+}
+
+// read-only mapping of a whole file
+class MappedFile {
+ public:
+  MappedFile() = default;
+  ~MappedFile() {
+    if (data_ != nullptr) {
+      munmap(const_cast<char*>(data_), size_);
+    }
+    if (fd_ >= 0) {
+      close(fd_);
+    }
+  }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  bool Open(const std::string &filepath) {
+    fd_ = open(filepath.c_str(), O_RDONLY);
+    if (fd_ < 0) {
+      std::cerr << "error : failed to open " << filepath << "\n";
+      return false;
+    }
+    struct stat st;
+    if (fstat(fd_, &st) != 0 || st.st_size == 0) {
+      std::cerr << "error : failed to stat " << filepath << "\n";
+      return false;
+    }
+    void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd_, 0);
+    if (addr == MAP_FAILED) {
+      std::cerr << "error : failed to mmap " << filepath << "\n";
+      return false;
+    }
+    data_ = static_cast<const char*>(addr);
+    size_ = st.st_size;
+    // blocks are parsed out of order
+    madvise(addr, size_, MADV_WILLNEED);
+    return true;
+  }
+
+  const char* data() const {
+    return data_;
+  }
+
+  std::size_t size() const {
+    return size_;
+  }
+
+ private:
+  int fd_ = -1;
+  const char *data_ = nullptr;
+  std::size_t size_ = 0;
+};
+
+}  // namespace
+
+bool IsMeshPath(const std::string &path) {
+  const std::string lower = Lowercase(path);
+  return HasSuffix(lower, ".ply") || HasSuffix(lower, ".obj");
+}
+
+bool LoadMesh(const std::string &filepath, MeshData *mesh) {
+  TRACE_SCOPE("LoadMesh");
+  *mesh = MeshData();
+  MappedFile file;
+  if (!file.Open(filepath)) {
+    return false;
+  }
+  const bool parsed = HasSuffix(Lowercase(filepath), ".obj") ?
+      ParseObj(file.data(), file.size(), mesh) :
+      ParsePly(file.data(), file.size(), mesh);
+  if (!parsed || !CheckIndices(*mesh)) {
+    std::cerr << "error : failed to read the mesh " << filepath << "\n";
+    return false;
+  }
+  if (mesh->num_triangles() == 0) {
+    std::cerr << "error : " << filepath << " has no triangles.\n";
+    return false;
+  }
+  if (mesh->normals.empty()) {
+    ComputeVertexNormals(mesh);
+  }
+  return true;
+}
+
+bool ParsePly(const char *data, std::size_t size, MeshData *mesh) {
+  TRACE_SCOPE("ParsePly");
+  PlyFormat format = kPlyAscii;
+  std::vector<PlyElement> elements;
+  std::size_t body_offset = 0;
+  if (!ParsePlyHeader(data, size, &format, &elements, &body_offset)) {
+    return false;
+  }
+  for (const PlyElement &element : elements) {
+    if (element.name == "vertex") {
+      int positions[3];
+      int normals[3];
+      PlyVertexProperties(element, positions, normals);
+      if (positions[0] < 0 || positions[1] < 0 || positions[2] < 0) {
+        std::cerr << "error : PLY vertices without x, y and z.\n";
+        return false;
+      }
+    } else if (element.name == "face" && PlyFaceProperty(element) < 0) {
+      std::cerr << "error : PLY faces without vertex_indices.\n";
+      return false;
+    }
+  }
+  if (format == kPlyAscii) {
+    return ParseAsciiPly(elements, data + body_offset, size - body_offset,
+        mesh);
+  }
+  const uint16_t one = 1;
+  const bool little_endian_host = *reinterpret_cast<const char*>(&one) == 1;
+  const bool swap = little_endian_host != (format == kPlyBinaryLittleEndian);
+  return ParseBinaryPly(elements, swap, data + body_offset, data + size, mesh);
+}
+
+bool ParseObj(const char *data, std::size_t size, MeshData *mesh) {
+  TRACE_SCOPE("ParseObj");
+  ThreadPool &pool = ThreadPool::Global();
+  const std::vector<std::size_t> block_begins = SplitTextBlocks(data, size);
+  const std::size_t num_blocks = block_begins.size() - 1;
+  const auto is_vertex = [](const char *p, const char *line_end) {
+    while (p < line_end && IsSpace(*p)) {
+      ++p;
+    }
+    return line_end - p > 1 && p[0] == 'v' && IsSpace(p[1]);
+  };
+
+  // pass 1: vertices of every block, the base of relative face indices
+  std::vector<std::size_t> block_vertices(num_blocks + 1, 0);
+  pool.ParallelFor(0, num_blocks, 1, [&](std::size_t b, std::size_t e) {
+    for (std::size_t block = b; block < e; ++block) {
+      std::size_t count = 0;
+      ForEachLine(data + block_begins[block], data + block_begins[block + 1],
+          [&](const char *p, const char *line_end) {
+            count += is_vertex(p, line_end) ? 1 : 0;
+            return true;
+          });
+      block_vertices[block + 1] = count;
+    }
+  });
+  for (std::size_t i = 0; i < num_blocks; ++i) {
+    block_vertices[i + 1] += block_vertices[i];
+  }
+  mesh->positions.resize(block_vertices[num_blocks] * 3);
+
+  // pass 2: vertices into their slots, triangles per block
+  std::vector<std::vector<uint32_t>> block_indices(num_blocks);
+  std::atomic<bool> parse_ok(true);
+  pool.ParallelFor(0, num_blocks, 1, [&](std::size_t b, std::size_t e) {
+    std::vector<uint32_t> polygon;
+    for (std::size_t block = b; block < e; ++block) {
+      std::size_t vertex = block_vertices[block];
+      std::vector<uint32_t> *indices = &block_indices[block];
+      ForEachLine(data + block_begins[block], data + block_begins[block + 1],
+          [&](const char *p, const char *line_end) {
+            const char *token_begin = nullptr;
+            const char *token_end = nullptr;
+            NextToken(&p, line_end, &token_begin, &token_end);
+            const std::size_t keyword_size = token_end - token_begin;
+            if (keyword_size != 1) {
+              // vt, vn, usemtl and the like
+              return true;
+            }
+            if (*token_begin == 'v') {
+              for (int k = 0; k < 3; ++k) {
+                if (!NextToken(&p, line_end, &token_begin, &token_end) ||
+                    !ParseFloat(token_begin, token_end,
+                        &mesh->positions[vertex * 3 + k])) {
+                  parse_ok = false;
+                  return false;
+                }
+              }
+              ++vertex;
+            } else if (*token_begin == 'f') {
+              // v, v/vt, v//vn or v/vt/vn, negative counting back from the
+              // last vertex so far
+              polygon.clear();
+              while (NextToken(&p, line_end, &token_begin, &token_end)) {
+                const char *slash = std::find(token_begin, token_end, '/');
+                long value = 0;
+                if (!ParseInt(token_begin, slash, &value) || value == 0 ||
+                    (value < 0 && static_cast<std::size_t>(-value) > vertex)) {
+                  parse_ok = false;
+                  return false;
+                }
+                polygon.push_back(static_cast<uint32_t>(value > 0 ?
+                    value - 1 : static_cast<long>(vertex) + value));
+              }
+              AppendFan(polygon.data(), polygon.size(), indices);
+            }
+            return true;
+          });
+    }
+  });
+  if (!parse_ok) {
+    std::cerr << "error : malformed line in OBJ file.\n";
+    return false;
+  }
+  GatherBlocks(block_indices, &mesh->indices);
+  return true;
+}
+
+void ComputeVertexNormals(MeshData *mesh) {
+  TRACE_SCOPE("ComputeVertexNormals");
+  const std::size_t num_vertices = mesh->num_vertices();
+  const std::vector<float> &positions = mesh->positions;
+  std::vector<float> &normals = mesh->normals;
+  normals.assign(num_vertices * 3, 0.f);
+  // the cross product is twice the triangle area long
+  for (std::size_t t = 0; t < mesh->num_triangles(); ++t) {
+    const uint32_t *triangle = &mesh->indices[t * 3];
+    const Eigen::Map<const Eigen::Vector3f> a(&positions[triangle[0] * 3]);
+    const Eigen::Map<const Eigen::Vector3f> b(&positions[triangle[1] * 3]);
+    const Eigen::Map<const Eigen::Vector3f> c(&positions[triangle[2] * 3]);
+    const Eigen::Vector3f normal = (b - a).cross(c - a);
+    for (int k = 0; k < 3; ++k) {
+      Eigen::Map<Eigen::Vector3f>(&normals[triangle[k] * 3]) += normal;
+    }
+  }
+  ThreadPool::Global().ParallelFor(0, num_vertices, kRecordGrain,
+      [&](std::size_t b, std::size_t e) {
+        for (std::size_t i = b; i < e; ++i) {
+          Eigen::Map<Eigen::Vector3f> normal(&normals[i * 3]);
+          const float norm = normal.norm();
+          if (norm > 0.f) {
+            normal /= norm;
+          }
+        }
+      });
+}
+
+}  // namespace ogl_viewer
@@ -0,0 +1,291 @@
+#include "mesh_optimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "thread_pool.h"
+#include "tracer.h"
+
+namespace ogl_viewer {
+
+namespace {
+
+// vertices per parallel task when moving vertex data
+const std::size_t kRemapGrain = 1 << 16;
+// vertices of a 16-bit indexed batch
+const std::size_t kMaxBatchVertices = 65536;
+
+// Forsyth's scoring: vertices of the last triangle get a fixed score, older
+// cache entries decay with their position, and vertices with few triangles
+// left get a boost so that they are finished off instead of left behind
+const float kCacheDecayPower = 1.5f;
+const float kLastTriangleScore = 0.75f;
+const float kValenceBoostScale = 2.0f;
+const float kValenceBoostPower = 0.5f;
+// valences with a tabulated boost, larger ones are computed
+const uint32_t kMaxTabulatedValence = 64;
+
+const uint32_t kUnused = std::numeric_limits<uint32_t>::max();
+
+class VertexScorer {
+ public:
+  VertexScorer() {
+    for (int i = 0; i < kVertexCacheSize; ++i) {
+      if (i < 3) {
+        cache_scores_[i] = kLastTriangleScore;
+      } else {
+        const float scale = 1.f / (kVertexCacheSize - 3);
+        cache_scores_[i] = std::pow(1.f - (i - 3) * scale, kCacheDecayPower);
+      }
+    }
+    valence_scores_[0] = 0.f;
+    for (uint32_t i = 1; i < kMaxTabulatedValence; ++i) {
+      valence_scores_[i] = ValenceBoost(i);
+    }
+  }
+
+  // -1 for a vertex without triangles left, so that it never attracts
+  float Score(int cache_position, uint32_t remaining) const {
+    if (remaining == 0) {
+      return -1.f;
+    }
+    const float cache_score =
+        cache_position >= 0 ? cache_scores_[cache_position] : 0.f;
+    return cache_score + (remaining < kMaxTabulatedValence ?
+        valence_scores_[remaining] : ValenceBoost(remaining));
+  }
+
+ private:
+  static float ValenceBoost(uint32_t remaining) {
+    return kValenceBoostScale *
+        std::pow(static_cast<float>(remaining), -kValenceBoostPower);
+  }
+
+ private:
+  float cache_scores_[kVertexCacheSize];
+  float valence_scores_[kMaxTabulatedValence];
+};
+
+}  // namespace
+
+VertexCacheStats AnalyzeVertexCache(const std::vector<uint32_t> &indices,
+    std::size_t num_vertices, int cache_size) {
+  VertexCacheStats stats;
+  if (indices.empty()) {
+    return stats;
+  }
+  // a vertex is cached while fewer than cache_size misses came after its own
+  std::vector<std::size_t> miss_time(num_vertices, 0);
+  std::size_t time = cache_size + 1;
+  std::size_t misses = 0;
+  std::size_t used_vertices = 0;
+  for (uint32_t index : indices) {
+    if (miss_time[index] == 0) {
+      ++used_vertices;
+    }
+    if (time - miss_time[index] > static_cast<std::size_t>(cache_size)) {
+      miss_time[index] = time++;
+      ++misses;
+    }
+  }
+  stats.acmr = static_cast<double>(misses) / (indices.size() / 3);
+  stats.atvr = static_cast<double>(misses) / used_vertices;
+  return stats;
+}
+
+void OptimizeVertexCache(std::vector<uint32_t> *indices,
+    std::size_t num_vertices) {
+  TRACE_SCOPE("OptimizeVertexCache");
+  const std::size_t num_triangles = indices->size() / 3;
+  if (num_triangles == 0) {
+    return;
+  }
+  const std::vector<uint32_t> &input = *indices;
+  const VertexScorer scorer;
+
+  // triangles of every vertex; the first remaining[v] of its range are
+  // those not emitted yet
+  std::vector<uint32_t> remaining(num_vertices, 0);
+  for (uint32_t index : input) {
+    ++remaining[index];
+  }
+  std::vector<std::size_t> offsets(num_vertices + 1, 0);
+  for (std::size_t v = 0; v < num_vertices; ++v) {
+    offsets[v + 1] = offsets[v] + remaining[v];
+  }
+  std::vector<uint32_t> adjacency(input.size());
+  {
+    std::vector<std::size_t> fill(offsets.begin(), offsets.end() - 1);
+    for (std::size_t i = 0; i < input.size(); ++i) {
+      adjacency[fill[input[i]]++] = static_cast<uint32_t>(i / 3);
+    }
+  }
+
+  std::vector<float> vertex_scores(num_vertices);
+  for (std::size_t v = 0; v < num_vertices; ++v) {
+    vertex_scores[v] = scorer.Score(-1, remaining[v]);
+  }
+  std::vector<float> triangle_scores(num_triangles);
+  std::size_t best = 0;
+  for (std::size_t t = 0; t < num_triangles; ++t) {
+    triangle_scores[t] = vertex_scores[input[t * 3]] +
+        vertex_scores[input[t * 3 + 1]] + vertex_scores[input[t * 3 + 2]];
+    if (triangle_scores[t] > triangle_scores[best]) {
+      best = t;
+    }
+  }
+
+  std::vector<uint8_t> emitted(num_triangles, 0);
+  std::vector<uint32_t> output;
+  output.reserve(input.size());
+  // LRU order, with room for the three vertices pushed in front
+  uint32_t cache[kVertexCacheSize + 3];
+  std::size_t cache_count = 0;
+  std::size_t dead_end_cursor = 0;
+  const std::size_t kNoTriangle = std::numeric_limits<std::size_t>::max();
+
+  for (std::size_t n = 0; n < num_triangles; ++n) {
+    if (best == kNoTriangle) {
+      // nothing in the cache has triangles left, go on in input order
+      while (emitted[dead_end_cursor]) {
+        ++dead_end_cursor;
+      }
+      best = dead_end_cursor;
+    }
+    const uint32_t *triangle = &input[best * 3];
+    emitted[best] = 1;
+    output.insert(output.end(), triangle, triangle + 3);
+
+    uint32_t new_cache[kVertexCacheSize + 3];
+    std::size_t new_count = 0;
+    for (int k = 0; k < 3; ++k) {
+      const uint32_t v = triangle[k];
+      uint32_t *begin = &adjacency[offsets[v]];
+      uint32_t *end = begin + remaining[v];
+      std::iter_swap(std::find(begin, end, static_cast<uint32_t>(best)),
+          end - 1);
+      --remaining[v];
+      if (std::find(new_cache, new_cache + new_count, v) ==
+          new_cache + new_count) {
+        new_cache[new_count++] = v;
+      }
+    }
+    const std::size_t num_new_entries = new_count;
+    for (std::size_t i = 0; i < cache_count; ++i) {
+      if (std::find(new_cache, new_cache + num_new_entries, cache[i]) ==
+          new_cache + num_new_entries) {
+        new_cache[new_count++] = cache[i];
+      }
+    }
+
+    // rescore the cached and evicted vertices and their triangles
+    for (std::size_t i = 0; i < new_count; ++i) {
+      const uint32_t v = new_cache[i];
+      const int position = i < kVertexCacheSize ? static_cast<int>(i) : -1;
+      const float score = scorer.Score(position, remaining[v]);
+      const float delta = score - vertex_scores[v];
+      vertex_scores[v] = score;
+      for (std::size_t j = offsets[v]; j < offsets[v] + remaining[v]; ++j) {
+        triangle_scores[adjacency[j]] += delta;
+      }
+    }
+    cache_count = std::min<std::size_t>(new_count, kVertexCacheSize);
+    std::copy(new_cache, new_cache + cache_count, cache);
+
+    // the next triangle shares a vertex with the cache when possible
+    best = kNoTriangle;
+    float best_score = -std::numeric_limits<float>::max();
+    for (std::size_t i = 0; i < cache_count; ++i) {
+      const uint32_t v = cache[i];
+      for (std::size_t j = offsets[v]; j < offsets[v] + remaining[v]; ++j) {
+        const uint32_t t = adjacency[j];
+        if (triangle_scores[t] > best_score) {
+          best_score = triangle_scores[t];
+          best = t;
+        }
+      }
+    }
+  }
+  indices->swap(output);
+}
+
+std::size_t OptimizeVertexFetch(std::vector<uint32_t> *indices,
+    std::size_t num_vertices, std::vector<uint32_t> *remap) {
+  TRACE_SCOPE("OptimizeVertexFetch");
+  remap->assign(num_vertices, kUnused);
+  uint32_t next = 0;
+  for (uint32_t &index : *indices) {
+    uint32_t &target = (*remap)[index];
+    if (target == kUnused) {
+      target = next++;
+    }
+    index = target;
+  }
+  return next;
+}
+
+void RemapVertices(const std::vector<uint32_t> &remap,
+    std::size_t new_num_vertices, int components, std::vector<float> *values) {
+  std::vector<float> remapped(new_num_vertices * components);
+  ThreadPool::Global().ParallelFor(0, remap.size(), kRemapGrain,
+      [&](std::size_t b, std::size_t e) {
+        for (std::size_t v = b; v < e; ++v) {
+          if (remap[v] == kUnused) {
+            continue;
+          }
+          std::copy(values->begin() + v * components,
+              values->begin() + (v + 1) * components,
+              remapped.begin() + remap[v] * components);
+        }
+      });
+  values->swap(remapped);
+}
+
+void SplitShortIndices(const std::vector<uint32_t> &indices,
+    std::size_t num_vertices, std::vector<uint16_t> *short_indices,
+    std::vector<uint32_t> *vertex_sources, std::vector<MeshBatch> *batches) {
+  TRACE_SCOPE("SplitShortIndices");
+  short_indices->clear();
+  short_indices->reserve(indices.size());
+  vertex_sources->clear();
+  vertex_sources->reserve(num_vertices);
+  batches->clear();
+
+  // index of every vertex within the batch that last used it
+  std::vector<uint32_t> batch_index(num_vertices, 0);
+  std::vector<uint32_t> batch_of(num_vertices, kUnused);
+  MeshBatch batch;
+  uint32_t batch_id = 0;
+  for (std::size_t t = 0; t * 3 < indices.size(); ++t) {
+    const uint32_t *triangle = &indices[t * 3];
+    std::size_t new_vertices = 0;
+    for (int k = 0; k < 3; ++k) {
+      const bool repeated = (k > 0 && triangle[k] == triangle[0]) ||
+          (k > 1 && triangle[k] == triangle[1]);
+      new_vertices += batch_of[triangle[k]] != batch_id && !repeated;
+    }
+    if (batch.num_vertices + new_vertices > kMaxBatchVertices) {
+      batches->push_back(batch);
+      batch = MeshBatch();
+      batch.first_index = t * 3;
+      batch.first_vertex = vertex_sources->size();
+      ++batch_id;
+    }
+    for (int k = 0; k < 3; ++k) {
+      const uint32_t v = triangle[k];
+      if (batch_of[v] != batch_id) {
+        batch_of[v] = batch_id;
+        batch_index[v] = static_cast<uint32_t>(batch.num_vertices++);
+        vertex_sources->push_back(v);
+      }
+      short_indices->push_back(static_cast<uint16_t>(batch_index[v]));
+    }
+    batch.num_indices += 3;
+  }
+  if (batch.num_indices > 0) {
+    batches->push_back(batch);
+  }
+}
+
+}  // namespace ogl_viewer
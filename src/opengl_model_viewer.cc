@@ -1,10 +1,44 @@
 #include "opengl_model_viewer.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <iomanip>
 #include <iostream>
+#include <sstream>
 
 #include "coordinate_axes.h"
+#include "pcd_writer.h"
+#include "tracer.h"
 
 namespace ogl_viewer {
 
+namespace {
+
+// seconds between two checks of the shader files
+const double kShaderCheckInterval = 0.5;
+// longest sleep between looks at the live ring and at pending picks
+const double kLivePollInterval = 0.005;
+const double kPickPollInterval = 0.01;
+const double kCapturePollInterval = 0.01;
+const double kExportPollInterval = 0.05;
+// camera inputs of the motion-to-photon latency percentiles
+const std::size_t kInputLatencyHistory = 128;
+// of the polylines of a file, in turn
+const Eigen::Vector4f kOverlayColors[] = {
+    Eigen::Vector4f(1.f, 0.6f, 0.1f, 1.f),
+    Eigen::Vector4f(0.2f, 0.9f, 0.3f, 1.f),
+    Eigen::Vector4f(0.3f, 0.6f, 1.f, 1.f)};
+// of the box around the selected points
+const Eigen::Vector4f kSelectionColor(1.f, 1.f, 0.2f, 1.f);
+// cursor movement in screen coordinates before a lasso takes a new vertex
+const float kLassoStep = 3.f;
+// points listed by N
+const std::size_t kNearestPoints = 8;
+
+}  // namespace
+
 OpenGLModelViewer::OpenGLModelViewer() {
 }
 
@@ -36,6 +70,7 @@ bool OpenGLModelViewer::Init(const char* window_name, int width, int height,
   // we don't want the old OpenGL
   glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
+  window_name_ = window_name;
   glfw_window_ = glfwCreateWindow(width, height, window_name,
       nullptr, nullptr);
   if (glfw_window_ == nullptr) {
@@ -53,26 +88,101 @@ bool OpenGLModelViewer::Init(const char* window_name, int width, int height,
       OpenGLModelViewer::MouseButtonCallback);
   glfwSetCursorPosCallback(glfw_window_, OpenGLModelViewer::CursorPosCallback);
   glfwSetScrollCallback(glfw_window_, OpenGLModelViewer::ScrollCallback);
+  glfwSetKeyCallback(glfw_window_, OpenGLModelViewer::KeyCallback);
+  glfwSetWindowRefreshCallback(glfw_window_,
+      OpenGLModelViewer::WindowRefreshCallback);
 
   if (glewInit() != 0) {
     std::cerr << "failed to init GLEW.\n";
     return false;
   }
 
+  return InitScene(width, height, model_file_path);
+}
+
+bool OpenGLModelViewer::InitScene(int width, int height,
+    const std::string &model_file_path) {
+  if (!options_.trace_path.empty()) {
+    Tracer::Global().set_enabled(true);
+    Tracer::Global().SetThreadName("render");
+  }
+  show_stats_overlay_ = options_.stats_overlay;
+  if (!options_.trace_path.empty() || show_stats_overlay_) {
+    gpu_timer_.reset(new GpuTimer);
+  }
+  cpu_frame_ms_.assign(GpuTimer::kFrameHistory, 0.f);
+
   glEnable(GL_DEPTH_TEST);
 
-  // TODO: init shader with config
+  // a failed build leaves the scene undrawn until the files are fixed
   shader_.reset(new GLSLShader);
-  shader_->Init("./data/shader/rainbow.vert",
-      "./data/shader/rainbow.frag");
-  // shader_->Init("./simple.vert", "./simple.frag");
+  shader_->set_use_binary_cache(options_.use_shader_cache);
+  shader_->Init(options_.shader_dir + "/rainbow.vert",
+      options_.shader_dir + "/rainbow.frag");
+
+  render_queue_.reset(new RenderQueue);
+  height_colormap_.reset(new Colormap);
+  render_queue_->set_height_colormap(height_colormap_->texture());
+  pick_buffer_.reset(new PickBuffer);
+  frame_recorder_.reset(new FrameRecorder);
+  if (options_.record && !StartRecording()) {
+    return false;
+  }
 
   // coordinates axes
   coord_axes_.reset(new CoordinateAxes);
+  coord_axes_->set_model_matrix((Eigen::UniformScaling<float>(3.0f) *
+      Eigen::Isometry3f::Identity()).matrix());
+  poses_.reset(new GizmoBatch(GizmoShape::kAxes, kPickPose));
+  boxes_.reset(new GizmoBatch(GizmoShape::kBox, kPickBox));
+  polylines_.reset(new PolylineBatch(kPickPolyline));
+  selection_box_.reset(new GizmoBatch(GizmoShape::kBox, kPickNone));
+  synthetic_overlays_.reset(new SyntheticOverlays(options_.synthetic_gizmos,
+      options_.synthetic_segments));
+  if (!LoadOverlays()) {
+    return false;
+  }
 
   // point cloud
   point_cloud_.reset(new PointCloud);
-  if (!point_cloud_->LoadDataFromFile(model_file_path)) {
+  point_cloud_->set_use_pcl_loader(options_.use_pcl_loader);
+  point_cloud_->set_use_lod(options_.use_lod);
+  point_cloud_->set_point_budget(options_.point_budget);
+  point_cloud_->set_quantize_positions(options_.quantize_positions);
+  point_cloud_->set_use_cache(options_.use_cache);
+  point_cloud_->set_build_index(options_.build_index);
+  point_cloud_->set_color_attribute(options_.color_attribute);
+  point_cloud_->SetColormapScaling(options_.colormap_scaling);
+  VoxelFilter voxel_filter;
+  voxel_filter.set_leaf_size(options_.voxel_leaf_size);
+  voxel_filter.set_target_points(options_.voxel_target_points);
+  point_cloud_->set_voxel_filter(voxel_filter);
+  bool loaded = false;
+  if (IsMeshPath(model_file_path)) {
+    // the point cloud stays empty
+    mesh_.reset(new TriangleMesh);
+    mesh_->set_optimize(options_.optimize_meshes);
+    mesh_->set_short_indices(options_.short_mesh_indices);
+    loaded = mesh_->LoadDataFromFile(model_file_path);
+  } else if (IsLivePath(model_file_path)) {
+    // waits for a producer, the ring is mapped once it exists
+    live_cloud_.reset(new LiveCloud(LiveRingName(model_file_path)));
+    loaded = true;
+  } else if (IsDirectory(model_file_path)) {
+    // the point cloud stays empty, frames are streamed instead
+    sequence_cloud_.reset(new SequenceCloud);
+    sequence_cloud_->set_frame_rate(options_.frame_rate);
+    PointSequence &sequence = sequence_cloud_->sequence();
+    sequence.set_prefetch_frames(options_.prefetch_frames);
+    sequence.set_cache_bytes(options_.frame_cache_bytes);
+    sequence.set_compress(options_.compress_frames);
+    loaded = sequence_cloud_->Open(model_file_path);
+  } else if (options_.async_loading) {
+    loaded = point_cloud_->StartLoading(model_file_path);
+  } else {
+    loaded = point_cloud_->LoadDataFromFile(model_file_path);
+  }
+  if (!loaded) {
     return false;
   }
 
@@ -83,20 +193,598 @@ bool OpenGLModelViewer::Init(const char* window_name, int width, int height,
   return true;
 }
 
+bool OpenGLModelViewer::LoadOverlays() {
+  typedef std::vector<Eigen::Affine3f,
+      Eigen::aligned_allocator<Eigen::Affine3f>> Transforms;
+  if (!options_.poses_path.empty()) {
+    Transforms poses;
+    if (!LoadPoseFile(options_.poses_path, &poses)) {
+      return false;
+    }
+    for (const Eigen::Affine3f &pose : poses) {
+      poses_->Add(pose, Eigen::Vector4f::Ones());
+    }
+    poses_->Upload();
+    // and the trajectory through them
+    Polyline trajectory;
+    for (const Eigen::Affine3f &pose : poses) {
+      trajectory.push_back(pose.translation());
+    }
+    polylines_->AddPolyline(trajectory, Eigen::Vector4f::Ones());
+    std::cout << "loaded " << poses.size() << " poses from "
+        << options_.poses_path << "\n";
+  }
+  if (!options_.boxes_path.empty()) {
+    Transforms boxes;
+    std::vector<Eigen::Vector4f,
+        Eigen::aligned_allocator<Eigen::Vector4f>> colors;
+    if (!LoadBoxFile(options_.boxes_path, &boxes, &colors)) {
+      return false;
+    }
+    for (std::size_t i = 0; i < boxes.size(); ++i) {
+      boxes_->Add(boxes[i], colors[i]);
+    }
+    boxes_->Upload();
+    std::cout << "loaded " << boxes.size() << " boxes from "
+        << options_.boxes_path << "\n";
+  }
+  if (!options_.polylines_path.empty()) {
+    std::vector<Polyline> polylines;
+    if (!LoadPolylineFile(options_.polylines_path, &polylines)) {
+      return false;
+    }
+    for (std::size_t i = 0; i < polylines.size(); ++i) {
+      polylines_->AddPolyline(polylines[i], kOverlayColors[i % 3]);
+    }
+    std::cout << "loaded " << polylines.size() << " polylines from "
+        << options_.polylines_path << "\n";
+  }
+  polylines_->Upload();
+  return true;
+}
+
+void OpenGLModelViewer::UpdateOverlays(double time) {
+  synthetic_overlays_->UpdateVehicles(time, SceneBounds(), poses_.get(),
+      boxes_.get());
+  // over the scene once it is loaded
+  if (!point_cloud_->loading()) {
+    synthetic_overlays_->AppendLanes(SceneBounds(), polylines_.get());
+  }
+  // only what was appended since the last frame
+  const std::size_t num_segments = polylines_->num_segments();
+  polylines_->Upload();
+  redraw_ = redraw_ || polylines_->num_segments() != num_segments;
+}
+
+const Eigen::AlignedBox3f& OpenGLModelViewer::SceneBounds() const {
+  return mesh_ ? mesh_->bounds() : point_cloud_->bounds();
+}
+
 void OpenGLModelViewer::Run() {
-  int display_w = 0;
-  int display_h = 0;
-  while(!glfwWindowShouldClose(glfw_window_)) {
-    glfwPollEvents();
+  if (Tracer::enabled()) {
+    Tracer::Global().SetThreadName("input");
+  }
+  PublishViewState();
+  // from here on the context belongs to the render thread, this one only
+  // waits for input, so camera moves never queue up behind a long frame
+  glfwMakeContextCurrent(nullptr);
+  quit_ = false;
+  render_thread_ = std::thread(&OpenGLModelViewer::RenderLoop, this);
+  while (!glfwWindowShouldClose(glfw_window_)) {
+    glfwWaitEvents();
+    // posted by the render thread, GLFW only sets titles from this one
+    std::string title;
+    {
+      std::lock_guard<std::mutex> lock(title_mutex_);
+      title.swap(pending_title_);
+    }
+    if (!title.empty()) {
+      glfwSetWindowTitle(glfw_window_, title.c_str());
+    }
+  }
+  quit_ = true;
+  WakeRenderer();
+  render_thread_.join();
+  glfwMakeContextCurrent(glfw_window_);
+  WriteTrace();
+}
+
+void OpenGLModelViewer::RenderLoop() {
+  glfwMakeContextCurrent(glfw_window_);
+  if (Tracer::enabled()) {
+    Tracer::Global().SetThreadName("render");
+  }
+  input_latency_ms_.assign(kInputLatencyHistory, 0.f);
+  num_input_latencies_ = 0;
+  while (!quit_) {
+    TRACE_SCOPE("Frame");
+    const bool animating = !options_.on_demand || Animating();
+    WaitForWork(animating);
+    if (quit_) {
+      break;
+    }
+    std::vector<std::pair<int, int>> keys;
+    ScreenPolygon lasso;
+    {
+      std::lock_guard<std::mutex> lock(render_mutex_);
+      keys.swap(pending_keys_);
+      lasso.swap(pending_lasso_);
+      redraw_ = redraw_ || refresh_pending_;
+      refresh_pending_ = false;
+    }
+    for (const std::pair<int, int> &key : keys) {
+      HandleKey(key.first, key.second);
+    }
+    if (!lasso.empty()) {
+      SelectLasso(lasso);
+    }
+    frame_recorder_->Poll();
+
+    if (point_cloud_->loading()) {
+      TRACE_GPU_SCOPE(gpu_timer_.get(), "Uploads");
+      point_cloud_->PumpUploads(options_.upload_bytes_per_frame);
+    }
+    point_cloud_->UpdateAttributes();
+    point_cloud_->UpdateIndex();
+    UpdateExport();
+    if (sequence_cloud_) {
+      sequence_cloud_->Update();
+    }
+    if (live_cloud_) {
+      const std::size_t frames_shown = live_cloud_->frames_shown();
+      live_cloud_->Update();
+      redraw_ = redraw_ || live_cloud_->frames_shown() != frames_shown;
+    }
+    UpdateOverlays(glfwGetTime());
+    CheckShaders();
+
+    // the newest camera and window, however many inputs came since the
+    // last frame
+    const ViewState view = view_state_.Load();
+    frame_size_ = Eigen::Vector2i(view.framebuffer_size[0],
+        view.framebuffer_size[1]);
+    frame_window_size_ = Eigen::Vector2i(view.window_size[0],
+        view.window_size[1]);
+    frame_cursor_ = Eigen::Vector2d(view.cursor[0], view.cursor[1]);
+    if (frame_size_ != drawn_size_ ||
+        view.camera_sequence != drawn_camera_sequence_) {
+      redraw_ = true;
+    }
+    const bool refine = !redraw_ && !animating && refining_;
+    if (!redraw_ && !animating && !refine) {
+      // the window still shows the last frame
+      PickHovered(false);
+      UpdateWindowTitle();
+      continue;
+    }
+
+    pick_buffer_->Resize(frame_size_.x(), frame_size_.y());
+    pick_buffer_->Bind();
+    glViewport(0, 0, frame_size_.x(), frame_size_.y());
+    if (refine) {
+      refining_ = DrawRefinement();
+      if (!refining_) {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        continue;
+      }
+    } else {
+      SetFrameCamera(Eigen::Map<const Eigen::Matrix4f>(view.view_matrix),
+          Eigen::Map<const Eigen::Matrix4f>(view.projection_matrix));
+      BeginFrameStats();
+      pick_buffer_->Clear(Eigen::Vector4f(0.5f, 0.5f, 0.5f, 1.0f));
+      Draw();
+      drawn_size_ = frame_size_;
+      drawn_camera_sequence_ = view.camera_sequence;
+      redraw_ = false;
+      refining_ = options_.on_demand;
+    }
+    PickHovered(true);
+    frame_recorder_->Capture(pick_buffer_->framebuffer(), frame_size_);
+    pick_buffer_->BlitColor(0);
+
+    if (point_cloud_->loading()) {
+      DrawProgressBar(point_cloud_->load_progress());
+    } else if (sequence_cloud_) {
+      // playback position
+      DrawProgressBar(sequence_cloud_->frame_shown() ?
+          (sequence_cloud_->shown_frame() + 1) /
+          static_cast<float>(sequence_cloud_->num_frames()) : 0.0f);
+    }
+    if (show_stats_overlay_) {
+      DrawStatsOverlay();
+    }
 
-    glfwGetFramebufferSize(glfw_window_, &display_w, &display_h);
-    glViewport(0, 0, display_w, display_h);
-    glClearColor(0.5f, 0.5f, 0.5f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    {
+      TRACE_SCOPE("glfwSwapBuffers");
+      glfwSwapBuffers(glfw_window_);
+    }
+    if (live_cloud_) {
+      live_cloud_->FramePresented();
+    }
+    // the first camera is that of the start, not of an input
+    if (drawn_camera_sequence_ != presented_camera_sequence_) {
+      if (presented_camera_sequence_ > 0) {
+        input_latency_ms_[num_input_latencies_ % kInputLatencyHistory] =
+            (Tracer::NowMicros() - view.input_time_us) * 1e-3f;
+        ++num_input_latencies_;
+      }
+      presented_camera_sequence_ = drawn_camera_sequence_;
+    }
+    ++stats_frames_;
+    UpdateWindowTitle();
+  }
+  // the last frames captured are still on their way
+  frame_recorder_->StopRecording();
+  frame_recorder_->Finish();
+  if (export_future_.valid()) {
+    export_future_.wait();
+    UpdateExport();
+  }
+  glfwMakeContextCurrent(nullptr);
+}
 
-    Draw();
+void OpenGLModelViewer::PublishViewState() {
+  ViewState state = published_state_;
+  Eigen::Map<Eigen::Matrix4f> view_matrix(state.view_matrix);
+  Eigen::Map<Eigen::Matrix4f> projection_matrix(state.projection_matrix);
+  if (view_matrix != camera_control_->GetViewMatrix() ||
+      projection_matrix != camera_control_->GetProjectionMatrix()) {
+    view_matrix = camera_control_->GetViewMatrix();
+    projection_matrix = camera_control_->GetProjectionMatrix();
+    ++state.camera_sequence;
+    state.input_time_us = Tracer::NowMicros();
+  }
+  glfwGetFramebufferSize(glfw_window_, &state.framebuffer_size[0],
+      &state.framebuffer_size[1]);
+  glfwGetWindowSize(glfw_window_, &state.window_size[0],
+      &state.window_size[1]);
+  glfwGetCursorPos(glfw_window_, &state.cursor[0], &state.cursor[1]);
+  published_state_ = state;
+  view_state_.Store(state);
+  WakeRenderer();
+}
 
-    glfwSwapBuffers(glfw_window_);
+void OpenGLModelViewer::WakeRenderer() {
+  {
+    std::lock_guard<std::mutex> lock(render_mutex_);
+    wake_pending_ = true;
+  }
+  render_wake_.notify_one();
+}
+
+bool OpenGLModelViewer::Animating() const {
+  return point_cloud_->loading() || point_cloud_->attribute_loading() ||
+      (sequence_cloud_ && !sequence_cloud_->settled()) ||
+      synthetic_overlays_->animating() ||
+      show_stats_overlay_;
+}
+
+void OpenGLModelViewer::WaitForWork(bool animating) {
+  std::unique_lock<std::mutex> lock(render_mutex_);
+  if (animating || redraw_ || refining_ || wake_pending_) {
+    wake_pending_ = false;
+    return;
+  }
+  TRACE_SCOPE("WaitForWork");
+  double timeout = -1.0;
+  if (options_.watch_shaders) {
+    timeout = kShaderCheckInterval;
+  }
+  if (live_cloud_) {
+    timeout = kLivePollInterval;
+  }
+  if (pick_buffer_->pending() && (timeout < 0.0 ||
+      kPickPollInterval < timeout)) {
+    timeout = kPickPollInterval;
+  }
+  if (frame_recorder_->pending() && (timeout < 0.0 ||
+      kCapturePollInterval < timeout)) {
+    timeout = kCapturePollInterval;
+  }
+  if (export_future_.valid() && (timeout < 0.0 ||
+      kExportPollInterval < timeout)) {
+    timeout = kExportPollInterval;
+  }
+  const auto woken = [this]() {
+    return wake_pending_ || quit_;
+  };
+  if (timeout < 0.0) {
+    render_wake_.wait(lock, woken);
+  } else {
+    render_wake_.wait_for(lock, std::chrono::duration<double>(timeout),
+        woken);
+  }
+  wake_pending_ = false;
+}
+
+bool OpenGLModelViewer::DrawRefinement() {
+  TRACE_SCOPE("OpenGLModelViewer::DrawRefinement");
+  if (!point_cloud_->RefineView()) {
+    return false;
+  }
+  // the frame uniforms are still those of the last Draw
+  point_cloud_->Enqueue(shader_.get(), render_queue_.get());
+  TRACE_GPU_SCOPE(gpu_timer_.get(), "Refinement");
+  render_queue_->Flush();
+  return true;
+}
+
+void OpenGLModelViewer::BeginFrameStats() {
+  if (!gpu_timer_) {
+    return;
+  }
+  gpu_timer_->BeginFrame();
+  const int64_t now_us = Tracer::NowMicros();
+  if (last_frame_us_ >= 0) {
+    cpu_frame_ms_[frame_index_ % GpuTimer::kFrameHistory] =
+        (now_us - last_frame_us_) * 1e-3f;
+  }
+  last_frame_us_ = now_us;
+  ++frame_index_;
+}
+
+void OpenGLModelViewer::WriteTrace() {
+  if (options_.trace_path.empty()) {
+    return;
+  }
+  if (gpu_timer_) {
+    // collect the GPU passes still in flight
+    glFinish();
+    gpu_timer_->BeginFrame();
+  }
+  Tracer::Global().WriteChromeTrace(options_.trace_path);
+}
+
+void OpenGLModelViewer::CheckShaders() {
+  if (!options_.watch_shaders) {
+    return;
+  }
+  const double now = glfwGetTime();
+  if (now - shader_check_time_ < kShaderCheckInterval) {
+    return;
+  }
+  shader_check_time_ = now;
+  // point buffers and VAOs are untouched, the render queue picks up the new
+  // program and its uniform locations on the next flush
+  if (shader_->ReloadIfChanged()) {
+    redraw_ = true;
+  }
+}
+
+void OpenGLModelViewer::PickHovered(bool frame_drawn) {
+  PickResult pick;
+  if (pick_buffer_->PollPick(&pick)) {
+    hovered_ = pick;
+  }
+  // cursor positions are in screen coordinates, which are not pixels on
+  // high-DPI displays
+  if ((frame_window_size_.array() <= 0).any()) {
+    return;
+  }
+  const Eigen::Vector2i &size = pick_buffer_->size();
+  const Eigen::Vector2i pixel(
+      static_cast<int>(std::floor(frame_cursor_.x() * size.x() /
+          frame_window_size_.x())),
+      static_cast<int>(std::floor(frame_cursor_.y() * size.y() /
+          frame_window_size_.y())));
+  if ((pixel.array() < 0).any() || (pixel.array() >= size.array()).any()) {
+    hovered_ = PickResult();
+    return;
+  }
+  if (!frame_drawn && pixel == pick_pixel_) {
+    return;
+  }
+  pick_pixel_ = pixel;
+  // the camera of the frame in the pick buffer, not the newest one
+  pick_buffer_->RequestPick(pixel, frame_projection_matrix_ *
+      frame_view_matrix_);
+}
+
+std::string OpenGLModelViewer::DescribePick(const PickResult &pick) const {
+  if (!pick.hit) {
+    return "";
+  }
+  std::ostringstream oss;
+  if (pick.pick_id == kPickPointCloud) {
+    std::size_t chunk = 0;
+    std::size_t point_index = 0;
+    if (!point_cloud_->LookupVertex(pick.vertex, &chunk, &point_index)) {
+      return "";
+    }
+    oss << "point " << point_index << " (chunk " << chunk << ")";
+  } else if (pick.pick_id == kPickSequence && sequence_cloud_) {
+    oss << "point " << pick.vertex << " of frame "
+        << sequence_cloud_->shown_frame() + 1;
+  } else if (pick.pick_id == kPickLive && live_cloud_) {
+    oss << "point " << pick.vertex << " of #"
+        << live_cloud_->stats().sequence;
+  } else if (pick.pick_id == kPickMesh && mesh_) {
+    std::size_t file_vertex = 0;
+    if (!mesh_->LookupVertex(pick.vertex, &file_vertex)) {
+      return "";
+    }
+    oss << "vertex " << file_vertex;
+  } else if (pick.pick_id == kPickPose || pick.pick_id == kPickBox) {
+    const bool pose = pick.pick_id == kPickPose;
+    Eigen::Affine3f transform;
+    if (!(pose ? poses_ : boxes_)->LookupInstance(pick.vertex, &transform)) {
+      return "";
+    }
+    oss << (pose ? "pose " : "box ") << pick.vertex;
+  } else if (pick.pick_id == kPickPolyline) {
+    std::size_t polyline = 0;
+    std::size_t segment = 0;
+    if (!polylines_->LookupSegment(pick.vertex, &polyline, &segment)) {
+      return "";
+    }
+    oss << "segment " << segment << " of polyline " << polyline;
+  } else {
+    return "";
+  }
+  oss << std::fixed << std::setprecision(3) << " at ("
+      << pick.position.x() << ", " << pick.position.y() << ", "
+      << pick.position.z() << ")";
+  return oss.str();
+}
+
+std::string OpenGLModelViewer::NextFreePath(const std::string &stem,
+    const std::string &extension, int *counter) {
+  while (true) {
+    std::ostringstream path;
+    path << stem << (*counter)++ << extension;
+    if (!std::ifstream(path.str().c_str())) {
+      return path.str();
+    }
+  }
+}
+
+bool OpenGLModelViewer::StartRecording() {
+  // a new name for every recording, earlier ones are kept
+  const bool raw = options_.record_format == RecordFormat::kRaw;
+  const std::string suffix = raw ? ".rgba" : "_000000.png";
+  std::string prefix = NextFreePath(options_.record_prefix, suffix,
+      &next_recording_);
+  prefix.resize(prefix.size() - suffix.size() + (raw ? 0 : 1));
+  return frame_recorder_->StartRecording(prefix, options_.record_format);
+}
+
+void OpenGLModelViewer::SelectLasso(const ScreenPolygon &lasso) {
+  const PointIndex *index = point_cloud_->index();
+  if (index == nullptr) {
+    std::cout << "no points to select, or they are still being indexed\n";
+    return;
+  }
+  if (lasso.size() < 3 || (frame_window_size_.array() <= 0).any()) {
+    return;
+  }
+  const auto start_time = std::chrono::steady_clock::now();
+  // cursor positions are in screen coordinates, which are not pixels on
+  // high-DPI displays
+  const Eigen::Vector2f scale = frame_size_.cast<float>().cwiseQuotient(
+      frame_window_size_.cast<float>());
+  ScreenPolygon polygon;
+  for (const Eigen::Vector2f &position : lasso) {
+    polygon.push_back(position.cwiseProduct(scale));
+  }
+  // with the camera of the frame the lasso was drawn over
+  std::vector<uint32_t> points;
+  index->SelectPolygon(frame_view_matrix_, frame_projection_matrix_,
+      frame_size_, polygon, &points);
+  SetSelection(&points, "in the lasso", start_time);
+}
+
+void OpenGLModelViewer::HandleSelectionKey(int key) {
+  if (key == GLFW_KEY_X) {
+    std::vector<uint32_t> none;
+    SetSelection(&none, "", std::chrono::steady_clock::now());
+    num_marks_ = 0;
+    return;
+  }
+  const PointIndex *index = point_cloud_->index();
+  if (index == nullptr) {
+    std::cout << "no points to select, or they are still being indexed\n";
+    return;
+  }
+  const auto start_time = std::chrono::steady_clock::now();
+  std::vector<uint32_t> points;
+
+  if (key == GLFW_KEY_B) {
+    Eigen::Affine3f box;
+    if (!hovered_.hit || hovered_.pick_id != kPickBox ||
+        !boxes_->LookupInstance(hovered_.vertex, &box)) {
+      std::cout << "B selects inside the box under the cursor\n";
+      return;
+    }
+    index->SelectOrientedBox(box, &points);
+    SetSelection(&points, "in the box", start_time);
+  } else if (key == GLFW_KEY_G) {
+    if (num_marks_ < 2) {
+      std::cout << "G selects around the point measured before the last "
+          << "(N) within the distance measured\n";
+      return;
+    }
+    index->SelectRadius(marks_[0], (marks_[1] - marks_[0]).norm(), &points);
+    SetSelection(&points, "in the sphere", start_time);
+  } else if (key == GLFW_KEY_N) {
+    if (!hovered_.hit) {
+      std::cout << "N measures at the point under the cursor\n";
+      return;
+    }
+    std::vector<float> squared_distances;
+    index->Nearest(hovered_.position, kNearestPoints, &points,
+        &squared_distances);
+    std::ostringstream oss;
+    oss << std::fixed << std::setprecision(3) << "nearest points to ("
+        << hovered_.position.x() << ", " << hovered_.position.y() << ", "
+        << hovered_.position.z() << "):";
+    for (std::size_t i = 0; i < points.size(); ++i) {
+      oss << " " << index->source_index(points[i]) << " at "
+          << std::sqrt(squared_distances[i]);
+    }
+    marks_[0] = marks_[1];
+    marks_[1] = hovered_.position;
+    num_marks_ = std::min(num_marks_ + 1, 2);
+    if (num_marks_ == 2) {
+      oss << "; " << (marks_[1] - marks_[0]).norm()
+          << " from the point measured before";
+    }
+    std::cout << oss.str() << "\n";
+  } else if (key == GLFW_KEY_E) {
+    if (selection_.empty()) {
+      std::cout << "nothing selected to export\n";
+      return;
+    }
+    if (export_future_.valid()) {
+      std::cout << "still exporting to " << export_path_ << "\n";
+      return;
+    }
+    export_path_ = NextFreePath("selection_", ".pcd", &next_selection_);
+    export_points_ = selection_.size();
+    export_start_time_ = std::chrono::steady_clock::now();
+    // off the render thread like the index build; the index lives as long
+    // as the cloud, the selection is copied
+    export_future_ = std::async(std::launch::async, WriteSelection,
+        export_path_, std::cref(*index), selection_,
+        point_cloud_->source_path());
+    std::cout << "exporting " << export_points_ << " points to "
+        << export_path_ << "\n";
+  }
+}
+
+void OpenGLModelViewer::UpdateExport() {
+  if (!export_future_.valid() || export_future_.wait_for(
+      std::chrono::seconds(0)) != std::future_status::ready) {
+    return;
+  }
+  if (export_future_.get()) {
+    const double elapsed_ms = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - export_start_time_).count();
+    std::cout << "exported " << export_points_ << " points to "
+        << export_path_ << " in " << elapsed_ms << " ms\n";
+  }
+}
+
+void OpenGLModelViewer::SetSelection(std::vector<uint32_t> *points,
+    const char *what, std::chrono::steady_clock::time_point start_time) {
+  selection_.swap(*points);
+  redraw_ = true;
+  selection_box_->Clear();
+  const PointIndex *index = point_cloud_->index();
+  if (!selection_.empty() && index != nullptr) {
+    const Eigen::AlignedBox3f bounds = index->Bounds(selection_);
+    const Eigen::Vector3f sizes = bounds.sizes().cwiseMax(
+        1e-3f * std::max(bounds.sizes().maxCoeff(), 1e-3f));
+    Eigen::Affine3f box = Eigen::Affine3f::Identity();
+    box.translate(bounds.center());
+    box.scale(sizes);
+    selection_box_->Add(box, kSelectionColor);
+  }
+  selection_box_->Upload();
+  if (*what != '\0') {
+    const double elapsed_ms = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start_time).count();
+    std::cout << "selected " << selection_.size() << " points " << what
+        << " in " << elapsed_ms << " ms\n";
   }
 }
 
@@ -104,33 +792,209 @@ void OpenGLModelViewer::Close() {
   glfwSetWindowShouldClose(glfw_window_, 1);
 }
 
-Eigen::Vector2i OpenGLModelViewer::FrameBufferSize() {
-  int width = 0;
-  int height = 0;
-  glfwGetFramebufferSize(glfw_window_, &width, &height);
-  return Eigen::Vector2i(width, height);
+void OpenGLModelViewer::UpdateWindowTitle() {
+  const double now = glfwGetTime();
+  const double elapsed = now - stats_start_time_;
+  if (elapsed < 1.0) {
+    return;
+  }
+
+  const RenderStats &stats = point_cloud_->render_stats();
+  std::ostringstream oss;
+  oss << window_name_ << " | " << std::fixed << std::setprecision(1);
+  if (point_cloud_->loading()) {
+    oss << "loading " << 100.f * point_cloud_->load_progress() << "% | ";
+  }
+  oss << stats_frames_ / elapsed << " fps | ";
+  if (refining_) {
+    oss << "refining | ";
+  }
+  if (sequence_cloud_) {
+    const SequenceCacheStats cache =
+        sequence_cloud_->sequence().cache_stats();
+    oss << "frame " << (sequence_cloud_->frame_shown() ?
+        sequence_cloud_->shown_frame() + 1 : 0) << "/"
+        << sequence_cloud_->num_frames()
+        << (sequence_cloud_->playing() ? "" : " paused") << " | points "
+        << sequence_cloud_->num_points() << " | cached "
+        << cache.cached_frames << " frames " << (cache.cached_bytes >> 20)
+        << " MB | late " << sequence_cloud_->late_frames();
+  } else if (mesh_) {
+    const MeshStats &mesh = mesh_->stats();
+    oss << "triangles " << mesh.num_triangles << " | vertices "
+        << mesh.num_vertices << " | ACMR " << std::setprecision(2)
+        << mesh.drawn_cache.acmr << " ATVR " << mesh.drawn_cache.atvr
+        << std::setprecision(1);
+  } else if (live_cloud_) {
+    const LiveStats live = live_cloud_->stats();
+    if (live.connected) {
+      oss << "live #" << live.sequence << " | points "
+          << live_cloud_->num_points() << " | latency p50 "
+          << live.present_latency_p50_ms << " p99 "
+          << live.present_latency_p99_ms << " ms | skipped "
+          << live.skipped_frames << " torn " << live.torn_frames;
+    } else {
+      oss << "waiting for a producer";
+    }
+  } else {
+    oss << "chunks " << stats.visible_chunks << "/" << stats.total_chunks
+        << " | points " << stats.visible_points << " | color "
+        << (point_cloud_->color_attribute().empty() ?
+            "height" : point_cloud_->color_attribute());
+    if (point_cloud_->attribute_loading()) {
+      oss << " (reading)";
+    }
+  }
+  const std::size_t num_gizmos = poses_->num_drawn() + boxes_->num_drawn();
+  if (num_gizmos > 0) {
+    oss << " | gizmos " << num_gizmos;
+  }
+  if (polylines_->num_segments() > 0) {
+    oss << " | segments " << polylines_->num_segments();
+  }
+  if (!selection_.empty()) {
+    oss << " | selected " << selection_.size();
+  }
+  const std::string hovered = DescribePick(hovered_);
+  if (!hovered.empty()) {
+    oss << " | " << hovered;
+  }
+  std::vector<float> latencies(input_latency_ms_.begin(),
+      input_latency_ms_.begin() + std::min(num_input_latencies_,
+          input_latency_ms_.size()));
+  if (!latencies.empty()) {
+    // from a camera input to the return of the swap that showed it
+    std::sort(latencies.begin(), latencies.end());
+    oss << " | input p50 " << latencies[latencies.size() / 2] << " p99 "
+        << latencies[std::min(latencies.size() - 1,
+            latencies.size() * 99 / 100)] << " ms";
+  }
+  oss << " | gl calls "
+      << render_queue_->stats().gl_calls << " ("
+      << render_queue_->stats().unsorted_gl_calls << " unsorted)";
+  {
+    std::lock_guard<std::mutex> lock(title_mutex_);
+    pending_title_ = oss.str();
+  }
+  glfwPostEmptyEvent();
+
+  stats_frames_ = 0;
+  stats_start_time_ = now;
 }
 
-void OpenGLModelViewer::Draw() {
-  shader_->Use();  // don't forget to "use" our shader
+void OpenGLModelViewer::DrawProgressBar(float progress) {
+  const Eigen::Vector2i size = FrameBufferSize();
+  const int height = std::max(4, size.y() / 100);
+  // scissored clears, no geometry or shader state involved
+  glEnable(GL_SCISSOR_TEST);
+  glScissor(0, 0, size.x(), height);
+  glClearColor(0.2f, 0.2f, 0.2f, 1.0f);
+  glClear(GL_COLOR_BUFFER_BIT);
+  glScissor(0, 0, static_cast<int>(size.x() * progress), height);
+  glClearColor(0.1f, 0.8f, 0.3f, 1.0f);
+  glClear(GL_COLOR_BUFFER_BIT);
+  glDisable(GL_SCISSOR_TEST);
+}
 
-  Eigen::Matrix4f view_matrix = camera_control_->GetViewMatrix();
-  Eigen::Matrix4f projection_matrix = camera_control_->GetProjectionMatrix();
+void OpenGLModelViewer::DrawStatsOverlay() {
+  if (!gpu_timer_) {
+    return;
+  }
+  const Eigen::Vector2i size = FrameBufferSize();
+  const int bar_width = 3;
+  const int width = GpuTimer::kFrameHistory * bar_width;
+  const int height = 100;
+  // the graph spans 0 to 2x the 60 fps frame time
+  const float pixels_per_ms = height / 33.3f;
+  const int left = 10;
+  const int bottom = size.y() - 10 - height;
 
-  shader_->SetUniform("view_matrix", view_matrix);
-  shader_->SetUniform("projection_matrix", projection_matrix);
+  glEnable(GL_SCISSOR_TEST);
+  glScissor(left, bottom, width, height);
+  glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+  glClear(GL_COLOR_BUFFER_BIT);
+  // oldest frame on the left, the current one is not complete yet
+  for (int age = 1; age < GpuTimer::kFrameHistory; ++age) {
+    const int x = left + width - (age + 1) * bar_width;
+    const float cpu_ms = cpu_frame_ms_[
+        (frame_index_ - age + GpuTimer::kFrameHistory) %
+        GpuTimer::kFrameHistory];
+    const int cpu_height = std::min(height,
+        static_cast<int>(cpu_ms * pixels_per_ms));
+    if (cpu_height > 0) {
+      glScissor(x, bottom, bar_width - 1, cpu_height);
+      glClearColor(1.0f, 0.6f, 0.1f, 1.0f);
+      glClear(GL_COLOR_BUFFER_BIT);
+    }
+    const float gpu_ms = gpu_timer_->frame_ms(age);
+    const int gpu_height = std::min(height,
+        static_cast<int>(gpu_ms * pixels_per_ms));
+    if (gpu_height > 0) {
+      glScissor(x, bottom, 1, gpu_height);
+      glClearColor(0.1f, 0.8f, 1.0f, 1.0f);
+      glClear(GL_COLOR_BUFFER_BIT);
+    }
+  }
+  glScissor(left, bottom + static_cast<int>(16.7f * pixels_per_ms), width, 1);
+  glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
+  glClear(GL_COLOR_BUFFER_BIT);
+  glDisable(GL_SCISSOR_TEST);
+}
 
-  shader_->SetUniform("z_clipping", 0);
-  shader_->SetUniform("z_range", Eigen::Vector2f(-5.f, 10.f));
+Eigen::Vector2i OpenGLModelViewer::FrameBufferSize() {
+  return frame_size_;
+}
+
+void OpenGLModelViewer::UpdateHeightColormap() {
+  const Drawable *sources[] = {point_cloud_.get(), sequence_cloud_.get(),
+      live_cloud_.get(), mesh_.get()};
+  // histograms only grow, so a new count means new heights
+  std::size_t count = 0;
+  for (const Drawable *source : sources) {
+    if (source != nullptr) {
+      count += source->height_histogram().count();
+    }
+  }
+  if (count == height_colormap_count_) {
+    return;
+  }
+  ValueHistogram heights;
+  for (const Drawable *source : sources) {
+    if (source != nullptr) {
+      heights.Merge(source->height_histogram());
+    }
+  }
+  height_colormap_->Update(heights, options_.colormap_scaling);
+  height_colormap_count_ = count;
+}
 
-  shader_->SetUniform("color_mode", 2);
-  shader_->SetUniform("model_matrix",
-      (Eigen::UniformScaling<float>(3.0f) *
-          Eigen::Isometry3f::Identity()).matrix());
-  coord_axes_->Draw(shader_.get());
+void OpenGLModelViewer::Draw() {
+  TRACE_SCOPE("OpenGLModelViewer::Draw");
+  UpdateHeightColormap();
+  render_queue_->SetFrameUniforms(frame_view_matrix_, frame_projection_matrix_,
+      height_colormap_->range(), false, FrameBufferSize());
 
-  shader_->SetUniform("color_mode", 0);
-  point_cloud_->Draw(shader_.get());
+  point_cloud_->UpdateView(frame_view_matrix_, frame_projection_matrix_,
+      FrameBufferSize());
+  coord_axes_->Enqueue(shader_.get(), render_queue_.get());
+  poses_->Enqueue(shader_.get(), render_queue_.get());
+  boxes_->Enqueue(shader_.get(), render_queue_.get());
+  polylines_->Enqueue(shader_.get(), render_queue_.get());
+  selection_box_->Enqueue(shader_.get(), render_queue_.get());
+  point_cloud_->Enqueue(shader_.get(), render_queue_.get());
+  if (sequence_cloud_) {
+    sequence_cloud_->Enqueue(shader_.get(), render_queue_.get());
+  }
+  if (live_cloud_) {
+    live_cloud_->Enqueue(shader_.get(), render_queue_.get());
+  }
+  if (mesh_) {
+    mesh_->Enqueue(shader_.get(), render_queue_.get());
+  }
+  {
+    TRACE_GPU_SCOPE(gpu_timer_.get(), "Scene");
+    render_queue_->Flush();
+  }
 }
 
 void OpenGLModelViewer::FrameBufferSizeCallback(GLFWwindow *window,
@@ -141,6 +1005,21 @@ void OpenGLModelViewer::FrameBufferSizeCallback(GLFWwindow *window,
   }
   OpenGLModelViewer *gl_app = static_cast<OpenGLModelViewer*>(user_data);
   gl_app->camera_control_->SetWindowSize(width, height);
+  gl_app->PublishViewState();
+}
+
+void OpenGLModelViewer::WindowRefreshCallback(GLFWwindow *window) {
+  void *user_data = glfwGetWindowUserPointer(window);
+  if (!user_data) {
+    return;
+  }
+  // the window contents were damaged
+  OpenGLModelViewer *gl_app = static_cast<OpenGLModelViewer*>(user_data);
+  {
+    std::lock_guard<std::mutex> lock(gl_app->render_mutex_);
+    gl_app->refresh_pending_ = true;
+  }
+  gl_app->WakeRenderer();
 }
 
 void OpenGLModelViewer::MouseButtonCallback(GLFWwindow* window, int button,
@@ -154,7 +1033,25 @@ void OpenGLModelViewer::MouseButtonCallback(GLFWwindow* window, int button,
   double x = 0.0;
   double y = 0.0;
   glfwGetCursorPos(window, &x, &y);
+  // shift and the left button draw a lasso instead of moving the camera
+  if (button == GLFW_MOUSE_BUTTON_LEFT && button_press_down &&
+      (mods & GLFW_MOD_SHIFT) != 0) {
+    gl_app->lasso_active_ = true;
+    gl_app->lasso_.assign(1, Eigen::Vector2f(x, y));
+    return;
+  }
+  if (button == GLFW_MOUSE_BUTTON_LEFT && gl_app->lasso_active_) {
+    gl_app->lasso_active_ = false;
+    {
+      std::lock_guard<std::mutex> lock(gl_app->render_mutex_);
+      gl_app->pending_lasso_.swap(gl_app->lasso_);
+    }
+    gl_app->lasso_.clear();
+    gl_app->WakeRenderer();
+    return;
+  }
   gl_app->camera_control_->OnMouseButton(x, y, button, button_press_down);
+  gl_app->PublishViewState();
 }
 
 void OpenGLModelViewer::CursorPosCallback(GLFWwindow* window,
@@ -164,7 +1061,105 @@ void OpenGLModelViewer::CursorPosCallback(GLFWwindow* window,
     return;
   }
   OpenGLModelViewer *gl_app = static_cast<OpenGLModelViewer*>(user_data);
-  gl_app->camera_control_->OnMouseMove(xpos, ypos);
+  if (gl_app->lasso_active_) {
+    const Eigen::Vector2f position(xpos, ypos);
+    if ((position - gl_app->lasso_.back()).norm() >= kLassoStep) {
+      gl_app->lasso_.push_back(position);
+    }
+  } else {
+    gl_app->camera_control_->OnMouseMove(xpos, ypos);
+  }
+  // also when the camera stays, the hovered point follows the cursor
+  gl_app->PublishViewState();
+}
+
+void OpenGLModelViewer::KeyCallback(GLFWwindow* window, int key,
+    int scancode, int action, int mods) {
+  void *user_data = glfwGetWindowUserPointer(window);
+  if (!user_data || action == GLFW_RELEASE) {
+    return;
+  }
+  OpenGLModelViewer *gl_app = static_cast<OpenGLModelViewer*>(user_data);
+  // the scene belongs to the render thread, which handles the key
+  {
+    std::lock_guard<std::mutex> lock(gl_app->render_mutex_);
+    gl_app->pending_keys_.push_back(std::make_pair(key, action));
+  }
+  gl_app->WakeRenderer();
+}
+
+void OpenGLModelViewer::HandleKey(int key, int action) {
+  // colors and sequence frames change in response
+  redraw_ = true;
+  if (key == GLFW_KEY_F3 && action == GLFW_PRESS) {
+    show_stats_overlay_ = !show_stats_overlay_;
+    if (!gpu_timer_) {
+      gpu_timer_.reset(new GpuTimer);
+    }
+  }
+
+  if (key == GLFW_KEY_C && action == GLFW_PRESS) {
+    point_cloud_->NextColorAttribute();
+  }
+
+  if (key == GLFW_KEY_M && action == GLFW_PRESS) {
+    const ColormapScaling scalings[] = {ColormapScaling::kMinMax,
+        ColormapScaling::kPercentile, ColormapScaling::kEqualize};
+    const int current = static_cast<int>(options_.colormap_scaling);
+    options_.colormap_scaling = scalings[(current + 1) % 3];
+    point_cloud_->SetColormapScaling(options_.colormap_scaling);
+    // rebuilt by the next Draw
+    height_colormap_count_ = 0;
+    std::cout << "colormap scaling: "
+        << ColormapScalingName(options_.colormap_scaling) << "\n";
+  }
+
+  // the frame drawn in response is the one captured
+  if (key == GLFW_KEY_F12 && action == GLFW_PRESS) {
+    frame_recorder_->RequestScreenshot(NextFreePath("screenshot_", ".png",
+        &next_screenshot_));
+  }
+
+  if (key == GLFW_KEY_R && action == GLFW_PRESS) {
+    if (frame_recorder_->recording()) {
+      frame_recorder_->StopRecording();
+    } else {
+      StartRecording();
+    }
+  }
+
+  if ((key == GLFW_KEY_B || key == GLFW_KEY_G || key == GLFW_KEY_N ||
+      key == GLFW_KEY_E || key == GLFW_KEY_X) && action == GLFW_PRESS) {
+    HandleSelectionKey(key);
+  }
+
+  if (key == GLFW_KEY_P && action == GLFW_PRESS) {
+    const std::string hovered = DescribePick(hovered_);
+    std::cout << (hovered.empty() ? "nothing under the cursor" : hovered)
+        << "\n";
+  }
+
+  // sequence playback, held arrow keys scrub through the frames
+  SequenceCloud *sequence = sequence_cloud_.get();
+  if (sequence == nullptr) {
+    return;
+  }
+  const int page = std::max<int>(1, sequence->num_frames() / 10);
+  if (key == GLFW_KEY_SPACE && action == GLFW_PRESS) {
+    sequence->SetPlaying(!sequence->playing());
+  } else if (key == GLFW_KEY_RIGHT) {
+    sequence->Step(1);
+  } else if (key == GLFW_KEY_LEFT) {
+    sequence->Step(-1);
+  } else if (key == GLFW_KEY_PAGE_UP) {
+    sequence->Step(page);
+  } else if (key == GLFW_KEY_PAGE_DOWN) {
+    sequence->Step(-page);
+  } else if (key == GLFW_KEY_HOME && action == GLFW_PRESS) {
+    sequence->Seek(0);
+  } else if (key == GLFW_KEY_END && action == GLFW_PRESS) {
+    sequence->Seek(sequence->num_frames() - 1);
+  }
 }
 
 void OpenGLModelViewer::ScrollCallback(GLFWwindow* window,
@@ -175,6 +1170,7 @@ void OpenGLModelViewer::ScrollCallback(GLFWwindow* window,
   }
   OpenGLModelViewer *gl_app = static_cast<OpenGLModelViewer*>(user_data);
   gl_app->camera_control_->OnMouseScroll(xoffset, yoffset);
+  gl_app->PublishViewState();
 }
 
 }  // namespace ogl_viewer
@@ -0,0 +1,705 @@
+#include "pcd_reader.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+#include "lzf.h"
+#include "thread_pool.h"
+#include "tracer.h"
+
+namespace ogl_viewer {
+
+namespace {
+
+// points per parallel task when de-interleaving
+const std::size_t kGatherGrain = 1 << 14;
+// bytes of one point record, far beyond any real descriptor; keeps the
+// int field offsets from overflowing
+const long long kMaxPointSize = 1 << 20;
+
+inline bool IsSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\r';
+}
+
+// parse the requested tokens of one ascii line [begin, end), value k being
+// token tokens[k]; with raw_bits integers land in the bits of the float
+bool ParseAsciiLine(const char *begin, const char *end, const int *tokens,
+    int num_values, bool raw_bits, float *values) {
+  const int last_token = *std::max_element(tokens, tokens + num_values);
+  const char *p = begin;
+  for (int token = 0; token <= last_token; ++token) {
+    while (p < end && IsSpace(*p)) {
+      ++p;
+    }
+    const char *token_begin = p;
+    while (p < end && !IsSpace(*p)) {
+      ++p;
+    }
+    if (p == token_begin) {
+      return false;
+    }
+    for (int k = 0; k < num_values; ++k) {
+      if (tokens[k] != token) {
+        continue;
+      }
+      // the mapping is not null-terminated, strtof needs a copy
+      char buf[64];
+      const std::size_t len = std::min<std::size_t>(p - token_begin,
+          sizeof(buf) - 1);
+      std::memcpy(buf, token_begin, len);
+      buf[len] = '\0';
+      if (raw_bits && std::strpbrk(buf, ".eE") == nullptr) {
+        const uint32_t bits = static_cast<uint32_t>(
+            std::strtoll(buf, nullptr, 10));
+        std::memcpy(&values[k], &bits, sizeof(bits));
+      } else {
+        values[k] = std::strtof(buf, nullptr);
+      }
+    }
+  }
+  return true;
+}
+
+template <typename T>
+float LoadAs(const char *p) {
+  T value;
+  std::memcpy(&value, p, sizeof(value));
+  return static_cast<float>(value);
+}
+
+// one value of a PCD field as float; with raw_bits a 4-byte value keeps its
+// bits (a float copy does not convert)
+float LoadValue(const char *p, char type, int size, bool raw_bits) {
+  if (type == 'F' || (raw_bits && size == 4)) {
+    return size == 8 ? LoadAs<double>(p) : LoadAs<float>(p);
+  }
+  if (type == 'I') {
+    switch (size) {
+      case 1:
+        return LoadAs<int8_t>(p);
+      case 2:
+        return LoadAs<int16_t>(p);
+      case 4:
+        return LoadAs<int32_t>(p);
+      default:
+        return LoadAs<int64_t>(p);
+    }
+  }
+  switch (size) {
+    case 1:
+      return LoadAs<uint8_t>(p);
+    case 2:
+      return LoadAs<uint16_t>(p);
+    case 4:
+      return LoadAs<uint32_t>(p);
+    default:
+      return LoadAs<uint64_t>(p);
+  }
+}
+
+// whether [begin, end) holds anything but white space
+bool HasContent(const char *begin, const char *end) {
+  for (const char *p = begin; p < end; ++p) {
+    if (!IsSpace(*p)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace
+
+int PcdHeader::FieldIndex(const std::string &name) const {
+  for (std::size_t i = 0; i < fields.size(); ++i) {
+    if (fields[i] == name) {
+      return static_cast<int>(i);
+    }
+  }
+  return -1;
+}
+
+int PcdHeader::FieldOffset(int field_index) const {
+  int offset = 0;
+  for (int i = 0; i < field_index; ++i) {
+    offset += sizes[i] * counts[i];
+  }
+  return offset;
+}
+
+int PcdHeader::PointSize() const {
+  return FieldOffset(static_cast<int>(fields.size()));
+}
+
+bool ParsePcdHeader(const char *data, std::size_t size, PcdHeader *header) {
+  *header = PcdHeader();
+  std::size_t pos = 0;
+  while (pos < size) {
+    const char *line_begin = data + pos;
+    const char *line_end = static_cast<const char*>(
+        std::memchr(line_begin, '\n', size - pos));
+    if (line_end == nullptr) {
+      std::cerr << "error : truncated PCD header.\n";
+      return false;
+    }
+    pos = line_end - data + 1;
+
+    std::istringstream iss(std::string(line_begin, line_end));
+    std::string key;
+    if (!(iss >> key) || key[0] == '#') {
+      continue;
+    }
+
+    if (key == "FIELDS") {
+      std::string field;
+      while (iss >> field) {
+        header->fields.push_back(field);
+      }
+    } else if (key == "SIZE") {
+      int value = 0;
+      while (iss >> value) {
+        header->sizes.push_back(value);
+      }
+    } else if (key == "TYPE") {
+      char value = 0;
+      while (iss >> value) {
+        header->types.push_back(value);
+      }
+    } else if (key == "COUNT") {
+      int value = 0;
+      while (iss >> value) {
+        header->counts.push_back(value);
+      }
+    } else if (key == "WIDTH") {
+      iss >> header->width;
+    } else if (key == "HEIGHT") {
+      iss >> header->height;
+    } else if (key == "POINTS") {
+      iss >> header->num_points;
+    } else if (key == "DATA") {
+      iss >> header->data_type;
+      header->data_offset = pos;
+      break;
+    }
+  }
+
+  if (header->data_type.empty()) {
+    std::cerr << "error : PCD header has no DATA line.\n";
+    return false;
+  }
+  if (header->counts.empty()) {
+    header->counts.assign(header->fields.size(), 1);
+  }
+  if (header->sizes.size() != header->fields.size() ||
+      header->types.size() != header->fields.size() ||
+      header->counts.size() != header->fields.size()) {
+    std::cerr << "error : inconsistent PCD header field description.\n";
+    return false;
+  }
+  // the payload bounds are computed from these, they must not wrap
+  long long point_size = 0;
+  for (std::size_t i = 0; i < header->fields.size(); ++i) {
+    const int field_size = header->sizes[i];
+    if ((field_size != 1 && field_size != 2 && field_size != 4 &&
+        field_size != 8) || header->counts[i] <= 0 ||
+        header->counts[i] > kMaxPointSize) {
+      std::cerr << "error : invalid SIZE or COUNT of PCD field "
+          << header->fields[i] << ".\n";
+      return false;
+    }
+    point_size += static_cast<long long>(field_size) * header->counts[i];
+  }
+  if (point_size == 0 || point_size > kMaxPointSize ||
+      header->width < 0 || header->height < 0) {
+    std::cerr << "error : invalid PCD header dimensions.\n";
+    return false;
+  }
+  if (header->num_points == 0) {
+    header->num_points = static_cast<std::size_t>(header->width) *
+        static_cast<std::size_t>(header->height);
+  }
+  return true;
+}
+
+PcdReader::~PcdReader() {
+  Close();
+}
+
+bool PcdReader::Open(const std::string &filepath) {
+  Close();
+
+  fd_ = open(filepath.c_str(), O_RDONLY);
+  if (fd_ < 0) {
+    std::cerr << "error : failed to open " << filepath << "\n";
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd_, &st) != 0 || st.st_size == 0) {
+    std::cerr << "error : failed to stat " << filepath << "\n";
+    Close();
+    return false;
+  }
+  size_ = st.st_size;
+
+  void *addr = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+  if (addr == MAP_FAILED) {
+    std::cerr << "error : failed to mmap " << filepath << "\n";
+    size_ = 0;
+    Close();
+    return false;
+  }
+  data_ = static_cast<const char*>(addr);
+  madvise(addr, size_, MADV_SEQUENTIAL);
+
+  if (!ParsePcdHeader(data_, size_, &header_)) {
+    Close();
+    return false;
+  }
+
+  const char *names[3] = {"x", "y", "z"};
+  for (int i = 0; i < 3; ++i) {
+    const int index = header_.FieldIndex(names[i]);
+    if (index < 0 || header_.types[index] != 'F' ||
+        header_.sizes[index] != 4) {
+      xyz_offsets_[i] = -1;
+      xyz_tokens_[i] = -1;
+    } else {
+      xyz_offsets_[i] = header_.FieldOffset(index);
+      xyz_tokens_[i] = FieldToken(index);
+    }
+  }
+  return true;
+}
+
+void PcdReader::Close() {
+  if (data_ != nullptr) {
+    munmap(const_cast<char*>(data_), size_);
+    data_ = nullptr;
+  }
+  if (fd_ >= 0) {
+    close(fd_);
+    fd_ = -1;
+  }
+  size_ = 0;
+  header_ = PcdHeader();
+  std::vector<float>().swap(chunk_buffer_);
+}
+
+bool PcdReader::CanReadPositions() const {
+  if (data_ == nullptr || (header_.data_type != "binary" &&
+      header_.data_type != "binary_compressed" &&
+      header_.data_type != "ascii")) {
+    return false;
+  }
+  return xyz_offsets_[0] >= 0 && xyz_offsets_[1] >= 0 && xyz_offsets_[2] >= 0;
+}
+
+bool PcdReader::ReadPositions(std::size_t chunk_points,
+    const ChunkCallback &callback) {
+  TRACE_SCOPE("PcdReader::ReadPositions");
+  if (!CanReadPositions()) {
+    std::cerr << "error : unsupported PCD layout (DATA "
+        << header_.data_type << ").\n";
+    return false;
+  }
+  chunk_points = std::max<std::size_t>(chunk_points, 1);
+  if (header_.num_points == 0) {
+    return true;
+  }
+  if (header_.data_type == "binary_compressed") {
+    return ReadCompressedPositions(chunk_points, callback);
+  } else if (header_.data_type == "ascii") {
+    return ReadAsciiValues(xyz_tokens_, 3, false, chunk_points, callback);
+  }
+  return ReadBinaryPositions(chunk_points, callback);
+}
+
+bool PcdReader::CanReadField(int field_index) const {
+  if (data_ == nullptr || field_index < 0 ||
+      field_index >= static_cast<int>(header_.fields.size()) ||
+      (header_.data_type != "binary" &&
+       header_.data_type != "binary_compressed" &&
+       header_.data_type != "ascii")) {
+    return false;
+  }
+  const char type = header_.types[field_index];
+  const int size = header_.sizes[field_index];
+  if (type == 'F') {
+    return size == 4 || size == 8;
+  }
+  return (type == 'I' || type == 'U') &&
+      (size == 1 || size == 2 || size == 4 || size == 8);
+}
+
+bool PcdReader::ReadField(int field_index, bool raw_bits,
+    std::size_t chunk_points, const FieldCallback &callback) {
+  TRACE_SCOPE("PcdReader::ReadField");
+  if (!CanReadField(field_index)) {
+    std::cerr << "error : unsupported PCD field layout (DATA "
+        << header_.data_type << ").\n";
+    return false;
+  }
+  chunk_points = std::max<std::size_t>(chunk_points, 1);
+  if (header_.num_points == 0) {
+    return true;
+  }
+  if (header_.data_type == "binary_compressed") {
+    return ReadCompressedField(field_index, raw_bits, chunk_points, callback);
+  } else if (header_.data_type == "ascii") {
+    const int token = FieldToken(field_index);
+    return ReadAsciiValues(&token, 1, raw_bits, chunk_points, callback);
+  }
+  return ReadBinaryField(field_index, raw_bits, chunk_points, callback);
+}
+
+bool PcdReader::CanReadRecords() const {
+  return header_.data_type == "binary" ||
+      header_.data_type == "binary_compressed";
+}
+
+bool PcdReader::ReadRecords(const std::vector<uint32_t> &points,
+    std::vector<char> *records) {
+  TRACE_SCOPE("PcdReader::ReadRecords");
+  if (!CanReadRecords()) {
+    std::cerr << "error : cannot copy the records of a " << header_.data_type
+        << " PCD payload.\n";
+    return false;
+  }
+  const std::size_t point_size = header_.PointSize();
+  const std::size_t num_points = header_.num_points;
+  if (!points.empty() &&
+      *std::max_element(points.begin(), points.end()) >= num_points) {
+    std::cerr << "error : point index beyond the PCD payload.\n";
+    return false;
+  }
+  records->resize(points.size() * point_size);
+  char *out = records->data();
+  ThreadPool &pool = ThreadPool::Global();
+
+  if (header_.data_type == "binary") {
+    if (!PayloadFits(point_size)) {
+      std::cerr << "error : PCD payload is shorter than declared.\n";
+      return false;
+    }
+    const char *payload = data_ + header_.data_offset;
+    pool.ParallelFor(0, points.size(), kGatherGrain,
+        [&](std::size_t b, std::size_t e) {
+          for (std::size_t i = b; i < e; ++i) {
+            std::memcpy(out + i * point_size,
+                payload + points[i] * point_size, point_size);
+          }
+        });
+    return true;
+  }
+
+  // the payload is stored field by field (SoA), COUNT values per point
+  std::vector<char> raw;
+  if (!DecompressPayload(&raw)) {
+    return false;
+  }
+  for (std::size_t f = 0; f < header_.fields.size(); ++f) {
+    const int field_index = static_cast<int>(f);
+    const std::size_t offset = header_.FieldOffset(field_index);
+    const std::size_t field_size = header_.sizes[f] * header_.counts[f];
+    const char *field = raw.data() + num_points * offset;
+    pool.ParallelFor(0, points.size(), kGatherGrain,
+        [&](std::size_t b, std::size_t e) {
+          for (std::size_t i = b; i < e; ++i) {
+            std::memcpy(out + i * point_size + offset,
+                field + points[i] * field_size, field_size);
+          }
+        });
+  }
+  return true;
+}
+
+bool PcdReader::ReadBinaryPositions(std::size_t chunk_points,
+    const ChunkCallback &callback) {
+  const std::size_t point_size = header_.PointSize();
+  const std::size_t num_points = header_.num_points;
+  if (!PayloadFits(point_size)) {
+    std::cerr << "error : PCD payload is shorter than declared.\n";
+    return false;
+  }
+
+  const char *payload = data_ + header_.data_offset;
+  // x y z as the leading packed float fields: hand out the mapping directly
+  const bool packed_xyz = point_size == 3 * sizeof(float) &&
+      xyz_offsets_[0] == 0 && xyz_offsets_[1] == 4 && xyz_offsets_[2] == 8 &&
+      reinterpret_cast<std::uintptr_t>(payload) % alignof(float) == 0;
+  if (!packed_xyz) {
+    chunk_buffer_.resize(std::min(chunk_points, num_points) * 3);
+  }
+  const std::size_t offsets[3] = {
+      static_cast<std::size_t>(xyz_offsets_[0]),
+      static_cast<std::size_t>(xyz_offsets_[1]),
+      static_cast<std::size_t>(xyz_offsets_[2])};
+
+  for (std::size_t first = 0; first < num_points; first += chunk_points) {
+    const std::size_t count = std::min(chunk_points, num_points - first);
+    bool keep_reading = true;
+    if (packed_xyz) {
+      keep_reading = callback(
+          reinterpret_cast<const float*>(payload + first * point_size), count);
+    } else {
+      GatherPositions(payload, offsets, point_size, first, count);
+      keep_reading = callback(chunk_buffer_.data(), count);
+    }
+    const std::size_t begin = header_.data_offset + first * point_size;
+    ReleasePages(begin, begin + count * point_size);
+    if (!keep_reading) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool PcdReader::ReadCompressedPositions(std::size_t chunk_points,
+    const ChunkCallback &callback) {
+  std::vector<char> raw;
+  if (!DecompressPayload(&raw)) {
+    return false;
+  }
+  const std::size_t num_points = header_.num_points;
+
+  // the payload is stored field by field (SoA)
+  const std::size_t offsets[3] = {
+      num_points * xyz_offsets_[0],
+      num_points * xyz_offsets_[1],
+      num_points * xyz_offsets_[2]};
+  chunk_buffer_.resize(std::min(chunk_points, num_points) * 3);
+  for (std::size_t first = 0; first < num_points; first += chunk_points) {
+    const std::size_t count = std::min(chunk_points, num_points - first);
+    GatherPositions(raw.data(), offsets, sizeof(float), first, count);
+    if (!callback(chunk_buffer_.data(), count)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool PcdReader::ReadBinaryField(int field_index, bool raw_bits,
+    std::size_t chunk_points, const FieldCallback &callback) {
+  const std::size_t point_size = header_.PointSize();
+  const std::size_t num_points = header_.num_points;
+  if (!PayloadFits(point_size)) {
+    std::cerr << "error : PCD payload is shorter than declared.\n";
+    return false;
+  }
+  const char *field = data_ + header_.data_offset +
+      header_.FieldOffset(field_index);
+  chunk_buffer_.resize(std::min(chunk_points, num_points));
+  for (std::size_t first = 0; first < num_points; first += chunk_points) {
+    const std::size_t count = std::min(chunk_points, num_points - first);
+    GatherField(field, point_size, header_.types[field_index],
+        header_.sizes[field_index], raw_bits, first, count);
+    const std::size_t begin = header_.data_offset + first * point_size;
+    ReleasePages(begin, begin + count * point_size);
+    if (!callback(chunk_buffer_.data(), count)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool PcdReader::ReadCompressedField(int field_index, bool raw_bits,
+    std::size_t chunk_points, const FieldCallback &callback) {
+  std::vector<char> raw;
+  if (!DecompressPayload(&raw)) {
+    return false;
+  }
+  const std::size_t num_points = header_.num_points;
+  const int size = header_.sizes[field_index];
+  // the values of the field are contiguous, COUNT of them per point
+  const char *field = raw.data() + num_points *
+      header_.FieldOffset(field_index);
+  chunk_buffer_.resize(std::min(chunk_points, num_points));
+  for (std::size_t first = 0; first < num_points; first += chunk_points) {
+    const std::size_t count = std::min(chunk_points, num_points - first);
+    GatherField(field, size * header_.counts[field_index],
+        header_.types[field_index], size, raw_bits, first, count);
+    if (!callback(chunk_buffer_.data(), count)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool PcdReader::PayloadFits(std::size_t point_size) const {
+  // divided rather than multiplied, num_points comes from the file
+  return header_.data_offset <= size_ &&
+      header_.num_points <= (size_ - header_.data_offset) / point_size;
+}
+
+bool PcdReader::DecompressPayload(std::vector<char> *raw) {
+  uint32_t sizes[2] = {0, 0};  // compressed, uncompressed
+  if (header_.data_offset + sizeof(sizes) > size_) {
+    std::cerr << "error : PCD payload is shorter than declared.\n";
+    return false;
+  }
+  std::memcpy(sizes, data_ + header_.data_offset, sizeof(sizes));
+  const std::size_t compressed_begin = header_.data_offset + sizeof(sizes);
+  const std::size_t point_size = header_.PointSize();
+  if (sizes[0] > size_ - compressed_begin ||
+      header_.num_points > sizes[1] / point_size ||
+      sizes[1] != header_.num_points * point_size) {
+    std::cerr << "error : corrupted binary_compressed PCD payload.\n";
+    return false;
+  }
+
+  // LZF is a single back-referencing stream, so this part stays serial
+  raw->resize(sizes[1]);
+  const std::size_t decompressed_size = LzfDecompress(
+      reinterpret_cast<const uint8_t*>(data_ + compressed_begin), sizes[0],
+      reinterpret_cast<uint8_t*>(raw->data()), raw->size());
+  if (decompressed_size != raw->size()) {
+    std::cerr << "error : failed to decompress PCD payload.\n";
+    return false;
+  }
+  ReleasePages(header_.data_offset, compressed_begin + sizes[0]);
+  return true;
+}
+
+bool PcdReader::ReadAsciiValues(const int *tokens, int num_values,
+    bool raw_bits, std::size_t chunk_points, const ChunkCallback &callback) {
+  const char *text = data_ + header_.data_offset;
+  const std::size_t text_size = size_ - header_.data_offset;
+  const std::size_t num_points = header_.num_points;
+
+  // split the text into blocks that start at line boundaries
+  ThreadPool &pool = ThreadPool::Global();
+  const std::size_t num_blocks = std::max<std::size_t>(1, std::min(
+      text_size / 4096, static_cast<std::size_t>(4 * (pool.num_threads() + 1))));
+  std::vector<std::size_t> block_begins(num_blocks + 1, text_size);
+  block_begins[0] = 0;
+  for (std::size_t i = 1; i < num_blocks; ++i) {
+    std::size_t pos = std::max(block_begins[i - 1], text_size * i / num_blocks);
+    const char *newline = static_cast<const char*>(
+        std::memchr(text + pos, '\n', text_size - pos));
+    block_begins[i] = newline ? newline - text + 1 : text_size;
+  }
+
+  // pass 1: count the points of every block
+  std::vector<std::size_t> block_points(num_blocks + 1, 0);
+  pool.ParallelFor(0, num_blocks, 1, [&](std::size_t b, std::size_t e) {
+    for (std::size_t block = b; block < e; ++block) {
+      const char *p = text + block_begins[block];
+      const char *block_end = text + block_begins[block + 1];
+      std::size_t count = 0;
+      while (p < block_end) {
+        const char *line_end = static_cast<const char*>(
+            std::memchr(p, '\n', block_end - p));
+        if (line_end == nullptr) {
+          line_end = block_end;
+        }
+        count += HasContent(p, line_end) ? 1 : 0;
+        p = line_end + 1;
+      }
+      block_points[block + 1] = count;
+    }
+  });
+  for (std::size_t i = 0; i < num_blocks; ++i) {
+    block_points[i + 1] += block_points[i];
+  }
+  if (block_points[num_blocks] < num_points) {
+    std::cerr << "error : PCD ascii payload has " << block_points[num_blocks]
+        << " points, " << num_points << " declared.\n";
+    return false;
+  }
+
+  // pass 2: parse every block into its slot of the output
+  std::vector<float> values(num_points * num_values);
+  std::atomic<bool> parse_ok(true);
+  pool.ParallelFor(0, num_blocks, 1, [&](std::size_t b, std::size_t e) {
+    for (std::size_t block = b; block < e; ++block) {
+      const char *p = text + block_begins[block];
+      const char *block_end = text + block_begins[block + 1];
+      std::size_t index = block_points[block];
+      while (p < block_end && index < num_points) {
+        const char *line_end = static_cast<const char*>(
+            std::memchr(p, '\n', block_end - p));
+        if (line_end == nullptr) {
+          line_end = block_end;
+        }
+        if (HasContent(p, line_end)) {
+          if (!ParseAsciiLine(p, line_end, tokens, num_values, raw_bits,
+              &values[index * num_values])) {
+            parse_ok = false;
+          }
+          ++index;
+        }
+        p = line_end + 1;
+      }
+    }
+  });
+  if (!parse_ok) {
+    std::cerr << "error : malformed line in PCD ascii payload.\n";
+    return false;
+  }
+  ReleasePages(header_.data_offset, size_);
+
+  for (std::size_t first = 0; first < num_points; first += chunk_points) {
+    const std::size_t count = std::min(chunk_points, num_points - first);
+    if (!callback(&values[first * num_values], count)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void PcdReader::GatherPositions(const char *base,
+    const std::size_t offsets[3], std::size_t step, std::size_t first,
+    std::size_t count) {
+  float *dst = chunk_buffer_.data();
+  ThreadPool::Global().ParallelFor(0, count, kGatherGrain,
+      [&](std::size_t b, std::size_t e) {
+        for (std::size_t i = b; i < e; ++i) {
+          const std::size_t src = (first + i) * step;
+          for (int k = 0; k < 3; ++k) {
+            std::memcpy(&dst[i * 3 + k], base + offsets[k] + src,
+                sizeof(float));
+          }
+        }
+      });
+}
+
+void PcdReader::GatherField(const char *base, std::size_t step, char type,
+    int size, bool raw_bits, std::size_t first, std::size_t count) {
+  float *dst = chunk_buffer_.data();
+  ThreadPool::Global().ParallelFor(0, count, kGatherGrain,
+      [&](std::size_t b, std::size_t e) {
+        for (std::size_t i = b; i < e; ++i) {
+          dst[i] = LoadValue(base + (first + i) * step, type, size, raw_bits);
+        }
+      });
+}
+
+int PcdReader::FieldToken(int field_index) const {
+  int token = 0;
+  for (int i = 0; i < field_index; ++i) {
+    token += header_.counts[i];
+  }
+  return token;
+}
+
+void PcdReader::ReleasePages(std::size_t begin, std::size_t end) {
+  const std::size_t page_size = sysconf(_SC_PAGESIZE);
+  // everything before `begin` has been consumed already, so the page holding
+  // it can go as well; the page holding `end` may still be read next chunk
+  begin = begin / page_size * page_size;
+  end = end / page_size * page_size;
+  if (end > begin) {
+    madvise(const_cast<char*>(data_) + begin, end - begin, MADV_DONTNEED);
+  }
+}
+
+}  // namespace ogl_viewer
@@ -0,0 +1,153 @@
+#include "pcd_writer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+
+#include "thread_pool.h"
+#include "tracer.h"
+
+namespace ogl_viewer {
+
+namespace {
+
+// points per parallel task when gathering a selection
+const std::size_t kGatherGrain = 1 << 14;
+
+std::string HeaderText(const PcdHeader &header, std::size_t num_points) {
+  std::ostringstream oss;
+  oss << "# .PCD v0.7 - Point Cloud Data file format\n"
+      << "VERSION 0.7\n"
+      << "FIELDS";
+  for (const std::string &field : header.fields) {
+    oss << " " << field;
+  }
+  oss << "\nSIZE";
+  for (int size : header.sizes) {
+    oss << " " << size;
+  }
+  oss << "\nTYPE";
+  for (char type : header.types) {
+    oss << " " << type;
+  }
+  oss << "\nCOUNT";
+  for (int count : header.counts) {
+    oss << " " << count;
+  }
+  oss << "\nWIDTH " << num_points << "\n"
+      << "HEIGHT 1\n"
+      << "VIEWPOINT 0 0 0 1 0 0 0\n"
+      << "POINTS " << num_points << "\n"
+      << "DATA binary\n";
+  return oss.str();
+}
+
+}  // namespace
+
+bool WritePcd(const std::string &path, const PcdHeader &header,
+    const char *records, std::size_t num_points) {
+  TRACE_SCOPE("WritePcd");
+  FILE *file = std::fopen(path.c_str(), "wb");
+  if (file == nullptr) {
+    std::cerr << "error : failed to open " << path << "\n";
+    return false;
+  }
+  const std::string text = HeaderText(header, num_points);
+  const std::size_t bytes = num_points * header.PointSize();
+  const bool written =
+      std::fwrite(text.data(), 1, text.size(), file) == text.size() &&
+      (bytes == 0 || std::fwrite(records, 1, bytes, file) == bytes);
+  if (std::fclose(file) != 0 || !written) {
+    std::cerr << "error : failed to write " << path << "\n";
+    return false;
+  }
+  return true;
+}
+
+bool WritePcdPositions(const std::string &path, const float *xyz,
+    std::size_t num_points) {
+  PcdHeader header;
+  header.fields = {"x", "y", "z"};
+  header.sizes = {4, 4, 4};
+  header.types = {'F', 'F', 'F'};
+  header.counts = {1, 1, 1};
+  return WritePcd(path, header, reinterpret_cast<const char*>(xyz),
+      num_points);
+}
+
+bool WriteSelection(const std::string &path, const PointIndex &index,
+    const std::vector<uint32_t> &points, const std::string &source_path) {
+  TRACE_SCOPE("WriteSelection");
+  ThreadPool &pool = ThreadPool::Global();
+  PcdReader reader;
+  if (!source_path.empty() && reader.Open(source_path) &&
+      reader.CanReadRecords()) {
+    std::vector<uint32_t> source(points.size());
+    pool.ParallelFor(0, points.size(), kGatherGrain,
+        [&](std::size_t begin, std::size_t end) {
+          for (std::size_t i = begin; i < end; ++i) {
+            source[i] = index.source_index(points[i]);
+          }
+        });
+    std::vector<char> records;
+    if (!reader.ReadRecords(source, &records)) {
+      return false;
+    }
+    return WritePcd(path, reader.header(), records.data(), points.size());
+  }
+
+  std::vector<float> xyz(points.size() * 3);
+  pool.ParallelFor(0, points.size(), kGatherGrain,
+      [&](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i < end; ++i) {
+          std::copy_n(index.position(points[i]).data(), 3, &xyz[i * 3]);
+        }
+      });
+  return WritePcdPositions(path, xyz.data(), points.size());
+}
+
+bool CropPointCloud(const std::string &source_path,
+    const Eigen::AlignedBox3f &box, const std::string &output_path) {
+  const auto start_time = std::chrono::steady_clock::now();
+  PcdReader reader;
+  if (!reader.Open(source_path)) {
+    return false;
+  }
+  std::vector<float> xyz;
+  xyz.reserve(reader.header().num_points * 3);
+  const bool read_ok = reader.ReadPositions(1 << 20,
+      [&](const float *chunk, std::size_t count) {
+        xyz.insert(xyz.end(), chunk, chunk + count * 3);
+        return true;
+      });
+  reader.Close();
+  if (!read_ok) {
+    std::cerr << "error : failed to read " << source_path << "\n";
+    return false;
+  }
+
+  PointIndex index;
+  index.Build(xyz.data(), 3, xyz.size() / 3, nullptr);
+  std::vector<float>().swap(xyz);
+  const auto index_time = std::chrono::steady_clock::now();
+  std::vector<uint32_t> points;
+  index.SelectBox(box, &points);
+  const auto select_time = std::chrono::steady_clock::now();
+  if (!WriteSelection(output_path, index, points, source_path)) {
+    return false;
+  }
+  const auto ms = [](std::chrono::steady_clock::time_point begin,
+      std::chrono::steady_clock::time_point end) {
+    return std::chrono::duration<double, std::milli>(end - begin).count();
+  };
+  std::cout << "wrote " << points.size() << " of " << index.size()
+      << " points to " << output_path << " (read and indexed in "
+      << ms(start_time, index_time) << " ms, selected in "
+      << ms(index_time, select_time) << " ms, written in "
+      << ms(select_time, std::chrono::steady_clock::now()) << " ms)\n";
+  return true;
+}
+
+}  // namespace ogl_viewer
@@ -0,0 +1,237 @@
+#include "pick_buffer.h"
+
+#include <algorithm>
+#include <iostream>
+#include <limits>
+
+#include <Eigen/LU>
+
+#include "tracer.h"
+
+namespace ogl_viewer {
+
+namespace {
+
+// pixels around the requested one searched for the nearest hit
+const int kPickRadius = 4;
+// readbacks in flight; each takes one or two frames to come back
+const int kPickReadbacks = 3;
+
+// RGBA32I ids followed by the float depths of the region
+const std::size_t kIdBytes = 4 * sizeof(GLint);
+const std::size_t kReadbackBytes =
+    (2 * kPickRadius + 1) * (2 * kPickRadius + 1) * (kIdBytes + sizeof(float));
+
+}  // namespace
+
+PickBuffer::PickBuffer() : readbacks_(kPickReadbacks) {
+  for (Readback &readback : readbacks_) {
+    glGenBuffers(1, &readback.buffer);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+    glBufferData(GL_PIXEL_PACK_BUFFER, kReadbackBytes, nullptr,
+        GL_STREAM_READ);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  glGenFramebuffers(1, &fbo_);
+  glGenRenderbuffers(1, &color_buffer_);
+  glGenRenderbuffers(1, &id_buffer_);
+  glGenRenderbuffers(1, &depth_buffer_);
+}
+
+PickBuffer::~PickBuffer() {
+  for (Readback &readback : readbacks_) {
+    if (readback.fence) {
+      glDeleteSync(readback.fence);
+    }
+    glDeleteBuffers(1, &readback.buffer);
+  }
+  glDeleteFramebuffers(1, &fbo_);
+  glDeleteRenderbuffers(1, &color_buffer_);
+  glDeleteRenderbuffers(1, &id_buffer_);
+  glDeleteRenderbuffers(1, &depth_buffer_);
+}
+
+bool PickBuffer::Resize(int width, int height) {
+  width = std::max(width, 1);
+  height = std::max(height, 1);
+  if (size_ == Eigen::Vector2i(width, height)) {
+    return true;
+  }
+  size_ = Eigen::Vector2i(width, height);
+  glBindRenderbuffer(GL_RENDERBUFFER, color_buffer_);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+  glBindRenderbuffer(GL_RENDERBUFFER, id_buffer_);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA32I, width, height);
+  glBindRenderbuffer(GL_RENDERBUFFER, depth_buffer_);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo_);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+      GL_RENDERBUFFER, color_buffer_);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1,
+      GL_RENDERBUFFER, id_buffer_);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+      GL_RENDERBUFFER, depth_buffer_);
+  const GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  if (status != GL_FRAMEBUFFER_COMPLETE) {
+    std::cerr << "error : incomplete pick framebuffer.\n";
+    return false;
+  }
+  return true;
+}
+
+void PickBuffer::Bind() {
+  const GLenum draw_buffers[] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo_);
+  glDrawBuffers(2, draw_buffers);
+}
+
+void PickBuffer::Clear(const Eigen::Vector4f &color) {
+  // glClear would write float values into the integer attachment
+  const GLint no_id[] = {0, 0, 0, 0};
+  const GLfloat depth = 1.f;
+  glClearBufferfv(GL_COLOR, 0, color.data());
+  glClearBufferiv(GL_COLOR, 1, no_id);
+  glClearBufferfv(GL_DEPTH, 0, &depth);
+}
+
+void PickBuffer::BlitColor(GLuint framebuffer) {
+  TRACE_SCOPE("PickBuffer::BlitColor");
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo_);
+  glReadBuffer(GL_COLOR_ATTACHMENT0);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
+  glBlitFramebuffer(0, 0, size_.x(), size_.y(), 0, 0, size_.x(), size_.y(),
+      GL_COLOR_BUFFER_BIT, GL_NEAREST);
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+}
+
+void PickBuffer::RequestPick(const Eigen::Vector2i &pixel,
+    const Eigen::Matrix4f &view_projection) {
+  const Eigen::Vector2i gl_pixel(pixel.x(), size_.y() - 1 - pixel.y());
+  if ((gl_pixel.array() < 0).any() ||
+      (gl_pixel.array() >= size_.array()).any()) {
+    return;
+  }
+  Readback *readback = nullptr;
+  for (Readback &candidate : readbacks_) {
+    if (candidate.fence == nullptr) {
+      readback = &candidate;
+      break;
+    }
+  }
+  if (readback == nullptr) {
+    return;
+  }
+  TRACE_SCOPE("PickBuffer::RequestPick");
+
+  const Eigen::Vector2i lower = (gl_pixel.array() - kPickRadius).max(0);
+  const Eigen::Vector2i upper =
+      (gl_pixel.array() + kPickRadius + 1).min(size_.array());
+  readback->sequence = next_sequence_++;
+  readback->origin = lower;
+  readback->extent = upper - lower;
+  readback->center = gl_pixel - lower;
+  readback->framebuffer_size = size_;
+  readback->inverse_view_projection = view_projection.inverse();
+
+  // into the bound pack buffer, so glReadPixels returns without waiting
+  const GLsizei num_pixels = readback->extent.prod();
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo_);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, readback->buffer);
+  glReadBuffer(GL_COLOR_ATTACHMENT1);
+  glReadPixels(lower.x(), lower.y(), readback->extent.x(),
+      readback->extent.y(), GL_RGBA_INTEGER, GL_INT, nullptr);
+  glReadPixels(lower.x(), lower.y(), readback->extent.x(),
+      readback->extent.y(), GL_DEPTH_COMPONENT, GL_FLOAT,
+      reinterpret_cast<void*>(num_pixels * kIdBytes));
+  glReadBuffer(GL_COLOR_ATTACHMENT0);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  readback->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+bool PickBuffer::PollPick(PickResult *result) {
+  bool found = false;
+  for (Readback &readback : readbacks_) {
+    if (readback.fence == nullptr) {
+      continue;
+    }
+    // poll only, never block the render thread
+    if (glClientWaitSync(readback.fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+      continue;
+    }
+    glDeleteSync(readback.fence);
+    readback.fence = nullptr;
+    if (readback.sequence < result_sequence_) {
+      continue;
+    }
+    TRACE_SCOPE("PickBuffer::PollPick");
+    result_sequence_ = readback.sequence;
+    Evaluate(readback, result);
+    found = true;
+  }
+  return found;
+}
+
+bool PickBuffer::pending() const {
+  for (const Readback &readback : readbacks_) {
+    if (readback.fence != nullptr) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void PickBuffer::Evaluate(const Readback &readback,
+    PickResult *result) const {
+  *result = PickResult();
+  const GLsizei num_pixels = readback.extent.prod();
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+  const char *data = static_cast<const char*>(glMapBufferRange(
+      GL_PIXEL_PACK_BUFFER, 0, num_pixels * (kIdBytes + sizeof(float)),
+      GL_MAP_READ_BIT));
+  if (data == nullptr) {
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    return;
+  }
+  const GLint *ids = reinterpret_cast<const GLint*>(data);
+  const float *depths =
+      reinterpret_cast<const float*>(data + num_pixels * kIdBytes);
+
+  int nearest = -1;
+  int nearest_distance = std::numeric_limits<int>::max();
+  for (int y = 0; y < readback.extent.y(); ++y) {
+    for (int x = 0; x < readback.extent.x(); ++x) {
+      const int i = y * readback.extent.x() + x;
+      if (ids[i * 4] == 0) {
+        continue;
+      }
+      const int distance =
+          (Eigen::Vector2i(x, y) - readback.center).squaredNorm();
+      if (distance < nearest_distance) {
+        nearest = i;
+        nearest_distance = distance;
+      }
+    }
+  }
+  if (nearest >= 0) {
+    const Eigen::Vector2i gl_pixel = readback.origin + Eigen::Vector2i(
+        nearest % readback.extent.x(), nearest / readback.extent.x());
+    result->hit = true;
+    result->pick_id = ids[nearest * 4];
+    result->vertex = ids[nearest * 4 + 1];
+    result->pixel = Eigen::Vector2i(gl_pixel.x(),
+        readback.framebuffer_size.y() - 1 - gl_pixel.y());
+    const Eigen::Vector2f ndc_xy = 2.f * (gl_pixel.cast<float>().array() +
+        0.5f) / readback.framebuffer_size.cast<float>().array() - 1.f;
+    const Eigen::Vector4f position = readback.inverse_view_projection *
+        Eigen::Vector4f(ndc_xy.x(), ndc_xy.y(), 2.f * depths[nearest] - 1.f,
+            1.f);
+    result->position = position.head<3>() / position.w();
+  }
+  glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+}  // namespace ogl_viewer
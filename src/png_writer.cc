@@ -0,0 +1,110 @@
+#include "png_writer.h"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <vector>
+
+namespace ogl_viewer {
+
+namespace {
+
+const uint8_t kPngSignature[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+// PNG row filter: every byte minus the byte of the pixel to its left
+const uint8_t kFilterSub = 1;
+
+void PutBigEndian(uint32_t value, uint8_t *out) {
+  out[0] = static_cast<uint8_t>(value >> 24);
+  out[1] = static_cast<uint8_t>(value >> 16);
+  out[2] = static_cast<uint8_t>(value >> 8);
+  out[3] = static_cast<uint8_t>(value);
+}
+
+// length, type, data and the CRC of type and data
+bool WriteChunk(FILE *file, const char *type, const uint8_t *data,
+    std::size_t size) {
+  uint8_t header[8];
+  PutBigEndian(static_cast<uint32_t>(size), header);
+  std::copy(type, type + 4, header + 4);
+  uLong crc = crc32(0L, header + 4, 4);
+  if (size > 0) {
+    crc = crc32(crc, data, static_cast<uInt>(size));
+  }
+  uint8_t footer[4];
+  PutBigEndian(static_cast<uint32_t>(crc), footer);
+  return std::fwrite(header, 1, 8, file) == 8 &&
+      (size == 0 || std::fwrite(data, 1, size, file) == size) &&
+      std::fwrite(footer, 1, 4, file) == 4;
+}
+
+}  // namespace
+
+bool WritePng(const std::string &path, const uint8_t *rgba, int width,
+    int height, bool bottom_up) {
+  // the filtered rows, each behind its filter type byte
+  const std::size_t row_bytes = 1 + 3 * static_cast<std::size_t>(width);
+  std::vector<uint8_t> filtered(row_bytes * height);
+  for (int y = 0; y < height; ++y) {
+    const uint8_t *in = rgba +
+        4 * static_cast<std::size_t>(width) * (bottom_up ? height - 1 - y : y);
+    uint8_t *out = &filtered[row_bytes * y];
+    *out++ = kFilterSub;
+    uint8_t left[3] = {0, 0, 0};
+    for (int x = 0; x < width; ++x, in += 4, out += 3) {
+      for (int c = 0; c < 3; ++c) {
+        out[c] = static_cast<uint8_t>(in[c] - left[c]);
+        left[c] = in[c];
+      }
+    }
+  }
+
+  z_stream stream = z_stream();
+  if (deflateInit2(&stream, Z_BEST_SPEED, Z_DEFLATED, 15, 8, Z_RLE) !=
+      Z_OK) {
+    std::cerr << "error : failed to initialize zlib.\n";
+    return false;
+  }
+  std::vector<uint8_t> compressed(deflateBound(&stream, filtered.size()));
+  stream.next_in = filtered.data();
+  stream.avail_in = static_cast<uInt>(filtered.size());
+  stream.next_out = compressed.data();
+  stream.avail_out = static_cast<uInt>(compressed.size());
+  const int status = deflate(&stream, Z_FINISH);
+  const std::size_t compressed_size = stream.total_out;
+  deflateEnd(&stream);
+  if (status != Z_STREAM_END) {
+    std::cerr << "error : failed to compress " << path << "\n";
+    return false;
+  }
+
+  // 8-bit truecolor, no interlacing
+  uint8_t header[13];
+  PutBigEndian(static_cast<uint32_t>(width), header);
+  PutBigEndian(static_cast<uint32_t>(height), header + 4);
+  header[8] = 8;
+  header[9] = 2;
+  header[10] = 0;
+  header[11] = 0;
+  header[12] = 0;
+
+  FILE *file = std::fopen(path.c_str(), "wb");
+  if (file == nullptr) {
+    std::cerr << "error : failed to open " << path << "\n";
+    return false;
+  }
+  const bool written =
+      std::fwrite(kPngSignature, 1, sizeof(kPngSignature), file) ==
+          sizeof(kPngSignature) &&
+      WriteChunk(file, "IHDR", header, sizeof(header)) &&
+      WriteChunk(file, "IDAT", compressed.data(), compressed_size) &&
+      WriteChunk(file, "IEND", nullptr, 0);
+  if (std::fclose(file) != 0 || !written) {
+    std::cerr << "error : failed to write " << path << "\n";
+    return false;
+  }
+  return true;
+}
+
+}  // namespace ogl_viewer
@@ -0,0 +1,380 @@
+#include "point_cache.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include "pcd_reader.h"
+#include "tracer.h"
+
+namespace ogl_viewer {
+
+namespace {
+
+const char kCacheMagic[8] = {'O', 'V', 'C', 'A', 'C', 'H', 'E', '\0'};
+const uint32_t kCacheVersion = 2;
+// sections start on cache line boundaries
+const std::size_t kSectionAlignment = 64;
+// the file head (PCD header and first points) and 16 blocks after it
+const std::size_t kHashHeadBytes = 64 << 10;
+const std::size_t kHashBlockBytes = 4 << 10;
+const int kHashBlocks = 16;
+
+struct CacheHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t node_size;
+  PointCacheKey key;
+  uint64_t num_points;
+  uint64_t num_nodes;
+  uint64_t positions_offset;
+  uint64_t order_offset;
+  uint64_t nodes_offset;
+};
+
+struct CachedNode {
+  float bounds[6];
+  float point_bounds[6];
+  float subtree_bounds[6];
+  uint64_t first;
+  uint64_t count;
+  uint64_t subtree_count;
+  int32_t level;
+  int32_t children[8];
+};
+
+void StoreBox(const Eigen::AlignedBox3f &box, float *values) {
+  for (int k = 0; k < 3; ++k) {
+    values[k] = box.min()[k];
+    values[k + 3] = box.max()[k];
+  }
+}
+
+Eigen::AlignedBox3f LoadBox(const float *values) {
+  return Eigen::AlignedBox3f(Eigen::Vector3f(values[0], values[1], values[2]),
+      Eigen::Vector3f(values[3], values[4], values[5]));
+}
+
+uint64_t Fnv1a(const char *data, std::size_t size, uint64_t hash) {
+  for (std::size_t i = 0; i < size; ++i) {
+    hash ^= static_cast<uint8_t>(data[i]);
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+std::size_t AlignUp(std::size_t offset) {
+  return (offset + kSectionAlignment - 1) / kSectionAlignment *
+      kSectionAlignment;
+}
+
+bool SameKey(const PointCacheKey &a, const PointCacheKey &b) {
+  return a.file_size == b.file_size && a.mtime_ns == b.mtime_ns &&
+      a.hash == b.hash;
+}
+
+}  // namespace
+
+bool ComputePointCacheKey(const std::string &source_path, PointCacheKey *key) {
+  const int fd = open(source_path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return false;
+  }
+#ifdef __APPLE__
+  const struct timespec &mtime = st.st_mtimespec;
+#else
+  const struct timespec &mtime = st.st_mtim;
+#endif
+  key->file_size = st.st_size;
+  key->mtime_ns = static_cast<int64_t>(mtime.tv_sec) * 1000000000 +
+      mtime.tv_nsec;
+
+  // hashing multi-GB files would cost as much as parsing them; the head and
+  // a few sampled blocks catch rewrites that keep size and mtime
+  std::vector<char> buffer(kHashHeadBytes);
+  uint64_t hash = 14695981039346656037ull;
+  const std::size_t size = key->file_size;
+  ssize_t n = pread(fd, buffer.data(), std::min(size, kHashHeadBytes), 0);
+  bool read_ok = n >= 0;
+  if (read_ok) {
+    hash = Fnv1a(buffer.data(), n, hash);
+  }
+  for (int i = 0; read_ok && i < kHashBlocks && size > kHashHeadBytes; ++i) {
+    const std::size_t offset = kHashHeadBytes +
+        (size - kHashHeadBytes) / kHashBlocks * i;
+    n = pread(fd, buffer.data(), std::min(size - offset, kHashBlockBytes),
+        offset);
+    read_ok = n >= 0;
+    if (read_ok) {
+      hash = Fnv1a(buffer.data(), n, hash);
+    }
+  }
+  close(fd);
+  key->hash = hash;
+  return read_ok;
+}
+
+std::string PointCachePath(const std::string &source_path) {
+  return source_path + ".ovcache";
+}
+
+bool WritePointCache(const std::string &cache_path, const PointCacheKey &key,
+    const std::vector<float> &xyz, const std::vector<uint32_t> &order,
+    const PointOctree &octree) {
+  TRACE_SCOPE("WritePointCache");
+  if (order.size() != xyz.size() / 3) {
+    std::cerr << "error : point order does not match the positions.\n";
+    return false;
+  }
+  const std::vector<OctreeNode> &nodes = octree.nodes();
+  CacheHeader header = CacheHeader();
+  std::memcpy(header.magic, kCacheMagic, sizeof(kCacheMagic));
+  header.version = kCacheVersion;
+  header.node_size = sizeof(CachedNode);
+  header.key = key;
+  header.num_points = xyz.size() / 3;
+  header.num_nodes = nodes.size();
+  header.positions_offset = AlignUp(sizeof(header));
+  header.order_offset = AlignUp(header.positions_offset +
+      xyz.size() * sizeof(float));
+  header.nodes_offset = AlignUp(header.order_offset +
+      order.size() * sizeof(uint32_t));
+
+  const std::string tmp_path = cache_path + ".tmp";
+  std::ofstream ofs(tmp_path.c_str(), std::ios::binary | std::ios::trunc);
+  if (!ofs) {
+    std::cerr << "error : failed to create " << tmp_path << "\n";
+    return false;
+  }
+  const char padding[kSectionAlignment] = {0};
+  ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  ofs.write(padding, header.positions_offset - sizeof(header));
+  ofs.write(reinterpret_cast<const char*>(xyz.data()),
+      xyz.size() * sizeof(float));
+  ofs.write(padding, header.order_offset - header.positions_offset -
+      xyz.size() * sizeof(float));
+  ofs.write(reinterpret_cast<const char*>(order.data()),
+      order.size() * sizeof(uint32_t));
+  ofs.write(padding, header.nodes_offset - header.order_offset -
+      order.size() * sizeof(uint32_t));
+  for (const OctreeNode &node : nodes) {
+    // zeroed padding, nothing uninitialized goes to disk
+    CachedNode cached{};
+    StoreBox(node.bounds, cached.bounds);
+    StoreBox(node.point_bounds, cached.point_bounds);
+    StoreBox(node.subtree_bounds, cached.subtree_bounds);
+    cached.first = node.first;
+    cached.count = node.count;
+    cached.subtree_count = node.subtree_count;
+    cached.level = node.level;
+    std::copy_n(node.children, 8, cached.children);
+    ofs.write(reinterpret_cast<const char*>(&cached), sizeof(cached));
+  }
+  ofs.close();
+  if (!ofs) {
+    std::cerr << "error : failed to write " << tmp_path << "\n";
+    std::remove(tmp_path.c_str());
+    return false;
+  }
+  if (std::rename(tmp_path.c_str(), cache_path.c_str()) != 0) {
+    std::cerr << "error : failed to rename " << tmp_path << "\n";
+    std::remove(tmp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool BuildPointCache(const std::string &source_path) {
+  const auto start_time = std::chrono::steady_clock::now();
+  PointCacheKey key;
+  if (!ComputePointCacheKey(source_path, &key)) {
+    std::cerr << "error : failed to read " << source_path << "\n";
+    return false;
+  }
+
+  PcdReader reader;
+  if (!reader.Open(source_path)) {
+    return false;
+  }
+  std::vector<float> xyz;
+  xyz.reserve(reader.header().num_points * 3);
+  const bool read_ok = reader.ReadPositions(1 << 20,
+      [&](const float *chunk, std::size_t count) {
+        xyz.insert(xyz.end(), chunk, chunk + count * 3);
+        return true;
+      });
+  reader.Close();
+  if (!read_ok) {
+    return false;
+  }
+
+  PointOctree octree;
+  std::vector<uint32_t> order;
+  octree.Build(&xyz, &order);
+  const std::string cache_path = PointCachePath(source_path);
+  if (!WritePointCache(cache_path, key, xyz, order, octree)) {
+    return false;
+  }
+  const double elapsed_ms = std::chrono::duration<double, std::milli>(
+      std::chrono::steady_clock::now() - start_time).count();
+  std::cout << "wrote " << cache_path << " (" << xyz.size() / 3
+      << " points, " << octree.nodes().size() << " octree nodes) in "
+      << elapsed_ms << " ms\n";
+  return true;
+}
+
+PointCache::~PointCache() {
+  Close();
+}
+
+bool PointCache::Open(const std::string &cache_path,
+    const PointCacheKey &key) {
+  Close();
+
+  fd_ = open(cache_path.c_str(), O_RDONLY);
+  if (fd_ < 0) {
+    // no cache yet
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd_, &st) != 0 ||
+      static_cast<std::size_t>(st.st_size) < sizeof(CacheHeader)) {
+    Close();
+    return false;
+  }
+  size_ = st.st_size;
+  void *addr = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+  if (addr == MAP_FAILED) {
+    std::cerr << "error : failed to mmap " << cache_path << "\n";
+    size_ = 0;
+    Close();
+    return false;
+  }
+  data_ = static_cast<const char*>(addr);
+  madvise(addr, size_, MADV_SEQUENTIAL);
+
+  CacheHeader header;
+  std::memcpy(&header, data_, sizeof(header));
+  if (std::memcmp(header.magic, kCacheMagic, sizeof(kCacheMagic)) == 0 &&
+      header.version < kCacheVersion) {
+    std::cout << cache_path << " was written by an older version, "
+        << "rebuilding it\n";
+    Close();
+    return false;
+  }
+  if (std::memcmp(header.magic, kCacheMagic, sizeof(kCacheMagic)) != 0 ||
+      header.version != kCacheVersion ||
+      header.node_size != sizeof(CachedNode)) {
+    std::cerr << "error : " << cache_path << " is not a supported cache.\n";
+    Close();
+    return false;
+  }
+  if (!SameKey(header.key, key)) {
+    std::cout << cache_path << " is out of date, rebuilding it\n";
+    Close();
+    return false;
+  }
+  const std::size_t max_points = size_ / (3 * sizeof(float));
+  const std::size_t max_nodes = size_ / sizeof(CachedNode);
+  if (header.num_points > max_points || header.num_nodes > max_nodes ||
+      header.positions_offset % sizeof(float) != 0 ||
+      header.positions_offset + header.num_points * 3 * sizeof(float) >
+          size_ ||
+      header.order_offset % sizeof(uint32_t) != 0 ||
+      header.order_offset + header.num_points * sizeof(uint32_t) > size_ ||
+      header.nodes_offset + header.num_nodes * sizeof(CachedNode) > size_) {
+    std::cerr << "error : " << cache_path << " is truncated.\n";
+    Close();
+    return false;
+  }
+
+  // the child links must form a tree rooted at node 0: children are stored
+  // after their parent, as PointOctree builds them, and have one parent each
+  std::vector<uint8_t> has_parent(header.num_nodes, 0);
+  bool corrupted = false;
+  for (std::size_t i = 0; i < header.num_nodes && !corrupted; ++i) {
+    CachedNode cached;
+    std::memcpy(&cached, data_ + header.nodes_offset + i * sizeof(cached),
+        sizeof(cached));
+    corrupted = cached.first > header.num_points ||
+        cached.count > cached.subtree_count ||
+        cached.subtree_count > header.num_points - cached.first;
+    for (int32_t child : cached.children) {
+      if (child == -1) {
+        continue;
+      }
+      if (child < 0 || static_cast<uint64_t>(child) <= i ||
+          static_cast<uint64_t>(child) >= header.num_nodes ||
+          has_parent[child]) {
+        corrupted = true;
+        break;
+      }
+      has_parent[child] = 1;
+    }
+  }
+  for (std::size_t i = 1; i < header.num_nodes && !corrupted; ++i) {
+    corrupted = !has_parent[i];
+  }
+  if (corrupted) {
+    std::cerr << "error : " << cache_path << " is corrupted.\n";
+    Close();
+    return false;
+  }
+
+  num_points_ = header.num_points;
+  positions_ = reinterpret_cast<const float*>(data_ + header.positions_offset);
+  order_ = reinterpret_cast<const uint32_t*>(data_ + header.order_offset);
+  num_nodes_ = header.num_nodes;
+  nodes_ = data_ + header.nodes_offset;
+  return true;
+}
+
+void PointCache::Close() {
+  if (data_ != nullptr) {
+    munmap(const_cast<char*>(data_), size_);
+    data_ = nullptr;
+  }
+  if (fd_ >= 0) {
+    close(fd_);
+    fd_ = -1;
+  }
+  size_ = 0;
+  num_points_ = 0;
+  positions_ = nullptr;
+  order_ = nullptr;
+  num_nodes_ = 0;
+  nodes_ = nullptr;
+}
+
+void PointCache::ReadOctree(PointOctree *octree) const {
+  std::vector<OctreeNode> nodes(num_nodes_);
+  for (std::size_t i = 0; i < num_nodes_; ++i) {
+    CachedNode cached;
+    std::memcpy(&cached, nodes_ + i * sizeof(CachedNode), sizeof(cached));
+    OctreeNode &node = nodes[i];
+    node.bounds = LoadBox(cached.bounds);
+    node.point_bounds = LoadBox(cached.point_bounds);
+    node.subtree_bounds = LoadBox(cached.subtree_bounds);
+    node.first = cached.first;
+    node.count = cached.count;
+    node.subtree_count = cached.subtree_count;
+    node.level = cached.level;
+    std::copy_n(cached.children, 8, node.children);
+  }
+  octree->set_nodes(std::move(nodes));
+}
+
+}  // namespace ogl_viewer
@@ -0,0 +1,158 @@
+#include "point_cloud_loader.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include "tracer.h"
+
+namespace ogl_viewer {
+
+PointCloudLoader::~PointCloudLoader() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    cancel_ = true;
+  }
+  queue_not_full_.notify_all();
+  if (worker_.joinable()) {
+    worker_.join();
+  }
+}
+
+bool PointCloudLoader::Start(const std::string &filepath, bool build_lod,
+    bool write_cache) {
+  // key the cache on the file as it was before reading it
+  PointCacheKey cache_key;
+  const bool has_key = build_lod && write_cache && !voxel_filter_.enabled() &&
+      ComputePointCacheKey(filepath, &cache_key);
+  if (!reader_.Open(filepath) || !reader_.CanReadPositions()) {
+    return false;
+  }
+  build_lod_ = build_lod;
+  if (has_key) {
+    cache_path_ = PointCachePath(filepath);
+    cache_key_ = cache_key;
+  }
+  num_points_ = reader_.header().num_points;
+  worker_ = std::thread(&PointCloudLoader::Run, this);
+  return true;
+}
+
+bool PointCloudLoader::PopChunk(Chunk *chunk) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (queue_.empty()) {
+      return false;
+    }
+    *chunk = std::move(queue_.front());
+    queue_.pop_front();
+  }
+  queue_not_full_.notify_one();
+  return true;
+}
+
+std::unique_ptr<PointOctree> PointCloudLoader::TakeOctree() {
+  return std::move(octree_);
+}
+
+std::vector<float> PointCloudLoader::TakeLodPositions() {
+  return std::move(lod_positions_);
+}
+
+std::vector<uint32_t> PointCloudLoader::TakePointOrder() {
+  return std::move(point_order_);
+}
+
+bool PointCloudLoader::PushChunk(Chunk chunk) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  queue_not_full_.wait(lock, [this]() {
+    return cancel_ || queue_.size() < kMaxQueuedChunks;
+  });
+  if (cancel_) {
+    return false;
+  }
+  queue_.push_back(std::move(chunk));
+  return true;
+}
+
+void PointCloudLoader::Run() {
+  if (Tracer::enabled()) {
+    Tracer::Global().SetThreadName("loader");
+  }
+  TRACE_SCOPE("PointCloudLoader::Run");
+  // the voxel filter needs the whole cloud, like the octree
+  const bool filter = voxel_filter_.enabled();
+  if (build_lod_ || filter) {
+    lod_positions_.reserve(num_points_ * 3);
+  }
+
+  std::size_t first = 0;
+  const bool read_ok = reader_.ReadPositions(kStagingChunkPoints,
+      [&](const float *xyz, std::size_t count) {
+        if (build_lod_ || filter) {
+          lod_positions_.insert(lod_positions_.end(), xyz, xyz + count * 3);
+        }
+        first += count;
+        num_decoded_points_ = first;
+        if (filter) {
+          return !cancel_.load();
+        }
+        Chunk chunk;
+        chunk.first = first - count;
+        chunk.xyz.assign(xyz, xyz + count * 3);
+        return PushChunk(std::move(chunk));
+      });
+  reader_.Close();
+
+  if (!read_ok) {
+    if (!cancel_) {
+      std::cerr << "error : background loading failed.\n";
+    }
+    failed_ = true;
+    finished_ = true;
+    return;
+  }
+
+  if (filter) {
+    voxel_filter_.Apply(&lod_positions_, &point_order_);
+    lod_positions_.shrink_to_fit();
+    num_points_ = lod_positions_.size() / 3;
+    for (std::size_t begin = 0; begin < num_points_;
+        begin += kStagingChunkPoints) {
+      const std::size_t end = std::min<std::size_t>(num_points_,
+          begin + kStagingChunkPoints);
+      Chunk chunk;
+      chunk.first = begin;
+      chunk.xyz.assign(lod_positions_.data() + begin * 3,
+          lod_positions_.data() + end * 3);
+      if (!PushChunk(std::move(chunk))) {
+        failed_ = true;
+        finished_ = true;
+        return;
+      }
+    }
+    if (!build_lod_) {
+      std::vector<float>().swap(lod_positions_);
+    }
+  }
+
+  if (build_lod_) {
+    std::unique_ptr<PointOctree> octree(new PointOctree);
+    std::vector<uint32_t> octree_order;
+    octree->Build(&lod_positions_, &octree_order);
+    if (!cache_path_.empty() && !cancel_) {
+      WritePointCache(cache_path_, cache_key_, lod_positions_, octree_order,
+          *octree);
+    }
+    // filtered points come from the file index of their cell
+    if (filter) {
+      for (uint32_t &index : octree_order) {
+        index = point_order_[index];
+      }
+    }
+    point_order_.swap(octree_order);
+    octree_ = std::move(octree);
+  }
+  finished_ = true;
+}
+
+}  // namespace ogl_viewer
@@ -0,0 +1,548 @@
+#include "point_index.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <utility>
+
+#include "radix_sort.h"
+#include "thread_pool.h"
+#include "tracer.h"
+
+namespace ogl_viewer {
+
+namespace {
+
+// points per parallel task when building and when testing a selection
+const std::size_t kIndexGrain = 1 << 15;
+const std::size_t kSelectGrain = 1 << 14;
+// Morton cells per axis are 2^bits; about one leaf per 8 cells
+const int kMaxAxisBits = 21;
+const std::size_t kCellsPerLeaf = 8;
+// clip space w below which a point counts as behind the camera
+const float kMinClipW = 1e-6f;
+
+// the low 21 bits of v, two zero bits between each
+uint64_t SpreadBits(uint64_t v) {
+  v &= 0x1fffff;
+  v = (v | v << 32) & 0x1f00000000ffffULL;
+  v = (v | v << 16) & 0x1f0000ff0000ffULL;
+  v = (v | v << 8) & 0x100f00f00f00f00fULL;
+  v = (v | v << 4) & 0x10c30c30c30c30c3ULL;
+  v = (v | v << 2) & 0x1249249249249249ULL;
+  return v;
+}
+
+// window pixel (top-left origin) of p, false behind the camera and beyond
+// the near and far planes
+bool ProjectToPixel(const Eigen::Matrix4f &view_projection,
+    const Eigen::Vector2f &viewport_size, const Eigen::Vector3f &p,
+    Eigen::Vector2f *pixel) {
+  const Eigen::Vector4f clip = view_projection * p.homogeneous();
+  if (clip.w() < kMinClipW || std::abs(clip.z()) > clip.w()) {
+    return false;
+  }
+  const float inv_w = 1.f / clip.w();
+  *pixel = Eigen::Vector2f((clip.x() * inv_w * 0.5f + 0.5f) * viewport_size.x(),
+      (0.5f - clip.y() * inv_w * 0.5f) * viewport_size.y());
+  return true;
+}
+
+// the pixels of a polygon, in the rectangle of pixels [origin, origin +
+// size) its bounds cover in the viewport, with a summed area table to
+// count them in any rectangle
+struct PolygonMask {
+  Eigen::Vector2i origin = Eigen::Vector2i::Zero();
+  Eigen::Vector2i size = Eigen::Vector2i::Zero();
+  std::vector<uint8_t> pixels;
+  // covered pixels above and left of every corner, (size + 1) squared
+  std::vector<uint32_t> sums;
+
+  bool covered(int x, int y) const {
+    x -= origin.x();
+    y -= origin.y();
+    return x >= 0 && y >= 0 && x < size.x() && y < size.y() &&
+        pixels[static_cast<std::size_t>(y) * size.x() + x] != 0;
+  }
+
+  // covered pixels of the inclusive rectangle [lower, upper]
+  uint32_t Count(Eigen::Vector2i lower, Eigen::Vector2i upper) const {
+    lower = (lower - origin).cwiseMax(0);
+    upper = (upper - origin).cwiseMin(size - Eigen::Vector2i::Ones());
+    if ((upper.array() < lower.array()).any()) {
+      return 0;
+    }
+    const std::size_t stride = size.x() + 1;
+    return sums[(upper.y() + 1) * stride + upper.x() + 1] -
+        sums[lower.y() * stride + upper.x() + 1] -
+        sums[(upper.y() + 1) * stride + lower.x()] +
+        sums[lower.y() * stride + lower.x()];
+  }
+};
+
+// even-odd fill of the pixels whose centers are inside the polygon
+void RasterizePolygon(const std::vector<Eigen::Vector2f,
+    Eigen::aligned_allocator<Eigen::Vector2f>> &polygon,
+    const Eigen::Vector2i &viewport_size, PolygonMask *mask) {
+  Eigen::Vector2f lower = polygon[0];
+  Eigen::Vector2f upper = polygon[0];
+  for (const Eigen::Vector2f &vertex : polygon) {
+    lower = lower.cwiseMin(vertex);
+    upper = upper.cwiseMax(vertex);
+  }
+  mask->origin = Eigen::Vector2i(
+      std::max(0, static_cast<int>(std::floor(lower.x()))),
+      std::max(0, static_cast<int>(std::floor(lower.y()))));
+  const Eigen::Vector2i last(
+      std::min(viewport_size.x() - 1, static_cast<int>(std::floor(upper.x()))),
+      std::min(viewport_size.y() - 1, static_cast<int>(std::floor(upper.y()))));
+  mask->size = (last - mask->origin + Eigen::Vector2i::Ones()).cwiseMax(0);
+  mask->pixels.assign(static_cast<std::size_t>(mask->size.prod()), 0);
+
+  std::vector<float> crossings;
+  for (int row = 0; row < mask->size.y(); ++row) {
+    const float y = mask->origin.y() + row + 0.5f;
+    crossings.clear();
+    for (std::size_t i = 0; i < polygon.size(); ++i) {
+      const Eigen::Vector2f &a = polygon[i];
+      const Eigen::Vector2f &b = polygon[(i + 1) % polygon.size()];
+      if ((a.y() <= y) != (b.y() <= y)) {
+        crossings.push_back(a.x() + (y - a.y()) * (b.x() - a.x()) /
+            (b.y() - a.y()));
+      }
+    }
+    std::sort(crossings.begin(), crossings.end());
+    uint8_t *pixels = &mask->pixels[static_cast<std::size_t>(row) *
+        mask->size.x()];
+    for (std::size_t i = 0; i + 1 < crossings.size(); i += 2) {
+      // pixel centers x + 0.5 in [crossings[i], crossings[i + 1])
+      const int begin = std::max(0, static_cast<int>(
+          std::ceil(crossings[i] - 0.5f)) - mask->origin.x());
+      const int end = std::min(mask->size.x(), static_cast<int>(
+          std::ceil(crossings[i + 1] - 0.5f)) - mask->origin.x());
+      if (begin < end) {
+        std::memset(pixels + begin, 1, end - begin);
+      }
+    }
+  }
+
+  const std::size_t stride = mask->size.x() + 1;
+  mask->sums.assign(stride * (mask->size.y() + 1), 0);
+  for (int y = 0; y < mask->size.y(); ++y) {
+    uint32_t row_sum = 0;
+    for (int x = 0; x < mask->size.x(); ++x) {
+      row_sum += mask->pixels[static_cast<std::size_t>(y) * mask->size.x() + x];
+      mask->sums[(y + 1) * stride + x + 1] = mask->sums[y * stride + x + 1] +
+          row_sum;
+    }
+  }
+}
+
+}  // namespace
+
+const std::size_t PointIndex::kLeafPoints;
+const std::size_t PointIndex::kFanout;
+
+void PointIndex::Build(const float *xyz, std::size_t stride,
+    std::size_t num_points, const uint32_t *source) {
+  TRACE_SCOPE("PointIndex::Build");
+  xyz_.clear();
+  source_.clear();
+  levels_.clear();
+  level_points_.clear();
+  bounds_.setEmpty();
+  ThreadPool &pool = ThreadPool::Global();
+
+  std::mutex mutex;
+  pool.ParallelFor(0, num_points, kIndexGrain,
+      [&](std::size_t begin, std::size_t end) {
+        Eigen::AlignedBox3f local;
+        for (std::size_t i = begin; i < end; ++i) {
+          const Eigen::Map<const Eigen::Vector3f> p(xyz + i * stride);
+          if (p.allFinite()) {
+            local.extend(p);
+          }
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        bounds_.extend(local);
+      });
+  if (bounds_.isEmpty()) {
+    return;
+  }
+
+  // cubic cells, fine enough for the leaves to stay compact; non-finite
+  // points get the bit above the cell bits and sort last
+  int axis_bits = 1;
+  while (axis_bits < kMaxAxisBits && (uint64_t(1) << (3 * axis_bits)) <
+      (num_points / kLeafPoints + 1) * kCellsPerLeaf) {
+    ++axis_bits;
+  }
+  const float max_cell = static_cast<float>((uint64_t(1) << axis_bits) - 1);
+  const float cell_scale = (uint64_t(1) << axis_bits) /
+      std::max(bounds_.sizes().maxCoeff() * 1.0001f, 1e-12f);
+  const Eigen::Vector3f origin = bounds_.min();
+  const uint64_t invalid_key = uint64_t(1) << (3 * axis_bits);
+
+  std::vector<uint64_t> keys(num_points);
+  std::vector<uint32_t> indices(num_points);
+  std::size_t num_invalid = 0;
+  pool.ParallelFor(0, num_points, kIndexGrain,
+      [&](std::size_t begin, std::size_t end) {
+        std::size_t local_invalid = 0;
+        for (std::size_t i = begin; i < end; ++i) {
+          const Eigen::Map<const Eigen::Vector3f> p(xyz + i * stride);
+          indices[i] = static_cast<uint32_t>(i);
+          if (!p.allFinite()) {
+            keys[i] = invalid_key;
+            ++local_invalid;
+            continue;
+          }
+          const Eigen::Vector3f cell = ((p - origin) * cell_scale)
+              .cwiseMax(0.f).cwiseMin(max_cell);
+          keys[i] = SpreadBits(static_cast<uint64_t>(cell.x())) |
+              SpreadBits(static_cast<uint64_t>(cell.y())) << 1 |
+              SpreadBits(static_cast<uint64_t>(cell.z())) << 2;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        num_invalid += local_invalid;
+      });
+  {
+    std::vector<uint64_t> keys_scratch;
+    std::vector<uint32_t> indices_scratch;
+    RadixSort(3 * axis_bits + 1, &keys, &indices, &keys_scratch,
+        &indices_scratch);
+  }
+  std::vector<uint64_t>().swap(keys);
+
+  const std::size_t num_valid = num_points - num_invalid;
+  xyz_.resize(num_valid * 3);
+  source_.resize(num_valid);
+  pool.ParallelFor(0, num_valid, kIndexGrain,
+      [&](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i < end; ++i) {
+          const std::size_t index = indices[i];
+          std::copy_n(xyz + index * stride, 3, &xyz_[i * 3]);
+          source_[i] = source != nullptr ? source[index] :
+              static_cast<uint32_t>(index);
+        }
+      });
+
+  // leaf boxes in parallel, the few levels above them serially
+  levels_.emplace_back((num_valid + kLeafPoints - 1) / kLeafPoints);
+  level_points_.push_back(kLeafPoints);
+  pool.ParallelFor(0, levels_[0].size(), kIndexGrain / kLeafPoints,
+      [&](std::size_t begin, std::size_t end) {
+        for (std::size_t leaf = begin; leaf < end; ++leaf) {
+          Eigen::AlignedBox3f box;
+          for (std::size_t i = RangeBegin(0, leaf); i < RangeEnd(0, leaf);
+              ++i) {
+            box.extend(position(static_cast<uint32_t>(i)));
+          }
+          levels_[0][leaf] = box;
+        }
+      });
+  while (levels_.back().size() > 1) {
+    const std::size_t num_children = levels_.back().size();
+    std::vector<Eigen::AlignedBox3f,
+        Eigen::aligned_allocator<Eigen::AlignedBox3f>> level(
+            (num_children + kFanout - 1) / kFanout);
+    for (std::size_t child = 0; child < num_children; ++child) {
+      level[child / kFanout].extend(levels_.back()[child]);
+    }
+    levels_.push_back(std::move(level));
+    level_points_.push_back(level_points_.back() * kFanout);
+  }
+}
+
+std::size_t PointIndex::RangeBegin(int level, std::size_t index) const {
+  return std::min(index * level_points_[level], source_.size());
+}
+
+std::size_t PointIndex::RangeEnd(int level, std::size_t index) const {
+  return std::min((index + 1) * level_points_[level], source_.size());
+}
+
+template <typename Classify, typename Test>
+void PointIndex::Select(const Classify &classify, const Test &test,
+    std::vector<uint32_t> *points) const {
+  points->clear();
+  if (levels_.empty()) {
+    return;
+  }
+  // ranges taken whole and leaves to test; depth first with the children
+  // in order, so they come out in index order
+  struct Range {
+    std::size_t begin;
+    std::size_t end;
+    bool test;
+  };
+  std::vector<Range> ranges;
+  std::vector<std::pair<int, std::size_t>> stack;
+  stack.push_back(std::make_pair(static_cast<int>(levels_.size()) - 1, 0));
+  while (!stack.empty()) {
+    const int level = stack.back().first;
+    const std::size_t index = stack.back().second;
+    stack.pop_back();
+    const Overlap overlap = classify(levels_[level][index]);
+    if (overlap == Overlap::kOutside) {
+      continue;
+    }
+    if (overlap == Overlap::kInside || level == 0) {
+      const Range range = {RangeBegin(level, index), RangeEnd(level, index),
+          overlap != Overlap::kInside};
+      if (!ranges.empty() && ranges.back().end == range.begin &&
+          ranges.back().test == range.test) {
+        ranges.back().end = range.end;
+      } else {
+        ranges.push_back(range);
+      }
+      continue;
+    }
+    const std::size_t first = index * kFanout;
+    const std::size_t last = std::min(first + kFanout,
+        levels_[level - 1].size());
+    for (std::size_t child = last; child-- > first;) {
+      stack.push_back(std::make_pair(level - 1, child));
+    }
+  }
+
+  // tasks of a bounded number of points, each gathering into its own list
+  std::vector<Range> tasks;
+  for (const Range &range : ranges) {
+    for (std::size_t begin = range.begin; begin < range.end;
+        begin += kSelectGrain) {
+      const Range task = {begin, std::min(range.end, begin + kSelectGrain),
+          range.test};
+      tasks.push_back(task);
+    }
+  }
+  std::vector<std::vector<uint32_t>> found(tasks.size());
+  ThreadPool::Global().ParallelFor(0, tasks.size(), 1,
+      [&](std::size_t begin, std::size_t end) {
+        for (std::size_t t = begin; t < end; ++t) {
+          std::vector<uint32_t> &list = found[t];
+          list.reserve(tasks[t].end - tasks[t].begin);
+          for (std::size_t i = tasks[t].begin; i < tasks[t].end; ++i) {
+            const uint32_t point = static_cast<uint32_t>(i);
+            if (!tasks[t].test || test(position(point))) {
+              list.push_back(point);
+            }
+          }
+        }
+      });
+  std::size_t total = 0;
+  for (const std::vector<uint32_t> &list : found) {
+    total += list.size();
+  }
+  points->reserve(total);
+  for (const std::vector<uint32_t> &list : found) {
+    points->insert(points->end(), list.begin(), list.end());
+  }
+}
+
+void PointIndex::SelectBox(const Eigen::AlignedBox3f &box,
+    std::vector<uint32_t> *points) const {
+  TRACE_SCOPE("PointIndex::SelectBox");
+  Select([&box](const Eigen::AlignedBox3f &bounds) {
+        if (!box.intersects(bounds)) {
+          return Overlap::kOutside;
+        }
+        return box.contains(bounds) ? Overlap::kInside : Overlap::kPartial;
+      },
+      [&box](const Eigen::Vector3f &p) {
+        return box.contains(p);
+      }, points);
+}
+
+void PointIndex::SelectOrientedBox(const Eigen::Affine3f &box,
+    std::vector<uint32_t> *points) const {
+  TRACE_SCOPE("PointIndex::SelectOrientedBox");
+  const Eigen::Affine3f to_box = box.inverse();
+  const Eigen::Matrix3f abs_linear = to_box.linear().cwiseAbs();
+  Select([&](const Eigen::AlignedBox3f &bounds) {
+        // the bounds in the box frame, bounded by an axis-aligned box
+        const Eigen::Vector3f center = to_box * bounds.center();
+        const Eigen::Vector3f extent = abs_linear * (0.5f * bounds.sizes());
+        if (((center.cwiseAbs() - extent).array() > 0.5f).any()) {
+          return Overlap::kOutside;
+        }
+        return ((center.cwiseAbs() + extent).array() <= 0.5f).all() ?
+            Overlap::kInside : Overlap::kPartial;
+      },
+      [&to_box](const Eigen::Vector3f &p) {
+        return ((to_box * p).cwiseAbs().array() <= 0.5f).all();
+      }, points);
+}
+
+void PointIndex::SelectRadius(const Eigen::Vector3f &center, float radius,
+    std::vector<uint32_t> *points) const {
+  TRACE_SCOPE("PointIndex::SelectRadius");
+  const float squared_radius = radius * radius;
+  Select([&](const Eigen::AlignedBox3f &bounds) {
+        if (bounds.squaredExteriorDistance(center) > squared_radius) {
+          return Overlap::kOutside;
+        }
+        // farthest corner
+        const Eigen::Vector3f far = (center - bounds.min()).cwiseAbs()
+            .cwiseMax((bounds.max() - center).cwiseAbs());
+        return far.squaredNorm() <= squared_radius ?
+            Overlap::kInside : Overlap::kPartial;
+      },
+      [&](const Eigen::Vector3f &p) {
+        return (p - center).squaredNorm() <= squared_radius;
+      }, points);
+}
+
+void PointIndex::SelectPolygon(const Eigen::Matrix4f &view_matrix,
+    const Eigen::Matrix4f &projection_matrix,
+    const Eigen::Vector2i &viewport_size,
+    const std::vector<Eigen::Vector2f,
+        Eigen::aligned_allocator<Eigen::Vector2f>> &polygon,
+    std::vector<uint32_t> *points) const {
+  TRACE_SCOPE("PointIndex::SelectPolygon");
+  points->clear();
+  if (polygon.size() < 3 || (viewport_size.array() <= 0).any()) {
+    return;
+  }
+  PolygonMask mask;
+  RasterizePolygon(polygon, viewport_size, &mask);
+  if ((mask.size.array() <= 0).any()) {
+    return;
+  }
+  const Eigen::Matrix4f view_projection = projection_matrix * view_matrix;
+  const Eigen::Vector2f viewport = viewport_size.cast<float>();
+  const Eigen::Vector2i mask_last = mask.origin + mask.size -
+      Eigen::Vector2i::Ones();
+
+  Select([&](const Eigen::AlignedBox3f &bounds) {
+        // the projection of a box lies within that of its corners, as long
+        // as all of them are in front of the camera
+        Eigen::AlignedBox2f screen;
+        int num_projected = 0;
+        int num_in_front = 0;
+        for (int c = 0; c < 8; ++c) {
+          const Eigen::Vector3f corner = bounds.corner(
+              static_cast<Eigen::AlignedBox3f::CornerType>(c));
+          Eigen::Vector2f pixel;
+          if (ProjectToPixel(view_projection, viewport, corner, &pixel)) {
+            screen.extend(pixel);
+            ++num_projected;
+          }
+          if ((view_projection * corner.homogeneous()).w() >= kMinClipW) {
+            ++num_in_front;
+          }
+        }
+        if (num_in_front == 0) {
+          return Overlap::kOutside;
+        }
+        if (num_projected < 8) {
+          return Overlap::kPartial;
+        }
+        const Eigen::Vector2i lower(
+            static_cast<int>(std::floor(screen.min().x())),
+            static_cast<int>(std::floor(screen.min().y())));
+        const Eigen::Vector2i upper(
+            static_cast<int>(std::floor(screen.max().x())),
+            static_cast<int>(std::floor(screen.max().y())));
+        const uint32_t covered = mask.Count(lower, upper);
+        if (covered == 0) {
+          return Overlap::kOutside;
+        }
+        const bool within = (lower.array() >= mask.origin.array()).all() &&
+            (upper.array() <= mask_last.array()).all();
+        const uint64_t area =
+            static_cast<uint64_t>(upper.x() - lower.x() + 1) *
+            (upper.y() - lower.y() + 1);
+        return within && covered == area ? Overlap::kInside :
+            Overlap::kPartial;
+      },
+      [&](const Eigen::Vector3f &p) {
+        Eigen::Vector2f pixel;
+        return ProjectToPixel(view_projection, viewport, p, &pixel) &&
+            mask.covered(static_cast<int>(std::floor(pixel.x())),
+                static_cast<int>(std::floor(pixel.y())));
+      }, points);
+}
+
+void PointIndex::Nearest(const Eigen::Vector3f &query, std::size_t k,
+    std::vector<uint32_t> *points,
+    std::vector<float> *squared_distances) const {
+  TRACE_SCOPE("PointIndex::Nearest");
+  points->clear();
+  if (squared_distances != nullptr) {
+    squared_distances->clear();
+  }
+  if (levels_.empty() || k == 0) {
+    return;
+  }
+  // boxes nearest first, and the k nearest points so far, farthest on top
+  typedef std::pair<float, std::pair<int, std::size_t>> Box;
+  std::priority_queue<Box, std::vector<Box>, std::greater<Box>> boxes;
+  std::priority_queue<std::pair<float, uint32_t>> nearest;
+  const int root_level = static_cast<int>(levels_.size()) - 1;
+  boxes.push(Box(levels_[root_level][0].squaredExteriorDistance(query),
+      std::make_pair(root_level, 0)));
+  while (!boxes.empty()) {
+    const Box box = boxes.top();
+    if (nearest.size() == k && box.first > nearest.top().first) {
+      break;
+    }
+    boxes.pop();
+    const int level = box.second.first;
+    const std::size_t index = box.second.second;
+    if (level == 0) {
+      for (std::size_t i = RangeBegin(0, index); i < RangeEnd(0, index);
+          ++i) {
+        const uint32_t point = static_cast<uint32_t>(i);
+        const float distance = (position(point) - query).squaredNorm();
+        if (nearest.size() < k) {
+          nearest.push(std::make_pair(distance, point));
+        } else if (distance < nearest.top().first) {
+          nearest.pop();
+          nearest.push(std::make_pair(distance, point));
+        }
+      }
+      continue;
+    }
+    const std::size_t first = index * kFanout;
+    const std::size_t last = std::min(first + kFanout,
+        levels_[level - 1].size());
+    for (std::size_t child = first; child < last; ++child) {
+      boxes.push(Box(levels_[level - 1][child].squaredExteriorDistance(query),
+          std::make_pair(level - 1, child)));
+    }
+  }
+
+  points->resize(nearest.size());
+  if (squared_distances != nullptr) {
+    squared_distances->resize(nearest.size());
+  }
+  for (std::size_t i = nearest.size(); i-- > 0;) {
+    (*points)[i] = nearest.top().second;
+    if (squared_distances != nullptr) {
+      (*squared_distances)[i] = nearest.top().first;
+    }
+    nearest.pop();
+  }
+}
+
+Eigen::AlignedBox3f PointIndex::Bounds(
+    const std::vector<uint32_t> &points) const {
+  Eigen::AlignedBox3f bounds;
+  std::mutex mutex;
+  ThreadPool::Global().ParallelFor(0, points.size(), kIndexGrain,
+      [&](std::size_t begin, std::size_t end) {
+        Eigen::AlignedBox3f local;
+        for (std::size_t i = begin; i < end; ++i) {
+          local.extend(position(points[i]));
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        bounds.extend(local);
+      });
+  return bounds;
+}
+
+}  // namespace ogl_viewer
@@ -0,0 +1,205 @@
+#include "point_octree.h"
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+#include <queue>
+#include <utility>
+
+#include "tracer.h"
+
+namespace ogl_viewer {
+
+namespace {
+
+inline int CellCoord(float value, float min, float inv_cell_size, int size) {
+  const int coord = static_cast<int>((value - min) * inv_cell_size);
+  return std::min(std::max(coord, 0), size - 1);
+}
+
+}  // namespace
+
+void PointOctree::Build(std::vector<float> *xyz,
+    std::vector<uint32_t> *order) {
+  TRACE_SCOPE("PointOctree::Build");
+  nodes_.clear();
+  const std::size_t num_points = xyz->size() / 3;
+  if (order != nullptr) {
+    order->clear();
+  }
+  if (num_points == 0) {
+    return;
+  }
+
+  Eigen::AlignedBox3f bounds;
+  for (std::size_t i = 0; i < num_points; ++i) {
+    bounds.extend(Eigen::Map<const Eigen::Vector3f>(&(*xyz)[i * 3]));
+  }
+  // cubic root cell, slightly enlarged so that no point sits on the border
+  const float half_size = 0.5f * bounds.sizes().maxCoeff() * 1.001f + 1e-6f;
+  const Eigen::Vector3f center = bounds.center();
+  OctreeNode root;
+  root.bounds = Eigen::AlignedBox3f(center - Eigen::Vector3f::Constant(half_size),
+      center + Eigen::Vector3f::Constant(half_size));
+  nodes_.push_back(root);
+
+  std::vector<uint32_t> point_order(num_points);
+  std::iota(point_order.begin(), point_order.end(), 0);
+  std::vector<uint32_t> scratch(num_points);
+  BuildNode(0, xyz->data(), point_order.data(), scratch.data(), 0,
+      num_points);
+  std::vector<uint32_t>().swap(scratch);
+
+  std::vector<float> sorted(xyz->size());
+  for (std::size_t i = 0; i < num_points; ++i) {
+    std::copy_n(&(*xyz)[static_cast<std::size_t>(point_order[i]) * 3], 3,
+        &sorted[i * 3]);
+  }
+  xyz->swap(sorted);
+  if (order != nullptr) {
+    order->swap(point_order);
+  }
+
+  ComputeSubtreeBounds(*xyz);
+}
+
+void PointOctree::ComputeSubtreeBounds(const std::vector<float> &xyz) {
+  // children are always stored after their parent
+  for (int i = static_cast<int>(nodes_.size()) - 1; i >= 0; --i) {
+    OctreeNode &node = nodes_[i];
+    node.point_bounds.setEmpty();
+    for (std::size_t p = node.first; p < node.first + node.count; ++p) {
+      node.point_bounds.extend(
+          Eigen::Map<const Eigen::Vector3f>(&xyz[p * 3]));
+    }
+    node.subtree_bounds = node.point_bounds;
+    for (int child : node.children) {
+      if (child >= 0) {
+        node.subtree_bounds.extend(nodes_[child].subtree_bounds);
+      }
+    }
+  }
+}
+
+void PointOctree::BuildNode(int node_index, const float *xyz,
+    uint32_t *order, uint32_t *scratch, std::size_t begin, std::size_t end) {
+  const Eigen::AlignedBox3f bounds = nodes_[node_index].bounds;
+  const int level = nodes_[node_index].level;
+  nodes_[node_index].first = begin;
+  nodes_[node_index].subtree_count = end - begin;
+  if (end - begin <= max_points_per_node_ || level >= kMaxDepth) {
+    nodes_[node_index].count = end - begin;
+    return;
+  }
+
+  // keep the first point of every sample grid cell, pass the others on
+  const int grid = kSampleGridSize;
+  const Eigen::Vector3f min = bounds.min();
+  const Eigen::Vector3f center = bounds.center();
+  const float inv_cell_size = grid / bounds.sizes().x();
+  std::vector<uint64_t> occupied(grid * grid * grid / 64, 0);
+  std::size_t num_samples = 0;
+  std::size_t num_rest = 0;
+  std::size_t octant_counts[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+  for (std::size_t i = begin; i < end; ++i) {
+    const uint32_t index = order[i];
+    const float *p = xyz + static_cast<std::size_t>(index) * 3;
+    const int cell = (CellCoord(p[2], min.z(), inv_cell_size, grid) * grid +
+        CellCoord(p[1], min.y(), inv_cell_size, grid)) * grid +
+        CellCoord(p[0], min.x(), inv_cell_size, grid);
+    const uint64_t bit = uint64_t(1) << (cell & 63);
+    if (!(occupied[cell >> 6] & bit)) {
+      occupied[cell >> 6] |= bit;
+      order[begin + num_samples++] = index;
+    } else {
+      scratch[begin + num_rest++] = index;
+      const int octant = (p[0] >= center.x() ? 1 : 0) |
+          (p[1] >= center.y() ? 2 : 0) | (p[2] >= center.z() ? 4 : 0);
+      ++octant_counts[octant];
+    }
+  }
+  nodes_[node_index].count = num_samples;
+
+  // counting sort of the remaining points by octant
+  std::size_t octant_begins[9];
+  octant_begins[0] = begin + num_samples;
+  for (int o = 0; o < 8; ++o) {
+    octant_begins[o + 1] = octant_begins[o] + octant_counts[o];
+  }
+  std::size_t cursor[8];
+  std::copy_n(octant_begins, 8, cursor);
+  for (std::size_t i = 0; i < num_rest; ++i) {
+    const uint32_t index = scratch[begin + i];
+    const float *p = xyz + static_cast<std::size_t>(index) * 3;
+    const int octant = (p[0] >= center.x() ? 1 : 0) |
+        (p[1] >= center.y() ? 2 : 0) | (p[2] >= center.z() ? 4 : 0);
+    order[cursor[octant]++] = index;
+  }
+
+  for (int o = 0; o < 8; ++o) {
+    if (octant_counts[o] == 0) {
+      continue;
+    }
+    OctreeNode child;
+    child.level = level + 1;
+    for (int axis = 0; axis < 3; ++axis) {
+      const bool upper = (o >> axis) & 1;
+      child.bounds.min()[axis] = upper ? center[axis] : bounds.min()[axis];
+      child.bounds.max()[axis] = upper ? bounds.max()[axis] : center[axis];
+    }
+    const int child_index = static_cast<int>(nodes_.size());
+    nodes_.push_back(child);
+    nodes_[node_index].children[o] = child_index;
+    BuildNode(child_index, xyz, order, scratch, octant_begins[o],
+        octant_begins[o + 1]);
+  }
+}
+
+void PointOctree::SelectNodes(const Eigen::Matrix4f &view_matrix,
+    const Eigen::Matrix4f &projection_matrix, float viewport_height,
+    std::size_t point_budget, float min_node_pixels,
+    const std::vector<uint8_t> *visible, std::vector<int> *selected) const {
+  selected->clear();
+  if (nodes_.empty() || (visible && !(*visible)[0])) {
+    return;
+  }
+
+  const Eigen::Vector3f eye = view_matrix.inverse().block<3, 1>(0, 3);
+  // pixels covered by a unit length at unit distance
+  const float pixel_scale = 0.5f * viewport_height * projection_matrix(1, 1);
+  auto projected_size = [&](const OctreeNode &node) {
+    const float radius = 0.5f * node.bounds.sizes().norm();
+    const float distance = (node.bounds.center() - eye).norm();
+    if (distance <= radius) {
+      return std::numeric_limits<float>::max();
+    }
+    return radius * pixel_scale / distance;
+  };
+
+  std::priority_queue<std::pair<float, int>> queue;
+  queue.push(std::make_pair(projected_size(nodes_[0]), 0));
+  std::size_t num_points = 0;
+  while (!queue.empty()) {
+    const int node_index = queue.top().second;
+    queue.pop();
+    const OctreeNode &node = nodes_[node_index];
+    if (num_points + node.count > point_budget && !selected->empty()) {
+      break;
+    }
+    num_points += node.count;
+    selected->push_back(node_index);
+
+    for (int o = 0; o < 8; ++o) {
+      if (node.children[o] < 0 ||
+          (visible && !(*visible)[node.children[o]])) {
+        continue;
+      }
+      const float size = projected_size(nodes_[node.children[o]]);
+      if (size >= min_node_pixels) {
+        queue.push(std::make_pair(size, node.children[o]));
+      }
+    }
+  }
+}
+
+}  // namespace ogl_viewer
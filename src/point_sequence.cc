@@ -0,0 +1,260 @@
+#include "point_sequence.h"
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#include "lzf.h"
+#include "pcd_reader.h"
+#include "tracer.h"
+
+namespace ogl_viewer {
+
+namespace {
+
+const std::size_t kDecodeChunkPoints = 1 << 18;
+
+bool HasPcdExtension(const std::string &name) {
+  return name.size() > 4 && name.compare(name.size() - 4, 4, ".pcd") == 0;
+}
+
+// byte k of float i goes to planes[k * n + i]: the sign and exponent bytes
+// of nearby points are alike and compress well, the mantissas barely do
+void SplitBytePlanes(const float *xyz, std::size_t num_floats,
+    uint8_t *planes) {
+  const uint8_t *bytes = reinterpret_cast<const uint8_t*>(xyz);
+  for (std::size_t i = 0; i < num_floats; ++i) {
+    for (std::size_t k = 0; k < sizeof(float); ++k) {
+      planes[k * num_floats + i] = bytes[i * sizeof(float) + k];
+    }
+  }
+}
+
+void MergeBytePlanes(const uint8_t *planes, std::size_t num_floats,
+    float *xyz) {
+  uint8_t *bytes = reinterpret_cast<uint8_t*>(xyz);
+  for (std::size_t i = 0; i < num_floats; ++i) {
+    for (std::size_t k = 0; k < sizeof(float); ++k) {
+      bytes[i * sizeof(float) + k] = planes[k * num_floats + i];
+    }
+  }
+}
+
+}  // namespace
+
+bool IsDirectory(const std::string &path) {
+  struct stat st;
+  return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+PointSequence::~PointSequence() {
+  // queued decodes return right away, running ones stop at the next chunk
+  cancel_ = true;
+  pool_.reset();
+}
+
+bool PointSequence::Open(const std::string &directory, int num_threads) {
+  DIR *dir = opendir(directory.c_str());
+  if (dir == nullptr) {
+    std::cerr << "error : failed to open directory " << directory << "\n";
+    return false;
+  }
+  std::vector<std::string> names;
+  while (const dirent *entry = readdir(dir)) {
+    if (HasPcdExtension(entry->d_name)) {
+      names.push_back(entry->d_name);
+    }
+  }
+  closedir(dir);
+  if (names.empty()) {
+    std::cerr << "error : no .pcd files in " << directory << "\n";
+    return false;
+  }
+
+  // zero padded frame numbers or timestamps sort in playback order
+  std::sort(names.begin(), names.end());
+  const std::string prefix = directory.back() == '/' ? directory :
+      directory + "/";
+  frame_paths_.clear();
+  for (const std::string &name : names) {
+    frame_paths_.push_back(prefix + name);
+  }
+  pool_.reset(new ThreadPool(num_threads));
+  return true;
+}
+
+void PointSequence::Prefetch(std::size_t index, int direction) {
+  const std::size_t n = frame_paths_.size();
+  if (n == 0) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  playback_index_ = index;
+  playback_direction_ = direction < 0 ? -1 : 1;
+
+  // the farthest cached frame, which a new frame would push out
+  std::size_t farthest = 0;
+  std::size_t num_ready = 0;
+  for (const auto &entry : frames_) {
+    if (entry.second.ready) {
+      farthest = std::max(farthest, PlaybackDistance(entry.first));
+      ++num_ready;
+    }
+  }
+  const std::size_t frame_bytes = num_ready > 0 ? cached_bytes_ / num_ready :
+      0;
+
+  const std::size_t window = std::min<std::size_t>(
+      std::max(prefetch_frames_, 0) + 1, n);
+  for (std::size_t k = 0; k < window; ++k) {
+    if (num_pending_ >= max_pending_frames_) {
+      break;
+    }
+    const std::size_t frame = playback_direction_ > 0 ? (index + k) % n :
+        (index + n - k % n) % n;
+    if (frames_.count(frame) != 0) {
+      continue;
+    }
+    // a full cache only takes frames closer than the ones it holds, else
+    // they would be decoded and dropped over and over
+    if (cached_bytes_ + frame_bytes > cache_bytes_ && k >= farthest) {
+      break;
+    }
+    frames_[frame] = Frame();
+    ++num_pending_;
+    pool_->Submit([this, frame]() { DecodeFrame(frame); });
+  }
+}
+
+bool PointSequence::GetFrame(std::size_t index, std::vector<float> *xyz) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto iter = frames_.find(index);
+  if (iter == frames_.end() || !iter->second.ready) {
+    return false;
+  }
+  const Frame &frame = iter->second;
+  if (frame.compressed.empty()) {
+    *xyz = frame.xyz;
+    return true;
+  }
+
+  TRACE_SCOPE("PointSequence::Decompress");
+  const std::size_t num_floats = frame.num_points * 3;
+  planes_buffer_.resize(num_floats * sizeof(float));
+  const std::size_t size = LzfDecompress(frame.compressed.data(),
+      frame.compressed.size(), planes_buffer_.data(), planes_buffer_.size());
+  if (size != planes_buffer_.size()) {
+    std::cerr << "error : corrupt cached frame " << frame_paths_[index]
+        << "\n";
+    xyz->clear();
+    return true;
+  }
+  xyz->resize(num_floats);
+  MergeBytePlanes(planes_buffer_.data(), num_floats, xyz->data());
+  return true;
+}
+
+SequenceCacheStats PointSequence::cache_stats() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  SequenceCacheStats stats;
+  stats.cached_bytes = cached_bytes_;
+  stats.pending_frames = num_pending_;
+  for (const auto &entry : frames_) {
+    if (entry.second.ready) {
+      ++stats.cached_frames;
+      stats.raw_bytes += entry.second.num_points * 3 * sizeof(float);
+    }
+  }
+  return stats;
+}
+
+void PointSequence::DecodeFrame(std::size_t index) {
+  Frame frame;
+  frame.ready = true;
+  if (!cancel_) {
+    TRACE_SCOPE("PointSequence::DecodeFrame");
+    const std::string &path = frame_paths_[index];
+    std::vector<float> xyz;
+    PcdReader reader;
+    bool read_ok = reader.Open(path) && reader.CanReadPositions();
+    if (read_ok) {
+      xyz.reserve(reader.header().num_points * 3);
+      read_ok = reader.ReadPositions(kDecodeChunkPoints,
+          [&](const float *points, std::size_t count) {
+            xyz.insert(xyz.end(), points, points + count * 3);
+            return !cancel_;
+          });
+    }
+    if (!read_ok) {
+      if (!cancel_) {
+        std::cerr << "error : failed to decode " << path << "\n";
+      }
+      xyz.clear();
+    }
+    frame.num_points = xyz.size() / 3;
+
+    bool compressed = false;
+    if (compress_ && !xyz.empty()) {
+      TRACE_SCOPE("PointSequence::Compress");
+      const std::size_t raw_size = xyz.size() * sizeof(float);
+      std::vector<uint8_t> planes(raw_size);
+      SplitBytePlanes(xyz.data(), xyz.size(), planes.data());
+      // incompressible frames are kept as they are
+      std::vector<uint8_t> buffer(raw_size);
+      const std::size_t size = LzfCompress(planes.data(), planes.size(),
+          buffer.data(), buffer.size());
+      if (size > 0) {
+        frame.compressed.assign(buffer.begin(), buffer.begin() + size);
+        compressed = true;
+      }
+    }
+    if (!compressed) {
+      frame.xyz.swap(xyz);
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  --num_pending_;
+  auto iter = frames_.find(index);
+  if (iter == frames_.end()) {
+    return;
+  }
+  iter->second = std::move(frame);
+  cached_bytes_ += FrameBytes(iter->second);
+  EvictFrames();
+}
+
+void PointSequence::EvictFrames() {
+  while (cached_bytes_ > cache_bytes_) {
+    auto victim = frames_.end();
+    std::size_t victim_distance = 0;
+    for (auto iter = frames_.begin(); iter != frames_.end(); ++iter) {
+      const std::size_t distance = PlaybackDistance(iter->first);
+      // the frame at the playback position is kept, whatever the budget
+      if (iter->second.ready && distance > victim_distance) {
+        victim = iter;
+        victim_distance = distance;
+      }
+    }
+    if (victim == frames_.end()) {
+      return;
+    }
+    cached_bytes_ -= FrameBytes(victim->second);
+    frames_.erase(victim);
+  }
+}
+
+std::size_t PointSequence::PlaybackDistance(std::size_t index) const {
+  const std::size_t n = frame_paths_.size();
+  return playback_direction_ > 0 ? (index + n - playback_index_) % n :
+      (playback_index_ + n - index) % n;
+}
+
+std::size_t PointSequence::FrameBytes(const Frame &frame) {
+  return frame.xyz.size() * sizeof(float) + frame.compressed.size();
+}
+
+}  // namespace ogl_viewer
@@ -0,0 +1,222 @@
+#include "polyline_batch.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "tracer.h"
+
+namespace ogl_viewer {
+
+namespace {
+
+// points of the first buffer, which then doubles as needed
+const std::size_t kMinCapacity = 1 << 16;
+// alpha byte of PolylinePoint::color on all but the last points
+const uint32_t kConnected = 0xffu << 24;
+
+uint32_t PackColor(const Eigen::Vector4f &color) {
+  uint32_t packed = 0;
+  for (int k = 0; k < 3; ++k) {
+    const float value = std::max(0.f, std::min(1.f, color[k]));
+    packed |= static_cast<uint32_t>(std::lround(value * 255.f)) << (8 * k);
+  }
+  return packed;
+}
+
+}  // namespace
+
+PolylineBatch::PolylineBatch(int pick_id) : pick_id_(pick_id) {
+  glGenVertexArrays(1, &vao_);
+}
+
+PolylineBatch::~PolylineBatch() {
+  glDeleteVertexArrays(1, &vao_);
+  glDeleteBuffers(1, &vbo_);
+}
+
+void PolylineBatch::Enqueue(GLSLShader *shader, RenderQueue *queue) const {
+  if (num_uploaded_points_ < 2) {
+    return;
+  }
+  // four strip vertices per segment, from gl_VertexID; the segments that
+  // join two polylines collapse in the shader
+  DrawItem item;
+  item.shader = shader;
+  item.vao = vao_;
+  item.mode = GL_TRIANGLE_STRIP;
+  item.first = 0;
+  item.count = 4;
+  item.instance_count = static_cast<GLsizei>(num_uploaded_points_ - 1);
+  item.color_mode = 7;
+  item.line_width = line_width_;
+  item.model_matrix = model_matrix_;
+  item.pick_id = pick_id_;
+  queue->Submit(item);
+}
+
+void PolylineBatch::AddPolyline(const Polyline &points,
+    const Eigen::Vector4f &color) {
+  if (points.size() < 2) {
+    return;
+  }
+  polyline_starts_.push_back(num_uploaded_points_ + staged_points_.size());
+  last_color_ = PackColor(color);
+  StagePoints(points);
+}
+
+void PolylineBatch::ExtendPolyline(const Polyline &points) {
+  if (points.empty() || polyline_starts_.empty()) {
+    return;
+  }
+  // the end of the polyline so far goes on to the new points
+  if (!staged_points_.empty()) {
+    staged_points_.back().color |= kConnected;
+  } else {
+    reopen_last_ = true;
+  }
+  StagePoints(points);
+}
+
+void PolylineBatch::StagePoints(const Polyline &points) {
+  for (const Eigen::Vector3f &position : points) {
+    PolylinePoint point;
+    Eigen::Map<Eigen::Vector3f>(point.position) = position;
+    point.color = last_color_ | kConnected;
+    staged_points_.push_back(point);
+  }
+  staged_points_.back().color = last_color_;
+}
+
+void PolylineBatch::Upload() {
+  if (staged_points_.empty()) {
+    return;
+  }
+  TRACE_SCOPE("PolylineBatch::Upload");
+  const std::size_t num_points = num_uploaded_points_ + staged_points_.size();
+  if (num_points > capacity_) {
+    Reserve(std::max(num_points, std::max(capacity_ * 2, kMinCapacity)));
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, vbo_);
+  if (reopen_last_) {
+    // only the color word of the old end point, its alpha joins it on
+    const uint32_t color = last_color_ | kConnected;
+    glBufferSubData(GL_ARRAY_BUFFER,
+        (num_uploaded_points_ - 1) * sizeof(PolylinePoint) +
+        offsetof(PolylinePoint, color), sizeof(color), &color);
+    reopen_last_ = false;
+  }
+  // behind the points drawn so far, which the GPU may still be reading
+  glBufferSubData(GL_ARRAY_BUFFER,
+      num_uploaded_points_ * sizeof(PolylinePoint),
+      staged_points_.size() * sizeof(PolylinePoint), staged_points_.data());
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  num_uploaded_points_ = num_points;
+  num_uploaded_polylines_ = polyline_starts_.size();
+  staged_points_.clear();
+}
+
+void PolylineBatch::Reserve(std::size_t capacity) {
+  TRACE_SCOPE("PolylineBatch::Reserve");
+  GLuint vbo = 0;
+  glGenBuffers(1, &vbo);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, vbo);
+  glBufferData(GL_COPY_WRITE_BUFFER, capacity * sizeof(PolylinePoint),
+      nullptr, GL_DYNAMIC_DRAW);
+  if (num_uploaded_points_ > 0) {
+    // GPU to GPU, nothing goes through the CPU again
+    glBindBuffer(GL_COPY_READ_BUFFER, vbo_);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0,
+        num_uploaded_points_ * sizeof(PolylinePoint));
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+  }
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  glDeleteBuffers(1, &vbo_);
+  vbo_ = vbo;
+  capacity_ = capacity;
+  SetupVertexArray();
+}
+
+void PolylineBatch::SetupVertexArray() {
+  glBindVertexArray(vao_);
+  glBindBuffer(GL_ARRAY_BUFFER, vbo_);
+  // segment i runs from point i to point i + 1, in the color of point i
+  glEnableVertexAttribArray(kPositionAttrib);
+  glVertexAttribPointer(kPositionAttrib, 3, GL_FLOAT, GL_FALSE,
+      sizeof(PolylinePoint), 0);
+  glVertexAttribDivisor(kPositionAttrib, 1);
+  glEnableVertexAttribArray(kNextPositionAttrib);
+  glVertexAttribPointer(kNextPositionAttrib, 3, GL_FLOAT, GL_FALSE,
+      sizeof(PolylinePoint),
+      reinterpret_cast<const void*>(sizeof(PolylinePoint)));
+  glVertexAttribDivisor(kNextPositionAttrib, 1);
+  glEnableVertexAttribArray(kColorAttrib);
+  glVertexAttribPointer(kColorAttrib, 4, GL_UNSIGNED_BYTE, GL_TRUE,
+      sizeof(PolylinePoint),
+      reinterpret_cast<const void*>(offsetof(PolylinePoint, color)));
+  glVertexAttribDivisor(kColorAttrib, 1);
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+bool PolylineBatch::LookupSegment(int segment, std::size_t *polyline,
+    std::size_t *index) const {
+  if (segment < 0 || static_cast<std::size_t>(segment) + 1 >=
+      num_uploaded_points_) {
+    return false;
+  }
+  const std::size_t point = segment;
+  const auto next = std::upper_bound(polyline_starts_.begin(),
+      polyline_starts_.begin() + num_uploaded_polylines_, point);
+  // the segment from the last point of a polyline to the next one
+  if (next == polyline_starts_.begin() ||
+      (next != polyline_starts_.begin() + num_uploaded_polylines_ &&
+          *next == point + 1)) {
+    return false;
+  }
+  *polyline = next - polyline_starts_.begin() - 1;
+  *index = point - polyline_starts_[*polyline];
+  return true;
+}
+
+bool LoadPolylineFile(const std::string &path,
+    std::vector<Polyline> *polylines) {
+  std::ifstream ifs(path);
+  if (!ifs) {
+    std::cerr << "error : failed to open " << path << "\n";
+    return false;
+  }
+  polylines->clear();
+  Polyline polyline;
+  std::string line;
+  for (int line_number = 1; std::getline(ifs, line); ++line_number) {
+    const std::size_t begin = line.find_first_not_of(" \t\r");
+    if (begin == std::string::npos) {
+      if (!polyline.empty()) {
+        polylines->push_back(polyline);
+        polyline.clear();
+      }
+      continue;
+    }
+    if (line[begin] == '#') {
+      continue;
+    }
+    std::istringstream iss(line);
+    Eigen::Vector3f point;
+    if (!(iss >> point.x() >> point.y() >> point.z())) {
+      std::cerr << "error : " << path << ":" << line_number
+          << ": expected x y z\n";
+      return false;
+    }
+    polyline.push_back(point);
+  }
+  if (!polyline.empty()) {
+    polylines->push_back(polyline);
+  }
+  return true;
+}
+
+}  // namespace ogl_viewer
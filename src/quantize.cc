@@ -0,0 +1,30 @@
+#include "quantize.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace ogl_viewer {
+
+float QuantizePositions(const float *xyz, std::size_t stride,
+    std::size_t count, const Eigen::Vector3f &offset,
+    const Eigen::Vector3f &scale, uint16_t *quantized) {
+  float inv_scale[3];
+  for (int k = 0; k < 3; ++k) {
+    inv_scale[k] = scale[k] > 0.f ? 65535.f / scale[k] : 0.f;
+  }
+  float max_error = 0.f;
+  for (std::size_t i = 0; i < count; ++i) {
+    for (int k = 0; k < 3; ++k) {
+      const float value = xyz[i * stride + k];
+      float q = std::round((value - offset[k]) * inv_scale[k]);
+      q = q > 0.f ? std::min(q, 65535.f) : 0.f;
+      quantized[i * 3 + k] = static_cast<uint16_t>(q);
+      // what rainbow.vert reconstructs
+      const float decoded = offset[k] + scale[k] * (q / 65535.f);
+      max_error = std::max(max_error, std::abs(decoded - value));
+    }
+  }
+  return max_error;
+}
+
+}  // namespace ogl_viewer
@@ -0,0 +1,77 @@
+#include "radix_sort.h"
+
+#include <algorithm>
+#include <cstddef>
+
+#include "thread_pool.h"
+#include "tracer.h"
+
+namespace ogl_viewer {
+
+namespace {
+
+// key bits sorted per pass
+const int kRadixBits = 8;
+const std::size_t kRadixBuckets = std::size_t(1) << kRadixBits;
+// keys per block, a few blocks per thread
+const std::size_t kRadixGrain = 1 << 15;
+
+}  // namespace
+
+// Every pass counts the digits of a few blocks per thread, then each
+// block scatters through its own offsets, so the passes need no atomics.
+void RadixSort(int num_bits, std::vector<uint64_t> *keys,
+    std::vector<uint32_t> *indices, std::vector<uint64_t> *keys_scratch,
+    std::vector<uint32_t> *indices_scratch) {
+  TRACE_SCOPE("RadixSort");
+  ThreadPool &pool = ThreadPool::Global();
+  const std::size_t n = keys->size();
+  const std::size_t num_blocks = std::max<std::size_t>(1, std::min<std::size_t>(
+      n / kRadixGrain, 4 * (pool.num_threads() + 1)));
+  std::vector<std::size_t> offsets(num_blocks * kRadixBuckets);
+  keys_scratch->resize(n);
+  indices_scratch->resize(n);
+
+  for (int shift = 0; shift < num_bits; shift += kRadixBits) {
+    const uint64_t *src_keys = keys->data();
+    const uint32_t *src_indices = indices->data();
+    uint64_t *dst_keys = keys_scratch->data();
+    uint32_t *dst_indices = indices_scratch->data();
+
+    std::fill(offsets.begin(), offsets.end(), 0);
+    pool.ParallelFor(0, num_blocks, 1, [&](std::size_t b, std::size_t e) {
+      for (std::size_t block = b; block < e; ++block) {
+        std::size_t *counts = &offsets[block * kRadixBuckets];
+        for (std::size_t i = n * block / num_blocks;
+            i < n * (block + 1) / num_blocks; ++i) {
+          ++counts[(src_keys[i] >> shift) & (kRadixBuckets - 1)];
+        }
+      }
+    });
+    // digit d of block b goes after digit d of the blocks before it
+    std::size_t sum = 0;
+    for (std::size_t digit = 0; digit < kRadixBuckets; ++digit) {
+      for (std::size_t block = 0; block < num_blocks; ++block) {
+        const std::size_t count = offsets[block * kRadixBuckets + digit];
+        offsets[block * kRadixBuckets + digit] = sum;
+        sum += count;
+      }
+    }
+    pool.ParallelFor(0, num_blocks, 1, [&](std::size_t b, std::size_t e) {
+      for (std::size_t block = b; block < e; ++block) {
+        std::size_t *next = &offsets[block * kRadixBuckets];
+        for (std::size_t i = n * block / num_blocks;
+            i < n * (block + 1) / num_blocks; ++i) {
+          const std::size_t pos =
+              next[(src_keys[i] >> shift) & (kRadixBuckets - 1)]++;
+          dst_keys[pos] = src_keys[i];
+          dst_indices[pos] = src_indices[i];
+        }
+      }
+    });
+    keys->swap(*keys_scratch);
+    indices->swap(*indices_scratch);
+  }
+}
+
+}  // namespace ogl_viewer
@@ -0,0 +1,230 @@
+#include "render_queue.h"
+
+#include <algorithm>
+#include <tuple>
+
+#include "tracer.h"
+
+namespace ogl_viewer {
+
+namespace {
+
+// std140 layout of the FrameUniforms block in the shaders
+struct FrameUniforms {
+  float view_matrix[16];
+  float projection_matrix[16];
+  float z_range[2];
+  int z_clipping;
+  int padding;
+  float viewport_size[2];
+  float padding2[2];
+};
+
+// program, VAO, colormap texture and uniform calls of a draw issued with
+// its whole state
+const std::size_t kUnsortedCallsPerItem = 1 + 1 + 1 + 7;
+// view, projection, z range, z clipping and viewport set one by one per
+// program
+const std::size_t kUnsortedFrameUniformCalls = 5;
+
+bool UsesColormap(int color_mode) {
+  return color_mode == 0 || color_mode == 3 || color_mode == 5;
+}
+
+}  // namespace
+
+RenderQueue::RenderQueue() {
+  glGenBuffers(1, &frame_ubo_);
+  glBindBuffer(GL_UNIFORM_BUFFER, frame_ubo_);
+  glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), nullptr,
+      GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  glBindBufferBase(GL_UNIFORM_BUFFER, kFrameUniformsBinding, frame_ubo_);
+}
+
+RenderQueue::~RenderQueue() {
+  glDeleteBuffers(1, &frame_ubo_);
+}
+
+void RenderQueue::SetFrameUniforms(const Eigen::Matrix4f &view_matrix,
+    const Eigen::Matrix4f &projection_matrix,
+    const Eigen::Vector2f &z_range, bool z_clipping,
+    const Eigen::Vector2i &viewport_size) {
+  FrameUniforms uniforms;
+  std::copy_n(view_matrix.data(), 16, uniforms.view_matrix);
+  std::copy_n(projection_matrix.data(), 16, uniforms.projection_matrix);
+  uniforms.z_range[0] = z_range.x();
+  uniforms.z_range[1] = z_range.y();
+  uniforms.z_clipping = z_clipping ? 1 : 0;
+  uniforms.padding = 0;
+  uniforms.viewport_size[0] = std::max(viewport_size.x(), 1);
+  uniforms.viewport_size[1] = std::max(viewport_size.y(), 1);
+  uniforms.padding2[0] = uniforms.padding2[1] = 0.f;
+
+  glBindBuffer(GL_UNIFORM_BUFFER, frame_ubo_);
+  glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(uniforms), &uniforms);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  frame_ubo_updates_ += 3;
+}
+
+void RenderQueue::Flush() {
+  TRACE_SCOPE("RenderQueue::Flush");
+  stats_ = RenderQueueStats();
+  stats_.draw_items = items_.size();
+  stats_.gl_calls = frame_ubo_updates_;
+  frame_ubo_updates_ = 0;
+  if (items_.empty()) {
+    return;
+  }
+
+  order_.resize(items_.size());
+  for (std::size_t i = 0; i < order_.size(); ++i) {
+    order_[i] = i;
+  }
+  // stable, so that items of equal state keep their submission order
+  std::stable_sort(order_.begin(), order_.end(),
+      [this](std::size_t a, std::size_t b) {
+        const DrawItem &x = items_[a];
+        const DrawItem &y = items_[b];
+        return std::make_tuple(x.shader, x.vao, x.color_mode, x.colormap) <
+            std::make_tuple(y.shader, y.vao, y.color_mode, y.colormap);
+      });
+
+  // other code may bind programs and VAOs between frames
+  GLSLShader *current_shader = nullptr;
+  GLuint current_vao = 0;
+  bool vao_bound = false;
+  // on texture unit 0, where the colormap sampler reads by default
+  GLuint current_colormap = 0;
+  bool colormap_bound = false;
+  ProgramState *state = nullptr;
+  std::size_t num_programs = 0;
+  for (std::size_t index : order_) {
+    const DrawItem &item = items_[index];
+    if (item.shader != current_shader || state == nullptr) {
+      item.shader->Use();
+      current_shader = item.shader;
+      state = GetProgramState(item.shader);
+      ++stats_.gl_calls;
+      ++num_programs;
+    }
+    if (!vao_bound || item.vao != current_vao) {
+      glBindVertexArray(item.vao);
+      current_vao = item.vao;
+      vao_bound = true;
+      ++stats_.gl_calls;
+    }
+    if (UsesColormap(item.color_mode)) {
+      const GLuint colormap =
+          item.colormap != 0 ? item.colormap : height_colormap_;
+      if (!colormap_bound || colormap != current_colormap) {
+        glBindTexture(GL_TEXTURE_1D, colormap);
+        current_colormap = colormap;
+        colormap_bound = true;
+        ++stats_.gl_calls;
+      }
+    }
+    stats_.gl_calls += ApplyUniforms(item, state);
+
+    if (item.indexed && item.instance_count != 1) {
+      glDrawElementsInstancedBaseVertex(item.mode, item.count,
+          item.index_type, reinterpret_cast<const void*>(item.index_offset),
+          item.instance_count, item.base_vertex);
+    } else if (item.indexed) {
+      glDrawElementsBaseVertex(item.mode, item.count, item.index_type,
+          reinterpret_cast<const void*>(item.index_offset), item.base_vertex);
+    } else if (item.firsts != nullptr) {
+      glMultiDrawArrays(item.mode, item.firsts, item.counts, item.draw_count);
+    } else if (item.instance_count != 1) {
+      glDrawArraysInstanced(item.mode, item.first, item.count,
+          item.instance_count);
+    } else {
+      glDrawArrays(item.mode, item.first, item.count);
+    }
+    ++stats_.gl_calls;
+  }
+  glBindVertexArray(0);
+  ++stats_.gl_calls;
+  if (colormap_bound) {
+    glBindTexture(GL_TEXTURE_1D, 0);
+    ++stats_.gl_calls;
+  }
+
+  stats_.unsorted_gl_calls = items_.size() * (kUnsortedCallsPerItem + 1) +
+      num_programs * kUnsortedFrameUniformCalls;
+  items_.clear();
+}
+
+RenderQueue::ProgramState* RenderQueue::GetProgramState(GLSLShader *shader) {
+  ProgramState *state = nullptr;
+  for (ProgramState &candidate : programs_) {
+    if (candidate.shader == shader) {
+      state = &candidate;
+      break;
+    }
+  }
+  if (state == nullptr) {
+    programs_.push_back(ProgramState());
+    state = &programs_.back();
+    state->shader = shader;
+  } else if (state->program == shader->program()) {
+    return state;
+  }
+
+  state->program = shader->program();
+  state->color_mode_loc = shader->GetUniformLocation("color_mode");
+  state->model_matrix_loc = shader->GetUniformLocation("model_matrix");
+  state->position_offset_loc = shader->GetUniformLocation("position_offset");
+  state->position_scale_loc = shader->GetUniformLocation("position_scale");
+  state->scalar_range_loc = shader->GetUniformLocation("scalar_range");
+  state->line_width_loc = shader->GetUniformLocation("line_width");
+  state->pick_id_loc = shader->GetUniformLocation("pick_id");
+  state->has_values = false;
+  return state;
+}
+
+std::size_t RenderQueue::ApplyUniforms(const DrawItem &item,
+    ProgramState *state) {
+  std::size_t calls = 0;
+  const bool force = !state->has_values;
+  if (force || item.color_mode != state->color_mode) {
+    glUniform1i(state->color_mode_loc, item.color_mode);
+    state->color_mode = item.color_mode;
+    ++calls;
+  }
+  if (force || item.model_matrix != state->model_matrix) {
+    glUniformMatrix4fv(state->model_matrix_loc, 1, GL_FALSE,
+        item.model_matrix.data());
+    state->model_matrix = item.model_matrix;
+    ++calls;
+  }
+  if (force || item.position_offset != state->position_offset) {
+    glUniform3fv(state->position_offset_loc, 1, item.position_offset.data());
+    state->position_offset = item.position_offset;
+    ++calls;
+  }
+  if (force || item.position_scale != state->position_scale) {
+    glUniform3fv(state->position_scale_loc, 1, item.position_scale.data());
+    state->position_scale = item.position_scale;
+    ++calls;
+  }
+  if (force || item.scalar_range != state->scalar_range) {
+    glUniform2fv(state->scalar_range_loc, 1, item.scalar_range.data());
+    state->scalar_range = item.scalar_range;
+    ++calls;
+  }
+  if (force || item.line_width != state->line_width) {
+    glUniform1f(state->line_width_loc, item.line_width);
+    state->line_width = item.line_width;
+    ++calls;
+  }
+  if (force || item.pick_id != state->pick_id) {
+    glUniform1i(state->pick_id_loc, item.pick_id);
+    state->pick_id = item.pick_id;
+    ++calls;
+  }
+  state->has_values = true;
+  return calls;
+}
+
+}  // namespace ogl_viewer
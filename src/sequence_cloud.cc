@@ -0,0 +1,116 @@
+#include "sequence_cloud.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#include "tracer.h"
+
+namespace ogl_viewer {
+
+bool SequenceCloud::Open(const std::string &directory) {
+  if (!sequence_.Open(directory)) {
+    return false;
+  }
+  shown_frame_ = 0;
+  frame_shown_ = false;
+  requested_frame_ = 0;
+  frame_in_histogram_.assign(sequence_.num_frames(), false);
+  clock_frame_ = 0;
+  clock_time_ = std::chrono::steady_clock::now();
+  std::cout << "playing " << sequence_.num_frames() << " frames from "
+      << directory << " at " << frame_rate_ << " Hz\n";
+  return true;
+}
+
+void SequenceCloud::Enqueue(GLSLShader *shader, RenderQueue *queue) const {
+  if (buffer_.num_points() == 0) {
+    return;
+  }
+  DrawItem item;
+  item.shader = shader;
+  item.vao = buffer_.vao();
+  item.mode = GL_POINTS;
+  item.count = static_cast<GLsizei>(buffer_.num_points());
+  item.color_mode = 0;
+  item.model_matrix = model_matrix_;
+  item.pick_id = kPickSequence;
+  queue->Submit(item);
+}
+
+void SequenceCloud::Update() {
+  const std::size_t num_frames = sequence_.num_frames();
+  if (num_frames == 0) {
+    return;
+  }
+  TRACE_SCOPE("SequenceCloud::Update");
+  const auto now = std::chrono::steady_clock::now();
+  const std::size_t target = TargetFrame(now);
+  sequence_.Prefetch(target, direction_);
+  if (frame_shown_ && target == shown_frame_) {
+    return;
+  }
+
+  if (sequence_.GetFrame(target, &frame_xyz_)) {
+    buffer_.Upload(frame_xyz_.data(), frame_xyz_.size() / 3);
+    shown_frame_ = target;
+    frame_shown_ = true;
+    // every frame once, playing in a loop leaves the colormap as it is
+    if (!frame_in_histogram_[target]) {
+      height_histogram_.Add(frame_xyz_.data() + 2, 3,
+          frame_xyz_.size() / 3);
+      frame_in_histogram_[target] = true;
+    }
+  } else if (playing_) {
+    // hold the clock on the missing frame until it is decoded
+    if (clock_frame_ != target) {
+      ++late_frames_;
+    }
+    clock_frame_ = target;
+    clock_time_ = now;
+  }
+  requested_frame_ = target;
+}
+
+void SequenceCloud::SetPlaying(bool playing) {
+  if (playing && !playing_) {
+    direction_ = 1;
+    clock_frame_ = requested_frame_;
+    clock_time_ = std::chrono::steady_clock::now();
+  }
+  playing_ = playing;
+}
+
+void SequenceCloud::Step(int delta) {
+  const long long n = static_cast<long long>(sequence_.num_frames());
+  if (n == 0) {
+    return;
+  }
+  playing_ = false;
+  direction_ = delta < 0 ? -1 : 1;
+  long long index = (static_cast<long long>(requested_frame_) + delta) % n;
+  requested_frame_ = static_cast<std::size_t>(index < 0 ? index + n : index);
+}
+
+void SequenceCloud::Seek(std::size_t index) {
+  if (index >= sequence_.num_frames()) {
+    return;
+  }
+  playing_ = false;
+  direction_ = index < requested_frame_ ? -1 : 1;
+  requested_frame_ = index;
+}
+
+std::size_t SequenceCloud::TargetFrame(
+    std::chrono::steady_clock::time_point now) const {
+  if (!playing_) {
+    return requested_frame_;
+  }
+  const double elapsed = std::chrono::duration<double>(
+      now - clock_time_).count();
+  const std::size_t frames = static_cast<std::size_t>(
+      std::max(0.0, std::floor(elapsed * frame_rate_)));
+  return (clock_frame_ + frames) % sequence_.num_frames();
+}
+
+}  // namespace ogl_viewer
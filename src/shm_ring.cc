@@ -0,0 +1,250 @@
+#include "shm_ring.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace ogl_viewer {
+
+// the atomics are shared between processes, which needs them lock-free
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2,
+    "64-bit atomics have to be lock-free for the shared memory ring");
+
+namespace {
+
+const char kRingMagic[8] = {'O', 'V', 'S', 'H', 'R', 'I', 'N', 'G'};
+const uint32_t kRingVersion = 1;
+const std::size_t kRingAlignment = 64;
+
+std::size_t AlignUp(std::size_t offset) {
+  return (offset + kRingAlignment - 1) / kRingAlignment * kRingAlignment;
+}
+
+std::size_t HeaderBytes() {
+  return AlignUp(sizeof(ShmRingHeader));
+}
+
+}  // namespace
+
+int64_t ShmRingNowNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+ShmRingProducer::~ShmRingProducer() {
+  Close();
+}
+
+bool ShmRingProducer::Create(const std::string &name, std::size_t max_points,
+    int num_slots) {
+  Close();
+  if (max_points == 0 || num_slots < 2) {
+    std::cerr << "error : a shared memory ring needs 2 slots and points.\n";
+    return false;
+  }
+  // a new object rather than the old one, so that readers of a previous run
+  // see it replaced
+  shm_unlink(name.c_str());
+  const int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+  if (fd < 0) {
+    std::cerr << "error : failed to create shared memory " << name << "\n";
+    return false;
+  }
+  const std::size_t slot_stride = AlignUp(sizeof(ShmRingSlot) +
+      max_points * 3 * sizeof(float));
+  const std::size_t size = HeaderBytes() + num_slots * slot_stride;
+  void *data = MAP_FAILED;
+  if (ftruncate(fd, size) == 0) {
+    data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (data == MAP_FAILED) {
+    std::cerr << "error : failed to map shared memory " << name << "\n";
+    shm_unlink(name.c_str());
+    return false;
+  }
+
+  // the object is zero filled, which is also the initial state of the locks
+  name_ = name;
+  data_ = static_cast<char*>(data);
+  size_ = size;
+  max_points_ = max_points;
+  sequence_ = 0;
+  ShmRingHeader *header = reinterpret_cast<ShmRingHeader*>(data_);
+  header->version = kRingVersion;
+  header->num_slots = num_slots;
+  header->max_points = max_points;
+  header->slot_stride = slot_stride;
+  // readers check the magic last
+  std::atomic_thread_fence(std::memory_order_release);
+  std::memcpy(header->magic, kRingMagic, sizeof(kRingMagic));
+  return true;
+}
+
+void ShmRingProducer::Close() {
+  if (data_ == nullptr) {
+    return;
+  }
+  munmap(data_, size_);
+  shm_unlink(name_.c_str());
+  data_ = nullptr;
+  size_ = 0;
+}
+
+float* ShmRingProducer::AcquireFrame() {
+  if (data_ == nullptr) {
+    return nullptr;
+  }
+  const ShmRingHeader *header = reinterpret_cast<ShmRingHeader*>(data_);
+  const uint64_t sequence = sequence_ + 1;
+  char *slot_data = data_ + HeaderBytes() +
+      (sequence % header->num_slots) * header->slot_stride;
+  ShmRingSlot *slot = reinterpret_cast<ShmRingSlot*>(slot_data);
+  if (!writing_) {
+    slot->lock.store(2 * sequence - 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    writing_ = true;
+  }
+  return reinterpret_cast<float*>(slot_data + sizeof(ShmRingSlot));
+}
+
+void ShmRingProducer::PublishFrame(std::size_t num_points) {
+  if (data_ == nullptr || !writing_) {
+    return;
+  }
+  ShmRingHeader *header = reinterpret_cast<ShmRingHeader*>(data_);
+  const uint64_t sequence = sequence_ + 1;
+  ShmRingSlot *slot = reinterpret_cast<ShmRingSlot*>(data_ + HeaderBytes() +
+      (sequence % header->num_slots) * header->slot_stride);
+  slot->num_points = std::min(num_points, max_points_);
+  slot->publish_time_ns = ShmRingNowNs();
+  slot->lock.store(2 * sequence, std::memory_order_release);
+  header->published.store(sequence, std::memory_order_release);
+  sequence_ = sequence;
+  writing_ = false;
+}
+
+void ShmRingProducer::Publish(const float *xyz, std::size_t num_points) {
+  float *frame = AcquireFrame();
+  if (frame == nullptr) {
+    return;
+  }
+  num_points = std::min(num_points, max_points_);
+  std::memcpy(frame, xyz, num_points * 3 * sizeof(float));
+  PublishFrame(num_points);
+}
+
+ShmRingConsumer::~ShmRingConsumer() {
+  Close();
+}
+
+bool ShmRingConsumer::Open(const std::string &name) {
+  Close();
+  const int fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  void *data = MAP_FAILED;
+  if (fstat(fd, &st) == 0 &&
+      static_cast<std::size_t>(st.st_size) >= HeaderBytes()) {
+    data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (data == MAP_FAILED) {
+    return false;
+  }
+  data_ = static_cast<char*>(data);
+  size_ = st.st_size;
+  inode_ = st.st_ino;
+
+  // a producer still initializing the header is picked up on a later try
+  const ShmRingHeader *header = reinterpret_cast<ShmRingHeader*>(data_);
+  const bool magic_ok =
+      std::memcmp(header->magic, kRingMagic, sizeof(kRingMagic)) == 0;
+  std::atomic_thread_fence(std::memory_order_acquire);
+  // checked with divisions, the header fields come from another process and
+  // their products may overflow
+  const uint64_t stride = header->slot_stride;
+  const bool layout_ok = stride >= sizeof(ShmRingSlot) &&
+      stride % alignof(ShmRingSlot) == 0 &&
+      header->max_points <= (stride - sizeof(ShmRingSlot)) /
+          (3 * sizeof(float)) &&
+      header->num_slots != 0 &&
+      header->num_slots <= (size_ - HeaderBytes()) / stride;
+  if (!magic_ok || header->version != kRingVersion || !layout_ok) {
+    Close();
+    return false;
+  }
+  name_ = name;
+  last_sequence_ = 0;
+  return true;
+}
+
+void ShmRingConsumer::Close() {
+  if (data_ == nullptr) {
+    return;
+  }
+  munmap(data_, size_);
+  data_ = nullptr;
+  size_ = 0;
+}
+
+bool ShmRingConsumer::AcquireLatest(Frame *frame) {
+  if (data_ == nullptr) {
+    return false;
+  }
+  const ShmRingHeader *header = reinterpret_cast<ShmRingHeader*>(data_);
+  const uint64_t sequence = header->published.load(std::memory_order_acquire);
+  if (sequence == 0 || sequence == last_sequence_) {
+    return false;
+  }
+  const ShmRingSlot *slot = SlotOf(sequence);
+  // already being overwritten, a newer frame is on its way
+  if (slot->lock.load(std::memory_order_acquire) != 2 * sequence) {
+    return false;
+  }
+  frame->sequence = sequence;
+  frame->num_points = std::min<uint64_t>(slot->num_points,
+      header->max_points);
+  frame->publish_time_ns = slot->publish_time_ns;
+  frame->xyz = reinterpret_cast<const float*>(
+      reinterpret_cast<const char*>(slot) + sizeof(ShmRingSlot));
+  if (last_sequence_ != 0 && sequence > last_sequence_ + 1) {
+    skipped_frames_ += sequence - last_sequence_ - 1;
+  }
+  last_sequence_ = sequence;
+  return true;
+}
+
+bool ShmRingConsumer::Validate(const Frame &frame) const {
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return SlotOf(frame.sequence)->lock.load(std::memory_order_relaxed) ==
+      2 * frame.sequence;
+}
+
+bool ShmRingConsumer::Stale() const {
+  const int fd = shm_open(name_.c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    return true;
+  }
+  struct stat st;
+  const bool replaced = fstat(fd, &st) != 0 || st.st_ino != inode_;
+  close(fd);
+  return replaced;
+}
+
+const ShmRingSlot* ShmRingConsumer::SlotOf(uint64_t sequence) const {
+  const ShmRingHeader *header = reinterpret_cast<ShmRingHeader*>(data_);
+  return reinterpret_cast<const ShmRingSlot*>(data_ + HeaderBytes() +
+      (sequence % header->num_slots) * header->slot_stride);
+}
+
+}  // namespace ogl_viewer
@@ -0,0 +1,50 @@
+#include "stream_buffer.h"
+
+#include <utility>
+
+#include "glsl_shader.h"
+#include "tracer.h"
+
+namespace ogl_viewer {
+
+StreamBuffer::StreamBuffer() {
+  glGenVertexArrays(2, vaos_);
+  glGenBuffers(2, vbos_);
+  for (int i = 0; i < 2; ++i) {
+    glBindVertexArray(vaos_[i]);
+    glBindBuffer(GL_ARRAY_BUFFER, vbos_[i]);
+    glEnableVertexAttribArray(kPositionAttrib);
+    glVertexAttribPointer(kPositionAttrib, 3, GL_FLOAT, GL_FALSE, 0, 0);
+  }
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+StreamBuffer::~StreamBuffer() {
+  glDeleteBuffers(2, vbos_);
+  glDeleteVertexArrays(2, vaos_);
+}
+
+void StreamBuffer::Upload(const float *xyz, std::size_t num_points) {
+  TRACE_SCOPE("StreamBuffer::Upload");
+  // the front buffer may still be read by the last frame's draw
+  const int back = 1 - front_;
+  glBindBuffer(GL_ARRAY_BUFFER, vbos_[back]);
+  const GLsizeiptr size = num_points * 3 * sizeof(float);
+  // orphaning hands the old storage to the driver instead of waiting on it
+  glBufferData(GL_ARRAY_BUFFER, size, nullptr, GL_STREAM_DRAW);
+  if (size > 0) {
+    glBufferSubData(GL_ARRAY_BUFFER, 0, size, xyz);
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  front_ = back;
+  back_num_points_ = num_points_;
+  num_points_ = num_points;
+}
+
+void StreamBuffer::Revert() {
+  front_ = 1 - front_;
+  std::swap(num_points_, back_num_points_);
+}
+
+}  // namespace ogl_viewer
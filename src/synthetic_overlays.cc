@@ -0,0 +1,149 @@
+#include "synthetic_overlays.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+#include "tracer.h"
+
+namespace ogl_viewer {
+
+namespace {
+
+// vehicles: length relative to the scene radius, and speed in scene radii
+// per second
+const float kVehicleScale = 0.02f;
+const float kVehicleSpeed = 0.05f;
+// golden angle, spreads the vehicles evenly over the disk
+const float kGoldenAngle = 2.39996323f;
+// lanes: segments per lane and their length relative to the scene radius,
+// and segments appended per frame, which ends most frames within a lane
+const std::size_t kLaneSegments = 1024;
+const float kLaneStep = 0.002f;
+const std::size_t kLaneSegmentsPerFrame = 50000;
+// of the boxes and lanes, in turn
+const Eigen::Vector4f kSyntheticColors[] = {
+    Eigen::Vector4f(1.f, 0.6f, 0.1f, 1.f),
+    Eigen::Vector4f(0.2f, 0.9f, 0.3f, 1.f),
+    Eigen::Vector4f(0.3f, 0.6f, 1.f, 1.f)};
+
+// center on the ground and radius of bounds, or of the unit disk while they
+// are empty
+void Ground(const Eigen::AlignedBox3f &bounds, Eigen::Vector3f *center,
+    float *radius) {
+  *center = Eigen::Vector3f::Zero();
+  *radius = 1.f;
+  if (!bounds.isEmpty()) {
+    *center = bounds.center();
+    center->z() = bounds.min().z();
+    *radius = std::max(0.5f * bounds.diagonal().head<2>().norm(), 1e-3f);
+  }
+}
+
+}  // namespace
+
+void SyntheticOverlays::UpdateVehicles(double time,
+    const Eigen::AlignedBox3f &bounds, GizmoBatch *poses,
+    GizmoBatch *boxes) const {
+  if (num_vehicles_ == 0) {
+    return;
+  }
+  TRACE_SCOPE("SyntheticOverlays::UpdateVehicles");
+  // vehicles circle the scene center on the ground, at constant speed
+  Eigen::Vector3f center;
+  float radius = 1.f;
+  Ground(bounds, &center, &radius);
+  const float length = radius * kVehicleScale;
+  const Eigen::Vector3f box_size(length, 0.45f * length, 0.35f * length);
+
+  poses->Clear();
+  boxes->Clear();
+  const std::size_t n = num_vehicles_;
+  for (std::size_t i = 0; i < n; ++i) {
+    const float ring = std::sqrt((i + 0.5f) / n);
+    // angular speed of the constant linear speed on this ring
+    const double turns = time * kVehicleSpeed / ring;
+    const float angle = static_cast<float>(
+        std::fmod(i * kGoldenAngle + turns, 2.0 * M_PI));
+    const Eigen::Vector3f position = center + ring * radius *
+        Eigen::Vector3f(std::cos(angle), std::sin(angle), 0.f);
+    const Eigen::AngleAxisf heading(angle + 0.5f * static_cast<float>(M_PI),
+        Eigen::Vector3f::UnitZ());
+
+    Eigen::Affine3f pose = Eigen::Affine3f::Identity();
+    pose.translate(position);
+    pose.rotate(heading);
+    Eigen::Affine3f box = pose;
+    box.translate(Eigen::Vector3f(0.f, 0.f, 0.5f * box_size.z()));
+    box.scale(box_size);
+    pose.scale(length);
+    poses->Add(pose, Eigen::Vector4f::Ones());
+    boxes->Add(box, kSyntheticColors[i % 3]);
+  }
+  poses->Upload();
+  boxes->Upload();
+}
+
+void SyntheticOverlays::AppendLanes(const Eigen::AlignedBox3f &bounds,
+    PolylineBatch *polylines) {
+  if (lane_segments_ >= num_lane_segments_) {
+    return;
+  }
+  TRACE_SCOPE("SyntheticOverlays::AppendLanes");
+  Eigen::Vector3f center;
+  float radius = 1.f;
+  Ground(bounds, &center, &radius);
+  std::size_t budget = std::min(kLaneSegmentsPerFrame,
+      num_lane_segments_ - lane_segments_);
+  Polyline lane;
+  while (budget > 0) {
+    const bool start = lane_length_ == 0 || lane_length_ == kLaneSegments;
+    if (start) {
+      // smooth random walks that turn back at the edge of the scene, the
+      // same for every run
+      if (lane_length_ == kLaneSegments) {
+        ++lane_index_;
+      }
+      lane_random_.seed(static_cast<uint32_t>(lane_index_));
+      std::uniform_real_distribution<float> uniform(-1.f, 1.f);
+      lane_position_.x() = uniform(lane_random_);
+      lane_position_.y() = uniform(lane_random_);
+      lane_position_ *= radius * 0.7f;
+      lane_heading_ = uniform(lane_random_) * static_cast<float>(M_PI);
+      lane_length_ = 0;
+    }
+    const std::size_t num_segments = std::min(budget,
+        kLaneSegments - lane_length_);
+    // a new lane needs its first point as well
+    WalkLane(center, radius, num_segments + (start ? 1 : 0), &lane);
+    if (start) {
+      polylines->AddPolyline(lane, kSyntheticColors[lane_index_ % 3]);
+    } else {
+      polylines->ExtendPolyline(lane);
+    }
+    lane_length_ += num_segments;
+    lane_segments_ += num_segments;
+    budget -= num_segments;
+  }
+}
+
+void SyntheticOverlays::WalkLane(const Eigen::Vector3f &center,
+    float radius, std::size_t num_points, Polyline *lane) {
+  const float step = radius * kLaneStep;
+  std::uniform_real_distribution<float> uniform(-1.f, 1.f);
+  lane->resize(num_points);
+  for (Eigen::Vector3f &point : *lane) {
+    point = center + Eigen::Vector3f(lane_position_.x(), lane_position_.y(),
+        0.f);
+    lane_heading_ += 0.05f * uniform(lane_random_);
+    const Eigen::Vector2f next = lane_position_ + step *
+        Eigen::Vector2f(std::cos(lane_heading_), std::sin(lane_heading_));
+    if (next.norm() > radius) {
+      lane_heading_ += static_cast<float>(M_PI);
+    } else {
+      lane_position_ = next;
+    }
+  }
+}
+
+}  // namespace ogl_viewer
@@ -0,0 +1,88 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <memory>
+
+namespace ogl_viewer {
+
+ThreadPool::ThreadPool(int num_threads) {
+  if (num_threads <= 0) {
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  for (int i = 0; i < num_threads; ++i) {
+    workers_.emplace_back(&ThreadPool::WorkerLoop, this);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cond_.notify_all();
+  for (auto &worker : workers_) {
+    worker.join();
+  }
+}
+
+ThreadPool& ThreadPool::Global() {
+  static ThreadPool pool;
+  return pool;
+}
+
+std::future<void> ThreadPool::Submit(std::function<void()> task) {
+  auto packaged = std::make_shared<std::packaged_task<void()>>(
+      std::move(task));
+  std::future<void> future = packaged->get_future();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    tasks_.push([packaged]() { (*packaged)(); });
+  }
+  cond_.notify_one();
+  return future;
+}
+
+void ThreadPool::ParallelFor(std::size_t begin, std::size_t end,
+    std::size_t min_grain,
+    const std::function<void(std::size_t, std::size_t)> &body) {
+  if (end <= begin) {
+    return;
+  }
+  const std::size_t total = end - begin;
+  // a few ranges per thread to even out unbalanced work
+  const std::size_t max_ranges = 4 * (workers_.size() + 1);
+  const std::size_t grain = std::max(std::max<std::size_t>(min_grain, 1),
+      (total + max_ranges - 1) / max_ranges);
+  if (total <= grain) {
+    body(begin, end);
+    return;
+  }
+
+  std::vector<std::future<void>> futures;
+  for (std::size_t first = begin + grain; first < end; first += grain) {
+    const std::size_t last = std::min(end, first + grain);
+    futures.push_back(Submit([&body, first, last]() { body(first, last); }));
+  }
+  body(begin, begin + grain);
+  for (auto &future : futures) {
+    future.get();
+  }
+}
+
+void ThreadPool::WorkerLoop() {
+  while (true) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cond_.wait(lock, [this]() { return stop_ || !tasks_.empty(); });
+      if (stop_ && tasks_.empty()) {
+        return;
+      }
+      task = std::move(tasks_.front());
+      tasks_.pop();
+    }
+    task();
+  }
+}
+
+}  // namespace ogl_viewer
@@ -0,0 +1,84 @@
+#include "tracer.h"
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+
+namespace ogl_viewer {
+
+std::atomic<bool> Tracer::enabled_{false};
+
+Tracer& Tracer::Global() {
+  static Tracer tracer;
+  return tracer;
+}
+
+int64_t Tracer::NowMicros() {
+  static const std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - start).count();
+}
+
+int Tracer::CurrentThreadId() {
+  static std::atomic<int> next_id{1};
+  thread_local int id = next_id++;
+  return id;
+}
+
+void Tracer::SetThreadName(const char *name) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  thread_names_.emplace_back(CurrentThreadId(), name);
+}
+
+void Tracer::AddEvent(const char *name, int thread_id, int64_t begin_us,
+    int64_t duration_us) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (events_.size() >= kMaxEvents) {
+    ++num_dropped_events_;
+    return;
+  }
+  Event event;
+  event.name = name;
+  event.thread_id = thread_id;
+  event.begin_us = begin_us;
+  event.duration_us = duration_us;
+  events_.push_back(event);
+}
+
+bool Tracer::WriteChromeTrace(const std::string &filepath) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::ofstream ofs(filepath.c_str());
+  if (!ofs) {
+    std::cerr << "error : failed to open " << filepath << "\n";
+    return false;
+  }
+
+  ofs << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+  ofs << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": "
+      << kGpuThreadId << ", \"args\": {\"name\": \"GPU\"}}";
+  for (const auto &thread_name : thread_names_) {
+    ofs << ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, "
+        << "\"tid\": " << thread_name.first << ", \"args\": {\"name\": \""
+        << thread_name.second << "\"}}";
+  }
+  for (const Event &event : events_) {
+    ofs << ",\n{\"name\": \"" << event.name << "\", \"ph\": \"X\", "
+        << "\"pid\": 1, \"tid\": " << event.thread_id << ", \"ts\": "
+        << event.begin_us << ", \"dur\": " << event.duration_us << "}";
+  }
+  ofs << "\n]}\n";
+  if (!ofs) {
+    std::cerr << "error : failed to write " << filepath << "\n";
+    return false;
+  }
+
+  std::cout << "wrote " << events_.size() << " trace events to " << filepath;
+  if (num_dropped_events_ > 0) {
+    std::cout << " (" << num_dropped_events_ << " dropped)";
+  }
+  std::cout << "\n";
+  return true;
+}
+
+}  // namespace ogl_viewer
@@ -0,0 +1,214 @@
+#include "triangle_mesh.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <iostream>
+#include <numeric>
+
+#include "thread_pool.h"
+#include "tracer.h"
+
+namespace ogl_viewer {
+
+namespace {
+
+// vertices per parallel task when packing the vertex buffer
+const std::size_t kPackGrain = 1 << 15;
+
+// position followed by the normal as GL_INT_2_10_10_10_REV
+struct MeshVertex {
+  float position[3];
+  uint32_t normal;
+};
+
+uint32_t PackNormal(const float *normal) {
+  uint32_t packed = 0;
+  for (int k = 0; k < 3; ++k) {
+    const float value = std::max(-1.f, std::min(1.f, normal[k]));
+    const int32_t q = static_cast<int32_t>(std::lround(value * 511.f));
+    packed |= (static_cast<uint32_t>(q) & 0x3ff) << (10 * k);
+  }
+  return packed;
+}
+
+// gather the attributes of the listed vertices
+void GatherVertices(const std::vector<uint32_t> &sources, int components,
+    std::vector<float> *values) {
+  std::vector<float> gathered(sources.size() * components);
+  ThreadPool::Global().ParallelFor(0, sources.size(), kPackGrain,
+      [&](std::size_t b, std::size_t e) {
+        for (std::size_t i = b; i < e; ++i) {
+          std::copy(values->begin() + sources[i] * components,
+              values->begin() + (sources[i] + 1) * components,
+              gathered.begin() + i * components);
+        }
+      });
+  values->swap(gathered);
+}
+
+}  // namespace
+
+TriangleMesh::~TriangleMesh() {
+  glDeleteVertexArrays(1, &vao_);
+  glDeleteBuffers(1, &vbo_);
+  glDeleteBuffers(1, &ebo_);
+}
+
+void TriangleMesh::Enqueue(GLSLShader *shader, RenderQueue *queue) const {
+  const std::size_t index_size =
+      index_type_ == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+  for (const MeshBatch &batch : batches_) {
+    DrawItem item;
+    item.shader = shader;
+    item.vao = vao_;
+    item.mode = GL_TRIANGLES;
+    item.indexed = true;
+    item.index_type = index_type_;
+    item.count = static_cast<GLsizei>(batch.num_indices);
+    item.index_offset = batch.first_index * index_size;
+    item.base_vertex = static_cast<GLint>(batch.first_vertex);
+    item.color_mode = 5;
+    item.model_matrix = model_matrix_;
+    item.pick_id = kPickMesh;
+    queue->Submit(item);
+  }
+}
+
+bool TriangleMesh::LoadDataFromFile(const std::string &filepath) {
+  TRACE_SCOPE("TriangleMesh::LoadDataFromFile");
+  const auto start_time = std::chrono::steady_clock::now();
+  stats_ = MeshStats();
+  MeshData mesh;
+  if (!LoadMesh(filepath, &mesh)) {
+    return false;
+  }
+  const auto optimize_time = std::chrono::steady_clock::now();
+  stats_.load_ms = std::chrono::duration<double, std::milli>(
+      optimize_time - start_time).count();
+  stats_.file_cache = AnalyzeVertexCache(mesh.indices, mesh.num_vertices());
+
+  source_vertices_.resize(mesh.num_vertices());
+  std::iota(source_vertices_.begin(), source_vertices_.end(), 0);
+  if (optimize_) {
+    OptimizeVertexCache(&mesh.indices, mesh.num_vertices());
+    std::vector<uint32_t> remap;
+    const std::size_t num_used = OptimizeVertexFetch(&mesh.indices,
+        mesh.num_vertices(), &remap);
+    RemapVertices(remap, num_used, 3, &mesh.positions);
+    RemapVertices(remap, num_used, 3, &mesh.normals);
+    source_vertices_.resize(num_used);
+    for (std::size_t v = 0; v < remap.size(); ++v) {
+      if (remap[v] < num_used) {
+        source_vertices_[remap[v]] = static_cast<uint32_t>(v);
+      }
+    }
+  }
+  stats_.drawn_cache = AnalyzeVertexCache(mesh.indices, mesh.num_vertices());
+
+  std::vector<uint16_t> short_indices;
+  batches_.clear();
+  if (short_indices_) {
+    std::vector<uint32_t> vertex_sources;
+    SplitShortIndices(mesh.indices, mesh.num_vertices(), &short_indices,
+        &vertex_sources, &batches_);
+    stats_.duplicated_vertices =
+        vertex_sources.size() - mesh.num_vertices();
+    GatherVertices(vertex_sources, 3, &mesh.positions);
+    GatherVertices(vertex_sources, 3, &mesh.normals);
+    for (uint32_t &source : vertex_sources) {
+      source = source_vertices_[source];
+    }
+    source_vertices_.swap(vertex_sources);
+    std::vector<uint32_t>().swap(mesh.indices);
+  } else {
+    MeshBatch batch;
+    batch.num_indices = mesh.indices.size();
+    batch.num_vertices = mesh.num_vertices();
+    batches_.push_back(batch);
+  }
+  stats_.optimize_ms = std::chrono::duration<double, std::milli>(
+      std::chrono::steady_clock::now() - optimize_time).count();
+
+  bounds_.setEmpty();
+  for (std::size_t i = 0; i < mesh.num_vertices(); ++i) {
+    bounds_.extend(Eigen::Map<const Eigen::Vector3f>(&mesh.positions[i * 3]));
+  }
+  height_histogram_.Clear();
+  height_histogram_.Add(mesh.positions.data() + 2, 3, mesh.num_vertices());
+  stats_.num_vertices = mesh.num_vertices();
+  stats_.num_triangles = short_indices_ ?
+      short_indices.size() / 3 : mesh.num_triangles();
+  stats_.num_batches = batches_.size();
+  if (short_indices_) {
+    index_type_ = GL_UNSIGNED_SHORT;
+    Upload(mesh, short_indices.data(),
+        short_indices.size() * sizeof(uint16_t));
+  } else {
+    index_type_ = GL_UNSIGNED_INT;
+    Upload(mesh, mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t));
+  }
+
+  std::cout << "loaded " << stats_.num_triangles << " triangles, "
+      << stats_.num_vertices << " vertices from " << filepath << ": "
+      << stats_.load_ms << " ms, vertex buffer "
+      << stats_.num_vertices * sizeof(MeshVertex) / (1024.0 * 1024.0)
+      << " MB\n"
+      << "vertex cache of " << kVertexCacheSize << ": ACMR "
+      << stats_.file_cache.acmr << " -> " << stats_.drawn_cache.acmr
+      << ", ATVR " << stats_.file_cache.atvr << " -> "
+      << stats_.drawn_cache.atvr << " (" << stats_.optimize_ms << " ms)\n";
+  if (short_indices_) {
+    std::cout << "16-bit indices: " << stats_.num_batches << " batches, "
+        << stats_.duplicated_vertices << " vertices duplicated\n";
+  }
+  return true;
+}
+
+bool TriangleMesh::LookupVertex(int vertex, std::size_t *file_vertex) const {
+  if (vertex < 0 || static_cast<std::size_t>(vertex) >=
+      source_vertices_.size()) {
+    return false;
+  }
+  *file_vertex = source_vertices_[vertex];
+  return true;
+}
+
+void TriangleMesh::Upload(const MeshData &mesh, const void *indices,
+    std::size_t index_bytes) {
+  TRACE_SCOPE("TriangleMesh::Upload");
+  const std::size_t num_vertices = mesh.num_vertices();
+  std::vector<MeshVertex> vertices(num_vertices);
+  ThreadPool::Global().ParallelFor(0, num_vertices, kPackGrain,
+      [&](std::size_t b, std::size_t e) {
+        for (std::size_t i = b; i < e; ++i) {
+          std::copy(&mesh.positions[i * 3], &mesh.positions[i * 3] + 3,
+              vertices[i].position);
+          vertices[i].normal = PackNormal(&mesh.normals[i * 3]);
+        }
+      });
+
+  if (vao_ == 0) {
+    glGenVertexArrays(1, &vao_);
+    glGenBuffers(1, &vbo_);
+    glGenBuffers(1, &ebo_);
+  }
+  glBindVertexArray(vao_);
+  glBindBuffer(GL_ARRAY_BUFFER, vbo_);
+  glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(MeshVertex),
+      vertices.data(), GL_STATIC_DRAW);
+  glEnableVertexAttribArray(kPositionAttrib);
+  glVertexAttribPointer(kPositionAttrib, 3, GL_FLOAT, GL_FALSE,
+      sizeof(MeshVertex), 0);
+  glEnableVertexAttribArray(kNormalAttrib);
+  glVertexAttribPointer(kNormalAttrib, 4, GL_INT_2_10_10_10_REV, GL_TRUE,
+      sizeof(MeshVertex),
+      reinterpret_cast<const void*>(offsetof(MeshVertex, normal)));
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo_);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, index_bytes, indices, GL_STATIC_DRAW);
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+}  // namespace ogl_viewer
@@ -0,0 +1,68 @@
+#include "upload_ring.h"
+
+#include <cstring>
+#include <iostream>
+
+namespace ogl_viewer {
+
+UploadRing::UploadRing(GLsizeiptr slot_size, int num_slots)
+    : slot_size_(slot_size), slots_(num_slots) {
+  for (auto &slot : slots_) {
+    glGenBuffers(1, &slot.buffer);
+    glBindBuffer(GL_COPY_READ_BUFFER, slot.buffer);
+    glBufferData(GL_COPY_READ_BUFFER, slot_size_, nullptr, GL_STREAM_DRAW);
+  }
+  glBindBuffer(GL_COPY_READ_BUFFER, 0);
+}
+
+UploadRing::~UploadRing() {
+  for (auto &slot : slots_) {
+    if (slot.fence) {
+      glDeleteSync(slot.fence);
+    }
+    glDeleteBuffers(1, &slot.buffer);
+  }
+}
+
+bool UploadRing::Upload(GLuint dst_buffer, GLintptr dst_offset,
+    const void *data, GLsizeiptr size) {
+  if (size > slot_size_) {
+    std::cerr << "error : upload of " << size << " bytes exceeds the "
+        << slot_size_ << " bytes staging slot.\n";
+    return false;
+  }
+
+  Slot &slot = slots_[next_slot_];
+  if (slot.fence) {
+    // poll only, never block the render thread
+    const GLenum status = glClientWaitSync(slot.fence, 0, 0);
+    if (status == GL_TIMEOUT_EXPIRED) {
+      return false;
+    }
+    glDeleteSync(slot.fence);
+    slot.fence = nullptr;
+  }
+
+  glBindBuffer(GL_COPY_READ_BUFFER, slot.buffer);
+  void *ptr = glMapBufferRange(GL_COPY_READ_BUFFER, 0, size,
+      GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT |
+      GL_MAP_UNSYNCHRONIZED_BIT);
+  if (ptr == nullptr) {
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    return false;
+  }
+  std::memcpy(ptr, data, size);
+  glUnmapBuffer(GL_COPY_READ_BUFFER);
+
+  glBindBuffer(GL_COPY_WRITE_BUFFER, dst_buffer);
+  glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0,
+      dst_offset, size);
+  slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  glBindBuffer(GL_COPY_READ_BUFFER, 0);
+  next_slot_ = (next_slot_ + 1) % slots_.size();
+  return true;
+}
+
+}  // namespace ogl_viewer
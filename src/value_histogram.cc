@@ -0,0 +1,235 @@
+#include "value_histogram.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <mutex>
+
+#include "thread_pool.h"
+
+namespace ogl_viewer {
+
+namespace {
+
+// values per parallel range, below that a batch is handled in place
+const std::size_t kMinGrain = 1 << 18;
+
+// smallest and largest finite value of count values stride floats apart
+void FiniteMinMax(const float *values, std::size_t stride, std::size_t count,
+    float *min_value, float *max_value) {
+  float low = std::numeric_limits<float>::max();
+  float high = std::numeric_limits<float>::lowest();
+  std::size_t i = 0;
+
+#if defined(__SSE2__)
+  if (stride == 1 || stride == 3) {
+    // four values per block of stride vectors, i.e. the z of four points
+    // for stride 3; a lane per float of the block keeps its own extremes
+    const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    const __m128 infinity =
+        _mm_set1_ps(std::numeric_limits<float>::infinity());
+    const __m128 none_low = _mm_set1_ps(low);
+    const __m128 none_high = _mm_set1_ps(high);
+    __m128 low4[3] = {none_low, none_low, none_low};
+    __m128 high4[3] = {none_high, none_high, none_high};
+    // a block of stride 3 reads two floats past its last value
+    const std::size_t end = stride == 1 ? count : (count > 0 ? count - 1 : 0);
+    for (; i + 4 <= end; i += 4) {
+      const float *block = values + i * stride;
+      for (std::size_t j = 0; j < stride; ++j) {
+        const __m128 v = _mm_loadu_ps(block + j * 4);
+        // false for NaN and infinities, which are replaced by neutral values
+        const __m128 finite = _mm_cmplt_ps(_mm_and_ps(v, abs_mask), infinity);
+        low4[j] = _mm_min_ps(low4[j], _mm_or_ps(_mm_and_ps(finite, v),
+            _mm_andnot_ps(finite, none_low)));
+        high4[j] = _mm_max_ps(high4[j], _mm_or_ps(_mm_and_ps(finite, v),
+            _mm_andnot_ps(finite, none_high)));
+      }
+    }
+    float lows[12];
+    float highs[12];
+    for (std::size_t j = 0; j < stride; ++j) {
+      _mm_storeu_ps(lows + j * 4, low4[j]);
+      _mm_storeu_ps(highs + j * 4, high4[j]);
+    }
+    // the values are every stride-th float of the block
+    for (std::size_t k = 0; k < 4 * stride; k += stride) {
+      low = std::min(low, lows[k]);
+      high = std::max(high, highs[k]);
+    }
+  }
+#endif
+
+  for (; i < count; ++i) {
+    const float value = values[i * stride];
+    if (std::isfinite(value)) {
+      low = std::min(low, value);
+      high = std::max(high, value);
+    }
+  }
+  *min_value = low;
+  *max_value = high;
+}
+
+}  // namespace
+
+void ValueHistogram::Add(const float *values, std::size_t stride,
+    std::size_t count) {
+  if (count == 0) {
+    return;
+  }
+  std::mutex mutex;
+  float batch_min = std::numeric_limits<float>::max();
+  float batch_max = std::numeric_limits<float>::lowest();
+  ThreadPool::Global().ParallelFor(0, count, kMinGrain,
+      [&](std::size_t begin, std::size_t end) {
+        float low = 0.f;
+        float high = 0.f;
+        FiniteMinMax(values + begin * stride, stride, end - begin, &low,
+            &high);
+        std::lock_guard<std::mutex> lock(mutex);
+        batch_min = std::min(batch_min, low);
+        batch_max = std::max(batch_max, high);
+      });
+  if (batch_min > batch_max) {
+    // nothing finite
+    return;
+  }
+  Fit(batch_min, batch_max);
+  min_ = count_ == 0 ? batch_min : std::min(min_, batch_min);
+  max_ = count_ == 0 ? batch_max : std::max(max_, batch_max);
+
+  // every range counts into its own bins, which are summed up at the end
+  const float low = low_;
+  const float inv_bin_width = 1.f / bin_width_;
+  ThreadPool::Global().ParallelFor(0, count, kMinGrain,
+      [&](std::size_t begin, std::size_t end) {
+        std::vector<uint64_t> bins(kNumBins, 0);
+        std::size_t num_values = 0;
+        for (std::size_t i = begin; i < end; ++i) {
+          const float value = values[i * stride];
+          if (!std::isfinite(value)) {
+            continue;
+          }
+          const int bin = static_cast<int>((value - low) * inv_bin_width);
+          ++bins[std::min(std::max(bin, 0), kNumBins - 1)];
+          ++num_values;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        for (int b = 0; b < kNumBins; ++b) {
+          bins_[b] += bins[b];
+        }
+        count_ += num_values;
+      });
+}
+
+void ValueHistogram::Merge(const ValueHistogram &other) {
+  if (other.count_ == 0) {
+    return;
+  }
+  if (count_ == 0) {
+    *this = other;
+    return;
+  }
+  Fit(other.min_, other.max_);
+  for (int b = 0; b < kNumBins; ++b) {
+    if (other.bins_[b] == 0) {
+      continue;
+    }
+    const float center = other.low_ + (b + 0.5f) * other.bin_width_;
+    bins_[Bin(std::min(std::max(center, other.min_), other.max_))] +=
+        other.bins_[b];
+  }
+  min_ = std::min(min_, other.min_);
+  max_ = std::max(max_, other.max_);
+  count_ += other.count_;
+}
+
+void ValueHistogram::Clear() {
+  bins_.clear();
+  low_ = 0.f;
+  bin_width_ = 0.f;
+  min_ = 0.f;
+  max_ = 0.f;
+  count_ = 0;
+}
+
+float ValueHistogram::Percentile(float fraction) const {
+  if (count_ == 0) {
+    return 0.f;
+  }
+  const double target =
+      std::min(std::max(fraction, 0.f), 1.f) * static_cast<double>(count_);
+  double cumulative = 0.0;
+  for (int b = 0; b < kNumBins; ++b) {
+    const double next = cumulative + bins_[b];
+    if (bins_[b] > 0 && next >= target) {
+      const double t = (target - cumulative) / bins_[b];
+      const float value = static_cast<float>(low_ + (b + t) * bin_width_);
+      return std::min(std::max(value, min_), max_);
+    }
+    cumulative = next;
+  }
+  return max_;
+}
+
+void ValueHistogram::Ranks(float low, float high, int num_values,
+    float *ranks) const {
+  double cumulative = 0.0;
+  int bin = 0;
+  for (int k = 0; k < num_values; ++k) {
+    if (count_ == 0) {
+      ranks[k] = 0.f;
+      continue;
+    }
+    const float value = num_values > 1 ?
+        low + (high - low) * k / (num_values - 1) : low;
+    const float position = std::min(std::max(
+        (value - low_) / bin_width_, 0.f), static_cast<float>(kNumBins));
+    // values grow with k, so the bins below are summed up only once
+    const int value_bin = std::min(static_cast<int>(position), kNumBins - 1);
+    for (; bin < value_bin; ++bin) {
+      cumulative += bins_[bin];
+    }
+    const double rank = (cumulative + bins_[bin] *
+        std::min(position - bin, 1.f)) / count_;
+    ranks[k] = static_cast<float>(std::min(std::max(rank, 0.0), 1.0));
+  }
+}
+
+void ValueHistogram::Fit(float min_value, float max_value) {
+  if (count_ == 0) {
+    bins_.assign(kNumBins, 0);
+    low_ = min_value;
+    const float width = max_value - min_value;
+    // a little wider than the values, so that the largest is inside
+    bin_width_ = (width > 0.f ? width * 1.0001f :
+        std::max(std::abs(min_value) * 1e-4f, 1e-6f)) / kNumBins;
+    return;
+  }
+  while (min_value < low_ || max_value >= low_ + kNumBins * bin_width_) {
+    // twice the range, pairs of bins go to the half on the old range's side
+    const bool grow_down = min_value < low_;
+    std::vector<uint64_t> merged(kNumBins, 0);
+    const int first = grow_down ? kNumBins / 2 : 0;
+    for (int b = 0; b < kNumBins / 2; ++b) {
+      merged[first + b] = bins_[b * 2] + bins_[b * 2 + 1];
+    }
+    if (grow_down) {
+      low_ -= kNumBins * bin_width_;
+    }
+    bin_width_ *= 2.f;
+    bins_.swap(merged);
+  }
+}
+
+int ValueHistogram::Bin(float value) const {
+  const int bin = static_cast<int>((value - low_) / bin_width_);
+  return std::min(std::max(bin, 0), kNumBins - 1);
+}
+
+}  // namespace ogl_viewer
@@ -0,0 +1,253 @@
+#include "voxel_filter.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <mutex>
+
+#include "radix_sort.h"
+#include "thread_pool.h"
+#include "tracer.h"
+
+namespace ogl_viewer {
+
+namespace {
+
+// points per parallel task when computing keys and centroids
+const std::size_t kFilterGrain = 1 << 15;
+// cell index bits of all three axes, one more flags non-finite points
+const int kMaxCellBits = 62;
+// leaf size search for a target point count
+const int kMaxSearchPasses = 8;
+const double kTargetTolerance = 0.05;
+
+// bits needed to store values in [0, count)
+int BitsFor(double count) {
+  int bits = 0;
+  while (bits < 64 && std::ldexp(1.0, bits) < count) {
+    ++bits;
+  }
+  return bits;
+}
+
+Eigen::AlignedBox3f FiniteBounds(const std::vector<float> &xyz) {
+  Eigen::AlignedBox3f bounds;
+  std::mutex mutex;
+  ThreadPool::Global().ParallelFor(0, xyz.size() / 3, kFilterGrain,
+      [&](std::size_t b, std::size_t e) {
+        Eigen::AlignedBox3f local;
+        for (std::size_t i = b; i < e; ++i) {
+          const Eigen::Map<const Eigen::Vector3f> p(&xyz[i * 3]);
+          if (p.allFinite()) {
+            local.extend(p);
+          }
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        bounds.extend(local);
+      });
+  return bounds;
+}
+
+}  // namespace
+
+void VoxelFilter::Apply(std::vector<float> *xyz,
+    std::vector<uint32_t> *source) {
+  TRACE_SCOPE("VoxelFilter::Apply");
+  const auto start_time = std::chrono::steady_clock::now();
+  const std::size_t num_points = xyz->size() / 3;
+  stats_ = VoxelFilterStats();
+  stats_.input_points = num_points;
+
+  const Eigen::AlignedBox3f bounds = FiniteBounds(*xyz);
+  float leaf_size = leaf_size_;
+  std::size_t num_cells = 0;
+  if (bounds.isEmpty() || (target_points_ > 0 &&
+      target_points_ >= num_points)) {
+    // nothing to reduce, only the non-finite points are dropped
+    if (source != nullptr) {
+      source->clear();
+      source->reserve(num_points);
+    }
+    std::size_t num_kept = 0;
+    for (std::size_t i = 0; i < num_points; ++i) {
+      const float *p = &(*xyz)[i * 3];
+      if (!std::isfinite(p[0]) || !std::isfinite(p[1]) ||
+          !std::isfinite(p[2])) {
+        continue;
+      }
+      std::copy_n(p, 3, &(*xyz)[num_kept * 3]);
+      if (source != nullptr) {
+        source->push_back(static_cast<uint32_t>(i));
+      }
+      ++num_kept;
+    }
+    xyz->resize(num_kept * 3);
+    stats_.output_points = num_kept;
+    std::cout << "voxel filter: " << num_kept << " of " << num_points
+        << " points kept\n";
+    return;
+  }
+  if (target_points_ > 0) {
+    // start from cells of the volume over the target and correct with the
+    // growth of the cell count measured so far: about 2 per halved leaf size
+    // for surface scans, 3 for volumes
+    const Eigen::Vector3f sizes = bounds.sizes().cwiseMax(
+        1e-3f * bounds.sizes().maxCoeff() + 1e-6f);
+    const double target = static_cast<double>(target_points_);
+    leaf_size = static_cast<float>(std::cbrt(sizes.prod() / target));
+    // keeps the cell keys within kMaxCellBits
+    const float min_leaf_size = std::ldexp(bounds.sizes().maxCoeff(),
+        -kMaxCellBits / 3 + 1);
+    double dimension = 2.0;
+    float last_leaf_size = 0.f;
+    std::size_t last_num_cells = 0;
+    for (int pass = 0; pass < kMaxSearchPasses; ++pass) {
+      num_cells = SortCells(*xyz, bounds, &leaf_size);
+      ++stats_.sort_passes;
+      if (std::abs(num_cells - target) <= kTargetTolerance * target ||
+          pass + 1 == kMaxSearchPasses) {
+        break;
+      }
+      if (num_cells == last_num_cells && num_cells < target) {
+        // smaller cells no longer split anything, every distinct position
+        // has its own cell
+        break;
+      }
+      if (last_num_cells > 0 && last_num_cells != num_cells &&
+          last_leaf_size != leaf_size) {
+        dimension = std::log(static_cast<double>(num_cells) / last_num_cells) /
+            std::log(static_cast<double>(last_leaf_size) / leaf_size);
+        dimension = std::min(3.0, std::max(1.0, dimension));
+      }
+      last_leaf_size = leaf_size;
+      last_num_cells = num_cells;
+      leaf_size = std::max(min_leaf_size, leaf_size * static_cast<float>(
+          std::pow(num_cells / target, 1.0 / dimension)));
+    }
+  } else {
+    num_cells = SortCells(*xyz, bounds, &leaf_size);
+    stats_.sort_passes = 1;
+  }
+
+  // first sorted point of every cell; non-finite points are sorted last
+  std::vector<std::size_t> cell_begins;
+  cell_begins.reserve(num_cells + 1);
+  for (std::size_t i = 0; i < num_valid_points_; ++i) {
+    if (i == 0 || keys_[i] != keys_[i - 1]) {
+      cell_begins.push_back(i);
+    }
+  }
+  cell_begins.push_back(num_valid_points_);
+
+  std::vector<float> filtered(num_cells * 3);
+  if (source != nullptr) {
+    source->resize(num_cells);
+  }
+  ThreadPool::Global().ParallelFor(0, num_cells, kFilterGrain / 8,
+      [&](std::size_t b, std::size_t e) {
+        for (std::size_t cell = b; cell < e; ++cell) {
+          double sum[3] = {0.0, 0.0, 0.0};
+          for (std::size_t i = cell_begins[cell]; i < cell_begins[cell + 1];
+              ++i) {
+            const float *p = &(*xyz)[static_cast<std::size_t>(indices_[i]) * 3];
+            for (int k = 0; k < 3; ++k) {
+              sum[k] += p[k];
+            }
+          }
+          const double count = static_cast<double>(
+              cell_begins[cell + 1] - cell_begins[cell]);
+          for (int k = 0; k < 3; ++k) {
+            filtered[cell * 3 + k] = static_cast<float>(sum[k] / count);
+          }
+          // the sort is stable, so this is the lowest input index
+          if (source != nullptr) {
+            (*source)[cell] = indices_[cell_begins[cell]];
+          }
+        }
+      });
+  xyz->swap(filtered);
+  std::vector<uint64_t>().swap(keys_);
+  std::vector<uint64_t>().swap(keys_scratch_);
+  std::vector<uint32_t>().swap(indices_);
+  std::vector<uint32_t>().swap(indices_scratch_);
+
+  stats_.output_points = num_cells;
+  stats_.leaf_size = leaf_size;
+  stats_.elapsed_ms = std::chrono::duration<double, std::milli>(
+      std::chrono::steady_clock::now() - start_time).count();
+  std::cout << "voxel filter: " << stats_.input_points << " -> "
+      << stats_.output_points << " points ("
+      << 100.0 * stats_.output_points / std::max<std::size_t>(1,
+          stats_.input_points)
+      << "%), leaf size " << stats_.leaf_size << ", " << stats_.sort_passes
+      << " sorts in " << stats_.elapsed_ms << " ms\n";
+}
+
+std::size_t VoxelFilter::SortCells(const std::vector<float> &xyz,
+    const Eigen::AlignedBox3f &bounds, float *leaf_size) {
+  TRACE_SCOPE("VoxelFilter::SortCells");
+  const std::size_t num_points = xyz.size() / 3;
+  const Eigen::Vector3f sizes = bounds.sizes();
+  int bits[3] = {0, 0, 0};
+  while (true) {
+    for (int k = 0; k < 3; ++k) {
+      bits[k] = BitsFor(std::floor(sizes[k] / *leaf_size) + 1.0);
+    }
+    if (bits[0] + bits[1] + bits[2] <= kMaxCellBits) {
+      break;
+    }
+    *leaf_size *= 2.f;
+    std::cerr << "warning : voxel leaf size too small for the cloud extent, "
+        << "using " << *leaf_size << "\n";
+  }
+  const int num_bits = bits[0] + bits[1] + bits[2];
+  const uint64_t invalid_key = uint64_t(1) << num_bits;
+  const float inv_leaf_size = 1.f / *leaf_size;
+  const Eigen::Vector3f origin = bounds.min();
+
+  keys_.resize(num_points);
+  indices_.resize(num_points);
+  std::mutex mutex;
+  std::size_t num_invalid = 0;
+  ThreadPool::Global().ParallelFor(0, num_points, kFilterGrain,
+      [&](std::size_t b, std::size_t e) {
+        std::size_t local_invalid = 0;
+        for (std::size_t i = b; i < e; ++i) {
+          indices_[i] = static_cast<uint32_t>(i);
+          const Eigen::Map<const Eigen::Vector3f> p(&xyz[i * 3]);
+          if (!p.allFinite()) {
+            keys_[i] = invalid_key;
+            ++local_invalid;
+            continue;
+          }
+          uint64_t key = 0;
+          for (int k = 0; k < 3; ++k) {
+            const uint64_t max_cell = (uint64_t(1) << bits[k]) - 1;
+            const uint64_t cell = static_cast<uint64_t>(std::max(0.f,
+                (p[k] - origin[k]) * inv_leaf_size));
+            key = (key << bits[k]) | std::min(cell, max_cell);
+          }
+          keys_[i] = key;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        num_invalid += local_invalid;
+      });
+  RadixSort(num_bits + 1, &keys_, &indices_, &keys_scratch_,
+      &indices_scratch_);
+  num_valid_points_ = num_points - num_invalid;
+
+  std::size_t num_cells = 0;
+  ThreadPool::Global().ParallelFor(0, num_valid_points_, kFilterGrain,
+      [&](std::size_t b, std::size_t e) {
+        std::size_t local_cells = 0;
+        for (std::size_t i = b; i < e; ++i) {
+          local_cells += (i == 0 || keys_[i] != keys_[i - 1]) ? 1 : 0;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        num_cells += local_cells;
+      });
+  return num_cells;
+}
+
+}  // namespace ogl_viewer
@@ -0,0 +1,692 @@
+// Times the CPU side of loading and drawing point clouds on synthetic clouds:
+// PCD header parsing and decoding, LZF decompression, position quantization,
+// the height histogram, the voxel filter, the octree build, frustum culling,
+// LOD selection, the spatial index with its selections, and the camera
+// matrices.
+// Only the GL-free core library is linked, so it runs on any build host, and
+// the JSON report can be compared between commits to catch regressions.
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+#include "camera_control.h"
+#include "frustum.h"
+#include "lzf.h"
+#include "pcd_reader.h"
+#include "point_index.h"
+#include "point_octree.h"
+#include "quantize.h"
+#include "thread_pool.h"
+#include "value_histogram.h"
+#include "voxel_filter.h"
+
+using namespace ogl_viewer;
+
+namespace {
+
+// points handed out per PcdReader callback and quantized per chunk, as in
+// the viewer
+const std::size_t kReadChunkPoints = 1 << 20;
+const std::size_t kQuantizeChunkPoints = 1 << 16;
+// camera positions along the orbit for culling and LOD selection
+const int kNumViews = 256;
+// the viewer's defaults
+const std::size_t kPointBudget = 3000000;
+const float kMinNodePixels = 50.f;
+const int kViewportWidth = 1280;
+const int kViewportHeight = 720;
+// iterations of the benchmarks that do not depend on the cloud size
+const int kHeaderParses = 100000;
+const int kCameraCalls = 1000000;
+// queries of the spatial index per run, and points per nearest query
+const int kSelections = 16;
+const int kNearestQueries = 10000;
+const std::size_t kNearestPoints = 8;
+// side of the synthetic square, in meters
+const float kGroundSize = 200.f;
+// voxel edge, in meters, which keeps roughly a fifth of a 1M point cloud
+const float kVoxelLeafSize = 0.5f;
+
+struct Options {
+  std::vector<std::size_t> sizes;
+  int repeat = 3;
+  std::string filter;
+  std::string temp_dir = "/tmp";
+  std::string output_path = "-";
+};
+
+struct Result {
+  std::string name;
+  // points of the cloud, 0 if the benchmark does not use one
+  std::size_t points = 0;
+  // what one run processes: points, boxes, selections, headers or calls
+  std::string unit;
+  std::size_t items = 0;
+  std::vector<double> ms;
+};
+
+// a well mixed 32-bit hash of i, to draw repeatable random numbers
+// from any thread
+uint32_t Hash(uint64_t i) {
+  i ^= i >> 33;
+  i *= 0xff51afd7ed558ccdull;
+  i ^= i >> 33;
+  i *= 0xc4ceb9fe1a85ec53ull;
+  i ^= i >> 33;
+  return static_cast<uint32_t>(i);
+}
+
+float Uniform(uint64_t i, int k) {
+  return Hash(i * 4 + k) * (1.f / 4294967296.f);
+}
+
+// a rolling ground with walls and poles standing on it, roughly what a
+// mapping drive produces; 3 floats per point
+void GenerateCloud(std::size_t num_points, std::vector<float> *xyz) {
+  xyz->resize(num_points * 3);
+  float *out = xyz->data();
+  ThreadPool::Global().ParallelFor(0, num_points, 1 << 16,
+      [out](std::size_t begin, std::size_t end) {
+    for (std::size_t i = begin; i < end; ++i) {
+      float x = (Uniform(i, 0) - 0.5f) * kGroundSize;
+      float y = (Uniform(i, 1) - 0.5f) * kGroundSize;
+      float z = 2.f * std::sin(0.05f * x) * std::cos(0.07f * y) +
+          0.05f * Uniform(i, 2);
+      const uint32_t kind = Hash(i * 4 + 3) % 10;
+      if (kind == 0) {
+        // a wall along x every 20 m
+        y = std::round(y / 20.f) * 20.f;
+        z += 6.f * Uniform(i, 2);
+      } else if (kind == 1) {
+        // a pole every 10 m
+        x = std::round(x / 10.f) * 10.f + 0.1f * (Uniform(i, 0) - 0.5f);
+        y = std::round(y / 10.f) * 10.f + 0.1f * (Uniform(i, 1) - 0.5f);
+        z += 4.f * Uniform(i, 2);
+      }
+      out[i * 3] = x;
+      out[i * 3 + 1] = y;
+      out[i * 3 + 2] = z;
+    }
+  });
+}
+
+std::string PcdHeaderText(std::size_t num_points,
+    const std::string &data_type) {
+  std::ostringstream oss;
+  oss << "# .PCD v0.7 - Point Cloud Data file format\n"
+      << "VERSION 0.7\n"
+      << "FIELDS x y z intensity\n"
+      << "SIZE 4 4 4 4\n"
+      << "TYPE F F F F\n"
+      << "COUNT 1 1 1 1\n"
+      << "WIDTH " << num_points << "\n"
+      << "HEIGHT 1\n"
+      << "VIEWPOINT 0 0 0 1 0 0 0\n"
+      << "POINTS " << num_points << "\n"
+      << "DATA " << data_type << "\n";
+  return oss.str();
+}
+
+float Intensity(std::size_t i) {
+  return static_cast<float>(Hash(i) & 0xff);
+}
+
+// x y z intensity records, written in pieces
+bool WriteBinaryPcd(const std::string &path, const std::vector<float> &xyz) {
+  std::ofstream ofs(path, std::ios::binary);
+  const std::size_t num_points = xyz.size() / 3;
+  const std::string header = PcdHeaderText(num_points, "binary");
+  ofs.write(header.data(), header.size());
+  std::vector<float> records;
+  for (std::size_t first = 0; first < num_points;
+      first += kReadChunkPoints) {
+    const std::size_t count = std::min(kReadChunkPoints, num_points - first);
+    records.resize(count * 4);
+    for (std::size_t i = 0; i < count; ++i) {
+      std::copy_n(&xyz[(first + i) * 3], 3, &records[i * 4]);
+      records[i * 4 + 3] = Intensity(first + i);
+    }
+    ofs.write(reinterpret_cast<const char*>(records.data()),
+        records.size() * sizeof(float));
+  }
+  if (!ofs) {
+    std::cerr << "error : failed to write " << path << "\n";
+    return false;
+  }
+  return true;
+}
+
+// the same fields one after the other, LZF compressed into compressed, which
+// the lzf benchmark reuses
+bool WriteCompressedPcd(const std::string &path,
+    const std::vector<float> &xyz, std::vector<uint8_t> *compressed,
+    std::size_t *raw_size) {
+  const std::size_t num_points = xyz.size() / 3;
+  std::vector<float> planes(num_points * 4);
+  for (std::size_t i = 0; i < num_points; ++i) {
+    for (int k = 0; k < 3; ++k) {
+      planes[k * num_points + i] = xyz[i * 3 + k];
+    }
+    planes[3 * num_points + i] = Intensity(i);
+  }
+  *raw_size = planes.size() * sizeof(float);
+  // synthetic floats hardly compress; leave room for the literal markers
+  compressed->resize(*raw_size + *raw_size / 16 + 64);
+  const std::size_t size = LzfCompress(
+      reinterpret_cast<const uint8_t*>(planes.data()), *raw_size,
+      compressed->data(), compressed->size());
+  if (size == 0) {
+    std::cerr << "error : failed to compress the synthetic cloud\n";
+    return false;
+  }
+  compressed->resize(size);
+
+  std::ofstream ofs(path, std::ios::binary);
+  const std::string header = PcdHeaderText(num_points, "binary_compressed");
+  ofs.write(header.data(), header.size());
+  const uint32_t sizes[2] = {static_cast<uint32_t>(size),
+      static_cast<uint32_t>(*raw_size)};
+  ofs.write(reinterpret_cast<const char*>(sizes), sizeof(sizes));
+  ofs.write(reinterpret_cast<const char*>(compressed->data()), size);
+  if (!ofs) {
+    std::cerr << "error : failed to write " << path << "\n";
+    return false;
+  }
+  return true;
+}
+
+class Runner {
+ public:
+  explicit Runner(const Options &options) : options_(options) {
+  }
+
+  const std::vector<Result>& results() const {
+    return results_;
+  }
+
+  /** @brief whether a benchmark passes the --filter option **/
+  bool Selected(const std::string &name) const {
+    return name.find(options_.filter) != std::string::npos;
+  }
+
+  /** @brief time body options_.repeat times, each after an untimed setup
+   *  (may be null) **/
+  void Run(const std::string &name, std::size_t points,
+      const std::string &unit, std::size_t items,
+      const std::function<void()> &setup, const std::function<void()> &body) {
+    if (!Selected(name)) {
+      return;
+    }
+    Result result;
+    result.name = name;
+    result.points = points;
+    result.unit = unit;
+    result.items = items;
+    for (int r = 0; r < options_.repeat; ++r) {
+      if (setup) {
+        setup();
+      }
+      const auto t0 = std::chrono::steady_clock::now();
+      body();
+      const auto t1 = std::chrono::steady_clock::now();
+      result.ms.push_back(
+          std::chrono::duration<double, std::milli>(t1 - t0).count());
+    }
+    const double best = *std::min_element(result.ms.begin(),
+        result.ms.end());
+    std::cerr << name << " (" << points << " points): " << best << " ms\n";
+    results_.push_back(result);
+  }
+
+ private:
+  const Options &options_;
+  std::vector<Result> results_;
+};
+
+// keeps the compiler from dropping a result nobody reads
+volatile float g_sink = 0.f;
+
+void RunSizeIndependent(Runner *runner) {
+  const std::string header = PcdHeaderText(1000000, "binary");
+  runner->Run("pcd_header", 0, "headers", kHeaderParses, nullptr,
+      [&header]() {
+    for (int i = 0; i < kHeaderParses; ++i) {
+      PcdHeader parsed;
+      ParsePcdHeader(header.data(), header.size(), &parsed);
+      g_sink = g_sink + parsed.num_points;
+    }
+  });
+
+  ArcCameraControl camera;
+  camera.SetWindowSize(kViewportWidth, kViewportHeight);
+  camera.OnMouseButton(0.0, 0.0, 0, true);
+  runner->Run("camera_matrices", 0, "calls", kCameraCalls, nullptr,
+      [&camera]() {
+    float sum = 0.f;
+    for (int i = 0; i < kCameraCalls; ++i) {
+      // a drag every call, so that the matrices change
+      camera.OnMouseMove(i % 640, i % 480);
+      sum += (camera.GetProjectionMatrix() * camera.GetViewMatrix())(0, 0);
+    }
+    g_sink = g_sink + sum;
+  });
+}
+
+// the spatial index and its selections, over regions spread across the
+// cloud that take a few percent of it each
+void RunIndex(const std::vector<float> &xyz, Runner *runner) {
+  const std::size_t num_points = xyz.size() / 3;
+  PointIndex index;
+  runner->Run("index_build", num_points, "points", num_points, nullptr,
+      [&]() {
+    index.Build(xyz.data(), 3, num_points, nullptr);
+  });
+  if (index.size() == 0) {
+    index.Build(xyz.data(), 3, num_points, nullptr);
+  }
+  const auto center = [](int i) {
+    return Eigen::Vector3f((Uniform(i, 0) - 0.5f) * 0.8f * kGroundSize,
+        (Uniform(i, 1) - 0.5f) * 0.8f * kGroundSize, 0.f);
+  };
+  const float half_size = 0.1f * kGroundSize;
+
+  std::vector<uint32_t> selected;
+  runner->Run("index_box", num_points, "selections", kSelections, nullptr,
+      [&]() {
+    std::size_t num_selected = 0;
+    for (int i = 0; i < kSelections; ++i) {
+      const Eigen::Vector3f extent(half_size, half_size, 10.f);
+      index.SelectBox(Eigen::AlignedBox3f(center(i) - extent,
+          center(i) + extent), &selected);
+      num_selected += selected.size();
+    }
+    g_sink = g_sink + num_selected;
+  });
+  runner->Run("index_oriented_box", num_points, "selections", kSelections,
+      nullptr, [&]() {
+    std::size_t num_selected = 0;
+    for (int i = 0; i < kSelections; ++i) {
+      const Eigen::Affine3f box = Eigen::Translation3f(center(i)) *
+          Eigen::AngleAxisf(0.1f * i, Eigen::Vector3f::UnitZ()) *
+          Eigen::Scaling(2.f * half_size, 2.f * half_size, 20.f);
+      index.SelectOrientedBox(box, &selected);
+      num_selected += selected.size();
+    }
+    g_sink = g_sink + num_selected;
+  });
+  runner->Run("index_radius", num_points, "selections", kSelections, nullptr,
+      [&]() {
+    std::size_t num_selected = 0;
+    for (int i = 0; i < kSelections; ++i) {
+      index.SelectRadius(center(i), half_size, &selected);
+      num_selected += selected.size();
+    }
+    g_sink = g_sink + num_selected;
+  });
+
+  // a lasso around the middle of the view, from views along the orbit
+  OrbitCameraPath path(index.bounds().center(),
+      0.5f * index.bounds().sizes().norm());
+  path.SetWindowSize(kViewportWidth, kViewportHeight);
+  std::vector<Eigen::Vector2f, Eigen::aligned_allocator<Eigen::Vector2f>>
+      polygon;
+  for (int k = 0; k < 64; ++k) {
+    const float angle = 2.f * static_cast<float>(M_PI) * k / 64;
+    const float radius = (0.15f + 0.05f * std::sin(5.f * angle)) *
+        kViewportHeight;
+    polygon.push_back(Eigen::Vector2f(0.5f * kViewportWidth,
+        0.5f * kViewportHeight) + radius * Eigen::Vector2f(std::cos(angle),
+            std::sin(angle)));
+  }
+  runner->Run("index_polygon", num_points, "selections", kSelections,
+      nullptr, [&]() {
+    std::size_t num_selected = 0;
+    for (int i = 0; i < kSelections; ++i) {
+      path.SetTime(static_cast<float>(i) / kSelections);
+      index.SelectPolygon(path.GetViewMatrix(), path.GetProjectionMatrix(),
+          Eigen::Vector2i(kViewportWidth, kViewportHeight), polygon,
+          &selected);
+      num_selected += selected.size();
+    }
+    g_sink = g_sink + num_selected;
+  });
+
+  std::vector<float> squared_distances;
+  runner->Run("index_nearest", num_points, "queries", kNearestQueries,
+      nullptr, [&]() {
+    float sum = 0.f;
+    for (int i = 0; i < kNearestQueries; ++i) {
+      index.Nearest(index.position(Hash(i) % index.size()), kNearestPoints,
+          &selected, &squared_distances);
+      sum += squared_distances.back();
+    }
+    g_sink = g_sink + sum;
+  });
+}
+
+bool RunCloud(std::size_t num_points, const Options &options,
+    Runner *runner) {
+  std::vector<float> xyz;
+  GenerateCloud(num_points, &xyz);
+
+  // decoding, from the page cache: the files were just written
+  const std::string stem = options.temp_dir + "/core_benchmark_" +
+      std::to_string(getpid()) + "_" + std::to_string(num_points);
+  const std::string binary_path = stem + ".pcd";
+  const std::string compressed_path = stem + "_compressed.pcd";
+  const auto read_positions = [](const std::string &path) {
+    float sum = 0.f;
+    const PcdReader::ChunkCallback callback =
+        [&sum](const float *chunk_xyz, std::size_t count) {
+      sum += chunk_xyz[(count - 1) * 3];
+      return true;
+    };
+    PcdReader reader;
+    if (!reader.Open(path) ||
+        !reader.ReadPositions(kReadChunkPoints, callback)) {
+      std::cerr << "error : failed to read " << path << "\n";
+    }
+    g_sink = g_sink + sum;
+  };
+  if (runner->Selected("pcd_decode_binary")) {
+    if (!WriteBinaryPcd(binary_path, xyz)) {
+      return false;
+    }
+    runner->Run("pcd_decode_binary", num_points, "points", num_points,
+        nullptr, [&]() {
+      read_positions(binary_path);
+    });
+    std::remove(binary_path.c_str());
+  }
+  if (runner->Selected("pcd_decode_compressed") ||
+      runner->Selected("lzf_decompress")) {
+    std::vector<uint8_t> compressed;
+    std::size_t raw_size = 0;
+    if (!WriteCompressedPcd(compressed_path, xyz, &compressed, &raw_size)) {
+      return false;
+    }
+    runner->Run("pcd_decode_compressed", num_points, "points", num_points,
+        nullptr, [&]() {
+      read_positions(compressed_path);
+    });
+    std::remove(compressed_path.c_str());
+
+    std::vector<uint8_t> raw(raw_size);
+    runner->Run("lzf_decompress", num_points, "points", num_points, nullptr,
+        [&]() {
+      if (LzfDecompress(compressed.data(), compressed.size(), raw.data(),
+          raw.size()) != raw.size()) {
+        std::cerr << "error : failed to decompress\n";
+      }
+    });
+  }
+
+  // chunk bounds as the viewer computes them for upload
+  if (runner->Selected("quantize")) {
+    std::vector<Eigen::AlignedBox3f> bounds;
+    for (std::size_t first = 0; first < num_points;
+        first += kQuantizeChunkPoints) {
+      const std::size_t count =
+          std::min(kQuantizeChunkPoints, num_points - first);
+      Eigen::AlignedBox3f box;
+      for (std::size_t i = first; i < first + count; ++i) {
+        box.extend(Eigen::Map<const Eigen::Vector3f>(&xyz[i * 3]));
+      }
+      bounds.push_back(box);
+    }
+    std::vector<uint16_t> quantized(kQuantizeChunkPoints * 3);
+    runner->Run("quantize", num_points, "points", num_points, nullptr,
+        [&]() {
+      float max_error = 0.f;
+      for (std::size_t c = 0; c < bounds.size(); ++c) {
+        const std::size_t first = c * kQuantizeChunkPoints;
+        const std::size_t count =
+            std::min(kQuantizeChunkPoints, num_points - first);
+        max_error = std::max(max_error, QuantizePositions(&xyz[first * 3], 3,
+            count, bounds[c].min(), bounds[c].sizes(), quantized.data()));
+      }
+      g_sink = g_sink + max_error;
+    });
+  }
+
+  // what the colormap is built from
+  runner->Run("height_histogram", num_points, "points", num_points, nullptr,
+      [&]() {
+    ValueHistogram histogram;
+    histogram.Add(&xyz[2], 3, num_points);
+    g_sink = g_sink + histogram.Percentile(0.5f);
+  });
+
+  const char *const index_benchmarks[] = {"index_build", "index_box",
+      "index_oriented_box", "index_radius", "index_polygon", "index_nearest"};
+  for (const char *name : index_benchmarks) {
+    if (runner->Selected(name)) {
+      RunIndex(xyz, runner);
+      break;
+    }
+  }
+
+  if (runner->Selected("voxel_filter")) {
+    VoxelFilter filter;
+    filter.set_leaf_size(kVoxelLeafSize);
+    std::vector<float> filtered;
+    std::vector<uint32_t> source;
+    runner->Run("voxel_filter", num_points, "points", num_points, [&]() {
+      filtered = xyz;
+    }, [&]() {
+      // the reduction Apply prints would end up in the report on stdout
+      std::streambuf *const cout_buffer = std::cout.rdbuf(nullptr);
+      filter.Apply(&filtered, &source);
+      std::cout.rdbuf(cout_buffer);
+      std::cout.clear();
+    });
+    std::cerr << "voxel_filter: " << filter.stats().output_points
+        << " points kept, " << filter.stats().sort_passes << " sorts\n";
+  }
+
+  const bool lod = runner->Selected("frustum_cull") ||
+      runner->Selected("lod_select");
+  if (!runner->Selected("octree_build") && !lod) {
+    return true;
+  }
+  PointOctree octree;
+  std::vector<float> reordered;
+  std::vector<uint32_t> order;
+  runner->Run("octree_build", num_points, "points", num_points, [&]() {
+    reordered = xyz;
+  }, [&]() {
+    octree.Build(&reordered, &order);
+  });
+  if (!lod) {
+    return true;
+  }
+  if (octree.nodes().empty()) {
+    reordered = xyz;
+    octree.Build(&reordered, &order);
+  }
+  // only the hierarchy is needed from here on
+  std::vector<float>().swap(xyz);
+  std::vector<float>().swap(reordered);
+  std::vector<uint32_t>().swap(order);
+
+  BoxArray boxes;
+  Eigen::AlignedBox3f scene;
+  for (const OctreeNode &node : octree.nodes()) {
+    boxes.Add(node.subtree_bounds);
+    scene.extend(node.subtree_bounds);
+  }
+  OrbitCameraPath path(scene.center(), 0.5f * scene.sizes().norm());
+  path.SetWindowSize(kViewportWidth, kViewportHeight);
+  std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>>
+      views;
+  std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f>>
+      projections;
+  for (int v = 0; v < kNumViews; ++v) {
+    path.SetTime(static_cast<float>(v) / kNumViews);
+    views.push_back(path.GetViewMatrix());
+    projections.push_back(path.GetProjectionMatrix());
+  }
+
+  std::vector<std::vector<uint8_t>> visible(kNumViews);
+  runner->Run("frustum_cull", num_points, "boxes", boxes.size() * kNumViews,
+      nullptr, [&]() {
+    std::size_t num_visible = 0;
+    for (int v = 0; v < kNumViews; ++v) {
+      const Frustum frustum(projections[v] * views[v]);
+      num_visible += frustum.CullBoxes(boxes, &visible[v]);
+    }
+    g_sink = g_sink + num_visible;
+  });
+  for (int v = 0; v < kNumViews; ++v) {
+    if (visible[v].empty()) {
+      Frustum(projections[v] * views[v]).CullBoxes(boxes, &visible[v]);
+    }
+  }
+
+  std::vector<int> selected;
+  runner->Run("lod_select", num_points, "selections", kNumViews, nullptr,
+      [&]() {
+    std::size_t num_selected = 0;
+    for (int v = 0; v < kNumViews; ++v) {
+      octree.SelectNodes(views[v], projections[v], kViewportHeight,
+          kPointBudget, kMinNodePixels, &visible[v], &selected);
+      num_selected += selected.size();
+    }
+    g_sink = g_sink + num_selected;
+  });
+  return true;
+}
+
+// "1M", "500k" or a plain number
+bool ParseSize(const std::string &text, std::size_t *size) {
+  char *end = nullptr;
+  const double value = std::strtod(text.c_str(), &end);
+  double multiplier = 1.0;
+  if (*end == 'k' || *end == 'K') {
+    multiplier = 1e3;
+    ++end;
+  } else if (*end == 'm' || *end == 'M') {
+    multiplier = 1e6;
+    ++end;
+  }
+  if (end == text.c_str() || *end != '\0' || value <= 0.0) {
+    return false;
+  }
+  *size = static_cast<std::size_t>(value * multiplier);
+  return true;
+}
+
+bool ParseSizes(const std::string &text, std::vector<std::size_t> *sizes) {
+  sizes->clear();
+  std::istringstream iss(text);
+  std::string item;
+  while (std::getline(iss, item, ',')) {
+    std::size_t size = 0;
+    if (!ParseSize(item, &size)) {
+      return false;
+    }
+    sizes->push_back(size);
+  }
+  return !sizes->empty();
+}
+
+bool WriteReport(const Options &options,
+    const std::vector<Result> &results) {
+  std::ofstream ofs;
+  if (options.output_path != "-") {
+    ofs.open(options.output_path.c_str());
+    if (!ofs) {
+      std::cerr << "error : failed to open " << options.output_path << "\n";
+      return false;
+    }
+  }
+  std::ostream &os = options.output_path == "-" ? std::cout : ofs;
+  os << "{\n"
+      << "  \"threads\": " << ThreadPool::Global().num_threads() << ",\n"
+      << "  \"repeat\": " << options.repeat << ",\n"
+      << "  \"results\": [";
+  for (std::size_t i = 0; i < results.size(); ++i) {
+    const Result &result = results[i];
+    std::vector<double> sorted = result.ms;
+    std::sort(sorted.begin(), sorted.end());
+    const double mean = std::accumulate(sorted.begin(), sorted.end(), 0.0) /
+        sorted.size();
+    os << (i == 0 ? "\n" : ",\n")
+        << "    {\"name\": \"" << result.name << "\""
+        << ", \"points\": " << result.points
+        << ", \"unit\": \"" << result.unit << "\""
+        << ", \"items\": " << result.items
+        << ", \"ms\": {\"min\": " << sorted.front()
+        << ", \"median\": " << sorted[sorted.size() / 2]
+        << ", \"mean\": " << mean
+        << ", \"max\": " << sorted.back() << "}"
+        << ", \"ns_per_item\": " << sorted.front() * 1e6 / result.items
+        << "}";
+  }
+  os << "\n  ]\n}\n";
+  return static_cast<bool>(os);
+}
+
+void PrintUsage(const char *program) {
+  std::cout << "Usage: " << program << " [options]\n"
+      << "  --points <list>   cloud sizes, e.g. 1M,10M,100M "
+      << "(default 1M,10M)\n"
+      << "  --repeat <n>      timed runs of every benchmark (default 3)\n"
+      << "  --filter <text>   only the benchmarks whose name contains text\n"
+      << "  --temp-dir <dir>  where the PCD files are written (default "
+      << "/tmp)\n"
+      << "  --output <file>   JSON report (default stdout)\n";
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  Options options;
+  ParseSizes("1M,10M", &options.sizes);
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg(argv[i]);
+    if (arg == "--points" && i + 1 < argc) {
+      if (!ParseSizes(argv[++i], &options.sizes)) {
+        std::cerr << "error : invalid --points " << argv[i] << "\n";
+        return 1;
+      }
+    } else if (arg == "--repeat" && i + 1 < argc) {
+      options.repeat = std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "--filter" && i + 1 < argc) {
+      options.filter = argv[++i];
+    } else if (arg == "--temp-dir" && i + 1 < argc) {
+      options.temp_dir = argv[++i];
+    } else if (arg == "--output" && i + 1 < argc) {
+      options.output_path = argv[++i];
+    } else {
+      PrintUsage(argv[0]);
+      return arg == "-h" || arg == "--help" ? 0 : 1;
+    }
+  }
+
+  Runner runner(options);
+  RunSizeIndependent(&runner);
+  for (std::size_t num_points : options.sizes) {
+    if (!RunCloud(num_points, options, &runner)) {
+      return 1;
+    }
+  }
+  return WriteReport(options, runner.results()) ? 0 : 1;
+}
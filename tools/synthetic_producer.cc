@@ -0,0 +1,98 @@
+// Publishes a synthetic rotating LiDAR-like scan into the shared memory
+// ring the viewer reads with `opengl_model_viewer shm:<name>`.
+
+#include <signal.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "shm_ring.h"
+
+namespace {
+
+volatile sig_atomic_t g_stop = 0;
+
+void HandleSignal(int) {
+  g_stop = 1;
+}
+
+// rings of a spinning sensor over a wavy ground, turning with the frame
+void FillScan(float *xyz, std::size_t num_points, uint64_t frame) {
+  const int num_rings = 32;
+  const std::size_t per_ring = (num_points + num_rings - 1) / num_rings;
+  const float phase = 0.05f * frame;
+  for (std::size_t i = 0; i < num_points; ++i) {
+    const int ring = static_cast<int>(i / per_ring);
+    const float angle = 2.f * static_cast<float>(M_PI) * (i % per_ring) /
+        per_ring;
+    const float range = 4.f + 1.5f * ring +
+        0.5f * std::sin(5.f * angle + phase);
+    xyz[i * 3] = range * std::cos(angle + phase);
+    xyz[i * 3 + 1] = range * std::sin(angle + phase);
+    xyz[i * 3 + 2] = -1.7f + 0.3f * std::sin(0.5f * range - phase) +
+        0.1f * ring;
+  }
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  std::string name = "/ogl_viewer";
+  std::size_t num_points = 100000;
+  double rate = 20.0;
+  long long num_frames = 0;
+  bool valid = true;
+  for (int i = 1; i < argc && valid; ++i) {
+    const std::string arg(argv[i]);
+    if (arg == "--name" && i + 1 < argc) {
+      name = argv[++i];
+    } else if (arg == "--points" && i + 1 < argc) {
+      num_points = std::strtoull(argv[++i], nullptr, 10);
+    } else if (arg == "--rate" && i + 1 < argc) {
+      rate = std::atof(argv[++i]);
+    } else if (arg == "--frames" && i + 1 < argc) {
+      num_frames = std::atoll(argv[++i]);
+    } else {
+      valid = false;
+    }
+  }
+  // the frame period is 1 / rate
+  if (!valid || !(rate > 0.0)) {
+    std::cout << "Usage: " << argv[0] << " [options]\n"
+        << "  --name <name>    shared memory object (default /ogl_viewer)\n"
+        << "  --points <n>     points per frame (default 100000)\n"
+        << "  --rate <hz>      frames per second, > 0 (default 20)\n"
+        << "  --frames <n>     stop after n frames (default: until Ctrl-C)\n";
+    return -1;
+  }
+  if (name.empty() || name[0] != '/') {
+    name = "/" + name;
+  }
+
+  ogl_viewer::ShmRingProducer producer;
+  if (!producer.Create(name, num_points)) {
+    return 1;
+  }
+  signal(SIGINT, HandleSignal);
+  signal(SIGTERM, HandleSignal);
+  std::cout << "publishing " << num_points << " points at " << rate
+      << " Hz into " << name << "\n";
+
+  const auto period = std::chrono::duration<double>(1.0 / rate);
+  auto next = std::chrono::steady_clock::now();
+  for (uint64_t frame = 0; !g_stop &&
+      (num_frames <= 0 || frame < static_cast<uint64_t>(num_frames));
+      ++frame) {
+    // written in place, no staging copy
+    FillScan(producer.AcquireFrame(), num_points, frame);
+    producer.PublishFrame(num_points);
+    next += std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        period);
+    std::this_thread::sleep_until(next);
+  }
+  return 0;
+}